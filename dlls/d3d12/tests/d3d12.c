@@ -218,14 +218,9 @@ static ID3D12RootSignature *create_default_root_signature(ID3D12Device *device)
     return root_signature;
 }
 
-#define create_pipeline_state(a, b, c, d) create_pipeline_state_(__LINE__, a, b, c, d)
-static ID3D12PipelineState *create_pipeline_state_(unsigned int line, ID3D12Device *device,
+static void init_pipeline_state_desc(D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc,
         ID3D12RootSignature *root_signature, DXGI_FORMAT rt_format, const D3D12_SHADER_BYTECODE *ps)
 {
-    D3D12_GRAPHICS_PIPELINE_STATE_DESC pipeline_state_desc;
-    ID3D12PipelineState *pipeline_state;
-    HRESULT hr;
-
     static const DWORD vs_code[] =
     {
 #if 0
@@ -271,18 +266,29 @@ static ID3D12PipelineState *create_pipeline_state_(unsigned int line, ID3D12Devi
     if (!ps)
         ps = &default_ps;
 
-    memset(&pipeline_state_desc, 0, sizeof(pipeline_state_desc));
-    pipeline_state_desc.pRootSignature = root_signature;
-    pipeline_state_desc.VS = vs;
-    pipeline_state_desc.PS = *ps;
-    pipeline_state_desc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
-    pipeline_state_desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-    pipeline_state_desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
-    pipeline_state_desc.SampleMask = ~(UINT)0;
-    pipeline_state_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-    pipeline_state_desc.NumRenderTargets = 1;
-    pipeline_state_desc.RTVFormats[0] = rt_format;
-    pipeline_state_desc.SampleDesc.Count = 1;
+    memset(desc, 0, sizeof(*desc));
+    desc->pRootSignature = root_signature;
+    desc->VS = vs;
+    desc->PS = *ps;
+    desc->BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+    desc->RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+    desc->RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
+    desc->SampleMask = ~(UINT)0;
+    desc->PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    desc->NumRenderTargets = 1;
+    desc->RTVFormats[0] = rt_format;
+    desc->SampleDesc.Count = 1;
+}
+
+#define create_pipeline_state(a, b, c, d) create_pipeline_state_(__LINE__, a, b, c, d)
+static ID3D12PipelineState *create_pipeline_state_(unsigned int line, ID3D12Device *device,
+        ID3D12RootSignature *root_signature, DXGI_FORMAT rt_format, const D3D12_SHADER_BYTECODE *ps)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC pipeline_state_desc;
+    ID3D12PipelineState *pipeline_state;
+    HRESULT hr;
+
+    init_pipeline_state_desc(&pipeline_state_desc, root_signature, rt_format, ps);
     hr = ID3D12Device_CreateGraphicsPipelineState(device, &pipeline_state_desc,
             &IID_ID3D12PipelineState, (void **)&pipeline_state);
     ok_(__FILE__, line)(hr == S_OK, "Failed to create graphics pipeline state, hr %#lx.\n", hr);
@@ -1009,6 +1015,110 @@ static void test_draw(void)
     destroy_test_context(&context);
 }
 
+#define draw_and_check(a, b) draw_and_check_(__LINE__, a, b)
+static void draw_and_check_(unsigned int line, struct test_context *context, ID3D12PipelineState *pipeline_state)
+{
+    static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    ID3D12GraphicsCommandList *command_list = context->list[0];
+
+    ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, context->rtv[0], white, 0, NULL);
+
+    ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &context->rtv[0], FALSE, NULL);
+    ID3D12GraphicsCommandList_SetGraphicsRootSignature(command_list, context->root_signature);
+    ID3D12GraphicsCommandList_SetPipelineState(command_list, pipeline_state);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(command_list, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D12GraphicsCommandList_RSSetViewports(command_list, 1, &context->viewport);
+    ID3D12GraphicsCommandList_RSSetScissorRects(command_list, 1, &context->scissor_rect);
+    ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+
+    transition_sub_resource_state(command_list, context->render_target[0], 0,
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+    check_sub_resource_uint_(line, context->render_target[0], 0, context->queue, command_list, 0xff00ff00, 0);
+
+    reset_command_list(context, 0);
+    transition_sub_resource_state(command_list, context->render_target[0], 0,
+            D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+}
+
+static void test_pipeline_library(void)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC pipeline_state_desc;
+    ID3D12PipelineLibrary *library, *library2;
+    ID3D12PipelineState *pipeline_state;
+    struct test_context context;
+    ID3D12Device1 *device1;
+    SIZE_T size;
+    ID3DBlob *blob;
+    void *data;
+    HRESULT hr;
+
+    if (!init_test_context(&context, NULL))
+        return;
+
+    create_render_target(&context);
+    init_pipeline_state_desc(&pipeline_state_desc, context.root_signature, DXGI_FORMAT_B8G8R8A8_UNORM, NULL);
+
+    hr = ID3D12PipelineState_GetCachedBlob(context.pipeline_state, &blob);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    pipeline_state_desc.CachedPSO.pCachedBlob = ID3D10Blob_GetBufferPointer(blob);
+    pipeline_state_desc.CachedPSO.CachedBlobSizeInBytes = ID3D10Blob_GetBufferSize(blob);
+    hr = ID3D12Device_CreateGraphicsPipelineState(context.device, &pipeline_state_desc,
+            &IID_ID3D12PipelineState, (void **)&pipeline_state);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    draw_and_check(&context, pipeline_state);
+    ID3D12PipelineState_Release(pipeline_state);
+    ID3D10Blob_Release(blob);
+    memset(&pipeline_state_desc.CachedPSO, 0, sizeof(pipeline_state_desc.CachedPSO));
+
+    if (FAILED(ID3D12Device_QueryInterface(context.device, &IID_ID3D12Device1, (void **)&device1)))
+    {
+        win_skip("ID3D12Device1 is not supported.\n");
+        destroy_test_context(&context);
+        return;
+    }
+
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, NULL, 0, &IID_ID3D12PipelineLibrary, (void **)&library);
+    if (hr == DXGI_ERROR_UNSUPPORTED)
+    {
+        skip("Pipeline libraries are not supported.\n");
+        ID3D12Device1_Release(device1);
+        destroy_test_context(&context);
+        return;
+    }
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+
+    hr = ID3D12PipelineLibrary_StorePipeline(library, L"default", context.pipeline_state);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    hr = ID3D12PipelineLibrary_StorePipeline(library, L"default", context.pipeline_state);
+    ok(hr == E_INVALIDARG, "Got hr %#lx.\n", hr);
+    hr = ID3D12PipelineLibrary_LoadGraphicsPipeline(library, L"unknown", &pipeline_state_desc,
+            &IID_ID3D12PipelineState, (void **)&pipeline_state);
+    ok(hr == E_INVALIDARG, "Got hr %#lx.\n", hr);
+
+    size = ID3D12PipelineLibrary_GetSerializedSize(library);
+    ok(size, "Got size %Iu.\n", size);
+    data = malloc(size);
+    hr = ID3D12PipelineLibrary_Serialize(library, data, size - 1);
+    ok(hr == E_INVALIDARG, "Got hr %#lx.\n", hr);
+    hr = ID3D12PipelineLibrary_Serialize(library, data, size);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    ID3D12PipelineLibrary_Release(library);
+
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, data, size, &IID_ID3D12PipelineLibrary, (void **)&library2);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    hr = ID3D12PipelineLibrary_LoadGraphicsPipeline(library2, L"default", &pipeline_state_desc,
+            &IID_ID3D12PipelineState, (void **)&pipeline_state);
+    ok(hr == S_OK, "Got hr %#lx.\n", hr);
+    draw_and_check(&context, pipeline_state);
+    ID3D12PipelineState_Release(pipeline_state);
+    ID3D12PipelineLibrary_Release(library2);
+
+    free(data);
+    ID3D12Device1_Release(device1);
+    destroy_test_context(&context);
+}
+
 static void test_swapchain_draw(void)
 {
     static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -1575,6 +1685,7 @@ START_TEST(d3d12)
     test_interfaces();
     test_create_device();
     test_draw();
+    test_pipeline_library();
     test_swapchain_draw();
     test_swapchain_refcount();
     test_swapchain_size_mismatch();
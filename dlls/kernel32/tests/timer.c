@@ -307,8 +307,58 @@ static void test_timeouts(void)
     adjust_system_time(-11);
 }
 
+static void test_many_timers(void)
+{
+    static const DWORD count = 100000;
+    DWORD i, r, created;
+    LARGE_INTEGER due;
+    HANDLE *timers;
+    BOOL ret;
+
+    timers = malloc(count * sizeof(*timers));
+    for (created = 0; created < count; created++)
+        if (!(timers[created] = CreateWaitableTimerW(NULL, TRUE, NULL))) break;
+    if (created < count)
+    {
+        skip("failed to create timer %lu, error %lu\n", created, GetLastError());
+        goto done;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        /* expire between one and two seconds after being set, in no particular
+         * order, so that the even timers are always canceled before they fire
+         * however long setting up all of them takes */
+        due.QuadPart = -(10000000 + (LONGLONG)((i * 7919) % count) * 100);
+        ret = SetWaitableTimer(timers[i], &due, 0, NULL, NULL, FALSE);
+        ok(ret, "SetWaitableTimer failed, error %lu\n", GetLastError());
+        if (i & 1) continue;
+        ret = CancelWaitableTimer(timers[i]);
+        ok(ret, "CancelWaitableTimer failed, error %lu\n", GetLastError());
+    }
+
+    for (i = 1; i < count; i += 2)
+    {
+        r = WaitForSingleObject(timers[i], 10000);
+        ok(r == WAIT_OBJECT_0, "timer %lu: got %lu\n", i, r);
+        if (r != WAIT_OBJECT_0) break;
+    }
+
+    for (i = 0; i < count; i += 2)
+    {
+        r = WaitForSingleObject(timers[i], 0);
+        ok(r == WAIT_TIMEOUT, "timer %lu: got %lu\n", i, r);
+        if (r != WAIT_TIMEOUT) break;
+    }
+
+done:
+    for (i = 0; i < created; i++) CloseHandle(timers[i]);
+    free(timers);
+}
+
 START_TEST(timer)
 {
     test_timer();
+    test_many_timers();
     test_timeouts();
 }
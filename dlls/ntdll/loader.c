@@ -42,6 +42,7 @@ WINE_DECLARE_DEBUG_CHANNEL(relay);
 WINE_DECLARE_DEBUG_CHANNEL(snoop);
 WINE_DECLARE_DEBUG_CHANNEL(loaddll);
 WINE_DECLARE_DEBUG_CHANNEL(imports);
+WINE_DECLARE_DEBUG_CHANNEL(exports);
 
 #ifdef _WIN64
 #define DEFAULT_SECURITY_COOKIE_64  (((ULONGLONG)0x00002b99 << 32) | 0x2ddfa232)
@@ -140,8 +141,33 @@ typedef struct _wine_modref
     struct file_id        id;
     ULONG                 CheckSum;
     BOOL                  system;
+    struct export_index  *export_index;
 } WINE_MODREF;
 
+/* hash index of the export names of a module, built on the first named lookup */
+struct export_index
+{
+    DWORD                 mask;           /* number of buckets - 1 */
+    struct
+    {
+        DWORD             hash;
+        DWORD             pos;            /* position in the names table + 1, 0 if the bucket is empty */
+    } buckets[1];
+};
+
+#define EXPORT_INDEX_MIN_NAMES 32  /* binary search is good enough for small export tables */
+
+/* named export lookup statistics, times are only measured with +exports */
+static struct
+{
+    ULONG                 lookups;
+    ULONG                 hint_hits;
+    ULONG                 indexes;
+    LONGLONG              build_time;
+    LONGLONG              index_time;
+    LONGLONG              search_time;    /* time the binary search would have taken */
+} export_stats;
+
 static UINT tls_module_count = 32;     /* number of modules with TLS directory */
 static IMAGE_TLS_DIRECTORY *tls_dirs;  /* array of TLS directories */
 
@@ -1077,6 +1103,121 @@ static int find_name_in_exports( HMODULE module, const IMAGE_EXPORT_DIRECTORY *e
 }
 
 
+static DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 0x811c9dc5;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 0x01000193;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		create_export_index
+ *
+ * Build the hash index of the export names of a module.
+ */
+static struct export_index *create_export_index( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    struct export_index *index;
+    DWORD i, size, hash, bucket;
+
+    for (size = 64; size < exports->NumberOfNames * 2; size *= 2) /* nothing */;
+    if (!(index = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   offsetof( struct export_index, buckets[size] ) )))
+        return NULL;
+    index->mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        hash = hash_export_name( get_rva( module, names[i] ) );
+        for (bucket = hash & index->mask; index->buckets[bucket].pos; bucket = (bucket + 1) & index->mask)
+            /* nothing */;
+        index->buckets[bucket].hash = hash;
+        index->buckets[bucket].pos  = i + 1;
+    }
+    return index;
+}
+
+
+/*************************************************************************
+ *		get_export_index
+ *
+ * Return the export names index of a module, building it if needed.
+ * The loader_section must be locked while calling this function.
+ */
+static const struct export_index *get_export_index( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    LARGE_INTEGER start, end;
+    WINE_MODREF *wm;
+
+    if (exports->NumberOfNames < EXPORT_INDEX_MIN_NAMES) return NULL;
+    if (!(wm = get_modref( module ))) return NULL;
+    if (wm->export_index) return wm->export_index;
+
+    if (TRACE_ON(exports)) RtlQueryPerformanceCounter( &start );
+    if (!(wm->export_index = create_export_index( module, exports ))) return NULL;
+    export_stats.indexes++;
+    if (TRACE_ON(exports))
+    {
+        RtlQueryPerformanceCounter( &end );
+        export_stats.build_time += end.QuadPart - start.QuadPart;
+        TRACE_(exports)( "indexed %lu names of %s\n", exports->NumberOfNames,
+                         debugstr_w(wm->ldr.BaseDllName.Buffer) );
+    }
+    return wm->export_index;
+}
+
+
+/*************************************************************************
+ *		find_name_in_export_index
+ *
+ * Helper for find_named_export.
+ */
+static int find_name_in_export_index( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
+                                      const struct export_index *index, const char *name )
+{
+    const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    DWORD hash = hash_export_name( name ), bucket, pos;
+
+    for (bucket = hash & index->mask; (pos = index->buckets[bucket].pos); bucket = (bucket + 1) & index->mask)
+    {
+        if (index->buckets[bucket].hash != hash) continue;
+        if (!strcmp( get_rva( module, names[pos - 1] ), name )) return ordinals[pos - 1];
+    }
+    return -1;
+}
+
+
+/*************************************************************************
+ *		lookup_export_name
+ *
+ * Helper for find_named_export.
+ * The loader_section must be locked while calling this function.
+ */
+static int lookup_export_name( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports, const char *name )
+{
+    const struct export_index *index;
+    LARGE_INTEGER start, mid, end;
+    int ordinal;
+
+    if (!(index = get_export_index( module, exports ))) return find_name_in_exports( module, exports, name );
+    if (!TRACE_ON(exports)) return find_name_in_export_index( module, exports, index, name );
+
+    /* time the binary search as well, to report the time saved */
+    RtlQueryPerformanceCounter( &start );
+    ordinal = find_name_in_export_index( module, exports, index, name );
+    RtlQueryPerformanceCounter( &mid );
+    find_name_in_exports( module, exports, name );
+    RtlQueryPerformanceCounter( &end );
+    export_stats.index_time += mid.QuadPart - start.QuadPart;
+    export_stats.search_time += end.QuadPart - mid.QuadPart;
+    return ordinal;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -1091,21 +1232,47 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
     const DWORD *names = get_rva( module, exports->AddressOfNames );
     int ordinal;
 
+    export_stats.lookups++;
+
     /* first check the hint */
     if (hint >= 0 && hint < exports->NumberOfNames)
     {
         char *ename = get_rva( module, names[hint] );
         if (!strcmp( ename, name ))
+        {
+            export_stats.hint_hits++;
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path, importer, is_dynamic );
+        }
     }
 
-    /* then do a binary search */
-    if ((ordinal = find_name_in_exports( module, exports, name )) == -1) return NULL;
+    /* then use the hash index, or a binary search for small tables */
+    if ((ordinal = lookup_export_name( module, exports, name )) == -1) return NULL;
     return find_ordinal_export( module, exports, exp_size, ordinal, load_path, importer, is_dynamic );
 
 }
 
 
+/*************************************************************************
+ *		dump_export_stats
+ *
+ * Report the named export lookup statistics of process startup.
+ */
+static void dump_export_stats(void)
+{
+    LARGE_INTEGER freq;
+
+    if (!TRACE_ON(exports)) return;
+
+    RtlQueryPerformanceFrequency( &freq );
+    TRACE_(exports)( "%lu named lookups, %lu resolved by hint, %lu indexes built in %lu us\n",
+                     export_stats.lookups, export_stats.hint_hits, export_stats.indexes,
+                     (ULONG)(export_stats.build_time * 1000000 / freq.QuadPart) );
+    TRACE_(exports)( "index lookups took %lu us, binary search would have taken %lu us\n",
+                     (ULONG)(export_stats.index_time * 1000000 / freq.QuadPart),
+                     (ULONG)(export_stats.search_time * 1000000 / freq.QuadPart) );
+}
+
+
 /*************************************************************************
  *		RtlFindExportedRoutineByName
  */
@@ -4047,6 +4214,7 @@ static void free_modref( WINE_MODREF *wm )
                         (wm->ldr.Flags & LDR_WINE_INTERNAL) ? "builtin" : "native" );
 
     free_tls_slot( &wm->ldr );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_index );
     RtlReleaseActivationContext( wm->ldr.ActivationContext );
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.DllBase );
     if (cached_modref == wm) cached_modref = NULL;
@@ -4573,6 +4741,7 @@ void loader_init( CONTEXT *context, void **entry )
             NtTerminateProcess( GetCurrentProcess(), status );
         }
         release_address_space();
+        dump_export_stats();
         if (wm->ldr.TlsIndex == -1) call_tls_callbacks( wm->ldr.DllBase, DLL_PROCESS_ATTACH );
         if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
 
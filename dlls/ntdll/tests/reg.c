@@ -801,6 +801,127 @@ static void test_NtQueryValueKey(void)
     pNtClose(key);
 }
 
+/* best case time of querying a value in iterations [first, last) of a query loop */
+static void update_query_time(LONGLONG *best, DWORD i, DWORD first, DWORD last,
+                              const LARGE_INTEGER *start, const LARGE_INTEGER *end)
+{
+    if (i < first || i >= last) return;
+    if (*best < 0 || end->QuadPart - start->QuadPart < *best) *best = end->QuadPart - start->QuadPart;
+}
+
+static void test_NtQueryValueKey_repeated(void)
+{
+    KEY_VALUE_PARTIAL_INFORMATION *info;
+    UNICODE_STRING name, value_name;
+    LONGLONG cold = -1, hot = -1;
+    LARGE_INTEGER start, end;
+    OBJECT_ATTRIBUTES attr;
+    HANDLE key, key2, root;
+    NTSTATUS status;
+    DWORD i, len, data;
+    char buffer[8192];
+    BYTE big[5000];
+
+    info = (KEY_VALUE_PARTIAL_INFORMATION *)buffer;
+
+    InitializeObjectAttributes(&attr, &winetestpath, 0, 0, 0);
+    status = pNtOpenKey(&root, KEY_ALL_ACCESS, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey Failed: 0x%08lx\n", status);
+
+    pRtlInitUnicodeString(&name, L"repeated");
+    InitializeObjectAttributes(&attr, &name, OBJ_CASE_INSENSITIVE, root, 0);
+    status = pNtCreateKey(&key, KEY_ALL_ACCESS, &attr, 0, 0, 0, 0);
+    ok(status == STATUS_SUCCESS, "NtCreateKey Failed: 0x%08lx\n", status);
+    status = pNtOpenKey(&key2, KEY_ALL_ACCESS, &attr);
+    ok(status == STATUS_SUCCESS, "NtOpenKey Failed: 0x%08lx\n", status);
+
+    pRtlInitUnicodeString(&value_name, L"Value");
+    data = 1;
+    status = pNtSetValueKey(key2, &value_name, 0, REG_DWORD, &data, sizeof(data));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey Failed: 0x%08lx\n", status);
+
+    /* query often enough for the key to be considered hot; Wine mirrors it in
+     * shared memory after 16 queries, and later ones don't need the server */
+    for (i = 0; i < 64; i++)
+    {
+        winetest_push_context("%lu", i);
+        QueryPerformanceCounter(&start);
+        status = pNtQueryValueKey(key, &value_name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+        QueryPerformanceCounter(&end);
+        update_query_time(&cold, i, 0, 15, &start, &end);
+        update_query_time(&hot, i, 32, 64, &start, &end);
+        ok(status == STATUS_SUCCESS, "got %#lx\n", status);
+        ok(info->Type == REG_DWORD, "got type %lu\n", info->Type);
+        ok(info->DataLength == sizeof(DWORD), "got length %lu\n", info->DataLength);
+        ok(*(DWORD *)info->Data == i + 1, "got data %lu\n", *(DWORD *)info->Data);
+        winetest_pop_context();
+
+        /* changes made through another handle must be seen right away */
+        data = i + 2;
+        status = pNtSetValueKey(key2, &value_name, 0, REG_DWORD, &data, sizeof(data));
+        ok(status == STATUS_SUCCESS, "NtSetValueKey Failed: 0x%08lx\n", status);
+    }
+
+    if (!strcmp(winetest_platform, "wine"))
+        ok(hot * 2 < cold, "hot key queries took %s ticks, cold ones %s\n",
+           wine_dbgstr_longlong(hot), wine_dbgstr_longlong(cold));
+
+    pRtlInitUnicodeString(&name, L"value");
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "got %#lx\n", status);
+    ok(*(DWORD *)info->Data == 65, "got data %lu\n", *(DWORD *)info->Data);
+
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data), &len);
+    ok(status == STATUS_BUFFER_OVERFLOW, "got %#lx\n", status);
+    ok(len == FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[sizeof(DWORD)]), "got len %lu\n", len);
+
+    pRtlInitUnicodeString(&name, L"missing");
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "got %#lx\n", status);
+
+    pRtlInitUnicodeString(&name, L"big");
+    memset(big, 0xcc, sizeof(big));
+    status = pNtSetValueKey(key2, &name, 0, REG_BINARY, big, sizeof(big));
+    ok(status == STATUS_SUCCESS, "NtSetValueKey Failed: 0x%08lx\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "got %#lx\n", status);
+    ok(info->DataLength == sizeof(big), "got length %lu\n", info->DataLength);
+    ok(!memcmp(info->Data, big, sizeof(big)), "got wrong data\n");
+    status = pNtQueryValueKey(key, &value_name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_SUCCESS, "got %#lx\n", status);
+    ok(*(DWORD *)info->Data == 65, "got data %lu\n", *(DWORD *)info->Data);
+
+    /* the key is too big to be mirrored now, it is again once it shrinks */
+    status = pNtDeleteValueKey(key2, &name);
+    ok(status == STATUS_SUCCESS, "NtDeleteValueKey Failed: 0x%08lx\n", status);
+    for (i = 0, hot = -1; i < 64; i++)
+    {
+        QueryPerformanceCounter(&start);
+        status = pNtQueryValueKey(key, &value_name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+        QueryPerformanceCounter(&end);
+        update_query_time(&hot, i, 32, 64, &start, &end);
+        ok(status == STATUS_SUCCESS, "got %#lx\n", status);
+    }
+    ok(*(DWORD *)info->Data == 65, "got data %lu\n", *(DWORD *)info->Data);
+    if (!strcmp(winetest_platform, "wine"))
+        ok(hot * 2 < cold, "shrunk key queries took %s ticks, cold ones %s\n",
+           wine_dbgstr_longlong(hot), wine_dbgstr_longlong(cold));
+
+    status = pNtDeleteValueKey(key2, &value_name);
+    ok(status == STATUS_SUCCESS, "NtDeleteValueKey Failed: 0x%08lx\n", status);
+    status = pNtQueryValueKey(key, &value_name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_OBJECT_NAME_NOT_FOUND, "got %#lx\n", status);
+
+    status = pNtDeleteKey(key2);
+    ok(status == STATUS_SUCCESS, "NtDeleteKey Failed: 0x%08lx\n", status);
+    status = pNtQueryValueKey(key, &name, KeyValuePartialInformation, info, sizeof(buffer), &len);
+    ok(status == STATUS_KEY_DELETED, "got %#lx\n", status);
+
+    pNtClose(key2);
+    pNtClose(key);
+    pNtClose(root);
+}
+
 static void test_NtDeleteKey(void)
 {
     UNICODE_STRING string;
@@ -3176,6 +3297,7 @@ START_TEST(reg)
     test_NtQueryKey();
     test_NtQueryLicenseKey();
     test_NtQueryValueKey();
+    test_NtQueryValueKey_repeated();
     test_long_value_name();
     test_notify();
     test_RtlCreateRegistryKey();
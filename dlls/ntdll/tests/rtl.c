@@ -3826,6 +3826,63 @@ static void test_RtlFindExportedRoutineByName(void)
     ok( proc == NULL, "Shouldn't find forwarded function\n" );
 }
 
+static void test_named_exports( const WCHAR *name )
+{
+    HMODULE module = GetModuleHandleW( name );
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    LARGE_INTEGER start, end, freq;
+    const DWORD *names;
+    ULONG size, i, count = 0;
+    void *proc, *expect;
+    ANSI_STRING str;
+    NTSTATUS status;
+
+    exports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size );
+    ok( exports != NULL, "no exports in %s\n", debugstr_w(name) );
+    if (!exports) return;
+    names = (const DWORD *)((char *)module + exports->AddressOfNames);
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        const char *export = (const char *)module + names[i];
+
+        /* forwarded exports are not resolved by RtlFindExportedRoutineByName */
+        if (!(expect = pRtlFindExportedRoutineByName( module, export ))) continue;
+        RtlInitAnsiString( &str, export );
+        status = LdrGetProcedureAddress( module, &str, 0, &proc );
+        ok( !status, "%s: got status %#lx\n", export, status );
+        ok( proc == expect, "%s: got %p, expected %p\n", export, proc, expect );
+        count++;
+    }
+    QueryPerformanceCounter( &end );
+    trace( "%s: looked up %lu of %lu names in %I64d us\n", debugstr_w(name), count, exports->NumberOfNames,
+           (end.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart );
+
+    RtlInitAnsiString( &str, "NoSuchExportedFunction" );
+    status = LdrGetProcedureAddress( module, &str, 0, &proc );
+    ok( status == STATUS_PROCEDURE_NOT_FOUND, "got status %#lx\n", status );
+}
+
+static void test_LdrGetProcedureAddress_names(void)
+{
+    void *proc, *expect;
+
+    if (!pRtlFindExportedRoutineByName)
+    {
+        win_skip( "RtlFindExportedRoutineByName is not present\n" );
+        return;
+    }
+    test_named_exports( L"ntdll" );
+    test_named_exports( L"kernelbase" );
+
+    /* forwarded exports are resolved through the target module exports */
+    expect = pRtlFindExportedRoutineByName( GetModuleHandleW( L"kernelbase" ), "CtrlRoutine" );
+    proc = GetProcAddress( GetModuleHandleW( L"kernel32" ), "CtrlRoutine" );
+    ok( proc == expect, "got %p, expected %p\n", proc, expect );
+}
+
 static void test_RtlGetDeviceFamilyInfoEnum(void)
 {
     ULONGLONG version;
@@ -5591,6 +5648,7 @@ START_TEST(rtl)
     test_RtlInitializeSid();
     test_RtlValidSecurityDescriptor();
     test_RtlFindExportedRoutineByName();
+    test_LdrGetProcedureAddress_names();
     test_RtlGetDeviceFamilyInfoEnum();
     test_RtlConvertDeviceFamilyInfoToString();
     test_rb_tree();
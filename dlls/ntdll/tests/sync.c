@@ -541,6 +541,106 @@ static void test_semaphore(void)
     NtClose( semaphore );
 }
 
+struct wait_all_race
+{
+    HANDLE objs[2];
+    LONG stop;
+};
+
+/* The semaphore is never released, so waiting for all objects never succeeds,
+ * and must never take the other object even for a moment. */
+static DWORD WINAPI wait_all_race_thread( void *arg )
+{
+    struct wait_all_race *race = arg;
+    DWORD ret;
+
+    while (!ReadAcquire( &race->stop ))
+    {
+        ret = WaitForMultipleObjects( 2, race->objs, TRUE, 0 );
+        ok( ret == WAIT_TIMEOUT, "WaitForMultipleObjects returned %08lx\n", ret );
+        if (ret != WAIT_TIMEOUT) break;
+    }
+    return 0;
+}
+
+static void test_wait_all_race(void)
+{
+    struct wait_all_race race = {0};
+    unsigned int i, stolen, reset_lost;
+    HANDLE event, mutant, semaphore, thread;
+    NTSTATUS status;
+    DWORD ret;
+
+    status = pNtCreateEvent( &event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE );
+    ok( status == STATUS_SUCCESS, "NtCreateEvent failed %08lx\n", status );
+    status = pNtCreateMutant( &mutant, MUTANT_ALL_ACCESS, NULL, FALSE );
+    ok( status == STATUS_SUCCESS, "NtCreateMutant failed %08lx\n", status );
+    status = pNtCreateSemaphore( &semaphore, SEMAPHORE_ALL_ACCESS, NULL, 0, 1 );
+    ok( status == STATUS_SUCCESS, "NtCreateSemaphore failed %08lx\n", status );
+
+    /* resetting the event while the other thread checks it */
+    race.objs[0] = event;
+    race.objs[1] = semaphore;
+    race.stop = 0;
+    thread = CreateThread( NULL, 0, wait_all_race_thread, &race, 0, NULL );
+
+    stolen = reset_lost = 0;
+    for (i = 0; i < 20000; i++)
+    {
+        pNtSetEvent( event, NULL );
+        if (WaitForSingleObject( event, 0 ) != WAIT_OBJECT_0) stolen++;
+        pNtSetEvent( event, NULL );
+        pNtResetEvent( event, NULL );
+        if (WaitForSingleObject( event, 0 ) != WAIT_TIMEOUT) reset_lost++;
+    }
+
+    WriteRelease( &race.stop, 1 );
+    ret = WaitForSingleObject( thread, 5000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject failed %08lx\n", ret );
+    CloseHandle( thread );
+    ok( !stolen, "event was not signaled %u times\n", stolen );
+    ok( !reset_lost, "event was signaled after a reset %u times\n", reset_lost );
+
+    /* releasing the mutex while the other thread checks it */
+    race.objs[0] = mutant;
+    race.stop = 0;
+    thread = CreateThread( NULL, 0, wait_all_race_thread, &race, 0, NULL );
+
+    stolen = 0;
+    for (i = 0; i < 20000; i++)
+    {
+        if (WaitForSingleObject( mutant, 0 ) != WAIT_OBJECT_0)
+        {
+            stolen++;
+            continue;
+        }
+        status = pNtReleaseMutant( mutant, NULL );
+        ok( status == STATUS_SUCCESS, "NtReleaseMutant failed %08lx\n", status );
+        if (status) break;
+    }
+
+    WriteRelease( &race.stop, 1 );
+    ret = WaitForSingleObject( thread, 5000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForSingleObject failed %08lx\n", ret );
+    CloseHandle( thread );
+    ok( !stolen, "mutex was not available %u times\n", stolen );
+
+    /* once all of them are signaled, they are all acquired */
+    pNtSetEvent( event, NULL );
+    pNtReleaseSemaphore( semaphore, 1, NULL );
+    race.objs[0] = event;
+    ret = WaitForMultipleObjects( 2, race.objs, TRUE, 1000 );
+    ok( ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %08lx\n", ret );
+    ret = WaitForSingleObject( event, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %08lx\n", ret );
+    ret = WaitForSingleObject( semaphore, 0 );
+    ok( ret == WAIT_TIMEOUT, "WaitForSingleObject returned %08lx\n", ret );
+
+    NtClose( semaphore );
+    NtClose( mutant );
+    NtClose( event );
+}
+
 static void test_wait_on_address(void)
 {
     SIZE_T size;
@@ -1477,6 +1577,7 @@ START_TEST(sync)
     test_event();
     test_mutant();
     test_semaphore();
+    test_wait_all_race();
     test_keyed_events();
     test_resource();
     test_tid_alert( argv );
@@ -838,6 +838,109 @@ static void test_tp_work_scheduler(void)
     pTpReleasePool(pool);
 }
 
+static void CALLBACK work_count_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    InterlockedIncrement((LONG *)userdata);
+}
+
+struct contention_info
+{
+    TP_WORK **works;
+    unsigned int count;
+    unsigned int posts;
+    LONG budget;
+    LONG fanout;
+};
+
+static void CALLBACK work_fanout_cb(TP_CALLBACK_INSTANCE *instance, void *userdata, TP_WORK *work)
+{
+    struct contention_info *info = userdata;
+
+    InterlockedIncrement(&info->fanout);
+    if (InterlockedDecrement(&info->budget) >= 0) pTpPostWork(work);
+    if (InterlockedDecrement(&info->budget) >= 0) pTpPostWork(work);
+}
+
+static DWORD WINAPI contention_thread(void *arg)
+{
+    struct contention_info *info = arg;
+    unsigned int i;
+
+    for (i = 0; i < info->posts; i++)
+        pTpPostWork(info->works[i % info->count]);
+    return 0;
+}
+
+static void test_tp_work_contention(void)
+{
+    TP_CALLBACK_ENVIRON_V3 environment;
+    LARGE_INTEGER start, end, freq;
+    struct contention_info info;
+    HANDLE threads[8];
+    LONG counts[16], total;
+    TP_WORK *works[16];
+    TP_WORK *fanout;
+    NTSTATUS status;
+    TP_POOL *pool;
+    unsigned int i;
+    DWORD result;
+
+    status = pTpAllocPool(&pool, NULL);
+    ok(!status, "TpAllocPool failed with status %lx\n", status);
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 3;
+    environment.Pool = pool;
+    environment.Size = sizeof(environment);
+    for (i = 0; i < ARRAY_SIZE(works); i++)
+    {
+        counts[i] = 0;
+        environment.CallbackPriority = TP_CALLBACK_PRIORITY_HIGH + i % 3;
+        status = pTpAllocWork(&works[i], work_count_cb, &counts[i], (TP_CALLBACK_ENVIRON *)&environment);
+        ok(!status, "TpAllocWork failed with status %lx\n", status);
+    }
+
+    /* many threads posting to the same few work objects */
+    info.works = works;
+    info.count = ARRAY_SIZE(works);
+    info.posts = 20000;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+        threads[i] = CreateThread(NULL, 0, contention_thread, &info, 0, NULL);
+    result = WaitForMultipleObjects(ARRAY_SIZE(threads), threads, TRUE, 30000);
+    ok(result == WAIT_OBJECT_0, "WaitForMultipleObjects returned %lu\n", result);
+    for (i = 0, total = 0; i < ARRAY_SIZE(works); i++)
+    {
+        pTpWaitForWork(works[i], FALSE);
+        total += counts[i];
+    }
+    QueryPerformanceCounter(&end);
+    ok(total == ARRAY_SIZE(threads) * info.posts, "got %lu callbacks\n", total);
+    trace("%lu callbacks posted from %u threads in %lu ms\n", total, (unsigned int)ARRAY_SIZE(threads),
+          (DWORD)((end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart));
+    for (i = 0; i < ARRAY_SIZE(threads); i++) CloseHandle(threads[i]);
+    for (i = 0; i < ARRAY_SIZE(works); i++) pTpReleaseWork(works[i]);
+
+    /* callbacks posting further work from the worker threads */
+    info.budget = 100000;
+    info.fanout = 0;
+    environment.CallbackPriority = TP_CALLBACK_PRIORITY_NORMAL;
+    status = pTpAllocWork(&fanout, work_fanout_cb, &info, (TP_CALLBACK_ENVIRON *)&environment);
+    ok(!status, "TpAllocWork failed with status %lx\n", status);
+    QueryPerformanceCounter(&start);
+    pTpPostWork(fanout);
+    while (info.budget > 0) Sleep(1);
+    pTpWaitForWork(fanout, FALSE);
+    QueryPerformanceCounter(&end);
+    ok(info.fanout == 100001, "got %lu callbacks\n", info.fanout);
+    trace("%lu callbacks posted from callbacks in %lu ms\n", info.fanout,
+          (DWORD)((end.QuadPart - start.QuadPart) * 1000 / freq.QuadPart));
+    pTpReleaseWork(fanout);
+
+    pTpReleasePool(pool);
+}
+
 static void CALLBACK simple_release_cb(TP_CALLBACK_INSTANCE *instance, void *userdata)
 {
     HANDLE *semaphores = userdata;
@@ -2484,6 +2587,7 @@ START_TEST(threadpool)
     test_tp_simple();
     test_tp_work();
     test_tp_work_scheduler();
+    test_tp_work_contention();
     test_tp_group_wait();
     test_tp_group_cancel();
     test_tp_instance();
@@ -96,8 +96,31 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#define THREADPOOL_QUEUE_SIZE 64        /* must be a power of 2 */
+#define THREADPOOL_MAX_QUEUES 64
+#define THREADPOOL_SHARED_INTERVAL 16
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+/* Lock-free queue of objects with pending callbacks. Only the worker owning it
+ * adds entries, which are removed in FIFO order by the owner or by other workers
+ * stealing them. */
+struct threadpool_queue
+{
+    LONG                    head;
+    LONG                    tail;
+    struct threadpool_object * volatile entries[THREADPOOL_QUEUE_SIZE];
+};
+
+/* per-worker queues, kept until the threadpool is destroyed */
+struct threadpool_slot
+{
+    struct threadpool      *pool;
+    unsigned int            index;
+    BOOL                    used;       /* locked via .pool->cs */
+    /* order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    struct threadpool_queue queues[3];
+};
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -105,14 +128,21 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
-    /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    /* Pools of work items posted from outside the worker threads, locked via .queue_lock,
+     * order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    RTL_SRWLOCK             queue_lock;
     struct list             pools[3];
+    LONG                    pool_sizes[3];
+    /* queues of the worker threads, slots are only added while holding .cs */
+    struct threadpool_slot *slots[THREADPOOL_MAX_QUEUES];
+    LONG                    num_slots;
     RTL_CONDITION_VARIABLE  update_event;
     /* information about worker threads, locked via .cs */
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
-    int                     num_busy_workers;
+    LONG                    num_busy_workers;  /* updated atomically */
+    LONG                    num_idle_workers;  /* updated atomically */
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
 };
@@ -151,14 +181,16 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
-    /* information about the pool, locked via .pool->cs */
+    /* information about the pool, locked via .pool->queue_lock */
     struct list             pool_entry;
+    /* callback counters are updated atomically, waiters sleep on .pool->cs */
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
     HANDLE                  completed_event;
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
+    LONG                    num_waiters;
     LONG                    update_serial;
     /* arguments for callback */
     union
@@ -372,6 +404,7 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 
 static void CALLBACK threadpool_worker_proc( void *param );
 static void tp_object_submit( struct threadpool_object *object, BOOL signaled );
+static LONG tp_object_start_callback( struct threadpool_object *object );
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread );
 static void tp_object_prepare_shutdown( struct threadpool_object *object );
 static BOOL tp_object_release( struct threadpool_object *object );
@@ -1361,10 +1394,8 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                 {
                     InterlockedIncrement( &wait->refcount );
-                    wait->num_pending_callbacks++;
-                    RtlEnterCriticalSection( &wait->pool->cs );
-                    tp_object_execute( wait, TRUE );
-                    RtlLeaveCriticalSection( &wait->pool->cs );
+                    InterlockedIncrement( &wait->num_pending_callbacks );
+                    if (tp_object_start_callback( wait )) tp_object_execute( wait, TRUE );
                     tp_object_release( wait );
                 }
                 else tp_object_submit( wait, FALSE );
@@ -1422,11 +1453,9 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                     }
                     if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                     {
-                        wait->u.wait.signaled++;
-                        wait->num_pending_callbacks++;
-                        RtlEnterCriticalSection( &wait->pool->cs );
-                        tp_object_execute( wait, TRUE );
-                        RtlLeaveCriticalSection( &wait->pool->cs );
+                        InterlockedIncrement( &wait->u.wait.signaled );
+                        InterlockedIncrement( &wait->num_pending_callbacks );
+                        if (tp_object_start_callback( wait )) tp_object_execute( wait, TRUE );
                     }
                     else tp_object_submit( wait, TRUE );
                 }
@@ -1772,14 +1801,21 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     RtlInitializeCriticalSectionEx( &pool->cs, 0, RTL_CRITICAL_SECTION_FLAG_FORCE_DEBUG_INFO );
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 
+    RtlInitializeSRWLock( &pool->queue_lock );
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
         list_init( &pool->pools[i] );
+        pool->pool_sizes[i] = 0;
+    }
+    memset( pool->slots, 0, sizeof(pool->slots) );
+    pool->num_slots               = 0;
     RtlInitializeConditionVariable( &pool->update_event );
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+    pool->num_idle_workers        = 0;
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
@@ -1822,6 +1858,8 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
     assert( !pool->objcount );
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         assert( list_empty( &pool->pools[i] ) );
+    for (i = 0; i < pool->num_slots; ++i)
+        RtlFreeHeap( GetProcessHeap(), 0, pool->slots[i] );
 
     pool->cs.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &pool->cs );
@@ -2062,49 +2100,211 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
-static void tp_object_prio_queue( struct threadpool_object *object )
+/* decrement a counter unless it is already zero, returns the previous value */
+static LONG interlocked_dec_if_positive( LONG volatile *dest )
+{
+    LONG value = ReadNoFence( dest ), prev;
+
+    while (value > 0 && (prev = InterlockedCompareExchange( dest, value - 1, value )) != value)
+        value = prev;
+    return max( value, 0 );
+}
+
+/* add an object to a worker queue, only called by its owner */
+static BOOL tp_queue_push( struct threadpool_queue *queue, struct threadpool_object *object )
+{
+    ULONG tail = queue->tail;
+
+    if (tail - (ULONG)ReadAcquire( &queue->head ) >= THREADPOOL_QUEUE_SIZE) return FALSE;
+    queue->entries[tail % THREADPOOL_QUEUE_SIZE] = object;
+    WriteRelease( &queue->tail, tail + 1 );
+    return TRUE;
+}
+
+/* remove the oldest object of a worker queue */
+static struct threadpool_object *tp_queue_pop( struct threadpool_queue *queue )
+{
+    struct threadpool_object *object;
+    ULONG head;
+
+    do
+    {
+        head = ReadAcquire( &queue->head );
+        if ((ULONG)ReadAcquire( &queue->tail ) == head) return NULL;
+        object = queue->entries[head % THREADPOOL_QUEUE_SIZE];
+    }
+    while (InterlockedCompareExchange( &queue->head, head + 1, head ) != head);
+
+    return object;
+}
+
+static BOOL tp_queue_empty( struct threadpool_queue *queue )
 {
-    ++object->pool->num_busy_workers;
-    list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
+    return ReadAcquire( &queue->head ) == ReadAcquire( &queue->tail );
+}
+
+/* add an object to the shared pools, fails if it is already queued there */
+static BOOL tp_threadpool_push_shared( struct threadpool *pool, struct threadpool_object *object )
+{
+    BOOL ret = FALSE;
+
+    RtlAcquireSRWLockExclusive( &pool->queue_lock );
+    if (!object->pool_entry.next)
+    {
+        list_add_tail( &pool->pools[object->priority], &object->pool_entry );
+        InterlockedIncrement( &pool->pool_sizes[object->priority] );
+        ret = TRUE;
+    }
+    RtlReleaseSRWLockExclusive( &pool->queue_lock );
+    return ret;
+}
+
+static BOOL tp_threadpool_remove_shared( struct threadpool *pool, struct threadpool_object *object )
+{
+    BOOL ret = FALSE;
+
+    RtlAcquireSRWLockExclusive( &pool->queue_lock );
+    if (object->pool_entry.next)
+    {
+        list_remove( &object->pool_entry );
+        memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+        InterlockedDecrement( &pool->pool_sizes[object->priority] );
+        ret = TRUE;
+    }
+    RtlReleaseSRWLockExclusive( &pool->queue_lock );
+    return ret;
+}
+
+static struct threadpool_object *tp_threadpool_pop_shared( struct threadpool *pool, unsigned int priority )
+{
+    struct threadpool_object *object = NULL;
+    struct list *ptr;
+
+    if (!ReadNoFence( &pool->pool_sizes[priority] )) return NULL;
+
+    RtlAcquireSRWLockExclusive( &pool->queue_lock );
+    if ((ptr = list_head( &pool->pools[priority] )))
+    {
+        object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
+        list_remove( &object->pool_entry );
+        memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+        InterlockedDecrement( &pool->pool_sizes[priority] );
+    }
+    RtlReleaseSRWLockExclusive( &pool->queue_lock );
+    return object;
 }
 
 /***********************************************************************
- *           tp_object_submit    (internal)
+ *           tp_threadpool_notify    (internal)
  *
- * Submits a threadpool object to the associated threadpool. This
- * function has to be VOID because TpPostWork can never fail on Windows.
+ * Starts a new worker thread if all of them are busy, or wakes up an
+ * idle one after work has been queued.
  */
-static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+static void tp_threadpool_notify( struct threadpool *pool )
 {
-    struct threadpool *pool = object->pool;
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
-    assert( !object->shutdown );
-    assert( !pool->shutdown );
+    /* Pairs with the increment of num_idle_workers in threadpool_worker_proc. */
+    MemoryBarrier();
+    if (!ReadNoFence( &pool->num_idle_workers ) &&
+        (ReadNoFence( &pool->num_busy_workers ) < pool->num_workers || pool->num_workers >= pool->max_workers))
+        return;
 
     RtlEnterCriticalSection( &pool->cs );
 
-    /* Start new worker threads if required. */
     if (pool->num_busy_workers >= pool->num_workers &&
         pool->num_workers < pool->max_workers)
         status = tp_new_worker_thread( pool );
 
-    /* Queue work item and increment refcount. */
+    if (status != STATUS_SUCCESS && pool->num_idle_workers)
+        RtlWakeConditionVariable( &pool->update_event );
+
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+/***********************************************************************
+ *           tp_object_prio_queue    (internal)
+ *
+ * Queues an object with pending callbacks, in the queue of the current
+ * worker thread if possible. The queue entry holds a reference to the
+ * object. An object may be queued several times after its callbacks have
+ * been canceled, extra entries are simply dropped by the workers.
+ */
+static void tp_object_prio_queue( struct threadpool_object *object, BOOL shared )
+{
+    struct threadpool_slot *slot = NtCurrentTeb()->ThreadPoolData;
+    struct threadpool *pool = object->pool;
+
     InterlockedIncrement( &object->refcount );
-    if (!object->num_pending_callbacks++)
-        tp_object_prio_queue( object );
+    InterlockedIncrement( &pool->num_busy_workers );
+
+    if (!shared && slot && slot->pool == pool && tp_queue_push( &slot->queues[object->priority], object ))
+        return;
+    if (tp_threadpool_push_shared( pool, object ))
+        return;
+
+    /* Already in the shared pools, that entry will run all pending callbacks. */
+    InterlockedDecrement( &pool->num_busy_workers );
+    tp_object_release( object );
+}
+
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    struct threadpool *pool = object->pool;
+
+    assert( !object->shutdown );
+    assert( !pool->shutdown );
 
     /* Count how often the object was signaled. */
     if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
-        object->u.wait.signaled++;
+        InterlockedIncrement( &object->u.wait.signaled );
 
-    /* No new thread started - wake up one existing thread. */
-    if (status != STATUS_SUCCESS)
+    /* Queue the object if it has no pending callbacks yet, otherwise the
+     * worker running it takes care of queuing it again. */
+    if (InterlockedIncrement( &object->num_pending_callbacks ) == 1)
     {
-        assert( pool->num_workers > 0 );
-        RtlWakeConditionVariable( &pool->update_event );
+        tp_object_prio_queue( object, FALSE );
+        tp_threadpool_notify( pool );
     }
+}
+
+static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
+{
+    if (object->num_pending_callbacks)
+        return FALSE;
+    if (object->type == TP_OBJECT_TYPE_IO && object->u.io.pending_count)
+        return FALSE;
+
+    if (group)
+        return !object->num_running_callbacks;
+    else
+        return !object->num_associated_callbacks;
+}
+
+/***********************************************************************
+ *           tp_object_wake_waiters    (internal)
+ *
+ * Wakes up threads waiting for the callbacks of an object to finish,
+ * after a callback counter has been decremented.
+ */
+static void tp_object_wake_waiters( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
 
+    /* The counter decrement is a full barrier, pairing with the increment in tp_object_wait. */
+    if (!ReadNoFence( &object->num_waiters )) return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (object_is_finished( object, TRUE ))
+        RtlWakeAllConditionVariable( &object->group_finished_event );
+    if (object_is_finished( object, FALSE ))
+        RtlWakeAllConditionVariable( &object->finished_event );
     RtlLeaveCriticalSection( &pool->cs );
 }
 
@@ -2116,40 +2316,27 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 static void tp_object_cancel( struct threadpool_object *object )
 {
     struct threadpool *pool = object->pool;
-    LONG pending_callbacks = 0;
 
-    RtlEnterCriticalSection( &pool->cs );
-    if (object->num_pending_callbacks)
+    if (InterlockedExchange( &object->num_pending_callbacks, 0 ))
     {
-        pending_callbacks = object->num_pending_callbacks;
-        object->num_pending_callbacks = 0;
-        list_remove( &object->pool_entry );
+        /* Entries in the worker queues will be dropped when dequeued. */
+        if (tp_threadpool_remove_shared( pool, object ))
+        {
+            InterlockedDecrement( &pool->num_busy_workers );
+            tp_object_release( object );
+        }
 
         if (object->type == TP_OBJECT_TYPE_WAIT)
-            object->u.wait.signaled = 0;
+            InterlockedExchange( &object->u.wait.signaled, 0 );
     }
+
     if (object->type == TP_OBJECT_TYPE_IO)
     {
+        RtlEnterCriticalSection( &pool->cs );
         object->u.io.skipped_count += object->u.io.pending_count;
         object->u.io.pending_count = 0;
+        RtlLeaveCriticalSection( &pool->cs );
     }
-    RtlLeaveCriticalSection( &pool->cs );
-
-    while (pending_callbacks--)
-        tp_object_release( object );
-}
-
-static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
-{
-    if (object->num_pending_callbacks)
-        return FALSE;
-    if (object->type == TP_OBJECT_TYPE_IO && object->u.io.pending_count)
-        return FALSE;
-
-    if (group)
-        return !object->num_running_callbacks;
-    else
-        return !object->num_associated_callbacks;
 }
 
 /***********************************************************************
@@ -2162,6 +2349,7 @@ static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
 {
     struct threadpool *pool = object->pool;
 
+    InterlockedIncrement( &object->num_waiters );
     RtlEnterCriticalSection( &pool->cs );
     while (!RtlDllShutdownInProgress() && !object_is_finished( object, group_wait ))
     {
@@ -2171,6 +2359,7 @@ static void tp_object_wait( struct threadpool_object *object, BOOL group_wait )
             RtlSleepConditionVariableCS( &object->finished_event, &pool->cs, NULL );
     }
     RtlLeaveCriticalSection( &pool->cs );
+    InterlockedDecrement( &object->num_waiters );
 }
 
 static void tp_ioqueue_unlock( struct threadpool_object *io )
@@ -2259,25 +2448,117 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
-static struct list *threadpool_get_next_item( const struct threadpool *pool )
+/***********************************************************************
+ *           tp_threadpool_next_object    (internal)
+ *
+ * Dequeues the next object to run, by order of priority from the queue
+ * of the worker thread, the shared pools, and the queues of the other
+ * workers. The shared pools are checked first on request, to avoid
+ * starving them.
+ */
+static struct threadpool_object *tp_threadpool_next_object( struct threadpool *pool, struct threadpool_slot *slot,
+                                                            BOOL shared_first, BOOL *shared )
 {
-    struct list *ptr;
-    unsigned int i;
+    struct threadpool_object *object;
+    unsigned int i, j, start, count;
+
+    count = ReadAcquire( &pool->num_slots );
+    start = slot ? slot->index + 1 : 0;
 
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
     {
-        if ((ptr = list_head( &pool->pools[i] )))
-            break;
+        if (shared_first && (object = tp_threadpool_pop_shared( pool, i )))
+        {
+            *shared = TRUE;
+            return object;
+        }
+        if (slot && (object = tp_queue_pop( &slot->queues[i] )))
+            return object;
+        if (!shared_first && (object = tp_threadpool_pop_shared( pool, i )))
+        {
+            *shared = TRUE;
+            return object;
+        }
+        for (j = 0; j < count; ++j)
+        {
+            struct threadpool_slot *other = pool->slots[(start + j) % count];
+            if (other != slot && (object = tp_queue_pop( &other->queues[i] )))
+                return object;
+        }
     }
 
-    return ptr;
+    return NULL;
+}
+
+static BOOL tp_threadpool_has_work( struct threadpool *pool )
+{
+    unsigned int i, j, count = ReadAcquire( &pool->num_slots );
+
+    for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
+    {
+        if (ReadNoFence( &pool->pool_sizes[i] )) return TRUE;
+        for (j = 0; j < count; ++j)
+            if (!tp_queue_empty( &pool->slots[j]->queues[i] )) return TRUE;
+    }
+    return FALSE;
+}
+
+/***********************************************************************
+ *           tp_threadpool_get_slot    (internal)
+ *
+ * Assigns worker queues to the current thread, pool->cs has to be held.
+ */
+static struct threadpool_slot *tp_threadpool_get_slot( struct threadpool *pool )
+{
+    struct threadpool_slot *slot;
+    LONG i;
+
+    for (i = 0; i < pool->num_slots; ++i)
+    {
+        if (pool->slots[i]->used) continue;
+        pool->slots[i]->used = TRUE;
+        return pool->slots[i];
+    }
+
+    if (pool->num_slots == THREADPOOL_MAX_QUEUES) return NULL;
+    if (!(slot = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*slot) ))) return NULL;
+    slot->pool  = pool;
+    slot->index = i;
+    slot->used  = TRUE;
+    pool->slots[i] = slot;
+    WriteRelease( &pool->num_slots, i + 1 );
+    return slot;
+}
+
+/***********************************************************************
+ *           tp_object_start_callback    (internal)
+ *
+ * Consumes a pending callback of an object and accounts it as running.
+ * Returns the number of callbacks that were pending, or 0 if they have
+ * been canceled in the meantime.
+ */
+static LONG tp_object_start_callback( struct threadpool_object *object )
+{
+    LONG pending;
+
+    /* Count the callback as running first, so that waiters never see the object finished. */
+    InterlockedIncrement( &object->num_associated_callbacks );
+    InterlockedIncrement( &object->num_running_callbacks );
+
+    if ((pending = interlocked_dec_if_positive( &object->num_pending_callbacks )))
+        return pending;
+
+    InterlockedDecrement( &object->num_running_callbacks );
+    InterlockedDecrement( &object->num_associated_callbacks );
+    tp_object_wake_waiters( object );
+    return 0;
 }
 
 /***********************************************************************
  *           tp_object_execute    (internal)
  *
- * Executes a threadpool object callback, object->pool->cs has to be
- * held.
+ * Executes a threadpool object callback, after tp_object_start_callback
+ * has succeeded.
  */
 static void tp_object_execute( struct threadpool_object *object, BOOL wait_thread )
 {
@@ -2288,24 +2569,21 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     TP_WAIT_RESULT wait_result = 0;
     NTSTATUS status;
 
-    object->num_pending_callbacks--;
-
     /* For wait objects check if they were signaled or have timed out. */
     if (object->type == TP_OBJECT_TYPE_WAIT)
     {
-        wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
-        if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+        if (interlocked_dec_if_positive( &object->u.wait.signaled )) wait_result = WAIT_OBJECT_0;
+        else wait_result = WAIT_TIMEOUT;
     }
     else if (object->type == TP_OBJECT_TYPE_IO)
     {
+        RtlEnterCriticalSection( &pool->cs );
         assert( object->u.io.completion_count );
         completion = object->u.io.completions[--object->u.io.completion_count];
+        RtlLeaveCriticalSection( &pool->cs );
     }
 
-    /* Leave critical section and do the actual callback. */
-    object->num_associated_callbacks++;
-    object->num_running_callbacks++;
-    RtlLeaveCriticalSection( &pool->cs );
+    /* Leave the waitqueue critical section and do the actual callback. */
     if (wait_thread) RtlLeaveCriticalSection( &waitqueue.cs );
 
     /* Initialize threadpool instance struct. */
@@ -2411,7 +2689,6 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
 
 skip_cleanup:
     if (wait_thread) RtlEnterCriticalSection( &waitqueue.cs );
-    RtlEnterCriticalSection( &pool->cs );
 
     /* Simple callbacks are automatically shutdown after execution. */
     if (object->type == TP_OBJECT_TYPE_SIMPLE)
@@ -2420,16 +2697,38 @@ skip_cleanup:
         object->shutdown = TRUE;
     }
 
-    object->num_running_callbacks--;
-    if (object_is_finished( object, TRUE ))
-        RtlWakeAllConditionVariable( &object->group_finished_event );
+    InterlockedDecrement( &object->num_running_callbacks );
+    if (instance.associated) InterlockedDecrement( &object->num_associated_callbacks );
+    tp_object_wake_waiters( object );
+}
+
+/***********************************************************************
+ *           tp_object_run    (internal)
+ *
+ * Runs a pending callback of an object removed from a queue, and
+ * releases the reference held by the queue entry.
+ */
+static void tp_object_run( struct threadpool_object *object, BOOL shared )
+{
+    struct threadpool *pool = object->pool;
+    LONG pending;
 
-    if (instance.associated)
+    if ((pending = tp_object_start_callback( object )))
     {
-        object->num_associated_callbacks--;
-        if (object_is_finished( object, FALSE ))
-            RtlWakeAllConditionVariable( &object->finished_event );
+        /* If further callbacks are pending, queue the object again at the
+         * end, so that other objects get their turn. */
+        if (pending > 1)
+        {
+            tp_object_prio_queue( object, shared );
+            tp_threadpool_notify( pool );
+        }
+        tp_object_execute( object, FALSE );
     }
+
+    assert( pool->num_busy_workers );
+    InterlockedDecrement( &pool->num_busy_workers );
+
+    tp_object_release( object );
 }
 
 /***********************************************************************
@@ -2438,33 +2737,29 @@ skip_cleanup:
 static void CALLBACK threadpool_worker_proc( void *param )
 {
     struct threadpool *pool = param;
+    struct threadpool_object *object;
+    struct threadpool_slot *slot;
+    unsigned int count = 0;
     LARGE_INTEGER timeout;
-    struct list *ptr;
+    NTSTATUS status;
+    BOOL shared;
 
     TRACE( "starting worker thread for pool %p\n", pool );
     set_thread_name(L"wine_threadpool_worker");
 
     RtlEnterCriticalSection( &pool->cs );
+    slot = tp_threadpool_get_slot( pool );
+    NtCurrentTeb()->ThreadPoolData = slot;
     for (;;)
     {
-        while ((ptr = threadpool_get_next_item( pool )))
+        RtlLeaveCriticalSection( &pool->cs );
+        shared = FALSE;
+        while ((object = tp_threadpool_next_object( pool, slot, !(++count % THREADPOOL_SHARED_INTERVAL), &shared )))
         {
-            struct threadpool_object *object = LIST_ENTRY( ptr, struct threadpool_object, pool_entry );
-            assert( object->num_pending_callbacks > 0 );
-
-            /* If further pending callbacks are queued, move the work item to
-             * the end of the pool list. Otherwise remove it from the pool. */
-            list_remove( &object->pool_entry );
-            if (object->num_pending_callbacks > 1)
-                tp_object_prio_queue( object );
-
-            tp_object_execute( object, FALSE );
-
-            assert(pool->num_busy_workers);
-            pool->num_busy_workers--;
-
-            tp_object_release( object );
+            tp_object_run( object, shared );
+            shared = FALSE;
         }
+        RtlEnterCriticalSection( &pool->cs );
 
         /* Shutdown worker thread if requested. */
         if (pool->shutdown)
@@ -2474,15 +2769,26 @@ static void CALLBACK threadpool_worker_proc( void *param )
          * when no new tasks are available, and the number of threads can be
          * decreased without violating the min_workers limit. An exception is when
          * min_workers == 0, then objcount is used to detect if the last thread
-         * can be terminated. */
-        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
-        if (RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout ) == STATUS_TIMEOUT &&
-            !threadpool_get_next_item( pool ) && (pool->num_workers > max( pool->min_workers, 1 ) ||
-            (!pool->min_workers && !pool->objcount)))
+         * can be terminated. The idle count is incremented before checking the
+         * queues again, pairing with the barrier in tp_threadpool_notify. */
+        InterlockedIncrement( &pool->num_idle_workers );
+        if (tp_threadpool_has_work( pool ))
+            status = STATUS_SUCCESS;
+        else
+        {
+            timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+            status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        }
+        InterlockedDecrement( &pool->num_idle_workers );
+
+        if (status == STATUS_TIMEOUT && !tp_threadpool_has_work( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) || (!pool->min_workers && !pool->objcount)))
         {
             break;
         }
     }
+    if (slot) slot->used = FALSE;
+    NtCurrentTeb()->ThreadPoolData = NULL;
     pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
@@ -2814,7 +3120,6 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
 {
     struct threadpool_instance *this = impl_from_TP_CALLBACK_INSTANCE( instance );
     struct threadpool_object *object = this->object;
-    struct threadpool *pool;
 
     TRACE( "%p\n", instance );
 
@@ -2827,14 +3132,8 @@ VOID WINAPI TpDisassociateCallback( TP_CALLBACK_INSTANCE *instance )
     if (!this->associated)
         return;
 
-    pool = object->pool;
-    RtlEnterCriticalSection( &pool->cs );
-
-    object->num_associated_callbacks--;
-    if (object_is_finished( object, FALSE ))
-        RtlWakeAllConditionVariable( &object->finished_event );
-
-    RtlLeaveCriticalSection( &pool->cs );
+    InterlockedDecrement( &object->num_associated_callbacks );
+    tp_object_wake_waiters( object );
     this->associated = FALSE;
 }
 
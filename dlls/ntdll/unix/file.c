@@ -241,6 +241,35 @@ static const unsigned int dir_data_names_initial_size  = 64;
 static struct dir_data **dir_data_cache;
 static unsigned int dir_data_cache_size;
 
+struct dir_index_name
+{
+    unsigned int            hash;    /* hash of the upper-cased Unicode name */
+    unsigned int            next;    /* next name in the same hash bucket, or ~0u */
+    unsigned int            len;     /* length of the Unicode name */
+    unsigned int            offset;  /* offset of the Unicode name in data, followed by the Unix name */
+};
+
+struct dir_index
+{
+    struct list             entry;   /* entry in the dir_index_lru list */
+    struct file_identity    id;      /* directory file identity */
+    struct timespec         mtime;   /* directory modification time when it was indexed */
+    struct timespec         ctime;   /* directory change time when it was indexed */
+    unsigned int            count;   /* count of used entries in the names array */
+    unsigned int            size;    /* size of the names array */
+    unsigned int            buckets; /* number of hash buckets, a power of 2 */
+    unsigned int           *heads;   /* first name of each hash bucket, or ~0u */
+    struct dir_index_name  *names;   /* directory file names */
+    char                   *data;    /* storage for the names */
+    unsigned int            data_size;
+    unsigned int            data_pos;
+};
+
+#define DIR_INDEX_CACHE_SIZE 64
+
+static struct list dir_index_lru = LIST_INIT( dir_index_lru );
+static unsigned int dir_index_count;
+
 static BOOL show_dot_files;
 static mode_t start_umask;
 
@@ -253,6 +282,7 @@ static const WCHAR unix_prefixW[] = {'\\','?','?','\\','u','n','i','x'};
 static const BOOL is_case_sensitive = FALSE;
 
 static pthread_mutex_t dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t dir_index_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t mnt_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* check if a given Unicode char is OK in a DOS short name */
@@ -2687,6 +2717,257 @@ static NTSTATUS read_directory_data_stat( struct dir_data *data, const char *uni
 }
 
 
+/* a name that can only be found through the short names we generate in hash_short_file_name() */
+static BOOL is_hashed_short_name( const WCHAR *name, int length )
+{
+    return length >= 8 && name[4] == '~' && is_legal_8dot3_name( name, length );
+}
+
+static unsigned int dir_index_hash( const WCHAR *name, int length )
+{
+    unsigned int hash = 2166136261u;
+    while (length--) hash = (hash ^ towupper( *name++ )) * 16777619u;
+    return hash;
+}
+
+static void get_dir_index_times( const struct stat *st, struct timespec *mtime, struct timespec *ctime )
+{
+    mtime->tv_sec = st->st_mtime;
+    ctime->tv_sec = st->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    mtime->tv_nsec = st->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    mtime->tv_nsec = st->st_mtimespec.tv_nsec;
+#else
+    mtime->tv_nsec = 0;
+#endif
+#ifdef HAVE_STRUCT_STAT_ST_CTIM
+    ctime->tv_nsec = st->st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_CTIMESPEC)
+    ctime->tv_nsec = st->st_ctimespec.tv_nsec;
+#else
+    ctime->tv_nsec = 0;
+#endif
+}
+
+static void free_dir_index( struct dir_index *index )
+{
+    free( index->heads );
+    free( index->names );
+    free( index->data );
+    free( index );
+}
+
+static BOOL add_dir_index_name( struct dir_index *index, const char *unix_name )
+{
+    WCHAR nameW[MAX_DIR_ENTRY_LEN];
+    struct dir_index_name *name;
+    unsigned int unix_len = strlen( unix_name ) + 1, size;
+    int len = ntdll_umbstowcs( unix_name, unix_len - 1, nameW, ARRAY_SIZE(nameW) );
+
+    if (index->count == index->size)
+    {
+        unsigned int new_size = max( index->size * 2, dir_data_names_initial_size );
+        if (!(name = realloc( index->names, new_size * sizeof(*name) ))) return FALSE;
+        index->names = name;
+        index->size = new_size;
+    }
+
+    size = (len * sizeof(WCHAR) + unix_len + sizeof(WCHAR) - 1) & ~(sizeof(WCHAR) - 1);
+    if (index->data_size - index->data_pos < size)
+    {
+        unsigned int new_size = max( index->data_size * 2, dir_data_buffer_initial_size );
+        char *data;
+
+        while (new_size - index->data_pos < size) new_size *= 2;
+        if (!(data = realloc( index->data, new_size ))) return FALSE;
+        index->data = data;
+        index->data_size = new_size;
+    }
+
+    name = &index->names[index->count++];
+    name->hash = dir_index_hash( nameW, len );
+    name->len = len;
+    name->offset = index->data_pos;
+    memcpy( index->data + index->data_pos, nameW, len * sizeof(WCHAR) );
+    memcpy( index->data + index->data_pos + len * sizeof(WCHAR), unix_name, unix_len );
+    index->data_pos += size;
+    return TRUE;
+}
+
+/***********************************************************************
+ *           create_dir_index
+ *
+ * Read a whole directory into a hash table of its names, indexed by their
+ * upper-cased Unicode form. Takes ownership of fd.
+ */
+static struct dir_index *create_dir_index( int fd, const struct stat *st )
+{
+    struct dir_index *index;
+    struct dirent *de;
+    unsigned int i;
+    DIR *dir;
+
+    if (!(dir = fdopendir( fd )))
+    {
+        close( fd );
+        return NULL;
+    }
+    if (!(index = calloc( 1, sizeof(*index) ))) goto failed;
+    index->id.dev = st->st_dev;
+    index->id.ino = st->st_ino;
+    get_dir_index_times( st, &index->mtime, &index->ctime );
+
+    while ((de = readdir( dir )))
+        if (!add_dir_index_name( index, de->d_name )) goto failed;
+
+    for (index->buckets = 16; index->buckets < index->count; index->buckets *= 2) /* nothing */;
+    if (!(index->heads = malloc( index->buckets * sizeof(*index->heads) ))) goto failed;
+    memset( index->heads, 0xff, index->buckets * sizeof(*index->heads) );
+
+    /* insert in reverse order, so that each bucket keeps the readdir order */
+    for (i = index->count; i--;)
+    {
+        unsigned int bucket = index->names[i].hash & (index->buckets - 1);
+        index->names[i].next = index->heads[bucket];
+        index->heads[bucket] = i;
+    }
+
+    closedir( dir );
+    TRACE( "indexed %u names\n", index->count );
+    return index;
+
+failed:
+    if (index) free_dir_index( index );
+    closedir( dir );
+    return NULL;
+}
+
+static const char *find_dir_index_name( const struct dir_index *index, const WCHAR *name, int length )
+{
+    unsigned int hash = dir_index_hash( name, length ), i;
+
+    for (i = index->heads[hash & (index->buckets - 1)]; i != ~0u; i = index->names[i].next)
+    {
+        const struct dir_index_name *entry = &index->names[i];
+        const WCHAR *nameW = (const WCHAR *)(index->data + entry->offset);
+
+        if (entry->hash == hash && entry->len == length && !wcsnicmp( nameW, name, length ))
+            return (const char *)(nameW + entry->len);
+    }
+    return NULL;
+}
+
+/* the directory may still change within the same timestamp, don't trust recent ones */
+static BOOL is_dir_index_time_stable( const struct timespec *time )
+{
+    struct timespec now;
+
+    if (clock_gettime( CLOCK_REALTIME, &now )) return FALSE;
+    return now.tv_sec - time->tv_sec > 2;
+}
+
+/***********************************************************************
+ *           lookup_dir_index
+ *
+ * Find a name through the cached case-insensitive index of a directory.
+ * Cached indexes are keyed by the directory identity, and dropped when its
+ * modification or change time differs from the time it was indexed at.
+ * Returns 1 and copies the Unix name to ret if found, 0 if not found, and
+ * -1 if the directory could not be read.
+ */
+static int lookup_dir_index( int root_fd, const char *dir_name, const WCHAR *name, int length, char *ret )
+{
+    struct timespec mtime, ctime;
+    struct dir_index *index;
+    const char *unix_name;
+    BOOL cached = FALSE;
+    struct stat st;
+    int fd;
+
+    if (fstatat( root_fd, dir_name, &st, 0 ) == -1) return -1;
+    get_dir_index_times( &st, &mtime, &ctime );
+
+    mutex_lock( &dir_index_mutex );
+
+    LIST_FOR_EACH_ENTRY( index, &dir_index_lru, struct dir_index, entry )
+    {
+        if (index->id.dev != st.st_dev || index->id.ino != st.st_ino) continue;
+        list_remove( &index->entry );
+        if (index->mtime.tv_sec == mtime.tv_sec && index->mtime.tv_nsec == mtime.tv_nsec &&
+            index->ctime.tv_sec == ctime.tv_sec && index->ctime.tv_nsec == ctime.tv_nsec)
+        {
+            list_add_head( &dir_index_lru, &index->entry );
+            cached = TRUE;
+            break;
+        }
+        free_dir_index( index );
+        dir_index_count--;
+        break;
+    }
+
+    if (!cached)
+    {
+        /* stat again through the fd, in case the directory was replaced meanwhile */
+        if ((fd = openat( root_fd, dir_name, O_RDONLY | O_DIRECTORY )) == -1) goto failed;
+        if (fstat( fd, &st ) == -1)
+        {
+            close( fd );
+            goto failed;
+        }
+        if (!(index = create_dir_index( fd, &st ))) goto failed;
+
+        if (is_dir_index_time_stable( &index->mtime ) && is_dir_index_time_stable( &index->ctime ))
+        {
+            if (dir_index_count == DIR_INDEX_CACHE_SIZE)
+            {
+                struct dir_index *old = LIST_ENTRY( list_tail( &dir_index_lru ), struct dir_index, entry );
+                list_remove( &old->entry );
+                free_dir_index( old );
+                dir_index_count--;
+            }
+            list_add_head( &dir_index_lru, &index->entry );
+            dir_index_count++;
+            cached = TRUE;
+        }
+    }
+
+    if ((unix_name = find_dir_index_name( index, name, length ))) strcpy( ret, unix_name );
+    if (!cached) free_dir_index( index );
+    mutex_unlock( &dir_index_mutex );
+    return !!unix_name;
+
+failed:
+    mutex_unlock( &dir_index_mutex );
+    return -1;
+}
+
+
+/***********************************************************************
+ *           read_directory_data_index
+ *
+ * Look for a single file identified by mask in the current directory,
+ * through the case-insensitive directory index.
+ */
+static NTSTATUS read_directory_data_index( struct dir_data *data, const UNICODE_STRING *mask )
+{
+    char unix_name[MAX_DIR_ENTRY_LEN * 3 + 1];
+    int ret, length = mask->Length / sizeof(WCHAR);
+
+    if (length > MAX_DIR_ENTRY_LEN) return STATUS_NO_SUCH_FILE;
+    if ((ret = lookup_dir_index( AT_FDCWD, ".", mask->Buffer, length, unix_name )) < 0) return STATUS_NO_SUCH_FILE;
+
+    /* short names aren't indexed, they need a full scan */
+    if (!ret) return is_hashed_short_name( mask->Buffer, length ) ? STATUS_NO_SUCH_FILE : STATUS_SUCCESS;
+
+    TRACE( "found %s\n", debugstr_a(unix_name) );
+
+    if (!append_entry( data, unix_name, NULL, mask )) return STATUS_NO_MEMORY;
+
+    return STATUS_SUCCESS;
+}
+
+
 /***********************************************************************
  *           read_directory_readdir
  *
@@ -2742,6 +3023,7 @@ static NTSTATUS read_directory_data( struct dir_data *data, int fd, const UNICOD
 #endif
             if (!(status = read_directory_data_stat( data, unix_name ))) return status;
         }
+        if (!(status = read_directory_data_index( data, mask ))) return status;
     }
 
     return read_directory_data_readdir( data, mask );
@@ -3084,6 +3366,14 @@ static NTSTATUS find_file_in_dir( int root_fd, char *unix_name, int pos, const W
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+    if ((ret = lookup_dir_index( root_fd, unix_name, name, length, unix_name + pos )) > 0)
+    {
+        unix_name[pos - 1] = '/';
+        return STATUS_SUCCESS;
+    }
+    /* short names aren't indexed, they need a full scan */
+    if (!ret && !is_hashed_short_name( name, length )) goto not_found;
+
     if ((fd = openat( root_fd, unix_name, O_RDONLY )) == -1) return errno_to_status( errno );
     if (!(dir = fdopendir( fd )))
     {
@@ -38,6 +38,124 @@ WINE_DEFAULT_DEBUG_CHANNEL(reg);
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* Hot keys have their values mirrored by the server in session shared memory,
+ * letting NtQueryValueKey answer without a server call. The locator of each
+ * key is cached by handle, and is forgotten when the handle is closed. */
+
+#define KEY_SHM_CACHE_SIZE 256
+
+struct key_shm_cache_entry
+{
+    LONG64 key;     /* handle << 32 | offset, 0 if unused */
+    LONG64 id;      /* id of the shared object */
+};
+
+static struct key_shm_cache_entry key_shm_cache[KEY_SHM_CACHE_SIZE];
+static LONG key_shm_close_serial;  /* incremented whenever a handle is closed */
+
+static struct key_shm_cache_entry *key_shm_cache_entry( HANDLE handle )
+{
+    return &key_shm_cache[(wine_server_obj_handle( handle ) >> 2) % KEY_SHM_CACHE_SIZE];
+}
+
+/* cache the locator returned by get_key_value; serial is the close serial from before the call */
+static void key_shm_cache_set( HANDLE handle, struct obj_locator locator, LONG serial )
+{
+    struct key_shm_cache_entry *entry = key_shm_cache_entry( handle );
+    LONG64 key = ((LONG64)wine_server_obj_handle( handle ) << 32) | locator.offset;
+    sigset_t sigset;
+
+    if (!locator.id || locator.offset >> 32) return;
+    if (ReadAcquire64( &entry->key ) == key && ReadAcquire64( &entry->id ) == locator.id) return;
+
+    /* fd_cache_mutex is held while closing handles; if any was closed meanwhile,
+     * the handle might now refer to another key */
+    server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
+    if (ReadAcquire( &key_shm_close_serial ) == serial)
+    {
+        WriteRelease64( &entry->key, 0 );
+        WriteRelease64( &entry->id, locator.id );
+        WriteRelease64( &entry->key, key );
+    }
+    server_leave_uninterrupted_section( &fd_cache_mutex, &sigset );
+}
+
+/***********************************************************************
+ *           key_forget_handle
+ *
+ * Called with fd_cache_mutex held when a handle is closed.
+ */
+void key_forget_handle( HANDLE handle )
+{
+    struct key_shm_cache_entry *entry = key_shm_cache_entry( handle );
+    LONG64 key = ReadAcquire64( &entry->key );
+
+    InterlockedIncrement( &key_shm_close_serial );
+    if ((ULONG64)key >> 32 == wine_server_obj_handle( handle ))
+        InterlockedCompareExchange64( &entry->key, 0, key );
+}
+
+/* look up a value in the shared memory mirror of a key; returns FALSE if the server must be asked */
+static BOOL query_key_shm( HANDLE handle, const UNICODE_STRING *name, void *data, DWORD data_len,
+                           int *type, DWORD *total, unsigned int *status )
+{
+    struct key_shm_cache_entry *entry = key_shm_cache_entry( handle );
+    const shared_object_t *object;
+    struct key_shm_value value;
+    data_size_t capacity, size, pos;
+    unsigned int i, count;
+    LONG64 key, id;
+    UINT64 seq;
+
+    key = ReadAcquire64( &entry->key );
+    if (!key || (ULONG64)key >> 32 != wine_server_obj_handle( handle )) return FALSE;
+    id = ReadAcquire64( &entry->id );
+    if (ReadAcquire64( &entry->key ) != key) return FALSE;
+
+    if (!(object = find_session_object( (ULONG)key, sizeof(*object) ))) return FALSE;
+    if (object->id != id) return FALSE;
+    capacity = object->shm.key.capacity;
+    __SHARED_READ_FENCE;
+    if (object->id != id || capacity > KEY_SHM_MAX_SIZE) return FALSE;
+    if (!(object = find_session_object( (ULONG)key, offsetof( shared_object_t, shm.key.values[capacity] ))))
+        return FALSE;
+
+    do
+    {
+        while ((seq = ReadNoFence64( &object->seq )) & 1) YieldProcessor();
+        __SHARED_READ_FENCE;
+        if (object->id != id || object->shm.key.capacity != capacity) return FALSE;
+
+        *status = STATUS_OBJECT_NAME_NOT_FOUND;
+        *type = REG_NONE;
+        *total = 0;
+        size = min( object->shm.key.size, capacity );
+        count = object->shm.key.count;
+        for (i = pos = 0; i < count && pos + sizeof(value) <= size; i++)
+        {
+            const char *ptr = (const char *)object->shm.key.values + pos;
+
+            memcpy( &value, ptr, sizeof(value) );
+            ptr += sizeof(value);
+            if (value.namelen > size - pos - sizeof(value) ||
+                value.len > size - pos - sizeof(value) - value.namelen) break;  /* torn read */
+            if (value.namelen == name->Length &&
+                !wcsnicmp( (const WCHAR *)ptr, name->Buffer, name->Length / sizeof(WCHAR) ))
+            {
+                *status = STATUS_SUCCESS;
+                *type = value.type;
+                *total = value.len;
+                if (data_len) memcpy( data, ptr + value.namelen, min( value.len, data_len ));
+                break;
+            }
+            pos += (sizeof(value) + value.namelen + value.len + 3) & ~3;
+        }
+        __SHARED_READ_FENCE;
+    } while (ReadNoFence64( &object->seq ) != seq);
+
+    return TRUE;
+}
+
 
 NTSTATUS open_hkcu_key( const char *path, HANDLE *key )
 {
@@ -493,6 +611,8 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
     unsigned int ret;
     UCHAR *data_ptr;
     unsigned int fixed_size, min_size;
+    DWORD data_len, total;
+    int type;
 
     TRACE( "(%p,%s,%d,%p,%d)\n", handle, debugstr_us(name), info_class, info, length );
 
@@ -538,21 +658,35 @@ NTSTATUS WINAPI NtQueryValueKey( HANDLE handle, const UNICODE_STRING *name,
         return STATUS_INVALID_PARAMETER;
     }
 
-    SERVER_START_REQ( get_key_value )
+    data_len = (length > fixed_size && data_ptr) ? length - fixed_size : 0;
+
+    if (!query_key_shm( handle, name, data_ptr, data_len, &type, &total, &ret ))
     {
-        req->hkey = wine_server_obj_handle( handle );
-        wine_server_add_data( req, name->Buffer, name->Length );
-        if (length > fixed_size && data_ptr) wine_server_set_reply( req, data_ptr, length - fixed_size );
-        if (!(ret = wine_server_call( req )))
+        LONG serial = ReadAcquire( &key_shm_close_serial );
+        struct obj_locator locator = {0};
+
+        SERVER_START_REQ( get_key_value )
         {
-            copy_key_value_info( info_class, info, length, reply->type,
-                                 name->Length, reply->total );
-            *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : reply->total);
-            if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
-            else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
+            req->hkey = wine_server_obj_handle( handle );
+            wine_server_add_data( req, name->Buffer, name->Length );
+            if (data_len) wine_server_set_reply( req, data_ptr, data_len );
+            ret = wine_server_call( req );
+            type = reply->type;
+            total = reply->total;
+            locator = reply->locator;
         }
+        SERVER_END_REQ;
+
+        key_shm_cache_set( handle, locator, serial );
+    }
+
+    if (!ret)
+    {
+        copy_key_value_info( info_class, info, length, type, name->Length, total );
+        *result_len = fixed_size + (info_class == KeyValueBasicInformation ? 0 : total);
+        if (length < min_size) ret = STATUS_BUFFER_TOO_SMALL;
+        else if (length < *result_len) ret = STATUS_BUFFER_OVERFLOW;
     }
-    SERVER_END_REQ;
     return ret;
 }
 
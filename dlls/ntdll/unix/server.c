@@ -1142,6 +1142,7 @@ static int remove_fd_from_cache( HANDLE handle )
         union fd_cache_entry cache;
         cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, 0 );
         if (cache.s.type != FD_TYPE_INVALID) fd = cache.s.fd - 1;
+        if (cache.s.type == FD_TYPE_SOCKET) sock_forget_handle( handle );
     }
 
     return fd;
@@ -1272,6 +1273,82 @@ NTSTATUS unixcall_wine_server_handle_to_fd( void *args )
 }
 
 
+#define SESSION_MAX_VIEWS 32
+
+struct session_view
+{
+    const char *data;
+    SIZE_T      offset;
+    SIZE_T      size;
+};
+
+static struct session_view session_views[SESSION_MAX_VIEWS];
+static LONG session_view_count;
+static pthread_mutex_t session_views_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/***********************************************************************
+ *           find_session_object
+ *
+ * Map the part of the session shared memory holding an object of the given size.
+ */
+const shared_object_t *find_session_object( mem_size_t offset, SIZE_T object_size )
+{
+    static const WCHAR nameW[] =
+    {
+        '\\','K','e','r','n','e','l','O','b','j','e','c','t','s','\\',
+        '_','_','w','i','n','e','_','s','e','s','s','i','o','n',0
+    };
+    UNICODE_STRING name = RTL_CONSTANT_STRING( nameW );
+    LARGE_INTEGER off = {.QuadPart = offset & ~0xffff};
+    const shared_object_t *object = NULL;
+    struct session_view *view;
+    OBJECT_ATTRIBUTES attr;
+    unsigned int status;
+    LONG i, count;
+    HANDLE section;
+    void *data = NULL;
+    SIZE_T size = 0;
+
+    count = ReadAcquire( &session_view_count );
+    for (i = 0; i < count; i++)
+    {
+        view = &session_views[i];
+        if (view->offset <= offset && offset + object_size <= view->offset + view->size)
+            return (const shared_object_t *)(view->data + offset - view->offset);
+    }
+
+    /* the session mapping grows, map the part that holds the object */
+    pthread_mutex_lock( &session_views_mutex );
+    if (session_view_count < SESSION_MAX_VIEWS)
+    {
+        InitializeObjectAttributes( &attr, &name, 0, NULL, NULL );
+        if ((status = NtOpenSection( &section, SECTION_MAP_READ, &attr )))
+            WARN( "failed to open the session section, status %#x\n", status );
+        else
+        {
+            if ((status = NtMapViewOfSection( section, GetCurrentProcess(), &data, 0, 0, &off,
+                                              &size, ViewUnmap, 0, PAGE_READONLY )))
+                WARN( "failed to map the session section, status %#x\n", status );
+            else if (offset + object_size > off.QuadPart + size)
+                NtUnmapViewOfSection( GetCurrentProcess(), data );
+            else
+            {
+                view = &session_views[session_view_count];
+                view->data = data;
+                view->offset = off.QuadPart;
+                view->size = size;
+                WriteRelease( &session_view_count, session_view_count + 1 );
+                object = (const shared_object_t *)(view->data + offset - view->offset);
+            }
+            NtClose( section );
+        }
+    }
+    pthread_mutex_unlock( &session_views_mutex );
+
+    return object;
+}
+
+
 /***********************************************************************
  *           server_pipe
  *
@@ -1698,6 +1775,7 @@ size_t server_init_process(void)
             {
                 inproc_device_fd = wine_server_receive_fd( &handle );
                 assert( handle == reply->inproc_device );
+                if (init_inproc_sync()) fatal_perror( "failed to map the in-process sync arena" );
             }
         }
     }
@@ -1886,6 +1964,7 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source, HANDLE
     {
         fd = remove_fd_from_cache( source );
         close_inproc_sync( source );
+        key_forget_handle( source );
     }
 
     SERVER_START_REQ( dup_handle )
@@ -1960,6 +2039,7 @@ NTSTATUS WINAPI NtClose( HANDLE handle )
      * retrieve it again */
     fd = remove_fd_from_cache( handle );
     close_inproc_sync( handle );
+    key_forget_handle( handle );
 
     SERVER_START_REQ( close_handle )
     {
@@ -157,6 +157,80 @@ struct async_transmit_ioctl
     LARGE_INTEGER offset;
 };
 
+/* Sockets publish SOCKET_SHM_* flags in session shared memory, telling us
+ * when a recv / send may be tried before making a server call. The locator
+ * of each socket is cached by handle; the cache is keyed by the handle value
+ * and is cleared when the handle is closed. */
+
+#define SOCK_SHM_CACHE_SIZE 1024
+
+struct sock_shm_cache_entry
+{
+    LONG64 key;     /* handle << 32 | offset, 0 if unused */
+    LONG64 id;      /* id of the shared object */
+};
+
+static struct sock_shm_cache_entry sock_shm_cache[SOCK_SHM_CACHE_SIZE];
+
+static struct sock_shm_cache_entry *sock_shm_cache_entry( HANDLE handle )
+{
+    return &sock_shm_cache[(wine_server_obj_handle( handle ) >> 2) % SOCK_SHM_CACHE_SIZE];
+}
+
+static void sock_shm_cache_set( HANDLE handle, struct obj_locator locator )
+{
+    struct sock_shm_cache_entry *entry = sock_shm_cache_entry( handle );
+
+    /* the offset has to fit in the low half of the key */
+    if (!locator.id || locator.offset >> 32) return;
+
+    WriteRelease64( &entry->key, 0 );
+    WriteRelease64( &entry->id, locator.id );
+    WriteRelease64( &entry->key, ((LONG64)wine_server_obj_handle( handle ) << 32) | locator.offset );
+}
+
+/***********************************************************************
+ *           sock_forget_handle
+ *
+ * Called when a handle is closed.
+ */
+void sock_forget_handle( HANDLE handle )
+{
+    struct sock_shm_cache_entry *entry = sock_shm_cache_entry( handle );
+    LONG64 key = ReadAcquire64( &entry->key );
+
+    if ((ULONG64)key >> 32 == wine_server_obj_handle( handle ))
+        InterlockedCompareExchange64( &entry->key, 0, key );
+}
+
+/* returns whether the SOCKET_SHM_* flag is set for the socket */
+static BOOL sock_shm_check( HANDLE handle, unsigned int flag )
+{
+    struct sock_shm_cache_entry *entry = sock_shm_cache_entry( handle );
+    const shared_object_t *object;
+    unsigned int flags;
+    LONG64 key, id;
+    UINT64 seq;
+
+    key = ReadAcquire64( &entry->key );
+    if (!key || (ULONG64)key >> 32 != wine_server_obj_handle( handle )) return FALSE;
+    id = ReadAcquire64( &entry->id );
+    if (ReadAcquire64( &entry->key ) != key) return FALSE;
+
+    if (!(object = find_session_object( (ULONG)key, sizeof(*object) ))) return FALSE;
+
+    do
+    {
+        while ((seq = ReadNoFence64( &object->seq )) & 1) YieldProcessor();
+        __SHARED_READ_FENCE;
+        if (object->id != id) return FALSE;
+        flags = object->shm.socket.flags;
+        __SHARED_READ_FENCE;
+    } while (ReadNoFence64( &object->seq ) != seq);
+
+    return !!(flags & flag);
+}
+
 static NTSTATUS sock_errno_to_status( int err )
 {
     switch (err)
@@ -916,8 +990,9 @@ static BOOL is_icmp_over_dgram( int fd )
 }
 
 static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
-                           int fd, struct async_recv_ioctl *async, int force_async )
+                           int fd, struct async_recv_ioctl *async, int force_async, unsigned int fd_options )
 {
+    struct obj_locator locator;
     HANDLE wait_handle;
     BOOL nonblocking;
     unsigned int i, status;
@@ -932,6 +1007,23 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         }
     }
 
+    /* If the server says nothing else is reading from the socket, try to
+     * complete synchronously without asking it first; it only needs to know
+     * about the request if we have to wait. */
+    if (!force_async && !apc && !(async->unix_flags & MSG_OOB) && sock_shm_check( handle, SOCKET_SHM_TRY_RECV ))
+    {
+        ULONG_PTR information;
+
+        status = try_recv( fd, async, &information );
+        if (status != STATUS_DEVICE_NOT_READY)
+        {
+            if (!NT_ERROR(status))
+                file_complete_async( handle, fd_options, event, NULL, apc_user, io, status, information );
+            release_fileio( &async->io );
+            return status;
+        }
+    }
+
     SERVER_START_REQ( recv_socket )
     {
         req->force_async = force_async;
@@ -941,9 +1033,12 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        locator     = reply->locator;
     }
     SERVER_END_REQ;
 
+    sock_shm_cache_set( handle, locator );
+
     /* the server currently will never succeed immediately */
     assert(status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
 
@@ -966,7 +1061,7 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
 
 
 static NTSTATUS sock_ioctl_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
-                                 int fd, const void *buffers_ptr, unsigned int count, WSABUF *control,
+                                 int fd, unsigned int options, const void *buffers_ptr, unsigned int count, WSABUF *control,
                                  struct WS_sockaddr *addr, int *addr_len, unsigned int *ret_flags, int unix_flags, int force_async )
 {
     struct async_recv_ioctl *async;
@@ -1014,7 +1109,7 @@ static NTSTATUS sock_ioctl_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE ap
     async->ret_flags = ret_flags;
     async->icmp_over_dgram = is_icmp_over_dgram( fd );
 
-    return sock_recv( handle, event, apc, apc_user, io, fd, async, force_async );
+    return sock_recv( handle, event, apc, apc_user, io, fd, async, force_async, options );
 }
 
 
@@ -1037,7 +1132,7 @@ NTSTATUS sock_read( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc,
     async->ret_flags = NULL;
     async->icmp_over_dgram = is_icmp_over_dgram( fd );
 
-    return sock_recv( handle, event, apc, apc_user, io, fd, async, 1 );
+    return sock_recv( handle, event, apc, apc_user, io, fd, async, 1, 0 );
 }
 
 
@@ -1183,13 +1278,31 @@ static void sock_save_icmp_id( struct async_send_ioctl *async )
 }
 
 static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
-                           IO_STATUS_BLOCK *io, int fd, struct async_send_ioctl *async, unsigned int server_flags )
+                           IO_STATUS_BLOCK *io, int fd, struct async_send_ioctl *async, unsigned int server_flags,
+                           unsigned int fd_options )
 {
+    struct obj_locator locator;
     HANDLE wait_handle;
     BOOL nonblocking;
     unsigned int status;
     ULONG options;
 
+    /* As in sock_recv(), try to complete synchronously first. A short write
+     * goes through the server, which queues the rest of the data. */
+    if (!(server_flags & SERVER_SOCKET_IO_FORCE_ASYNC) && !apc && sock_shm_check( handle, SOCKET_SHM_TRY_SEND )
+        && !is_icmp_over_dgram( fd ))
+    {
+        status = try_send( fd, async );
+        if (status != STATUS_DEVICE_NOT_READY)
+        {
+            if (!NT_ERROR(status))
+                file_complete_async( handle, fd_options, event, NULL, apc_user, io, status, async->sent_len );
+            if (async->fd != -1) close( async->fd );
+            release_fileio( &async->io );
+            return status;
+        }
+    }
+
     SERVER_START_REQ( send_socket )
     {
         req->flags = server_flags;
@@ -1198,9 +1311,12 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        locator     = reply->locator;
     }
     SERVER_END_REQ;
 
+    sock_shm_cache_set( handle, locator );
+
     /* the server currently will never succeed immediately */
     assert(status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
 
@@ -1265,7 +1381,7 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
                 rem_io->Pointer = p;
                 p += sizeof(IO_STATUS_BLOCK32);
                 status = sock_send( handle, NULL, NULL, NULL, rem_io, fd, rem_async,
-                                    SERVER_SOCKET_IO_FORCE_ASYNC | SERVER_SOCKET_IO_SYSTEM );
+                                    SERVER_SOCKET_IO_FORCE_ASYNC | SERVER_SOCKET_IO_SYSTEM, options );
                 if (status == STATUS_PENDING) status = STATUS_SUCCESS;
                 if (!status)
                 {
@@ -1290,7 +1406,7 @@ static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
 }
 
 static NTSTATUS sock_ioctl_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
-                                 IO_STATUS_BLOCK *io, int fd, const void *buffers_ptr, unsigned int count,
+                                 IO_STATUS_BLOCK *io, int fd, unsigned int options, const void *buffers_ptr, unsigned int count,
                                  const struct WS_sockaddr *addr, unsigned int addr_len, int unix_flags, int force_async )
 {
     struct async_send_ioctl *async;
@@ -1330,7 +1446,7 @@ static NTSTATUS sock_ioctl_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE ap
     async->iov_cursor = 0;
     async->sent_len = 0;
 
-    return sock_send( handle, event, apc, apc_user, io, fd, async, force_async ? SERVER_SOCKET_IO_FORCE_ASYNC : 0 );
+    return sock_send( handle, event, apc, apc_user, io, fd, async, force_async ? SERVER_SOCKET_IO_FORCE_ASYNC : 0, options );
 }
 
 
@@ -1353,7 +1469,7 @@ NTSTATUS sock_write( HANDLE handle, int fd, HANDLE event, PIO_APC_ROUTINE apc,
     async->iov_cursor = 0;
     async->sent_len = 0;
 
-    return sock_send( handle, event, apc, apc_user, io, fd, async, SERVER_SOCKET_IO_FORCE_ASYNC );
+    return sock_send( handle, event, apc, apc_user, io, fd, async, SERVER_SOCKET_IO_FORCE_ASYNC, 0 );
 }
 
 
@@ -1703,7 +1819,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
             struct afd_recv_params params;
             int unix_flags = 0;
 
-            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL )))
+            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, &options )))
                 return status;
 
             if (out_size) FIXME( "unexpected output size %u\n", out_size );
@@ -1752,7 +1868,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
                 unix_flags |= MSG_PEEK;
             if (params.msg_flags & AFD_MSG_WAITALL)
                 FIXME( "MSG_WAITALL is not supported\n" );
-            status = sock_ioctl_recv( handle, event, apc, apc_user, io, fd, params.buffers, params.count, NULL,
+            status = sock_ioctl_recv( handle, event, apc, apc_user, io, fd, options, params.buffers, params.count, NULL,
                                       NULL, NULL, NULL, unix_flags, !!(params.recv_flags & AFD_RECV_FORCE_ASYNC) );
             if (needs_close) close( fd );
             return status;
@@ -1764,7 +1880,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
             unsigned int *ws_flags = u64_to_user_ptr(params->ws_flags_ptr);
             int unix_flags = 0;
 
-            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL )))
+            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, &options )))
                 return status;
 
             if (in_size < sizeof(*params))
@@ -1779,7 +1895,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
                 unix_flags |= MSG_PEEK;
             if (*ws_flags & WS_MSG_WAITALL)
                 FIXME( "MSG_WAITALL is not supported\n" );
-            status = sock_ioctl_recv( handle, event, apc, apc_user, io, fd, u64_to_user_ptr(params->buffers_ptr),
+            status = sock_ioctl_recv( handle, event, apc, apc_user, io, fd, options, u64_to_user_ptr(params->buffers_ptr),
                                       params->count, u64_to_user_ptr(params->control_ptr),
                                       u64_to_user_ptr(params->addr_ptr), u64_to_user_ptr(params->addr_len_ptr),
                                       ws_flags, unix_flags, params->force_async );
@@ -1792,7 +1908,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
             const struct afd_sendmsg_params *params = in_buffer;
             int unix_flags = 0;
 
-            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL )))
+            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, &options )))
                 return status;
 
             if (in_size < sizeof(*params))
@@ -1807,7 +1923,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
                 WARN( "ignoring MSG_PARTIAL\n" );
             if (params->ws_flags & ~(WS_MSG_OOB | WS_MSG_PARTIAL))
                 FIXME( "unknown flags %#x\n", params->ws_flags );
-            status = sock_ioctl_send( handle, event, apc, apc_user, io, fd, u64_to_user_ptr( params->buffers_ptr ),
+            status = sock_ioctl_send( handle, event, apc, apc_user, io, fd, options, u64_to_user_ptr( params->buffers_ptr ),
                                       params->count, u64_to_user_ptr( params->addr_ptr ), params->addr_len,
                                       unix_flags, params->force_async );
             if (needs_close) close( fd );
@@ -36,6 +36,7 @@
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef HAVE_SYS_SYSCALL_H
 #include <sys/syscall.h>
 #endif
@@ -499,6 +500,431 @@ static NTSTATUS linux_wait_objs( int device, DWORD count, const int *objs, WAIT_
 
 #endif /* NTSYNC_IOC_EVENT_READ */
 
+/* When /dev/ntsync is not available, the server keeps in-process objects in a
+ * shared memory arena instead, which it sends to us in place of the device fd.
+ * Objects are modified with atomic operations, and waiters sleep on the futex
+ * word of each object, which is bumped whenever its state changes in a way that
+ * may satisfy a wait. Waiting for all objects locks them in index order, with
+ * signals blocked, and only acquires them if all of them are signaled; everybody
+ * else waits for the lock to be dropped before changing a locked object, so the
+ * objects are acquired atomically like with ntsync. PulseEvent only wakes the
+ * waiters that get to run before the event is reset again. */
+
+static inproc_futex_t *inproc_futex_arena;
+
+#if defined(__linux__) && defined(__NR_futex_waitv) && defined(FUTEX_32)
+
+struct futex_timespec64
+{
+    long long tv_sec;
+    long long tv_nsec;
+};
+
+static void futex_wake_obj( inproc_futex_t *obj )
+{
+    InterlockedIncrement( (LONG *)&obj->futex );
+    if (ReadAcquire( (LONG *)&obj->waiters ))
+        syscall( __NR_futex, &obj->futex, FUTEX_WAKE, INT_MAX, NULL, 0, 0 );
+}
+
+/* read the state of an object, waiting until no thread has it locked */
+static LONG64 futex_read_state( inproc_futex_t *obj )
+{
+    unsigned int spins = 0;
+    LONG64 state;
+
+    while ((state = ReadAcquire64( &obj->state )) & INPROC_FUTEX_LOCKED)
+    {
+        if (++spins < 64) YieldProcessor();
+        else NtYieldExecution();
+    }
+    return state;
+}
+
+static LONG64 futex_exchange_state( inproc_futex_t *obj, LONG64 value )
+{
+    LONG64 state;
+    do state = futex_read_state( obj );
+    while (InterlockedCompareExchange64( &obj->state, value, state ) != state);
+    return state;
+}
+
+/* computes the state of an object once acquired; returns 0 if it is not signaled, 1 if it
+ * can be acquired, 2 if it is an abandoned mutex, -1 if the mutex count would overflow */
+static int futex_grab_state( inproc_futex_t *obj, LONG64 state, LONG64 *new_state )
+{
+    const LONG64 one = (LONG64)1 << INPROC_FUTEX_MUTEX_COUNT_SHIFT;
+    DWORD tid = GetCurrentThreadId();
+
+    switch (obj->type)
+    {
+    case INPROC_SYNC_INTERNAL:
+    case INPROC_SYNC_EVENT:
+        if (!state) return 0;
+        *new_state = obj->manual ? state : 0;
+        return 1;
+    case INPROC_SYNC_SEMAPHORE:
+        if (!state) return 0;
+        *new_state = state - 1;
+        return 1;
+    case INPROC_SYNC_MUTEX:
+        if (state & INPROC_FUTEX_MUTEX_ABANDONED)
+        {
+            *new_state = tid | one;
+            return 2;
+        }
+        if (!(DWORD)state) *new_state = tid | one;
+        else if ((DWORD)state != tid) return 0;
+        else if ((state >> INPROC_FUTEX_MUTEX_COUNT_SHIFT) == INPROC_FUTEX_MUTEX_MAX_COUNT) return -1;
+        else *new_state = state + one;
+        return 1;
+    }
+    return 0;
+}
+
+static int futex_acquire_obj( inproc_futex_t *obj )
+{
+    LONG64 state, new_state;
+    int ret;
+
+    do
+    {
+        state = futex_read_state( obj );
+        if ((ret = futex_grab_state( obj, state, &new_state )) <= 0 || new_state == state) return ret;
+    }
+    while (InterlockedCompareExchange64( &obj->state, new_state, state ) != state);
+
+    return ret;
+}
+
+/* lock an object for futex_acquire_all_objs(), returning its state */
+static LONG64 futex_lock_obj( inproc_futex_t *obj )
+{
+    LONG64 state;
+
+    do state = futex_read_state( obj );
+    while (InterlockedCompareExchange64( &obj->state, state | INPROC_FUTEX_LOCKED, state ) != state);
+
+    obj->locker = GetCurrentThreadId();
+    return state;
+}
+
+/* acquire all the objects if all of them are signaled, or none of them */
+static NTSTATUS futex_acquire_all_objs( DWORD count, inproc_futex_t **slots, const int *objs, const unsigned int *ids )
+{
+    LONG64 state[MAXIMUM_WAIT_OBJECTS], new_state[MAXIMUM_WAIT_OBJECTS];
+    DWORD order[MAXIMUM_WAIT_OBJECTS], i, j;
+    NTSTATUS ret = STATUS_SUCCESS;
+    sigset_t sigset;
+    int acquired;
+
+    /* lock the objects in index order, so that concurrent waits can't deadlock */
+    for (i = 0; i < count; i++)
+    {
+        for (j = i; j && objs[order[j - 1]] > objs[i]; j--) order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    /* don't let a suspend request stop us while we hold the locks */
+    pthread_sigmask( SIG_BLOCK, &server_block_set, &sigset );
+
+    for (i = 0; i < count; i++) state[order[i]] = futex_lock_obj( slots[order[i]] );
+
+    for (i = 0; i < count; i++)
+    {
+        /* a closed object whose slot got reused never becomes signaled */
+        if (slots[i]->id != ids[i] || !(acquired = futex_grab_state( slots[i], state[i], &new_state[i] )))
+        {
+            ret = STATUS_PENDING;
+            break;
+        }
+        if (acquired < 0)
+        {
+            ret = STATUS_MUTANT_LIMIT_EXCEEDED;
+            break;
+        }
+        if (acquired == 2) ret = STATUS_ABANDONED;
+    }
+
+    /* the objects are either unchanged or acquired, nobody needs to be woken up */
+    for (i = 0; i < count; i++)
+    {
+        if (ret == STATUS_SUCCESS || ret == STATUS_ABANDONED) WriteRelease64( &slots[i]->state, new_state[i] );
+        else WriteRelease64( &slots[i]->state, state[i] );
+    }
+
+    pthread_sigmask( SIG_SETMASK, &sigset, NULL );
+    return ret;
+}
+
+static NTSTATUS futex_release_semaphore_obj( unsigned int index, ULONG count, ULONG *prev_count )
+{
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    LONG64 state;
+
+    do
+    {
+        state = futex_read_state( obj );
+        if (count > obj->max - state) return STATUS_SEMAPHORE_LIMIT_EXCEEDED;
+    }
+    while (InterlockedCompareExchange64( &obj->state, state + count, state ) != state);
+
+    futex_wake_obj( obj );
+    if (prev_count) *prev_count = state;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_query_semaphore_obj( unsigned int index, SEMAPHORE_BASIC_INFORMATION *info )
+{
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    info->CurrentCount = ReadNoFence64( &obj->state ) & ~INPROC_FUTEX_LOCKED;
+    info->MaximumCount = obj->max;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_set_event_obj( unsigned int index, LONG *prev_state )
+{
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    LONG64 prev = futex_exchange_state( obj, 1 );
+    if (!prev) futex_wake_obj( obj );
+    if (prev_state) *prev_state = prev;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_reset_event_obj( unsigned int index, LONG *prev_state )
+{
+    LONG64 prev = futex_exchange_state( &inproc_futex_arena[index], 0 );
+    if (prev_state) *prev_state = prev;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_pulse_event_obj( unsigned int index, LONG *prev_state )
+{
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    LONG64 prev = futex_exchange_state( obj, 1 );
+    futex_wake_obj( obj );
+    futex_exchange_state( obj, 0 );
+    if (prev_state) *prev_state = prev;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_query_event_obj( unsigned int index, EVENT_BASIC_INFORMATION *info )
+{
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    info->EventType = obj->manual ? NotificationEvent : SynchronizationEvent;
+    info->EventState = ReadNoFence64( &obj->state ) & ~INPROC_FUTEX_LOCKED;
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_release_mutex_obj( unsigned int index, LONG *prev_count )
+{
+    const LONG64 one = (LONG64)1 << INPROC_FUTEX_MUTEX_COUNT_SHIFT;
+    inproc_futex_t *obj = &inproc_futex_arena[index];
+    LONG64 state, new_state;
+
+    do
+    {
+        state = futex_read_state( obj );
+        if ((state & INPROC_FUTEX_MUTEX_ABANDONED) || (DWORD)state != GetCurrentThreadId())
+            return STATUS_MUTANT_NOT_OWNED;
+        new_state = state - one;
+        if (!(new_state >> INPROC_FUTEX_MUTEX_COUNT_SHIFT)) new_state = 0;
+    }
+    while (InterlockedCompareExchange64( &obj->state, new_state, state ) != state);
+
+    if (!new_state) futex_wake_obj( obj );
+    if (prev_count) *prev_count = 1 - (LONG)(state >> INPROC_FUTEX_MUTEX_COUNT_SHIFT);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_query_mutex_obj( unsigned int index, MUTANT_BASIC_INFORMATION *info )
+{
+    LONG64 state = ReadNoFence64( &inproc_futex_arena[index].state ) & ~INPROC_FUTEX_LOCKED;
+
+    if (state & INPROC_FUTEX_MUTEX_ABANDONED)
+    {
+        info->AbandonedState = TRUE;
+        info->OwnedByCaller = FALSE;
+        info->CurrentCount = 1;
+        return STATUS_SUCCESS;
+    }
+    info->AbandonedState = FALSE;
+    info->OwnedByCaller = ((DWORD)state == GetCurrentThreadId());
+    info->CurrentCount = 1 - (LONG)(state >> INPROC_FUTEX_MUTEX_COUNT_SHIFT);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS futex_wait_objs( DWORD count, const int *objs, const unsigned int *ids, WAIT_TYPE type,
+                                 unsigned int alert, const LARGE_INTEGER *timeout )
+{
+    struct futex_waitv waitv[MAXIMUM_WAIT_OBJECTS + 1];
+    inproc_futex_t *slots[MAXIMUM_WAIT_OBJECTS + 1];
+    struct futex_timespec64 end, *end_ptr = NULL;
+    clockid_t clock = CLOCK_MONOTONIC;
+    DWORD i, j, total = count;
+    NTSTATUS ret;
+    int acquired;
+
+    assert( count <= MAXIMUM_WAIT_OBJECTS );
+
+    if (type == WaitAll && count > 1)
+    {
+        for (i = 1; i < count; i++)
+            for (j = 0; j < i; j++)
+                if (objs[i] == objs[j]) return STATUS_INVALID_PARAMETER;
+    }
+
+    if (timeout && timeout->QuadPart != TIMEOUT_INFINITE)
+    {
+        LONGLONG ticks;
+
+        if (timeout->QuadPart <= 0)
+        {
+            struct timespec now;
+            clock_gettime( CLOCK_MONOTONIC, &now );
+            end.tv_sec = now.tv_sec - timeout->QuadPart / TICKSPERSEC;
+            end.tv_nsec = now.tv_nsec - (timeout->QuadPart % TICKSPERSEC) * 100;
+        }
+        else
+        {
+            ticks = timeout->QuadPart - (LONGLONG)SECS_1601_TO_1970 * TICKSPERSEC;
+            if (ticks < 0) ticks = 0;
+            end.tv_sec = ticks / TICKSPERSEC;
+            end.tv_nsec = (ticks % TICKSPERSEC) * 100;
+            clock = CLOCK_REALTIME;
+        }
+        if (end.tv_nsec >= NSECPERSEC)
+        {
+            end.tv_sec++;
+            end.tv_nsec -= NSECPERSEC;
+        }
+        end_ptr = &end;
+    }
+
+    if (alert) total++;
+    for (i = 0; i < total; i++)
+    {
+        slots[i] = &inproc_futex_arena[i < count ? objs[i] : alert];
+        InterlockedIncrement( (LONG *)&slots[i]->waiters );
+        waitv[i].uaddr = (ULONG_PTR)&slots[i]->futex;
+        waitv[i].flags = FUTEX_32;
+        waitv[i].__reserved = 0;
+    }
+
+    for (;;)
+    {
+        /* read the sequence numbers first, so that we don't miss a wake up
+         * between checking the objects and going to sleep */
+        for (i = 0; i < total; i++) waitv[i].val = (unsigned int)ReadAcquire( (LONG *)&slots[i]->futex );
+
+        ret = STATUS_PENDING;
+        if (type == WaitAll && count > 1) ret = futex_acquire_all_objs( count, slots, objs, ids );
+        else
+        {
+            for (i = 0; i < count; i++)
+            {
+                if (slots[i]->id != ids[i] || !(acquired = futex_acquire_obj( slots[i] ))) continue;
+                if (acquired < 0) ret = STATUS_MUTANT_LIMIT_EXCEEDED;
+                else ret = (acquired == 2 ? STATUS_ABANDONED : STATUS_WAIT_0) + i;
+                break;
+            }
+        }
+        if (ret == STATUS_PENDING && alert && (ReadNoFence64( &slots[count]->state ) & ~INPROC_FUTEX_LOCKED))
+            ret = STATUS_USER_APC;
+        if (ret != STATUS_PENDING) break;
+
+        if (timeout && !timeout->QuadPart)
+        {
+            ret = STATUS_TIMEOUT;
+            break;
+        }
+        if (syscall( __NR_futex_waitv, waitv, total, 0, end_ptr, clock ) >= 0) continue;
+        if (errno == EAGAIN || errno == EINTR) continue;
+        ret = errno == ETIMEDOUT ? STATUS_TIMEOUT : errno_to_status( errno );
+        break;
+    }
+
+    for (i = 0; i < total; i++) InterlockedDecrement( (LONG *)&slots[i]->waiters );
+
+    if (ret == STATUS_USER_APC)
+    {
+        static const LARGE_INTEGER zero;
+
+        ret = server_wait( NULL, 0, SELECT_INTERRUPTIBLE | SELECT_ALERTABLE, &zero );
+        assert( ret == STATUS_USER_APC );
+    }
+    return ret;
+}
+
+/* map the futex arena, if the server sent one instead of the ntsync device */
+int init_inproc_sync(void)
+{
+    struct stat st;
+    void *ptr;
+
+    if (inproc_device_fd < 0 || fstat( inproc_device_fd, &st ) || !S_ISREG( st.st_mode )) return 0;
+    if ((ptr = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, inproc_device_fd, 0 )) == MAP_FAILED)
+        return -1;
+    inproc_futex_arena = ptr;
+    TRACE( "using futex in-process synchronization\n" );
+    return 0;
+}
+
+#else /* __NR_futex_waitv */
+
+static NTSTATUS futex_release_semaphore_obj( unsigned int index, ULONG count, ULONG *prev_count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_query_semaphore_obj( unsigned int index, SEMAPHORE_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_set_event_obj( unsigned int index, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_reset_event_obj( unsigned int index, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_pulse_event_obj( unsigned int index, LONG *prev_state )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_query_event_obj( unsigned int index, EVENT_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_release_mutex_obj( unsigned int index, LONG *prev_count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_query_mutex_obj( unsigned int index, MUTANT_BASIC_INFORMATION *info )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS futex_wait_objs( DWORD count, const int *objs, const unsigned int *ids, WAIT_TYPE type,
+                                 unsigned int alert, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+int init_inproc_sync(void)
+{
+    return 0;
+}
+
+#endif /* __NR_futex_waitv */
+
 /* It's possible for synchronization primitives to remain alive even after being
  * closed, because a thread is still waiting on them. It's rare in practice, and
  * documented as being undefined behaviour by Microsoft, but it works, and some
@@ -536,7 +962,9 @@ static NTSTATUS linux_wait_objs( int device, DWORD count, const int *objs, WAIT_
 struct inproc_sync
 {
     LONG           refcount;  /* reference count of the sync object */
-    int            fd;        /* unix file descriptor */
+    int            fd;        /* unix file descriptor, or -1 for futex objects */
+    unsigned int   index;     /* slot in the futex arena, or 0 */
+    unsigned int   id;        /* id of the futex arena slot when it was cached */
     unsigned int   access;    /* handle access rights */
     unsigned short type;      /* enum inproc_sync_type as short to save space */
     unsigned short closed;    /* fd has been closed but sync is still referenced */
@@ -599,6 +1027,8 @@ static struct inproc_sync *cache_inproc_sync( HANDLE handle, struct inproc_sync
     }
 
     cache->fd = sync->fd;
+    cache->index = sync->index;
+    cache->id = sync->id;
     cache->access = sync->access;
     cache->type = sync->type;
     cache->closed = sync->closed;
@@ -634,7 +1064,7 @@ static void release_inproc_sync( struct inproc_sync *sync )
     LONG ref = InterlockedDecrement( &sync->refcount );
 
     assert( ref >= 0 );
-    if (!ref) close( fd );
+    if (!ref && fd >= 0) close( fd );
 }
 
 static struct inproc_sync *get_cached_inproc_sync( HANDLE handle )
@@ -675,8 +1105,17 @@ static NTSTATUS get_server_inproc_sync( HANDLE handle, struct inproc_sync *sync
         {
             obj_handle_t fd_handle;
             sync->refcount = 1;
-            sync->fd = wine_server_receive_fd( &fd_handle );
-            assert( wine_server_ptr_handle(fd_handle) == handle );
+            if ((sync->index = reply->index))
+            {
+                sync->fd = -1;
+                sync->id = inproc_futex_arena[sync->index].id;
+            }
+            else
+            {
+                sync->fd = wine_server_receive_fd( &fd_handle );
+                assert( wine_server_ptr_handle(fd_handle) == handle );
+                sync->id = 0;
+            }
             sync->access = reply->access;
             sync->type = reply->type;
             sync->closed = 0;
@@ -780,7 +1219,8 @@ static NTSTATUS inproc_release_semaphore( HANDLE handle, ULONG count, ULONG *pre
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_SEMAPHORE, SEMAPHORE_MODIFY_STATE, &stack, &sync ))) return ret;
-    ret = linux_release_semaphore_obj( sync->fd, count, prev_count );
+    if (sync->index) ret = futex_release_semaphore_obj( sync->index, count, prev_count );
+    else ret = linux_release_semaphore_obj( sync->fd, count, prev_count );
     release_inproc_sync( sync );
     return ret;
 }
@@ -792,7 +1232,8 @@ static NTSTATUS inproc_query_semaphore( HANDLE handle, SEMAPHORE_BASIC_INFORMATI
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_SEMAPHORE, SEMAPHORE_QUERY_STATE, &stack, &sync ))) return ret;
-    ret = linux_query_semaphore_obj( sync->fd, info );
+    if (sync->index) ret = futex_query_semaphore_obj( sync->index, info );
+    else ret = linux_query_semaphore_obj( sync->fd, info );
     release_inproc_sync( sync );
     return ret;
 }
@@ -804,7 +1245,8 @@ static NTSTATUS inproc_set_event( HANDLE handle, LONG *prev_state )
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_EVENT, EVENT_MODIFY_STATE, &stack, &sync ))) return ret;
-    ret = linux_set_event_obj( sync->fd, prev_state );
+    if (sync->index) ret = futex_set_event_obj( sync->index, prev_state );
+    else ret = linux_set_event_obj( sync->fd, prev_state );
     release_inproc_sync( sync );
     return ret;
 }
@@ -816,7 +1258,8 @@ static NTSTATUS inproc_reset_event( HANDLE handle, LONG *prev_state )
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_EVENT, EVENT_MODIFY_STATE, &stack, &sync ))) return ret;
-    ret = linux_reset_event_obj( sync->fd, prev_state );
+    if (sync->index) ret = futex_reset_event_obj( sync->index, prev_state );
+    else ret = linux_reset_event_obj( sync->fd, prev_state );
     release_inproc_sync( sync );
     return ret;
 }
@@ -828,7 +1271,8 @@ static NTSTATUS inproc_pulse_event( HANDLE handle, LONG *prev_state )
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_EVENT, EVENT_MODIFY_STATE, &stack, &sync ))) return ret;
-    ret = linux_pulse_event_obj( sync->fd, prev_state );
+    if (sync->index) ret = futex_pulse_event_obj( sync->index, prev_state );
+    else ret = linux_pulse_event_obj( sync->fd, prev_state );
     release_inproc_sync( sync );
     return ret;
 }
@@ -840,7 +1284,8 @@ static NTSTATUS inproc_query_event( HANDLE handle, EVENT_BASIC_INFORMATION *info
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_EVENT, EVENT_QUERY_STATE, &stack, &sync ))) return ret;
-    ret = linux_query_event_obj( sync->fd, info );
+    if (sync->index) ret = futex_query_event_obj( sync->index, info );
+    else ret = linux_query_event_obj( sync->fd, info );
     release_inproc_sync( sync );
     return ret;
 }
@@ -852,7 +1297,8 @@ static NTSTATUS inproc_release_mutex( HANDLE handle, LONG *prev_count )
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_MUTEX, 0, &stack, &sync ))) return ret;
-    ret = linux_release_mutex_obj( sync->fd, prev_count );
+    if (sync->index) ret = futex_release_mutex_obj( sync->index, prev_count );
+    else ret = linux_release_mutex_obj( sync->fd, prev_count );
     release_inproc_sync( sync );
     return ret;
 }
@@ -864,7 +1310,8 @@ static NTSTATUS inproc_query_mutex( HANDLE handle, MUTANT_BASIC_INFORMATION *inf
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
     if ((ret = get_inproc_sync( handle, INPROC_SYNC_MUTEX, MUTANT_QUERY_STATE, &stack, &sync ))) return ret;
-    ret = linux_query_mutex_obj( sync->fd, info );
+    if (sync->index) ret = futex_query_mutex_obj( sync->index, info );
+    else ret = linux_query_mutex_obj( sync->fd, info );
     release_inproc_sync( sync );
     return ret;
 }
@@ -876,13 +1323,13 @@ static int get_inproc_alert_fd(void)
     sigset_t sigset;
     int fd;
 
-    if ((fd = data->alert_fd) < 0)
+    if ((fd = data->alert_fd) < 0 && !data->alert_index)
     {
         server_enter_uninterrupted_section( &fd_cache_mutex, &sigset );
 
         SERVER_START_REQ( get_inproc_alert_fd )
         {
-            if (!server_call_unlocked( req ))
+            if (!server_call_unlocked( req ) && !(data->alert_index = reply->index))
             {
                 data->alert_fd = fd = wine_server_receive_fd( &token );
                 assert( token == reply->handle );
@@ -896,17 +1343,40 @@ static int get_inproc_alert_fd(void)
     return fd;
 }
 
+static NTSTATUS wait_inproc_syncs( DWORD count, struct inproc_sync **syncs, WAIT_TYPE type,
+                                   BOOLEAN alertable, const LARGE_INTEGER *timeout )
+{
+    int objs[64], alert_fd = 0;
+    unsigned int ids[ARRAY_SIZE(objs)];
+
+    assert( count <= ARRAY_SIZE(objs) );
+    objs[0] = -1;  /* make gcc happy, otherwise it thinks objs is not initialized */
+
+    if (inproc_futex_arena)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            objs[i] = syncs[i]->index;
+            ids[i] = syncs[i]->id;
+        }
+        if (alertable) get_inproc_alert_fd();
+        return futex_wait_objs( count, objs, ids, type, alertable ? get_thread_data()->alert_index : 0, timeout );
+    }
+
+    for (int i = 0; i < count; ++i) objs[i] = syncs[i]->fd;
+    if (alertable) alert_fd = get_inproc_alert_fd();
+    return linux_wait_objs( inproc_device_fd, count, objs, type, alert_fd, timeout );
+}
+
 static NTSTATUS inproc_wait( DWORD count, const HANDLE *handles, WAIT_TYPE type,
                              BOOLEAN alertable, const LARGE_INTEGER *timeout )
 {
     struct inproc_sync *syncs[64], stack[ARRAY_SIZE(syncs)];
-    int objs[ARRAY_SIZE(syncs)], alert_fd = 0;
     NTSTATUS ret;
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
 
     assert( count <= ARRAY_SIZE(syncs) );
-    objs[0] = -1;  /* make gcc happy, otherwise it thinks objs is not initialized */
     for (int i = 0; i < count; ++i)
     {
         if ((ret = get_inproc_sync( handles[i], INPROC_SYNC_UNKNOWN, SYNCHRONIZE, &stack[i], &syncs[i] )))
@@ -914,11 +1384,9 @@ static NTSTATUS inproc_wait( DWORD count, const HANDLE *handles, WAIT_TYPE type,
             while (i--) release_inproc_sync( syncs[i] );
             return ret;
         }
-        objs[i] = syncs[i]->fd;
     }
 
-    if (alertable) alert_fd = get_inproc_alert_fd();
-    ret = linux_wait_objs( inproc_device_fd, count, objs, type, alert_fd, timeout );
+    ret = wait_inproc_syncs( count, syncs, type, alertable, timeout );
 
     while (count--) release_inproc_sync( syncs[count] );
     return ret;
@@ -928,7 +1396,6 @@ static NTSTATUS inproc_signal_and_wait( HANDLE signal, HANDLE wait,
                                         BOOLEAN alertable, const LARGE_INTEGER *timeout )
 {
     struct inproc_sync stack_signal, stack_wait, *signal_sync = &stack_signal, *wait_sync = &stack_wait;
-    int alert_fd = 0;
     NTSTATUS ret;
 
     if (inproc_device_fd < 0) return STATUS_NOT_IMPLEMENTED;
@@ -938,20 +1405,29 @@ static NTSTATUS inproc_signal_and_wait( HANDLE signal, HANDLE wait,
 
     if ((ret = get_inproc_sync( wait, INPROC_SYNC_UNKNOWN, SYNCHRONIZE, &stack_wait, &wait_sync ))) goto done;
 
-    switch (signal_sync->type)
+    if (signal_sync->index)
     {
-    case INPROC_SYNC_EVENT:     ret = linux_set_event_obj( signal_sync->fd, NULL ); break;
-    case INPROC_SYNC_MUTEX:     ret = linux_release_mutex_obj( signal_sync->fd, NULL ); break;
-    case INPROC_SYNC_SEMAPHORE: ret = linux_release_semaphore_obj( signal_sync->fd, 1, NULL ); break;
-    default: assert( 0 ); break;
+        switch (signal_sync->type)
+        {
+        case INPROC_SYNC_EVENT:     ret = futex_set_event_obj( signal_sync->index, NULL ); break;
+        case INPROC_SYNC_MUTEX:     ret = futex_release_mutex_obj( signal_sync->index, NULL ); break;
+        case INPROC_SYNC_SEMAPHORE: ret = futex_release_semaphore_obj( signal_sync->index, 1, NULL ); break;
+        default: assert( 0 ); break;
+        }
     }
-
-    if (!ret)
+    else
     {
-        if (alertable) alert_fd = get_inproc_alert_fd();
-        ret = linux_wait_objs( inproc_device_fd, 1, &wait_sync->fd, WaitAny, alert_fd, timeout );
+        switch (signal_sync->type)
+        {
+        case INPROC_SYNC_EVENT:     ret = linux_set_event_obj( signal_sync->fd, NULL ); break;
+        case INPROC_SYNC_MUTEX:     ret = linux_release_mutex_obj( signal_sync->fd, NULL ); break;
+        case INPROC_SYNC_SEMAPHORE: ret = linux_release_semaphore_obj( signal_sync->fd, 1, NULL ); break;
+        default: assert( 0 ); break;
+        }
     }
 
+    if (!ret) ret = wait_inproc_syncs( 1, &wait_sync, WaitAny, alertable, timeout );
+
     release_inproc_sync( wait_sync );
 done:
     release_inproc_sync( signal_sync );
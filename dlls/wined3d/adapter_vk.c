@@ -346,6 +346,78 @@ static void get_physical_device_info(const struct wined3d_adapter_vk *adapter_vk
         VK_CALL(vkGetPhysicalDeviceFeatures(physical_device, &features2->features));
 }
 
+static void adapter_vk_get_pipeline_cache_id(const struct wined3d_adapter *adapter, struct wined3d_cache_key *id)
+{
+    wined3d_cache_key_init(id);
+    wined3d_cache_key_update(id, &adapter->driver_uuid, sizeof(adapter->driver_uuid));
+    wined3d_cache_key_update(id, &adapter->device_uuid, sizeof(adapter->device_uuid));
+}
+
+/* The pipeline cache is shared by all graphics and compute pipelines the
+ * device creates, and is seeded with the data saved by previous runs of the
+ * same application on the same GPU and driver. */
+static void adapter_vk_create_pipeline_cache(struct wined3d_device_vk *device_vk,
+        const struct wined3d_adapter *adapter)
+{
+    const struct wined3d_vk_info *vk_info = &device_vk->vk_info;
+    VkPipelineCacheCreateInfo cache_info;
+    struct wined3d_cache_key id;
+    size_t size = 0;
+    void *data;
+    VkResult vr;
+
+    adapter_vk_get_pipeline_cache_id(adapter, &id);
+    data = wined3d_disk_cache_load_blob("vk-pipelines", &id, &size);
+
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.pNext = NULL;
+    cache_info.flags = 0;
+    cache_info.initialDataSize = size;
+    cache_info.pInitialData = data;
+    if ((vr = VK_CALL(vkCreatePipelineCache(device_vk->vk_device,
+            &cache_info, NULL, &device_vk->vk_pipeline_cache))) < 0 && data)
+    {
+        WARN("Failed to create pipeline cache from saved data, vr %s.\n", wined3d_debug_vkresult(vr));
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = NULL;
+        vr = VK_CALL(vkCreatePipelineCache(device_vk->vk_device, &cache_info, NULL, &device_vk->vk_pipeline_cache));
+    }
+    free(data);
+
+    if (vr < 0)
+    {
+        WARN("Failed to create pipeline cache, vr %s.\n", wined3d_debug_vkresult(vr));
+        device_vk->vk_pipeline_cache = VK_NULL_HANDLE;
+    }
+}
+
+static void adapter_vk_destroy_pipeline_cache(struct wined3d_device_vk *device_vk,
+        const struct wined3d_adapter *adapter)
+{
+    const struct wined3d_vk_info *vk_info = &device_vk->vk_info;
+    struct wined3d_cache_key id;
+    size_t size;
+    void *data;
+
+    if (!device_vk->vk_pipeline_cache)
+        return;
+
+    if (VK_CALL(vkGetPipelineCacheData(device_vk->vk_device, device_vk->vk_pipeline_cache, &size, NULL)) >= 0
+            && size && (data = malloc(size)))
+    {
+        /* VK_INCOMPLETE means the data is truncated; don't save it. */
+        if (VK_CALL(vkGetPipelineCacheData(device_vk->vk_device,
+                device_vk->vk_pipeline_cache, &size, data)) == VK_SUCCESS)
+        {
+            adapter_vk_get_pipeline_cache_id(adapter, &id);
+            wined3d_disk_cache_store_blob("vk-pipelines", &id, data, size);
+        }
+        free(data);
+    }
+
+    VK_CALL(vkDestroyPipelineCache(device_vk->vk_device, device_vk->vk_pipeline_cache, NULL));
+}
+
 static HRESULT adapter_vk_create_device(struct wined3d *wined3d, const struct wined3d_adapter *adapter,
         enum wined3d_device_type device_type, HWND focus_window, unsigned int flags, BYTE surface_alignment,
         const enum wined3d_feature_level *levels, unsigned int level_count,
@@ -444,10 +516,13 @@ static HRESULT adapter_vk_create_device(struct wined3d *wined3d, const struct wi
         goto fail;
     }
 
+    adapter_vk_create_pipeline_cache(device_vk, adapter);
+
     if (FAILED(hr = wined3d_device_init(&device_vk->d, wined3d, adapter->ordinal, device_type, focus_window,
             flags, surface_alignment, levels, level_count, vk_info->supported, device_parent)))
     {
         WARN("Failed to initialize device, hr %#lx.\n", hr);
+        VK_CALL(vkDestroyPipelineCache(vk_device, device_vk->vk_pipeline_cache, NULL));
         wined3d_allocator_cleanup(&device_vk->allocator);
         goto fail;
     }
@@ -477,6 +552,7 @@ static void adapter_vk_destroy_device(struct wined3d_device *device)
     wined3d_incref(wined3d);
 
     wined3d_device_cleanup(&device_vk->d);
+    adapter_vk_destroy_pipeline_cache(device_vk, device->adapter);
     wined3d_allocator_cleanup(&device_vk->allocator);
 
     wined3d_lock_cleanup(&device_vk->allocator_cs);
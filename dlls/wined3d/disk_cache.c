@@ -0,0 +1,643 @@
+/*
+ * On-disk caches for translated shaders and pipeline data
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+
+#include "wined3d_private.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(d3d);
+
+#define WINED3D_DISK_CACHE_MAGIC        0x43443357u /* "W3DC" */
+#define WINED3D_DISK_CACHE_RECORD_MAGIC 0x52443357u /* "W3DR" */
+#define WINED3D_DISK_CACHE_VERSION      1
+/* Caches that would grow beyond this evict their least recently used entries
+ * until they are down to WINED3D_DISK_CACHE_TRIM_SIZE, so that they don't
+ * have to be rewritten again right away. */
+#define WINED3D_DISK_CACHE_MAX_SIZE     (256u << 20)
+#define WINED3D_DISK_CACHE_TRIM_SIZE    (WINED3D_DISK_CACHE_MAX_SIZE / 4 * 3)
+
+struct wined3d_disk_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    struct wined3d_cache_key id;
+};
+
+struct wined3d_disk_cache_record
+{
+    uint32_t magic;
+    uint32_t size;
+    uint64_t checksum;
+    struct wined3d_cache_key key;
+};
+
+struct wined3d_disk_cache_entry
+{
+    struct wine_rb_entry entry;
+    struct list lru_entry;
+    /* The record is immediately followed by its data, so that an entry can
+     * be appended to the file with a single write. */
+    struct wined3d_disk_cache_record record;
+    uint8_t data[1];
+};
+
+struct wined3d_disk_cache
+{
+    struct wine_rb_tree entries;
+    /* Least recently used entries first. */
+    struct list lru;
+    /* The total size of the records of all entries. */
+    uint64_t size;
+    HANDLE file;
+    char path[MAX_PATH];
+    struct wined3d_cache_key id;
+};
+
+void wined3d_cache_key_init(struct wined3d_cache_key *key)
+{
+    key->hash[0] = 0xcbf29ce484222325ull;
+    key->hash[1] = 0x84222325cbf29ce4ull;
+}
+
+/* Two independent 64-bit lanes; the first one is plain FNV-1a. */
+void wined3d_cache_key_update(struct wined3d_cache_key *key, const void *data, size_t size)
+{
+    uint64_t h0 = key->hash[0], h1 = key->hash[1];
+    const uint8_t *ptr = data;
+
+    while (size--)
+    {
+        h0 = (h0 ^ *ptr) * 0x100000001b3ull;
+        h1 = (h1 ^ *ptr++) * 0x9e3779b97f4a7c15ull;
+        h1 ^= h1 >> 29;
+    }
+
+    key->hash[0] = h0;
+    key->hash[1] = h1;
+}
+
+static uint64_t wined3d_disk_cache_checksum(const void *data, size_t size)
+{
+    struct wined3d_cache_key key;
+
+    wined3d_cache_key_init(&key);
+    wined3d_cache_key_update(&key, data, size);
+    return key.hash[0] ^ key.hash[1];
+}
+
+static int wined3d_disk_cache_entry_compare(const void *key, const struct wine_rb_entry *entry)
+{
+    const struct wined3d_disk_cache_entry *e = WINE_RB_ENTRY_VALUE(entry, struct wined3d_disk_cache_entry, entry);
+
+    return memcmp(key, &e->record.key, sizeof(e->record.key));
+}
+
+static void wined3d_disk_cache_entry_destroy(struct wine_rb_entry *entry, void *context)
+{
+    free(WINE_RB_ENTRY_VALUE(entry, struct wined3d_disk_cache_entry, entry));
+}
+
+static size_t wined3d_disk_cache_entry_size(const struct wined3d_disk_cache_entry *entry)
+{
+    return sizeof(entry->record) + entry->record.size;
+}
+
+static void wined3d_disk_cache_remove(struct wined3d_disk_cache *cache, struct wined3d_disk_cache_entry *entry)
+{
+    wine_rb_remove(&cache->entries, &entry->entry);
+    list_remove(&entry->lru_entry);
+    cache->size -= wined3d_disk_cache_entry_size(entry);
+    free(entry);
+}
+
+/* Later records replace earlier ones with the same key. */
+static void wined3d_disk_cache_insert(struct wined3d_disk_cache *cache, struct wined3d_disk_cache_entry *entry)
+{
+    struct wine_rb_entry *old;
+
+    if ((old = wine_rb_get(&cache->entries, &entry->record.key)))
+        wined3d_disk_cache_remove(cache, WINE_RB_ENTRY_VALUE(old, struct wined3d_disk_cache_entry, entry));
+
+    wine_rb_put(&cache->entries, &entry->record.key, &entry->entry);
+    list_add_tail(&cache->lru, &entry->lru_entry);
+    cache->size += wined3d_disk_cache_entry_size(entry);
+}
+
+static void wined3d_disk_cache_evict(struct wined3d_disk_cache *cache, uint64_t size)
+{
+    struct wined3d_disk_cache_entry *entry;
+    struct list *head;
+
+    while (sizeof(struct wined3d_disk_cache_header) + cache->size > size && (head = list_head(&cache->lru)))
+    {
+        entry = LIST_ENTRY(head, struct wined3d_disk_cache_entry, lru_entry);
+        TRACE("Evicting shader cache entry %s.\n", wine_dbgstr_longlong(entry->record.key.hash[0]));
+        wined3d_disk_cache_remove(cache, entry);
+    }
+}
+
+/* Cache files are stored as "<app>.<id>.<name>" in the directory given by the
+ * "shader_cache_path" setting, or in "%LOCALAPPDATA%\wined3d" by default.
+ * Including the id in the file name keeps the caches for different GPUs and
+ * drivers from evicting each other. Caches that don't depend on the GPU pass
+ * a NULL id and are stored as "<app>.<name>", so that a stale file is
+ * replaced instead of left behind. */
+static bool wined3d_disk_cache_get_path(char *path, size_t path_size,
+        const char *name, const struct wined3d_cache_key *id)
+{
+    char app_name[MAX_PATH], dir[MAX_PATH];
+    const char *base;
+    int len;
+
+    if (!wined3d_settings.shader_cache)
+        return false;
+
+    if (!wined3d_get_app_name(app_name, ARRAY_SIZE(app_name)))
+        return false;
+
+    if (wined3d_settings.shader_cache_path)
+    {
+        len = snprintf(dir, sizeof(dir), "%s", wined3d_settings.shader_cache_path);
+    }
+    else
+    {
+        if (!(base = getenv("LOCALAPPDATA")))
+            return false;
+        len = snprintf(dir, sizeof(dir), "%s\\wined3d", base);
+    }
+    if (len < 0 || len >= sizeof(dir))
+        return false;
+
+    if (!CreateDirectoryA(dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        WARN("Failed to create shader cache directory %s, error %lu.\n", debugstr_a(dir), GetLastError());
+        return false;
+    }
+
+    if (id)
+        len = snprintf(path, path_size, "%s\\%s.%08x.%s", dir, app_name, (uint32_t)id->hash[0], name);
+    else
+        len = snprintf(path, path_size, "%s\\%s.%s", dir, app_name, name);
+    return len >= 0 && len < path_size;
+}
+
+static void *wined3d_disk_cache_read_file(HANDLE file, size_t *size)
+{
+    LARGE_INTEGER file_size, pos = {0};
+    uint8_t *data;
+    DWORD count;
+    size_t offset;
+
+    /* Concurrent appends may take a cache slightly beyond the size limit. */
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart > 2 * (LONGLONG)WINED3D_DISK_CACHE_MAX_SIZE
+            || !SetFilePointerEx(file, pos, NULL, FILE_BEGIN))
+        return NULL;
+
+    if (!(data = malloc(file_size.QuadPart ? file_size.QuadPart : 1)))
+        return NULL;
+
+    for (offset = 0; offset < file_size.QuadPart; offset += count)
+    {
+        if (!ReadFile(file, data + offset, file_size.QuadPart - offset, &count, NULL) || !count)
+        {
+            free(data);
+            return NULL;
+        }
+    }
+
+    *size = offset;
+    return data;
+}
+
+static bool wined3d_disk_cache_check_header(const void *data, size_t size, const struct wined3d_cache_key *id)
+{
+    const struct wined3d_disk_cache_header *header = data;
+
+    return size >= sizeof(*header) && header->magic == WINED3D_DISK_CACHE_MAGIC
+            && header->version == WINED3D_DISK_CACHE_VERSION && !memcmp(&header->id, id, sizeof(*id));
+}
+
+/* Records are not aligned in the file, so the header is copied out. Returns
+ * the size of the record at "offset", or 0 if it is truncated or corrupt. */
+static size_t wined3d_disk_cache_check_record(const uint8_t *data, size_t size, size_t offset,
+        struct wined3d_disk_cache_record *record)
+{
+    if (size - offset < sizeof(*record))
+        return 0;
+    memcpy(record, &data[offset], sizeof(*record));
+    offset += sizeof(*record);
+
+    if (record->magic != WINED3D_DISK_CACHE_RECORD_MAGIC || size - offset < record->size
+            || wined3d_disk_cache_checksum(&data[offset], record->size) != record->checksum)
+        return 0;
+
+    return sizeof(*record) + record->size;
+}
+
+/* Adds the records following the header to the cache, and returns the offset
+ * after the last valid one. With "merge", records for keys the cache already
+ * has are skipped, so that data returned by wined3d_disk_cache_get() stays
+ * valid. */
+static size_t wined3d_disk_cache_read_records(struct wined3d_disk_cache *cache,
+        const uint8_t *data, size_t size, bool merge)
+{
+    struct wined3d_disk_cache_entry *entry;
+    struct wined3d_disk_cache_record record;
+    size_t offset, record_size;
+
+    for (offset = sizeof(struct wined3d_disk_cache_header); offset < size; offset += record_size)
+    {
+        if (!(record_size = wined3d_disk_cache_check_record(data, size, offset, &record)))
+            break;
+
+        if (merge && wine_rb_get(&cache->entries, &record.key))
+            continue;
+
+        if (!(entry = malloc(offsetof(struct wined3d_disk_cache_entry, data[record.size]))))
+            break;
+        entry->record = record;
+        memcpy(entry->data, &data[offset + sizeof(record)], record.size);
+        wined3d_disk_cache_insert(cache, entry);
+    }
+
+    return offset;
+}
+
+static bool wined3d_disk_cache_write(HANDLE file, const void *data, size_t size)
+{
+    DWORD count;
+
+    return WriteFile(file, data, size, &count, NULL) && count == size;
+}
+
+static HANDLE wined3d_disk_cache_open_file(const char *path)
+{
+    return CreateFileA(path, GENERIC_READ | FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+/* Processes take a shared lock to append to the file, and an exclusive one
+ * to replace it. The locked byte is far beyond the end of the file, so that
+ * reading the file is not affected. */
+static bool wined3d_disk_cache_lock(HANDLE file, bool exclusive)
+{
+    OVERLAPPED overlapped = {.OffsetHigh = 0x7fffffff};
+
+    return LockFileEx(file, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &overlapped);
+}
+
+static void wined3d_disk_cache_unlock(HANDLE file)
+{
+    OVERLAPPED overlapped = {.OffsetHigh = 0x7fffffff};
+
+    UnlockFileEx(file, 0, 1, 0, &overlapped);
+}
+
+/* Whether another process replaced or deleted the file since we opened it.
+ * Anything we append to it afterwards would be lost. */
+static bool wined3d_disk_cache_file_replaced(HANDLE file)
+{
+    FILE_STANDARD_INFO info;
+
+    return !GetFileInformationByHandleEx(file, FileStandardInfo, &info, sizeof(info))
+            || !info.NumberOfLinks || info.DeletePending;
+}
+
+/* The file is only ever appended to, so that records written by concurrent
+ * processes don't overwrite each other. Dropping anything from it means
+ * writing the entries to a new file, and replacing the old one. That happens
+ * under an exclusive lock, after adding the records other processes appended
+ * in the meantime; their later appends see the file was replaced, and go to
+ * the new one. */
+static bool wined3d_disk_cache_rewrite(struct wined3d_disk_cache *cache)
+{
+    struct wined3d_disk_cache_header header;
+    struct wined3d_disk_cache_entry *entry;
+    char tmp_path[MAX_PATH + 16];
+    HANDLE file;
+    uint8_t *data;
+    size_t size;
+    bool ret;
+
+    for (;;)
+    {
+        if (!wined3d_disk_cache_lock(cache->file, true))
+        {
+            WARN("Failed to lock shader cache, error %lu.\n", GetLastError());
+            return false;
+        }
+        if (!wined3d_disk_cache_file_replaced(cache->file))
+            break;
+
+        wined3d_disk_cache_unlock(cache->file);
+        CloseHandle(cache->file);
+        if ((cache->file = wined3d_disk_cache_open_file(cache->path)) == INVALID_HANDLE_VALUE)
+            return false;
+    }
+
+    if ((data = wined3d_disk_cache_read_file(cache->file, &size)))
+    {
+        if (wined3d_disk_cache_check_header(data, size, &cache->id))
+            wined3d_disk_cache_read_records(cache, data, size, true);
+        free(data);
+    }
+    wined3d_disk_cache_evict(cache, WINED3D_DISK_CACHE_TRIM_SIZE);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%08lx", cache->path, GetCurrentProcessId());
+    if ((file = CreateFileA(tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+    {
+        wined3d_disk_cache_unlock(cache->file);
+        return false;
+    }
+
+    header.magic = WINED3D_DISK_CACHE_MAGIC;
+    header.version = WINED3D_DISK_CACHE_VERSION;
+    header.id = cache->id;
+    ret = wined3d_disk_cache_write(file, &header, sizeof(header));
+
+    /* In LRU order, which loading the file preserves. */
+    LIST_FOR_EACH_ENTRY(entry, &cache->lru, struct wined3d_disk_cache_entry, lru_entry)
+    {
+        if (!ret)
+            break;
+        ret = wined3d_disk_cache_write(file, &entry->record, wined3d_disk_cache_entry_size(entry));
+    }
+    CloseHandle(file);
+
+    if (!ret || !MoveFileExA(tmp_path, cache->path, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to rewrite shader cache, error %lu.\n", GetLastError());
+        DeleteFileA(tmp_path);
+        wined3d_disk_cache_unlock(cache->file);
+        return false;
+    }
+
+    file = wined3d_disk_cache_open_file(cache->path);
+    wined3d_disk_cache_unlock(cache->file);
+    CloseHandle(cache->file);
+    cache->file = file;
+
+    TRACE("Rewrote shader cache with %s bytes of entries.\n", wine_dbgstr_longlong(cache->size));
+    return file != INVALID_HANDLE_VALUE;
+}
+
+/* Also used to pick up the entries of a file another process replaced ours
+ * with. Files consisting mostly of replaced records, or whose entries exceed
+ * the size limit, are compacted right away. */
+static bool wined3d_disk_cache_load(struct wined3d_disk_cache *cache, bool merge)
+{
+    size_t size, offset;
+    uint8_t *data;
+
+    if (!(data = wined3d_disk_cache_read_file(cache->file, &size))
+            || !wined3d_disk_cache_check_header(data, size, &cache->id))
+    {
+        TRACE("Discarding stale or invalid shader cache.\n");
+        free(data);
+        return wined3d_disk_cache_rewrite(cache);
+    }
+
+    offset = wined3d_disk_cache_read_records(cache, data, size, merge);
+    free(data);
+
+    /* Drop anything following the last valid record, e.g. a write that was
+     * interrupted, so that new records can be appended again. */
+    if (offset < size)
+    {
+        WARN("Truncating shader cache at offset %#Ix.\n", offset);
+        return wined3d_disk_cache_rewrite(cache);
+    }
+
+    if (offset > 2 * (sizeof(struct wined3d_disk_cache_header) + cache->size)
+            || sizeof(struct wined3d_disk_cache_header) + cache->size > WINED3D_DISK_CACHE_MAX_SIZE)
+    {
+        TRACE("Compacting shader cache of %#Ix bytes.\n", offset);
+        return wined3d_disk_cache_rewrite(cache);
+    }
+
+    TRACE("Loaded %#Ix bytes of cached data.\n", offset);
+    return true;
+}
+
+struct wined3d_disk_cache *wined3d_disk_cache_open(const char *name, const struct wined3d_cache_key *id, bool shared)
+{
+    struct wined3d_disk_cache *cache;
+
+    if (!(cache = calloc(1, sizeof(*cache))))
+        return NULL;
+    wine_rb_init(&cache->entries, wined3d_disk_cache_entry_compare);
+    list_init(&cache->lru);
+    cache->id = *id;
+
+    if (!wined3d_disk_cache_get_path(cache->path, ARRAY_SIZE(cache->path), name, shared ? NULL : id))
+    {
+        free(cache);
+        return NULL;
+    }
+
+    if ((cache->file = wined3d_disk_cache_open_file(cache->path)) == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to open shader cache %s, error %lu.\n", debugstr_a(cache->path), GetLastError());
+        free(cache);
+        return NULL;
+    }
+
+    if (!wined3d_disk_cache_load(cache, false))
+    {
+        WARN("Failed to load shader cache %s, error %lu.\n", debugstr_a(cache->path), GetLastError());
+        wined3d_disk_cache_close(cache);
+        return NULL;
+    }
+
+    TRACE("Opened shader cache %s.\n", debugstr_a(cache->path));
+    return cache;
+}
+
+void wined3d_disk_cache_close(struct wined3d_disk_cache *cache)
+{
+    if (!cache)
+        return;
+
+    if (cache->file != INVALID_HANDLE_VALUE)
+        CloseHandle(cache->file);
+    wine_rb_destroy(&cache->entries, wined3d_disk_cache_entry_destroy, NULL);
+    free(cache);
+}
+
+/* The returned data stays valid until the entry is replaced or evicted, or
+ * the cache is closed. Entries are only evicted by wined3d_disk_cache_put(). */
+bool wined3d_disk_cache_get(struct wined3d_disk_cache *cache,
+        const struct wined3d_cache_key *key, const void **data, size_t *size)
+{
+    struct wined3d_disk_cache_entry *entry;
+    struct wine_rb_entry *e;
+
+    if (!(e = wine_rb_get(&cache->entries, key)))
+        return false;
+
+    entry = WINE_RB_ENTRY_VALUE(e, struct wined3d_disk_cache_entry, entry);
+    list_remove(&entry->lru_entry);
+    list_add_tail(&cache->lru, &entry->lru_entry);
+    *data = entry->data;
+    *size = entry->record.size;
+    return true;
+}
+
+/* Appends the record of "entry" to the file, under a shared lock so that the
+ * file is not replaced in the meantime. If it was replaced already, the
+ * entries of the new file are loaded first. Once the file would exceed the
+ * size limit it is rewritten instead, evicting old entries. */
+static bool wined3d_disk_cache_append(struct wined3d_disk_cache *cache, const struct wined3d_disk_cache_entry *entry)
+{
+    LARGE_INTEGER file_size;
+    bool ret;
+
+    for (;;)
+    {
+        if (cache->file == INVALID_HANDLE_VALUE)
+            return false;
+
+        if (!wined3d_disk_cache_lock(cache->file, false))
+        {
+            WARN("Failed to lock shader cache, error %lu.\n", GetLastError());
+            return false;
+        }
+        if (!wined3d_disk_cache_file_replaced(cache->file))
+            break;
+
+        TRACE("Shader cache was replaced, reloading it.\n");
+        wined3d_disk_cache_unlock(cache->file);
+        CloseHandle(cache->file);
+        if ((cache->file = wined3d_disk_cache_open_file(cache->path)) == INVALID_HANDLE_VALUE
+                || !wined3d_disk_cache_load(cache, true))
+            return false;
+    }
+
+    if (!GetFileSizeEx(cache->file, &file_size)
+            || file_size.QuadPart + wined3d_disk_cache_entry_size(entry) > WINED3D_DISK_CACHE_MAX_SIZE)
+    {
+        wined3d_disk_cache_unlock(cache->file);
+        return wined3d_disk_cache_rewrite(cache);
+    }
+
+    ret = wined3d_disk_cache_write(cache->file, &entry->record, wined3d_disk_cache_entry_size(entry));
+    wined3d_disk_cache_unlock(cache->file);
+    return ret;
+}
+
+/* Records are appended to the file as soon as they are added, so they survive
+ * the application exiting without destroying its device. Adding a record for
+ * an existing key replaces the old one. */
+void wined3d_disk_cache_put(struct wined3d_disk_cache *cache,
+        const struct wined3d_cache_key *key, const void *data, size_t size)
+{
+    struct wined3d_disk_cache_entry *entry;
+
+    if (size > WINED3D_DISK_CACHE_TRIM_SIZE - sizeof(struct wined3d_disk_cache_header) - sizeof(entry->record))
+        return;
+
+    if (!(entry = malloc(offsetof(struct wined3d_disk_cache_entry, data[size]))))
+        return;
+    entry->record.magic = WINED3D_DISK_CACHE_RECORD_MAGIC;
+    entry->record.size = size;
+    entry->record.checksum = wined3d_disk_cache_checksum(data, size);
+    entry->record.key = *key;
+    memcpy(entry->data, data, size);
+    wined3d_disk_cache_insert(cache, entry);
+
+    if (!wined3d_disk_cache_append(cache, entry))
+        WARN("Failed to write shader cache record, error %lu.\n", GetLastError());
+}
+
+void *wined3d_disk_cache_load_blob(const char *name, const struct wined3d_cache_key *id, size_t *size)
+{
+    struct wined3d_disk_cache_record record;
+    size_t file_size, offset;
+    char path[MAX_PATH];
+    uint8_t *data;
+    HANDLE file;
+
+    if (!wined3d_disk_cache_get_path(path, ARRAY_SIZE(path), name, id))
+        return NULL;
+
+    if ((file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+        return NULL;
+    data = wined3d_disk_cache_read_file(file, &file_size);
+    CloseHandle(file);
+
+    offset = sizeof(struct wined3d_disk_cache_header);
+    if (!data || !wined3d_disk_cache_check_header(data, file_size, id)
+            || !wined3d_disk_cache_check_record(data, file_size, offset, &record))
+    {
+        WARN("Ignoring invalid cache file %s.\n", debugstr_a(path));
+        free(data);
+        return NULL;
+    }
+
+    *size = record.size;
+    memmove(data, &data[offset + sizeof(record)], record.size);
+    return data;
+}
+
+/* The blob is written to a temporary file first, so that a concurrent or
+ * interrupted store never leaves a partially written file behind. */
+void wined3d_disk_cache_store_blob(const char *name, const struct wined3d_cache_key *id,
+        const void *data, size_t size)
+{
+    char path[MAX_PATH], tmp_path[MAX_PATH + 16];
+    struct wined3d_disk_cache_header header;
+    struct wined3d_disk_cache_record record;
+    HANDLE file;
+    bool ret;
+
+    if (size > WINED3D_DISK_CACHE_MAX_SIZE - sizeof(header) - sizeof(record)
+            || !wined3d_disk_cache_get_path(path, ARRAY_SIZE(path), name, id))
+        return;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%08lx", path, GetCurrentProcessId());
+    if ((file = CreateFileA(tmp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to create %s, error %lu.\n", debugstr_a(tmp_path), GetLastError());
+        return;
+    }
+
+    header.magic = WINED3D_DISK_CACHE_MAGIC;
+    header.version = WINED3D_DISK_CACHE_VERSION;
+    header.id = *id;
+    record.magic = WINED3D_DISK_CACHE_RECORD_MAGIC;
+    record.size = size;
+    record.checksum = wined3d_disk_cache_checksum(data, size);
+    record.key = *id;
+
+    ret = wined3d_disk_cache_write(file, &header, sizeof(header))
+            && wined3d_disk_cache_write(file, &record, sizeof(record))
+            && wined3d_disk_cache_write(file, data, size);
+    CloseHandle(file);
+
+    if (!ret || !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to write %s, error %lu.\n", debugstr_a(path), GetLastError());
+        DeleteFileA(tmp_path);
+        return;
+    }
+
+    TRACE("Wrote %#Ix bytes to %s.\n", size, debugstr_a(path));
+}
@@ -37,6 +37,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(d3d_shader);
 WINE_DECLARE_DEBUG_CHANNEL(d3d);
+WINE_DECLARE_DEBUG_CHANNEL(d3d_perf);
 WINE_DECLARE_DEBUG_CHANNEL(winediag);
 
 #define WINED3D_GLSL_SAMPLE_PROJECTED   0x01
@@ -140,6 +141,15 @@ struct shader_glsl_priv
     struct wine_rb_tree ffp_vertex_shaders;
     struct wine_rb_tree ffp_fragment_shaders;
     BOOL legacy_lighting;
+
+    /* The program binary cache is loaded by a separate thread while the
+     * device is being created. */
+    HANDLE program_cache_thread;
+    struct wined3d_cache_key program_cache_id;
+    struct wined3d_disk_cache *program_cache;
+    unsigned int program_cache_hits;
+    unsigned int program_cache_misses;
+    unsigned int program_cache_rejects;
 };
 
 struct glsl_vs_program
@@ -631,6 +641,135 @@ void shader_glsl_validate_link(const struct wined3d_gl_info *gl_info, GLuint pro
     print_glsl_info_log(gl_info, program, TRUE);
 }
 
+static DWORD WINAPI shader_glsl_program_cache_load(void *ctx)
+{
+    struct shader_glsl_priv *priv = ctx;
+
+    priv->program_cache = wined3d_disk_cache_open("gl-programs", &priv->program_cache_id, false);
+    return 0;
+}
+
+static struct wined3d_disk_cache *shader_glsl_get_program_cache(struct shader_glsl_priv *priv)
+{
+    if (priv->program_cache_thread)
+    {
+        WaitForSingleObject(priv->program_cache_thread, INFINITE);
+        CloseHandle(priv->program_cache_thread);
+        priv->program_cache_thread = NULL;
+    }
+
+    return priv->program_cache;
+}
+
+/* The key covers the source of all attached shaders, in any order, on top of
+ * the state set up by the caller before linking. */
+static bool shader_glsl_program_cache_key_add_shaders(const struct wined3d_gl_info *gl_info,
+        GLuint program_id, struct wined3d_cache_key *key)
+{
+    struct wined3d_cache_key shader_keys[6], tmp;
+    GLint i, j, shader_count, length;
+    GLuint shaders[6];
+    char *source;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_ATTACHED_SHADERS, &shader_count));
+    if (shader_count > ARRAY_SIZE(shaders))
+        return false;
+
+    GL_EXTCALL(glGetAttachedShaders(program_id, ARRAY_SIZE(shaders), &shader_count, shaders));
+    for (i = 0; i < shader_count; ++i)
+    {
+        GL_EXTCALL(glGetShaderiv(shaders[i], GL_SHADER_SOURCE_LENGTH, &length));
+        if (length <= 0 || !(source = malloc(length)))
+            return false;
+        GL_EXTCALL(glGetShaderSource(shaders[i], length, &length, source));
+        wined3d_cache_key_init(&shader_keys[i]);
+        wined3d_cache_key_update(&shader_keys[i], source, length);
+        free(source);
+
+        for (j = i; j > 0 && memcmp(&shader_keys[j - 1], &shader_keys[j], sizeof(tmp)) > 0; --j)
+        {
+            tmp = shader_keys[j];
+            shader_keys[j] = shader_keys[j - 1];
+            shader_keys[j - 1] = tmp;
+        }
+    }
+    checkGLcall("get program sources");
+
+    wined3d_cache_key_update(key, &shader_count, sizeof(shader_count));
+    wined3d_cache_key_update(key, shader_keys, shader_count * sizeof(*shader_keys));
+    return true;
+}
+
+/* Links the program, or loads it from the program binary cache. "key" holds
+ * any state that affects linking but isn't part of the shader source, or is
+ * NULL if the program shouldn't be cached.
+ *
+ * Context activation is done by the caller. */
+static void shader_glsl_link_program(const struct wined3d_gl_info *gl_info, struct shader_glsl_priv *priv,
+        GLuint program_id, struct wined3d_cache_key *key)
+{
+    struct wined3d_disk_cache *cache = NULL;
+    GLint status, length;
+    const void *data;
+    GLenum format;
+    uint8_t *blob;
+    size_t size;
+
+    if (key && (cache = shader_glsl_get_program_cache(priv))
+            && !shader_glsl_program_cache_key_add_shaders(gl_info, program_id, key))
+        cache = NULL;
+
+    if (cache)
+    {
+        if (wined3d_disk_cache_get(cache, key, &data, &size) && size > sizeof(format))
+        {
+            memcpy(&format, data, sizeof(format));
+            GL_EXTCALL(glProgramBinary(program_id, format,
+                    (const uint8_t *)data + sizeof(format), size - sizeof(format)));
+            GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+            checkGLcall("glProgramBinary");
+            if (status)
+            {
+                TRACE("Loaded GLSL shader program %u from the program binary cache.\n", program_id);
+                ++priv->program_cache_hits;
+                return;
+            }
+
+            /* This can happen if the driver was updated without changing its
+             * version string; relink and replace the cached binary. */
+            WARN("Cached binary for program %u was rejected.\n", program_id);
+            ++priv->program_cache_rejects;
+        }
+        else
+        {
+            ++priv->program_cache_misses;
+        }
+
+        GL_EXTCALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
+
+    TRACE("Linking GLSL shader program %u.\n", program_id);
+    GL_EXTCALL(glLinkProgram(program_id));
+    shader_glsl_validate_link(gl_info, program_id);
+
+    if (!cache)
+        return;
+
+    GL_EXTCALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+    GL_EXTCALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (!status || length <= 0 || !(blob = malloc(sizeof(format) + length)))
+        return;
+
+    GL_EXTCALL(glGetProgramBinary(program_id, length, &length, &format, blob + sizeof(format)));
+    checkGLcall("glGetProgramBinary");
+    if (length > 0)
+    {
+        memcpy(blob, &format, sizeof(format));
+        wined3d_disk_cache_put(cache, key, blob, sizeof(format) + length);
+    }
+    free(blob);
+}
+
 static struct vkd3d_shader_resource_binding *create_resource_bindings(const struct wined3d_gl_info *gl_info,
         enum wined3d_shader_type shader_type, unsigned int *count)
 {
@@ -10267,6 +10406,7 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
     struct glsl_cs_compiled_shader *gl_shaders;
     struct glsl_shader_private *shader_data;
     struct glsl_shader_prog_link *entry;
+    struct wined3d_cache_key cache_key;
     GLuint shader_id, program_id;
 
     if (!(entry = malloc(sizeof(*entry))))
@@ -10320,9 +10460,8 @@ static HRESULT shader_glsl_compile_compute_shader(struct shader_glsl_priv *priv,
 
     list_add_head(&shader->linked_programs, &entry->cs.shader_entry);
 
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    wined3d_cache_key_init(&cache_key);
+    shader_glsl_link_program(gl_info, priv, program_id, &cache_key);
 
     GL_EXTCALL(glUseProgram(program_id));
     checkGLcall("glUseProgram");
@@ -10392,9 +10531,11 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
     struct glsl_shader_prog_link *entry = NULL;
     struct wined3d_shader *vshader = NULL;
     struct wined3d_shader *pshader = NULL;
+    struct wined3d_cache_key cache_key, *cache_key_ptr = &cache_key;
     GLuint reorder_shader_id = 0;
     struct glsl_program_key key;
     uint32_t attribs_map;
+    bool dual_source;
     GLuint program_id;
     unsigned int i;
     GLuint vs_id = 0;
@@ -10565,6 +10706,13 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
         attribs_map = (1u << WINED3D_FFP_ATTRIBS_COUNT) - 1;
     }
 
+    /* Attribute and fragment output bindings aren't part of the shader
+     * source, but they are baked into the program binary. */
+    dual_source = state->blend_state && state->blend_state->dual_source;
+    wined3d_cache_key_init(&cache_key);
+    wined3d_cache_key_update(&cache_key, &attribs_map, sizeof(attribs_map));
+    wined3d_cache_key_update(&cache_key, &dual_source, sizeof(dual_source));
+
     if (!shader_glsl_use_explicit_attrib_location(gl_info))
     {
         /* Bind vertex attributes to a corresponding index number to match
@@ -10597,7 +10745,7 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
             for (i = 0; i < WINED3D_MAX_RENDER_TARGETS; ++i)
             {
                 string_buffer_sprintf(tmp_name, "color_out%u", i);
-                if (state->blend_state && state->blend_state->dual_source)
+                if (dual_source)
                     GL_EXTCALL(glBindFragDataLocationIndexed(program_id, 0, i, tmp_name->buffer));
                 else
                     GL_EXTCALL(glBindFragDataLocation(program_id, i, tmp_name->buffer));
@@ -10632,6 +10780,10 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
         checkGLcall("glAttachShader");
 
         shader_glsl_init_transform_feedback(context_gl, priv, program_id, gshader);
+        /* Neither are the transform feedback varyings; don't bother caching
+         * programs that use stream output. */
+        if (gshader->u.gs.so_desc)
+            cache_key_ptr = NULL;
 
         list_add_head(&gshader->linked_programs, &entry->gs.shader_entry);
     }
@@ -10647,9 +10799,7 @@ static void set_glsl_shader_program(const struct wined3d_context_gl *context_gl,
     }
 
     /* Link the program */
-    TRACE("Linking GLSL shader program %u.\n", program_id);
-    GL_EXTCALL(glLinkProgram(program_id));
-    shader_glsl_validate_link(gl_info, program_id);
+    shader_glsl_link_program(gl_info, priv, program_id, cache_key_ptr);
 
     shader_glsl_init_vs_uniform_locations(gl_info, priv, program_id, &entry->vs,
             vshader ? vshader->limits->constant_float : 0);
@@ -11208,6 +11358,7 @@ static HRESULT shader_glsl_alloc(struct wined3d_device *device, const struct win
         const struct wined3d_fragment_pipe_ops *fragment_pipe)
 {
     SIZE_T stack_size = wined3d_log2i(max(WINED3D_MAX_VS_CONSTS_F, WINED3D_MAX_PS_CONSTS_F)) + 1;
+    const struct wined3d_adapter_gl *adapter_gl = wined3d_adapter_gl_const(device->adapter);
     void *vertex_priv, *fragment_priv;
     struct shader_glsl_priv *priv;
 
@@ -11268,6 +11419,13 @@ static HRESULT shader_glsl_alloc(struct wined3d_device *device, const struct win
     priv->fragment_pipe = fragment_pipe;
     priv->legacy_lighting = device->wined3d->flags & WINED3D_LEGACY_FFP_LIGHTING;
 
+    if (adapter_gl->gl_info.supported[ARB_GET_PROGRAM_BINARY] && wined3d_settings.shader_cache)
+    {
+        priv->program_cache_id = adapter_gl->program_cache_id;
+        if (!(priv->program_cache_thread = CreateThread(NULL, 0, shader_glsl_program_cache_load, priv, 0, NULL)))
+            ERR("Failed to create program cache thread, error %lu.\n", GetLastError());
+    }
+
     device->vertex_priv = vertex_priv;
     device->fragment_priv = fragment_priv;
     device->shader_priv = priv;
@@ -11290,6 +11448,13 @@ static void shader_glsl_free(struct wined3d_device *device, struct wined3d_conte
 {
     struct shader_glsl_priv *priv = device->shader_priv;
 
+    if (shader_glsl_get_program_cache(priv))
+    {
+        TRACE_(d3d_perf)("Program binary cache: %u hits, %u misses, %u rejected.\n",
+                priv->program_cache_hits, priv->program_cache_misses, priv->program_cache_rejects);
+        wined3d_disk_cache_close(priv->program_cache);
+    }
+
     wine_rb_destroy(&priv->program_lookup, NULL, NULL);
     constant_free(&priv->pconst_heap);
     constant_free(&priv->vconst_heap);
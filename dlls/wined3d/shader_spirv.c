@@ -49,8 +49,14 @@ struct shader_spirv_priv
     struct shader_spirv_resource_bindings bindings;
 
     struct vkd3d_shader_compile_option compile_options[3];
+
+    struct wined3d_disk_cache *spirv_cache;
 };
 
+/* Bump this when the way shaders are translated changes in a way that isn't
+ * covered by the cache key, e.g. the layout of the compile arguments. */
+#define WINED3D_SPIRV_CACHE_VERSION 1
+
 #define MAX_SM1_INTER_STAGE_VARYINGS 12
 
 struct shader_spirv_compile_arguments
@@ -346,6 +352,60 @@ static void shader_spirv_init_shader_interface_vk(struct wined3d_shader_spirv_sh
     iface->vkd3d_interface.uav_counter_count = b->uav_counter_count;
 }
 
+/* Everything that affects the output of vkd3d_shader_compile() has to be
+ * part of the key. */
+static void shader_spirv_get_cache_key(struct wined3d_cache_key *key, const struct shader_spirv_priv *priv,
+        const struct vkd3d_shader_compile_info *info, const struct wined3d_shader_spirv_compile_args *compile_args,
+        enum wined3d_shader_type shader_type, const struct shader_spirv_compile_arguments *args,
+        const struct shader_spirv_resource_bindings *bindings, const struct wined3d_stream_output_desc *so_desc)
+{
+    const struct wined3d_stream_output_element *e;
+    unsigned int i;
+
+    wined3d_cache_key_init(key);
+    wined3d_cache_key_update(key, &shader_type, sizeof(shader_type));
+    wined3d_cache_key_update(key, &info->source_type, sizeof(info->source_type));
+    wined3d_cache_key_update(key, &info->source.size, sizeof(info->source.size));
+    wined3d_cache_key_update(key, info->source.code, info->source.size);
+    wined3d_cache_key_update(key, priv->compile_options, sizeof(priv->compile_options));
+    wined3d_cache_key_update(key, &compile_args->spirv_target.extension_count,
+            sizeof(compile_args->spirv_target.extension_count));
+    wined3d_cache_key_update(key, compile_args->extensions,
+            compile_args->spirv_target.extension_count * sizeof(*compile_args->extensions));
+
+    if (args)
+        wined3d_cache_key_update(key, args, sizeof(*args));
+
+    wined3d_cache_key_update(key, &bindings->binding_count, sizeof(bindings->binding_count));
+    wined3d_cache_key_update(key, bindings->bindings, bindings->binding_count * sizeof(*bindings->bindings));
+    wined3d_cache_key_update(key, &bindings->uav_counter_count, sizeof(bindings->uav_counter_count));
+    wined3d_cache_key_update(key, bindings->uav_counters,
+            bindings->uav_counter_count * sizeof(*bindings->uav_counters));
+    wined3d_cache_key_update(key, &bindings->ffp_ps_extra_binding, sizeof(bindings->ffp_ps_extra_binding));
+    wined3d_cache_key_update(key, &bindings->ffp_vs_extra_binding, sizeof(bindings->ffp_vs_extra_binding));
+
+    if (!so_desc)
+        return;
+
+    wined3d_cache_key_update(key, &so_desc->element_count, sizeof(so_desc->element_count));
+    for (i = 0; i < so_desc->element_count; ++i)
+    {
+        e = &so_desc->elements[i];
+        wined3d_cache_key_update(key, &e->stream_idx, sizeof(e->stream_idx));
+        if (e->semantic_name)
+            wined3d_cache_key_update(key, e->semantic_name, strlen(e->semantic_name) + 1);
+        else
+            wined3d_cache_key_update(key, "", 1);
+        wined3d_cache_key_update(key, &e->semantic_idx, sizeof(e->semantic_idx));
+        wined3d_cache_key_update(key, &e->component_idx, sizeof(e->component_idx));
+        wined3d_cache_key_update(key, &e->component_count, sizeof(e->component_count));
+        wined3d_cache_key_update(key, &e->output_slot, sizeof(e->output_slot));
+    }
+    wined3d_cache_key_update(key, &so_desc->buffer_stride_count, sizeof(so_desc->buffer_stride_count));
+    wined3d_cache_key_update(key, so_desc->buffer_strides,
+            so_desc->buffer_stride_count * sizeof(*so_desc->buffer_strides));
+}
+
 static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *context_vk,
         const struct wined3d_shader_desc *shader_desc, enum vkd3d_shader_source_type source_type,
         enum wined3d_shader_type shader_type, const struct shader_spirv_compile_arguments *args,
@@ -359,6 +419,8 @@ static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *con
     VkShaderModuleCreateInfo shader_create_info;
     struct vkd3d_shader_compile_info info;
     struct vkd3d_shader_code spirv;
+    struct wined3d_cache_key key;
+    bool cached = false;
     VkShaderModule module;
     char *messages;
     VkResult vr;
@@ -379,26 +441,39 @@ static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *con
     info.log_level = VKD3D_SHADER_LOG_WARNING;
     info.source_name = NULL;
 
-    ret = vkd3d_shader_compile(&info, &spirv, &messages);
-    if (messages && *messages && FIXME_ON(d3d_shader))
+    if (priv->spirv_cache)
     {
-        const char *ptr, *end, *line;
+        shader_spirv_get_cache_key(&key, priv, &info, &compile_args, shader_type, args, bindings, so_desc);
+        if ((cached = wined3d_disk_cache_get(priv->spirv_cache, &key, &spirv.code, &spirv.size)))
+            TRACE("Using cached SPIR-V.\n");
+    }
 
-        FIXME("Shader log:\n");
-        ptr = messages;
-        end = ptr + strlen(ptr);
-        while ((line = wined3d_get_line(&ptr, end)))
+    if (!cached)
+    {
+        ret = vkd3d_shader_compile(&info, &spirv, &messages);
+        if (messages && *messages && FIXME_ON(d3d_shader))
         {
-            FIXME("    %.*s", (int)(ptr - line), line);
+            const char *ptr, *end, *line;
+
+            FIXME("Shader log:\n");
+            ptr = messages;
+            end = ptr + strlen(ptr);
+            while ((line = wined3d_get_line(&ptr, end)))
+            {
+                FIXME("    %.*s", (int)(ptr - line), line);
+            }
+            FIXME("\n");
         }
-        FIXME("\n");
-    }
-    vkd3d_shader_free_messages(messages);
+        vkd3d_shader_free_messages(messages);
 
-    if (ret < 0)
-    {
-        ERR("Failed to compile shader, ret %d.\n", ret);
-        return VK_NULL_HANDLE;
+        if (ret < 0)
+        {
+            ERR("Failed to compile shader, ret %d.\n", ret);
+            return VK_NULL_HANDLE;
+        }
+
+        if (priv->spirv_cache)
+            wined3d_disk_cache_put(priv->spirv_cache, &key, spirv.code, spirv.size);
     }
 
     shader_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -406,15 +481,15 @@ static VkShaderModule shader_spirv_compile_shader(struct wined3d_context_vk *con
     shader_create_info.flags = 0;
     shader_create_info.codeSize = spirv.size;
     shader_create_info.pCode = spirv.code;
-    if ((vr = VK_CALL(vkCreateShaderModule(device_vk->vk_device, &shader_create_info, NULL, &module))) < 0)
-    {
+    vr = VK_CALL(vkCreateShaderModule(device_vk->vk_device, &shader_create_info, NULL, &module));
+    if (!cached)
         vkd3d_shader_free_shader_code(&spirv);
+    if (vr < 0)
+    {
         WARN("Failed to create Vulkan shader module, vr %s.\n", wined3d_debug_vkresult(vr));
         return VK_NULL_HANDLE;
     }
 
-    vkd3d_shader_free_shader_code(&spirv);
-
     return module;
 }
 
@@ -523,7 +598,7 @@ static struct shader_spirv_compute_program_vk *shader_spirv_find_compute_program
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
     if ((vr = VK_CALL(vkCreateComputePipelines(device_vk->vk_device,
-            VK_NULL_HANDLE, 1, &pipeline_info, NULL, &program->vk_pipeline))) < 0)
+            device_vk->vk_pipeline_cache, 1, &pipeline_info, NULL, &program->vk_pipeline))) < 0)
     {
         ERR("Failed to create Vulkan compute pipeline, vr %s.\n", wined3d_debug_vkresult(vr));
         VK_CALL(vkDestroyShaderModule(device_vk->vk_device, program->vk_module, NULL));
@@ -1132,6 +1207,9 @@ static HRESULT shader_spirv_alloc(struct wined3d_device *device,
     const struct wined3d_vk_info *vk_info = &wined3d_adapter_vk(device->adapter)->vk_info;
     void *vertex_priv, *fragment_priv;
     struct shader_spirv_priv *priv;
+    unsigned int cache_version;
+    struct wined3d_cache_key id;
+    const char *version;
 
     if (!(priv = malloc(sizeof(*priv))))
         return E_OUTOFMEMORY;
@@ -1169,6 +1247,16 @@ static HRESULT shader_spirv_alloc(struct wined3d_device *device,
     else
         priv->compile_options[2].value = VKD3D_SHADER_COMPILE_OPTION_TYPED_UAV_READ_FORMAT_R32;
 
+    /* The translated shaders don't depend on the GPU, so the cache is shared
+     * between all of them; it only needs to be invalidated when
+     * vkd3d-shader is updated. */
+    version = vkd3d_shader_get_version(NULL, NULL);
+    cache_version = WINED3D_SPIRV_CACHE_VERSION;
+    wined3d_cache_key_init(&id);
+    wined3d_cache_key_update(&id, version, strlen(version));
+    wined3d_cache_key_update(&id, &cache_version, sizeof(cache_version));
+    priv->spirv_cache = wined3d_disk_cache_open("spirv", &id, true);
+
     return WINED3D_OK;
 }
 
@@ -1177,6 +1265,7 @@ static void shader_spirv_free(struct wined3d_device *device, struct wined3d_cont
     struct shader_spirv_priv *priv = device->shader_priv;
 
     shader_spirv_resource_bindings_cleanup(&priv->bindings);
+    wined3d_disk_cache_close(priv->spirv_cache);
     priv->fragment_pipe->free_private(device, context);
     priv->vertex_pipe->vp_free(device, context);
     free(priv);
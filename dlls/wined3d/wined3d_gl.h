@@ -83,6 +83,7 @@ enum wined3d_gl_extension
     ARB_FRAMEBUFFER_OBJECT,
     ARB_FRAMEBUFFER_SRGB,
     ARB_GEOMETRY_SHADER4,
+    ARB_GET_PROGRAM_BINARY,
     ARB_GPU_SHADER5,
     ARB_HALF_FLOAT_PIXEL,
     ARB_HALF_FLOAT_VERTEX,
@@ -814,6 +815,7 @@ struct wined3d_adapter_gl
     struct wined3d_adapter a;
 
     struct wined3d_gl_info gl_info;
+    struct wined3d_cache_key program_cache_id;
 
     /* Indexed by the WGL pixel format index minus 1. */
     struct wined3d_pixel_format *pixel_formats;
@@ -119,6 +119,7 @@ struct wined3d_settings wined3d_settings =
     .max_gl_version = MAKEDWORD_VERSION(4, 4),
     .pci_vendor_id = PCI_VENDOR_NONE,
     .pci_device_id = PCI_DEVICE_NONE,
+    .shader_cache = TRUE,
     .multisample_textures = TRUE,
     .sample_count = ~0u,
     .max_sm_vs = UINT_MAX,
@@ -415,6 +416,17 @@ static BOOL wined3d_dll_init(HINSTANCE hInstDLL)
             else
                 memcpy(wined3d_settings.logo, buffer, len);
         }
+        if (!get_config_key_dword(hkey, appkey, env, "shader_cache", &wined3d_settings.shader_cache))
+            TRACE("Setting shader cache to %#x.\n", wined3d_settings.shader_cache);
+        if (!get_config_key(hkey, appkey, env, "shader_cache_path", buffer, size))
+        {
+            size_t len = strlen(buffer) + 1;
+
+            if (!(wined3d_settings.shader_cache_path = malloc(len)))
+                ERR("Failed to allocate shader cache path memory.\n");
+            else
+                memcpy(wined3d_settings.shader_cache_path, buffer, len);
+        }
         if (!get_config_key_dword(hkey, appkey, env, "MultisampleTextures", &wined3d_settings.multisample_textures))
             ERR_(winediag)("Setting multisample textures to %#x.\n", wined3d_settings.multisample_textures);
         if (!get_config_key_dword(hkey, appkey, env, "SampleCount", &wined3d_settings.sample_count))
@@ -527,6 +539,7 @@ static BOOL wined3d_dll_destroy(HINSTANCE hInstDLL)
     free(swapchain_state_table.hooks);
 
     free(wined3d_settings.logo);
+    free(wined3d_settings.shader_cache_path);
     UnregisterClassA(WINED3D_OPENGL_WINDOW_CLASS_NAME, hInstDLL);
 
     DeleteCriticalSection(&wined3d_command_cs);
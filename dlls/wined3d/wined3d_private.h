@@ -471,6 +471,8 @@ struct wined3d_settings
     /* Memory tracking and object counting. */
     UINT64 emulated_textureram;
     char *logo;
+    char *shader_cache_path;
+    unsigned int shader_cache;
     unsigned int multisample_textures;
     unsigned int sample_count;
     unsigned int strict_shader_math;
@@ -2766,6 +2768,26 @@ void wined3d_unregister_window(HWND window);
 
 BOOL wined3d_get_app_name(char *app_name, unsigned int app_name_size);
 
+struct wined3d_cache_key
+{
+    uint64_t hash[2];
+};
+
+void wined3d_cache_key_init(struct wined3d_cache_key *key);
+void wined3d_cache_key_update(struct wined3d_cache_key *key, const void *data, size_t size);
+
+struct wined3d_disk_cache;
+
+struct wined3d_disk_cache *wined3d_disk_cache_open(const char *name, const struct wined3d_cache_key *id, bool shared);
+void wined3d_disk_cache_close(struct wined3d_disk_cache *cache);
+bool wined3d_disk_cache_get(struct wined3d_disk_cache *cache,
+        const struct wined3d_cache_key *key, const void **data, size_t *size);
+void wined3d_disk_cache_put(struct wined3d_disk_cache *cache,
+        const struct wined3d_cache_key *key, const void *data, size_t size);
+void *wined3d_disk_cache_load_blob(const char *name, const struct wined3d_cache_key *id, size_t *size);
+void wined3d_disk_cache_store_blob(const char *name, const struct wined3d_cache_key *id,
+        const void *data, size_t size);
+
 /* Direct3D 1-9 shader constants are submitted by internally feeding them into
  * wined3d_buffer objects, which are updated with
  * wined3d_device_context_emit_update_sub_resource().
@@ -14552,6 +14552,158 @@ static void test_select_after_WSAEventSelect(void)
     closesocket(client);
 }
 
+static void test_nonblocking_recv_send_sequence(void)
+{
+    OVERLAPPED overlapped = {0};
+    SOCKET client, server;
+    char buffer[32], expect[32];
+    WSABUF wsabuf;
+    DWORD size, flags;
+    u_long one = 1;
+    HANDLE event;
+    int ret, i;
+
+    tcp_socketpair(&client, &server);
+    ret = ioctlsocket(client, FIONBIO, &one);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+
+    /* Many small nonblocking calls in a row; data must stay in order. */
+    for (i = 0; i < 200; ++i)
+    {
+        sprintf(expect, "message %d", i);
+
+        WSASetLastError(0xdeadbeef);
+        ret = recv(client, buffer, sizeof(buffer), 0);
+        ok(ret == -1, "got %d\n", ret);
+        ok(WSAGetLastError() == WSAEWOULDBLOCK, "got error %u\n", WSAGetLastError());
+
+        ret = send(server, expect, strlen(expect), 0);
+        ok(ret == strlen(expect), "got %d\n", ret);
+        check_poll(client, POLLRDNORM | POLLWRNORM);
+
+        memset(buffer, 0, sizeof(buffer));
+        ret = recv(client, buffer, sizeof(buffer), 0);
+        ok(ret == strlen(expect), "got %d\n", ret);
+        ok(!strcmp(buffer, expect), "got %s\n", debugstr_a(buffer));
+
+        ret = send(client, expect, strlen(expect), 0);
+        ok(ret == strlen(expect), "got %d\n", ret);
+        memset(buffer, 0, sizeof(buffer));
+        ret = recv(server, buffer, sizeof(buffer), 0);
+        ok(ret == strlen(expect), "got %d\n", ret);
+        ok(!strcmp(buffer, expect), "got %s\n", debugstr_a(buffer));
+    }
+
+    /* A pending overlapped recv gets the data before later nonblocking calls. */
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    wsabuf.buf = buffer;
+    wsabuf.len = sizeof(buffer);
+    flags = 0;
+    memset(buffer, 0, sizeof(buffer));
+    ret = WSARecv(client, &wsabuf, 1, NULL, &flags, &overlapped, NULL);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == ERROR_IO_PENDING, "got error %u\n", WSAGetLastError());
+
+    ret = send(server, "async", 5, 0);
+    ok(ret == 5, "got %d\n", ret);
+    ret = WaitForSingleObject(overlapped.hEvent, 1000);
+    ok(!ret, "wait returned %d\n", ret);
+    ret = GetOverlappedResult((HANDLE)client, &overlapped, &size, FALSE);
+    ok(ret, "got error %lu\n", GetLastError());
+    ok(size == 5, "got size %lu\n", size);
+    ok(!strcmp(buffer, "async"), "got %s\n", debugstr_a(buffer));
+    CloseHandle(overlapped.hEvent);
+
+    WSASetLastError(0xdeadbeef);
+    ret = recv(client, buffer, sizeof(buffer), 0);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == WSAEWOULDBLOCK, "got error %u\n", WSAGetLastError());
+
+    /* Once events are selected, recv() must still re-enable FD_READ. */
+    event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    ret = WSAEventSelect(client, event, FD_READ);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+
+    for (i = 0; i < 3; ++i)
+    {
+        ret = send(server, "data", 4, 0);
+        ok(ret == 4, "got %d\n", ret);
+        ret = WaitForSingleObject(event, 1000);
+        ok(!ret, "%d: wait returned %d\n", i, ret);
+        ret = recv(client, buffer, sizeof(buffer), 0);
+        ok(ret == 4, "got %d\n", ret);
+    }
+
+    CloseHandle(event);
+    closesocket(server);
+    closesocket(client);
+}
+
+/* best case time of a recv() of data that already arrived */
+static LONGLONG min_recv_time(SOCKET client, SOCKET peer)
+{
+    const struct timeval timeout = {1, 0};
+    LARGE_INTEGER start, end;
+    LONGLONG best = -1;
+    char buffer[1];
+    fd_set set;
+    int ret, i;
+
+    for (i = 0; i < 200; ++i)
+    {
+        ret = send(peer, "x", 1, 0);
+        ok(ret == 1, "got %d\n", ret);
+        FD_ZERO(&set);
+        FD_SET(client, &set);
+        ret = select(0, &set, NULL, NULL, &timeout);
+        ok(ret == 1, "got %d\n", ret);
+
+        QueryPerformanceCounter(&start);
+        ret = recv(client, buffer, sizeof(buffer), 0);
+        QueryPerformanceCounter(&end);
+        ok(ret == 1, "got %d\n", ret);
+
+        if (best < 0 || end.QuadPart - start.QuadPart < best) best = end.QuadPart - start.QuadPart;
+    }
+
+    return best;
+}
+
+static void test_recv_bypass(void)
+{
+    LONGLONG direct, server;
+    SOCKET client, peer;
+    u_long one = 1;
+    HANDLE event;
+    int ret;
+
+    /* Wine tries recv() itself when the socket has no selected events, and
+     * only asks the server otherwise. */
+    if (strcmp(winetest_platform, "wine"))
+    {
+        skip("the server bypass is Wine specific\n");
+        return;
+    }
+
+    tcp_socketpair(&client, &peer);
+    ret = ioctlsocket(client, FIONBIO, &one);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+
+    direct = min_recv_time(client, peer);
+
+    event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    ret = WSAEventSelect(client, event, FD_READ);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+    server = min_recv_time(client, peer);
+
+    ok(direct * 2 < server, "recv took %s ticks without events selected, %s with\n",
+            wine_dbgstr_longlong(direct), wine_dbgstr_longlong(server));
+
+    CloseHandle(event);
+    closesocket(peer);
+    closesocket(client);
+}
+
 static void test_broadcast(void)
 {
     struct sockaddr_in bcast = {.sin_family = AF_INET, .sin_port = htons(12345), .sin_addr.s_addr = htonl(INADDR_BROADCAST)};
@@ -15103,6 +15255,8 @@ START_TEST( sock )
 
     test_events();
     test_select_after_WSAEventSelect();
+    test_nonblocking_recv_send_sequence();
+    test_recv_bypass();
 
     test_ipv6only();
     test_TransmitFile();
@@ -21,6 +21,7 @@
  */
 
 #include "InitInternalGDKC.h"
+#include "System/Threading/WorkScheduler.h"
 #include "../WineCoreUAP/Foundation/IWineAsync.hpp"
 
 #include <libxml/parser.h>
@@ -172,3 +173,15 @@ InitializeGDKComponent( INITIALIZE_OPTIONS *options )
 
     return hr;
 }
+
+HRESULT WINAPI
+UninitializeGDKComponent( void )
+{
+    TRACE( "\n" );
+
+    //  The scheduler's workers keep the DLL loaded, so they have to be
+    // stopped here for FreeLibrary to be able to unload it.
+    OS::WorkScheduler::Shutdown();
+
+    return S_OK;
+}
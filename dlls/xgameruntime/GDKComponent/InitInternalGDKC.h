@@ -26,6 +26,7 @@ extern "C" {
 #endif
 
 HRESULT WINAPI InitializeGDKComponent( INITIALIZE_OPTIONS *options );
+HRESULT WINAPI UninitializeGDKComponent( void );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,277 @@
+/*
+ * AsyncStatePool Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "AsyncStatePool.h"
+
+#include <atomic>
+#include <mutex>
+
+WINE_DEFAULT_DEBUG_CHANNEL(gdkc);
+
+namespace
+{
+    const uint32_t c_heapBucket = UINT32_MAX;
+    const size_t c_bucketSizes[ASYNC_POOL_BUCKETS] = { ASYNC_POOL_BUCKET_0, ASYNC_POOL_BUCKET_1, ASYNC_POOL_BUCKET_2 };
+
+    struct alignas(16) BlockHeader
+    {
+        uint32_t bucket;
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct FreeList
+    {
+        FreeBlock* head = nullptr;
+        uint32_t count = 0;
+
+        void Push(FreeBlock* block)
+        {
+            block->next = head;
+            head = block;
+            count++;
+        }
+
+        FreeBlock* Pop()
+        {
+            FreeBlock* block = head;
+            if (block != nullptr)
+            {
+                head = block->next;
+                count--;
+            }
+            return block;
+        }
+    };
+
+    struct Depot
+    {
+        std::mutex lock;
+        FreeList lists[ASYNC_POOL_BUCKETS];
+    };
+
+    struct Counters
+    {
+        std::atomic<uint64_t> allocations{ 0 };
+        std::atomic<uint64_t> threadCacheHits{ 0 };
+        std::atomic<uint64_t> depotHits{ 0 };
+        std::atomic<uint64_t> heapAllocations{ 0 };
+        std::atomic<uint64_t> frees{ 0 };
+    };
+
+    // Neither is ever destroyed: thread caches may be flushed into the depot
+    // by threads that exit during process shutdown.
+    Depot& GetDepot()
+    {
+        static Depot* s_depot = new Depot;
+        return *s_depot;
+    }
+
+    Counters& GetCounters()
+    {
+        static Counters* s_counters = new Counters;
+        return *s_counters;
+    }
+
+    void ReleaseBlocks(FreeList& list, uint32_t count)
+    {
+        while (count-- != 0)
+        {
+            FreeBlock* block = list.Pop();
+            if (block == nullptr)
+            {
+                break;
+            }
+
+            ::operator delete(reinterpret_cast<BlockHeader*>(block) - 1);
+        }
+    }
+
+    void MoveBlocks(FreeList& from, FreeList& to, uint32_t count)
+    {
+        while (count-- != 0)
+        {
+            FreeBlock* block = from.Pop();
+            if (block == nullptr)
+            {
+                break;
+            }
+
+            to.Push(block);
+        }
+    }
+
+    struct ThreadCache
+    {
+        FreeList lists[ASYNC_POOL_BUCKETS];
+
+        ~ThreadCache()
+        {
+            Depot& depot = GetDepot();
+            std::lock_guard<std::mutex> lock(depot.lock);
+
+            for (uint32_t bucket = 0; bucket < ASYNC_POOL_BUCKETS; bucket++)
+            {
+                MoveBlocks(lists[bucket], depot.lists[bucket], lists[bucket].count);
+
+                if (depot.lists[bucket].count > ASYNC_POOL_DEPOT_MAX)
+                {
+                    ReleaseBlocks(depot.lists[bucket], depot.lists[bucket].count - ASYNC_POOL_DEPOT_MAX);
+                }
+            }
+        }
+    };
+
+    thread_local ThreadCache t_cache;
+
+    uint32_t BucketFor(size_t size)
+    {
+        for (uint32_t bucket = 0; bucket < ASYNC_POOL_BUCKETS; bucket++)
+        {
+            if (size <= c_bucketSizes[bucket])
+            {
+                return bucket;
+            }
+        }
+
+        return c_heapBucket;
+    }
+}
+
+void* AsyncStatePool::Alloc(
+    _In_ size_t size,
+    _In_ const std::nothrow_t& tag
+) noexcept {
+    Counters& counters = GetCounters();
+    size_t total = size + sizeof(BlockHeader);
+    uint32_t bucket = BucketFor(total);
+    void* block = nullptr;
+
+    uint64_t allocations = ++counters.allocations;
+    if ((allocations & 0xffff) == 0)
+    {
+        TRACE("%s allocations, %s thread cache hits, %s depot hits, %s heap.\n",
+            wine_dbgstr_longlong(allocations),
+            wine_dbgstr_longlong(counters.threadCacheHits.load()),
+            wine_dbgstr_longlong(counters.depotHits.load()),
+            wine_dbgstr_longlong(counters.heapAllocations.load()));
+    }
+
+    if (bucket != c_heapBucket)
+    {
+        FreeList& list = t_cache.lists[bucket];
+
+        block = list.Pop();
+        if (block != nullptr)
+        {
+            counters.threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            Depot& depot = GetDepot();
+
+            {
+                std::lock_guard<std::mutex> lock(depot.lock);
+                MoveBlocks(depot.lists[bucket], list, ASYNC_POOL_BATCH);
+            }
+
+            block = list.Pop();
+            if (block != nullptr)
+            {
+                counters.depotHits.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (block != nullptr)
+        {
+            block = reinterpret_cast<BlockHeader*>(block) - 1;
+        }
+        else
+        {
+            total = c_bucketSizes[bucket];
+        }
+    }
+
+    if (block == nullptr)
+    {
+        block = ::operator new(total, tag);
+        if (block == nullptr)
+        {
+            counters.frees.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        counters.heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    BlockHeader* header = static_cast<BlockHeader*>(block);
+    header->bucket = bucket;
+
+    return header + 1;
+}
+
+void AsyncStatePool::Free(
+    _In_opt_ void* ptr
+) noexcept {
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+    uint32_t bucket = header->bucket;
+
+    GetCounters().frees.fetch_add(1, std::memory_order_relaxed);
+
+    if (bucket == c_heapBucket)
+    {
+        ::operator delete(header);
+        return;
+    }
+
+    FreeList& list = t_cache.lists[bucket];
+    list.Push(reinterpret_cast<FreeBlock*>(header + 1));
+
+    if (list.count > ASYNC_POOL_THREAD_MAX)
+    {
+        Depot& depot = GetDepot();
+        std::lock_guard<std::mutex> lock(depot.lock);
+
+        MoveBlocks(list, depot.lists[bucket], ASYNC_POOL_BATCH);
+
+        if (depot.lists[bucket].count > ASYNC_POOL_DEPOT_MAX)
+        {
+            ReleaseBlocks(depot.lists[bucket], depot.lists[bucket].count - ASYNC_POOL_DEPOT_MAX);
+        }
+    }
+}
+
+void AsyncStatePool::GetStatistics(
+    _Out_ AsyncStatePoolStatistics* stats
+) noexcept {
+    Counters& counters = GetCounters();
+
+    stats->allocations = counters.allocations.load();
+    stats->threadCacheHits = counters.threadCacheHits.load();
+    stats->depotHits = counters.depotHits.load();
+    stats->heapAllocations = counters.heapAllocations.load();
+    stats->outstanding = stats->allocations - counters.frees.load();
+}
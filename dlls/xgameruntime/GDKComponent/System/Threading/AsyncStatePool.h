@@ -0,0 +1,64 @@
+/*
+ * AsyncStatePool Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __ASYNCSTATEPOOL_H__
+#define __ASYNCSTATEPOOL_H__
+
+#include "../../../private.h"
+
+#include <new>
+
+// Block sizes served from the pool, header included. AsyncState plus a
+// provider context that does not fit in the largest bucket goes to the heap.
+#define ASYNC_POOL_BUCKETS 3
+#define ASYNC_POOL_BUCKET_0 512
+#define ASYNC_POOL_BUCKET_1 1024
+#define ASYNC_POOL_BUCKET_2 2048
+
+// Blocks a thread keeps per bucket before handing a batch to the shared depot.
+#define ASYNC_POOL_THREAD_MAX 64
+// Blocks moved between a thread cache and the depot at once.
+#define ASYNC_POOL_BATCH 32
+// Blocks the depot keeps per bucket before releasing them to the heap.
+#define ASYNC_POOL_DEPOT_MAX 4096
+
+struct AsyncStatePoolStatistics
+{
+    uint64_t allocations;       // Total Alloc calls.
+    uint64_t threadCacheHits;   // Served from the calling thread's free list.
+    uint64_t depotHits;         // Served after refilling from the shared depot.
+    uint64_t heapAllocations;   // Served by the heap (pool empty or oversized).
+    uint64_t outstanding;       // Blocks currently handed out.
+};
+
+//
+// AsyncStatePool: recycles the memory behind AsyncState and its provider
+// context. Freed blocks go onto a per-thread free list; when that list grows
+// past ASYNC_POOL_THREAD_MAX half of it is moved to a shared depot, which
+// threads that only allocate (e.g. a game thread whose states are released on
+// a completion thread) refill from in batches.
+//
+class AsyncStatePool
+{
+public:
+    static void* Alloc(_In_ size_t size, _In_ const std::nothrow_t& tag) noexcept;
+    static void Free(_In_opt_ void* ptr) noexcept;
+    static void GetStatistics(_Out_ AsyncStatePoolStatistics* stats) noexcept;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * BoundedQueue Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __BOUNDEDQUEUE_H__
+#define __BOUNDEDQUEUE_H__
+
+#include <windows.h>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <new>
+
+/*****************************************************************************
+
+ BoundedQueue is a fixed capacity, multi producer / multi consumer lock free
+ queue with the same push_back / pop_front / empty surface as LocklessQueue.
+ All cells are allocated by init(), so neither push_back nor pop_front ever
+ touch the allocator. When the queue is full push_back returns false and the
+ caller decides what to do with the item (typically spill it into an
+ unbounded LocklessQueue).
+
+ Each cell carries a sequence number. A producer claims the cell at the
+ enqueue position once its sequence equals that position, and publishes it by
+ setting the sequence to position + 1; a consumer claims it once the sequence
+ equals position + 1 and hands it back to producers of the next lap by
+ setting it to position + capacity. The enqueue and dequeue positions live on
+ separate cache lines so producers and consumers don't invalidate each other.
+
+ Unlike LocklessQueue there are no node addresses, so BoundedQueue can't be
+ used where entries are reserved up front or moved between queues that share
+ a node heap. It is, however, safe to use as a class member.
+
+ The algorithm is Dmitry Vyukov's bounded MPMC queue:
+
+ https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+ ******************************************************************************/
+
+template <typename TData>
+class BoundedQueue
+{
+public:
+    BoundedQueue() noexcept = default;
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Allocates the cells. capacity is rounded up to a power of two.
+    HRESULT init(_In_ uint32_t capacity) noexcept
+    {
+        uint32_t size = 2;
+
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        m_cells.reset(new (std::nothrow) Cell[size]);
+        if (!m_cells)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        for (uint32_t idx = 0; idx < size; idx++)
+        {
+            m_cells[idx].sequence.store(idx, std::memory_order_relaxed);
+        }
+
+        m_mask = size - 1;
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+
+        return S_OK;
+    }
+
+    uint32_t capacity() const noexcept
+    {
+        return m_mask + 1;
+    }
+
+    bool empty() const noexcept
+    {
+        return m_dequeuePos.load(std::memory_order_acquire) ==
+            m_enqueuePos.load(std::memory_order_acquire);
+    }
+
+    bool push_back(_In_ const TData& data) noexcept
+    {
+        uint32_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // The consumer of the previous lap has not released the cell.
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop_front(_Out_ TData& data) noexcept
+    {
+        uint32_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(sequence - (pos + 1));
+
+            if (diff == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        data = std::move(cell->data);
+        cell->data = TData {};
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<uint32_t> sequence;
+        TData data;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    uint32_t m_mask = 0;
+
+    alignas(64) std::atomic<uint32_t> m_enqueuePos{ 0 };
+    alignas(64) std::atomic<uint32_t> m_dequeuePos{ 0 };
+    char m_padding[64 - sizeof(std::atomic<uint32_t>)];
+};
+
+#endif
@@ -19,7 +19,9 @@
 #ifndef __LOCKLESSQUEUE_H__
 #define __LOCKLESSQUEUE_H__
 
-#include "../../../private.h"
+#include <windows.h>
+#include <cstdint>
+#include <new>
 #include "SpinLock.h"
 
 /*****************************************************************************
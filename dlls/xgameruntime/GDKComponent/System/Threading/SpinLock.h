@@ -20,7 +20,7 @@
 #ifndef __SPINLOCK_H__
 #define __SPINLOCK_H__
 
-#include "../../../private.h"
+#include <windows.h>
 
 #include <algorithm>
 #include <atomic>
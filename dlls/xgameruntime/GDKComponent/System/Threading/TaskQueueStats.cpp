@@ -0,0 +1,205 @@
+/*
+ * TaskQueueStats Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "TaskQueueStats.h"
+
+#include <cstdio>
+
+WINE_DEFAULT_DEBUG_CHANNEL(gdkc);
+
+namespace
+{
+    struct StatsSection
+    {
+        TaskQueueStatsHeader header;
+        TaskQueuePortStats slots[TASK_QUEUE_STATS_SLOTS];
+    };
+
+    StatsSection* CreateSection() noexcept
+    {
+        char name[64];
+        StatsSection* section = nullptr;
+        HANDLE mapping;
+
+        snprintf(name, sizeof(name), "Local\\XTaskQueueStats-%lu", GetCurrentProcessId());
+
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(StatsSection), name);
+        if (mapping != nullptr)
+        {
+            section = static_cast<StatsSection*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(StatsSection)));
+
+            // The view keeps the section alive for the lifetime of the process.
+            CloseHandle(mapping);
+        }
+
+        if (section == nullptr)
+        {
+            WARN("Failed to create the task queue stats section, error %lu.\n", GetLastError());
+
+            section = static_cast<StatsSection*>(calloc(1, sizeof(StatsSection)));
+            if (section == nullptr)
+            {
+                return nullptr;
+            }
+        }
+
+        section->header.version = TASK_QUEUE_STATS_VERSION;
+        section->header.slotCount = TASK_QUEUE_STATS_SLOTS;
+        section->header.bucketCount = TASK_QUEUE_STATS_BUCKETS;
+        section->header.slotSize = sizeof(TaskQueuePortStats);
+        section->header.processId = GetCurrentProcessId();
+        section->slots[0].flags = TASK_QUEUE_STATS_OVERFLOW;
+        section->slots[0].dispatchMode = TASK_QUEUE_STATS_MIXED_MODE;
+        section->slots[0].inUse = 1;
+
+        // Readers check the signature last.
+        std::atomic_thread_fence(std::memory_order_release);
+        section->header.signature = TASK_QUEUE_STATS_SIGNATURE;
+
+        return section;
+    }
+
+    StatsSection* GetSection() noexcept
+    {
+        static StatsSection* s_section = CreateSection();
+        return s_section;
+    }
+
+    uint32_t BucketFor(uint64_t durationUs) noexcept
+    {
+        uint32_t bucket = 0;
+
+        while (durationUs != 0 && bucket < TASK_QUEUE_STATS_BUCKETS - 1)
+        {
+            durationUs >>= 1;
+            bucket++;
+        }
+
+        return bucket;
+    }
+
+    void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) noexcept
+    {
+        uint64_t current = max.load(std::memory_order_relaxed);
+
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void Record(
+        std::atomic<uint64_t>& total,
+        std::atomic<uint64_t>& max,
+        std::atomic<uint64_t>* histogram,
+        uint64_t durationNs) noexcept
+    {
+        uint64_t durationUs = durationNs / 1000;
+
+        total.fetch_add(durationUs, std::memory_order_relaxed);
+        histogram[BucketFor(durationUs)].fetch_add(1, std::memory_order_relaxed);
+        UpdateMax(max, durationUs);
+    }
+}
+
+TaskQueuePortStats* TaskQueueStats::Acquire(
+    _In_ const void* port,
+    _In_ uint32_t dispatchMode
+) noexcept {
+    static TaskQueuePortStats s_local = {};
+    StatsSection* section = GetSection();
+
+    if (section == nullptr)
+    {
+        return &s_local;
+    }
+
+    for (uint32_t idx = 1; idx < TASK_QUEUE_STATS_SLOTS; idx++)
+    {
+        TaskQueuePortStats* slot = &section->slots[idx];
+        uint32_t expected = 0;
+
+        if (slot->inUse.load(std::memory_order_relaxed) == 0 &&
+            slot->inUse.compare_exchange_strong(expected, 1))
+        {
+            slot->dispatchMode = dispatchMode;
+            slot->port = reinterpret_cast<uintptr_t>(port);
+            slot->generation++;
+            return slot;
+        }
+    }
+
+    TRACE("Out of stats slots, port %p shares the overflow slot.\n", port);
+    return &section->slots[0];
+}
+
+void TaskQueueStats::SetDispatchMode(
+    _In_ TaskQueuePortStats* stats,
+    _In_ uint32_t dispatchMode
+) noexcept {
+    if (stats->flags & TASK_QUEUE_STATS_OVERFLOW)
+    {
+        return;
+    }
+
+    stats->dispatchMode = dispatchMode;
+}
+
+void TaskQueueStats::Release(
+    _In_ TaskQueuePortStats* stats
+) noexcept {
+    StatsSection* section = GetSection();
+
+    if (section == nullptr || stats < &section->slots[1] || stats >= &section->slots[TASK_QUEUE_STATS_SLOTS])
+    {
+        return;
+    }
+
+    stats->port = 0;
+    stats->queueDepth = 0;
+    stats->pendingDepth = 0;
+    stats->waitCount = 0;
+    stats->enqueued = 0;
+    stats->dispatched = 0;
+    stats->waitRegistrations = 0;
+    stats->latencyTotalUs = 0;
+    stats->latencyMaxUs = 0;
+    stats->executionTotalUs = 0;
+    stats->executionMaxUs = 0;
+
+    for (uint32_t idx = 0; idx < TASK_QUEUE_STATS_BUCKETS; idx++)
+    {
+        stats->latency[idx] = 0;
+        stats->execution[idx] = 0;
+    }
+
+    stats->inUse.store(0, std::memory_order_release);
+}
+
+void TaskQueueStats::RecordLatency(
+    _In_ TaskQueuePortStats* stats,
+    _In_ uint64_t durationNs
+) noexcept {
+    Record(stats->latencyTotalUs, stats->latencyMaxUs, stats->latency, durationNs);
+}
+
+void TaskQueueStats::RecordExecution(
+    _In_ TaskQueuePortStats* stats,
+    _In_ uint64_t durationNs
+) noexcept {
+    Record(stats->executionTotalUs, stats->executionMaxUs, stats->execution, durationNs);
+}
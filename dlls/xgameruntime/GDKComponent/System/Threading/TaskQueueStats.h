@@ -0,0 +1,125 @@
+/*
+ * TaskQueueStats Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __TASKQUEUESTATS_H__
+#define __TASKQUEUESTATS_H__
+
+#include "../../../private.h"
+
+#include <atomic>
+
+/*****************************************************************************
+
+ Every TaskQueuePortImpl owns a slot in a per process shared memory section
+ named "Local\XTaskQueueStats-<pid>" (decimal process id). External tools can
+ open it with OpenFileMapping and read the slots at any time without stopping
+ the process; all fields are updated with relaxed atomic operations so a
+ reader sees counters that are individually, but not mutually, consistent.
+
+ The section starts with a TaskQueueStatsHeader followed by slotCount
+ TaskQueuePortStats. Slot 0 is shared by every port created after the other
+ slots ran out (flags has TASK_QUEUE_STATS_OVERFLOW set); its dispatchMode
+ is always TASK_QUEUE_STATS_MIXED_MODE and its counters are the sum over those
+ ports. A slot whose inUse is zero is free; generation changes every time a
+ slot is handed to a new port, so a reader that sees a different generation
+ between two reads knows the slot was recycled in between.
+
+ Histogram bucket 0 counts durations below 1us, bucket n (n > 0) counts
+ durations in [2^(n-1), 2^n) microseconds, the last bucket everything larger.
+
+ ******************************************************************************/
+
+#define TASK_QUEUE_STATS_SIGNATURE 0x53515458 // XTQS
+#define TASK_QUEUE_STATS_VERSION 1
+#define TASK_QUEUE_STATS_SLOTS 256
+#define TASK_QUEUE_STATS_BUCKETS 32
+
+#define TASK_QUEUE_STATS_OVERFLOW 0x1
+#define TASK_QUEUE_STATS_MIXED_MODE 0xffffffff
+
+struct TaskQueueStatsHeader
+{
+    uint32_t signature;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t bucketCount;
+    uint32_t slotSize;
+    uint32_t processId;
+};
+
+struct TaskQueuePortStats
+{
+    std::atomic<uint32_t> inUse;
+    uint32_t flags;
+    uint32_t dispatchMode;           // XTaskQueueDispatchMode of the port.
+    uint32_t reserved;
+    std::atomic<uint64_t> generation;
+    std::atomic<uint64_t> port;      // Address of the port, for correlating with traces.
+
+    // Current state.
+    std::atomic<int64_t> queueDepth;       // Entries ready to dispatch.
+    std::atomic<int64_t> pendingDepth;     // Delayed callbacks not yet due.
+    std::atomic<int64_t> waitCount;        // Registered wait handles.
+
+    // Totals.
+    std::atomic<uint64_t> enqueued;
+    std::atomic<uint64_t> dispatched;
+    std::atomic<uint64_t> waitRegistrations;
+
+    // Enqueue to dispatch latency. Delayed callbacks are measured from their
+    // due time, wait callbacks from the time the handle was signaled.
+    std::atomic<uint64_t> latencyTotalUs;
+    std::atomic<uint64_t> latencyMaxUs;
+    std::atomic<uint64_t> latency[TASK_QUEUE_STATS_BUCKETS];
+
+    // Time spent inside the callback.
+    std::atomic<uint64_t> executionTotalUs;
+    std::atomic<uint64_t> executionMaxUs;
+    std::atomic<uint64_t> execution[TASK_QUEUE_STATS_BUCKETS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared stats need lock free 64-bit atomics");
+
+class TaskQueueStats
+{
+public:
+    // Returns a slot for a new port. Never fails: if the section could not be
+    // created a process local slot is returned instead.
+    static TaskQueuePortStats* Acquire(
+        _In_ const void* port,
+        _In_ uint32_t dispatchMode) noexcept;
+
+    // Records the dispatch mode of the port owning the slot. The overflow
+    // slot is shared and keeps TASK_QUEUE_STATS_MIXED_MODE.
+    static void SetDispatchMode(
+        _In_ TaskQueuePortStats* stats,
+        _In_ uint32_t dispatchMode) noexcept;
+
+    static void Release(
+        _In_ TaskQueuePortStats* stats) noexcept;
+
+    static void RecordLatency(
+        _In_ TaskQueuePortStats* stats,
+        _In_ uint64_t durationNs) noexcept;
+
+    static void RecordExecution(
+        _In_ TaskQueuePortStats* stats,
+        _In_ uint64_t durationNs) noexcept;
+};
+
+#endif
@@ -18,11 +18,17 @@
  */
 
 #include "ThreadPool.h"
-//FIXME: CallbackMayRunLong is implemented in code, but not in headers!
-#include <winternl.h>
+#include "WorkScheduler.h"
 
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// Number of times an idle batch drainer polls for new submissions before
+// handing its worker back to the scheduler.
+#define THREADPOOL_DRAIN_SPIN 64
 
 WINE_DEFAULT_DEBUG_CHANNEL(gdkc);
 
@@ -74,66 +80,228 @@ namespace OS
 
         HRESULT Initialize(
             _In_opt_ void* context,
-            _In_ ThreadPoolCallback* callback) noexcept
+            _In_ ThreadPoolCallback* callback,
+            _In_ uint32_t batchConcurrency) noexcept
         {
             m_context = context;
             m_callback = callback;
-            m_work = CreateThreadpoolWork(TPCallback, this, nullptr);
-            RETURN_LAST_ERROR_IF_NULL(m_work);
+            m_scheduler = WorkScheduler::Get();
+            RETURN_IF_NULL_ALLOC(m_scheduler);
+
+            m_maxDrainers = std::min(batchConcurrency, m_scheduler->WorkerCount());
 
             return S_OK;
         }
 
+        // Waits for every submitted callback to either finish or call
+        // Complete. Like WaitForThreadpoolWorkCallbacks(work, FALSE) this
+        // does not cancel callbacks that have not started yet.
         void Terminate() noexcept
         {
-            if (m_work != nullptr)
-            {
-                WaitForThreadpoolWorkCallbacks(m_work, FALSE);
-                CloseThreadpoolWork(m_work);
-                m_work = nullptr;
-            }
+            std::unique_lock<std::mutex> lock(m_outstandingLock);
+            m_outstandingCv.wait(lock, [this] { return m_outstanding.load() == 0; });
         }
 
         void Submit() noexcept
         {
-            if (!RtlDllShutdownInProgress())
+            if (RtlDllShutdownInProgress())
             {
-                SubmitThreadpoolWork(m_work);
+                return;
+            }
+
+            if (m_maxDrainers != 0)
+            {
+                m_outstanding++;
+                m_pending++;
+
+                if (TryAcquireDrainer() && !PostDrainer())
+                {
+                    // No drainer may be left to run this submission, so drop
+                    // it like the unbatched path does instead of leaving it
+                    // counted for Terminate to wait on.
+                    if (TryTakePendingOnce())
+                    {
+                        CallbackComplete();
+                    }
+                }
+            }
+            else
+            {
+                WorkItem item = { SchedulerCallback, this };
+
+                AddRef();
+                m_outstanding++;
+
+                if (!m_scheduler->Submit(item))
+                {
+                    ERR("Failed to queue thread pool work.\n");
+                    CallbackComplete();
+                    Release();
+                }
             }
         }
 
     private:
 
-        static void CALLBACK TPCallback(
-            _In_ PTP_CALLBACK_INSTANCE instance,
-            _In_ void* context, PTP_WORK) noexcept
+        static void SchedulerCallback(
+            _In_opt_ void* context) noexcept
+        {
+            ThreadPoolImpl* pthis = static_cast<ThreadPoolImpl*>(context);
+            pthis->InvokeCallback(false);
+            pthis->Release(); // May delete this
+        }
+
+        // Batched mode: a drainer keeps invoking the callback for as long as
+        // submissions are pending, so a burst of Submit calls costs a single
+        // scheduler wake-up instead of one per call.
+        static void BatchCallback(
+            _In_opt_ void* context) noexcept
         {
             ThreadPoolImpl* pthis = static_cast<ThreadPoolImpl*>(context);
-            ActionStatusImpl status(pthis, instance);
-            pthis->AddRef();
-            pthis->m_callback(pthis->m_context, status);
+            bool draining;
+
+            do
+            {
+                draining = true;
+
+                while (draining && pthis->TryTakePending())
+                {
+                    draining = pthis->InvokeCallback(true);
+                }
+
+                if (draining)
+                {
+                    pthis->m_drainers--;
+                }
+
+                // A Submit racing with the decrement above may have seen no
+                // free drainer slot, so check again before leaving.
+            } while (pthis->m_pending.load() != 0 && pthis->TryAcquireDrainer());
+
+            pthis->Release(); // May delete this
+        }
+
+        // Returns false if the callback ran on a drainer and handed its
+        // drainer slot back.
+        bool InvokeCallback(
+            _In_ bool drainer) noexcept
+        {
+            ActionStatusImpl status(this, drainer);
+            m_callback(m_context, status);
 
             if (!status.IsComplete)
             {
                 status.Complete();
             }
-            pthis->Release(); // May delete this
+
+            return !status.HandedBack;
+        }
+
+        // A drainer whose callback may block gives up its slot, so that the
+        // submissions still pending are drained by another worker (such as
+        // the spare the scheduler starts for it) instead of waiting for the
+        // callback to return.
+        void HandBackDrainer() noexcept
+        {
+            m_drainers--;
+
+            if (m_pending.load() != 0 && TryAcquireDrainer())
+            {
+                // If no new drainer could be queued the pending submissions
+                // are picked up again once the blocking callback returns.
+                PostDrainer();
+            }
+        }
+
+        // Claims one pending submission, spinning briefly before giving up
+        // so that a burst which arrives while draining is picked up by this
+        // worker instead of waking another one.
+        bool TryTakePending() noexcept
+        {
+            for (uint32_t spin = 0; spin < THREADPOOL_DRAIN_SPIN; spin++)
+            {
+                if (TryTakePendingOnce())
+                {
+                    return true;
+                }
+
+                YieldProcessor();
+            }
+
+            return false;
+        }
+
+        bool TryTakePendingOnce() noexcept
+        {
+            uint32_t pending = m_pending.load();
+
+            while (pending != 0)
+            {
+                if (m_pending.compare_exchange_weak(pending, pending - 1))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool TryAcquireDrainer() noexcept
+        {
+            uint32_t drainers = m_drainers.load();
+
+            while (drainers < m_maxDrainers && drainers < m_pending.load())
+            {
+                if (m_drainers.compare_exchange_weak(drainers, drainers + 1))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool PostDrainer() noexcept
+        {
+            WorkItem item = { BatchCallback, this };
+
+            AddRef();
+
+            if (!m_scheduler->Submit(item))
+            {
+                ERR("Failed to queue thread pool work.\n");
+                m_drainers--;
+                Release();
+                return false;
+            }
+
+            return true;
+        }
+
+        void CallbackComplete() noexcept
+        {
+            if (--m_outstanding == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_outstandingLock);
+                m_outstandingCv.notify_all();
+            }
         }
 
         struct ActionStatusImpl : ThreadPoolActionStatus
         {
-            ActionStatusImpl(ThreadPoolImpl* owner, PTP_CALLBACK_INSTANCE instance) :
+            ActionStatusImpl(ThreadPoolImpl* owner, bool drainer) :
                 m_owner(owner),
-                m_instance(instance)
+                m_drainer(drainer)
             {
             }
 
             bool IsComplete = false;
+            bool HandedBack = false;
 
             void Complete() override
             {
                 IsComplete = true;
-                DisassociateCurrentThreadFromCallback(m_instance);
+                m_owner->CallbackComplete();
             }
 
             void MayRunLong() override
@@ -141,19 +309,30 @@ namespace OS
                 if (!m_longRunning)
                 {
                     m_longRunning = true;
-                    //FIXME: CallbackMayRunLong is implemented in code, but not in headers!
-                    TpCallbackMayRunLong(m_instance);
+                    m_owner->m_scheduler->MayRunLong();
+
+                    if (m_drainer)
+                    {
+                        HandedBack = true;
+                        m_owner->HandBackDrainer();
+                    }
                 }
             }
 
         private:
             ThreadPoolImpl* m_owner = nullptr;
-            PTP_CALLBACK_INSTANCE m_instance = nullptr;
+            bool m_drainer = false;
             bool m_longRunning = false;
         };
 
         std::atomic<uint32_t> m_refs{ 1 };
-        PTP_WORK m_work = nullptr;
+        std::atomic<uint32_t> m_outstanding{ 0 };
+        std::atomic<uint32_t> m_pending{ 0 };
+        std::atomic<uint32_t> m_drainers{ 0 };
+        uint32_t m_maxDrainers = 0;
+        std::mutex m_outstandingLock;
+        std::condition_variable m_outstandingCv;
+        WorkScheduler* m_scheduler = nullptr;
         void* m_context = nullptr;
         ThreadPoolCallback* m_callback = nullptr;
     };
@@ -168,14 +347,14 @@ namespace OS
         Terminate();
     }
 
-    HRESULT ThreadPool::Initialize(_In_opt_ void* context, _In_ ThreadPoolCallback* callback) noexcept
+    HRESULT ThreadPool::Initialize(_In_opt_ void* context, _In_ ThreadPoolCallback* callback, _In_ uint32_t batchConcurrency) noexcept
     {
         RETURN_HR_IF(E_UNEXPECTED, m_impl != nullptr);
 
         std::unique_ptr<ThreadPoolImpl> impl(new (std::nothrow) ThreadPoolImpl);
         RETURN_IF_NULL_ALLOC(impl);
 
-        RETURN_IF_FAILED(impl->Initialize(context, callback));
+        RETURN_IF_FAILED(impl->Initialize(context, callback, batchConcurrency));
 
         m_impl = impl.release();
         return S_OK;
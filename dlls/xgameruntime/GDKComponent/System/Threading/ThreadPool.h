@@ -34,15 +34,21 @@ namespace OS
 
     class ThreadPoolImpl;
 
-    // A thread pool will invoke its callback on a pool of threads.
+    // A thread pool will invoke its callback on a pool of threads. All thread
+    // pools share the process wide WorkScheduler.
     class ThreadPool
     {
     public:
         ThreadPool() noexcept;
         ~ThreadPool() noexcept;
 
-        // Initializes the thread pool.
-        HRESULT Initialize(_In_opt_ void* context, _In_ ThreadPoolCallback* callback) noexcept;
+        // Initializes the thread pool. With a batchConcurrency of zero every
+        // Submit queues its own scheduler work item. Otherwise submissions are
+        // coalesced: at most batchConcurrency workers (capped to the scheduler
+        // worker count) drain them, each invoking the callback once per Submit
+        // for as long as submissions keep arriving. A callback that calls
+        // MayRunLong hands its drainer slot over to another worker.
+        HRESULT Initialize(_In_opt_ void* context, _In_ ThreadPoolCallback* callback, _In_ uint32_t batchConcurrency = 0) noexcept;
 
         // Terminates the thread pool, waiting for any outstanding calls to drain
         // and and canceling any pending calls.
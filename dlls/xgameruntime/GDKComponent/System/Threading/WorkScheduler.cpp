@@ -0,0 +1,503 @@
+/*
+ * WorkScheduler Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include "WorkScheduler.h"
+#include "SpinLock.h"
+
+#include <chrono>
+
+WINE_DEFAULT_DEBUG_CHANNEL(gdkc);
+
+namespace OS
+{
+    // The worker owned by the calling thread, if it is a core worker.
+    static thread_local void* t_currentWorker = nullptr;
+
+    // The scheduler whose work item the calling thread is running, and
+    // whether that item has declared it may run long.
+    static thread_local void* t_currentScheduler = nullptr;
+    static thread_local bool t_blocked = false;
+
+    static std::mutex s_schedulerLock;
+    static std::atomic<WorkScheduler*> s_scheduler{ nullptr };
+
+    WorkScheduler* WorkScheduler::Get() noexcept
+    {
+        WorkScheduler* scheduler = s_scheduler.load(std::memory_order_acquire);
+
+        if (scheduler != nullptr)
+        {
+            return scheduler;
+        }
+
+        std::lock_guard<std::mutex> lock(s_schedulerLock);
+
+        if ((scheduler = s_scheduler.load(std::memory_order_relaxed)) == nullptr)
+        {
+            scheduler = new (std::nothrow) WorkScheduler;
+            if (scheduler != nullptr && FAILED(scheduler->Initialize()))
+            {
+                Shutdown(scheduler);
+                scheduler = nullptr;
+            }
+            s_scheduler.store(scheduler, std::memory_order_release);
+        }
+
+        return scheduler;
+    }
+
+    void WorkScheduler::Shutdown() noexcept
+    {
+        std::lock_guard<std::mutex> lock(s_schedulerLock);
+        WorkScheduler* scheduler = s_scheduler.exchange(nullptr);
+
+        if (scheduler != nullptr)
+        {
+            Shutdown(scheduler);
+        }
+    }
+
+    void WorkScheduler::Shutdown(
+        _In_ WorkScheduler* scheduler
+    ) noexcept {
+        HANDLE thread;
+
+        {
+            std::lock_guard<std::mutex> lock(scheduler->m_idleLock);
+            scheduler->m_exiting = true;
+            scheduler->m_idleCv.notify_all();
+        }
+
+        // Work drained on the way out may still start spares. Those are
+        // started by a thread that is itself in the list, so the list can
+        // only be empty once every thread has been joined.
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(scheduler->m_threadLock);
+                if (scheduler->m_threadHandles.empty())
+                {
+                    break;
+                }
+                thread = scheduler->m_threadHandles.back();
+                scheduler->m_threadHandles.pop_back();
+            }
+
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+
+        TRACE("Stopped scheduler %p.\n", scheduler);
+        delete scheduler;
+    }
+
+    WorkScheduler::WorkScheduler() noexcept
+    {
+    }
+
+    WorkScheduler::~WorkScheduler() noexcept
+    {
+    }
+
+    HRESULT WorkScheduler::Initialize() noexcept
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+
+        m_coreCount = std::min<uint32_t>(std::max<uint32_t>(info.dwNumberOfProcessors, 2), SCHEDULER_WORKER_MAX);
+
+        if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            reinterpret_cast<LPCWSTR>(CoreThreadProc), &m_module))
+        {
+            RETURN_LAST_ERROR();
+        }
+
+        RETURN_IF_FAILED(m_injection.init(SCHEDULER_INJECTION_SIZE));
+
+        m_overflow.reset(new (std::nothrow) LocklessQueue<WorkItem>);
+        RETURN_IF_NULL_ALLOC(m_overflow);
+
+        m_workers.reset(new (std::nothrow) Worker[m_coreCount]);
+        RETURN_IF_NULL_ALLOC(m_workers);
+
+        for (uint32_t idx = 0; idx < m_coreCount; idx++)
+        {
+            Worker& worker = m_workers[idx];
+            worker.Owner = this;
+            worker.Index = idx;
+            worker.Lock.clear();
+            worker.Head = 0;
+            worker.Tail = 0;
+        }
+
+        // If the first worker can't be started nothing references us yet and
+        // the caller may shut the scheduler down. A later failure just leaves
+        // a deque that is never pushed to.
+        RETURN_IF_FAILED(StartThread(&m_workers[0]));
+
+        for (uint32_t idx = 1; idx < m_coreCount; idx++)
+        {
+            LOG_IF_FAILED(StartThread(&m_workers[idx]));
+        }
+
+        TRACE("Started %u scheduler workers.\n", m_coreCount);
+        return S_OK;
+    }
+
+    HRESULT WorkScheduler::StartThread(
+        _In_opt_ Worker* worker
+    ) noexcept {
+        std::lock_guard<std::mutex> lock(m_threadLock);
+        HMODULE module;
+        HANDLE thread;
+
+        // Spares that have since exited only need their handle closed.
+        for (size_t idx = m_threadHandles.size(); idx-- > 0;)
+        {
+            if (WaitForSingleObject(m_threadHandles[idx], 0) == WAIT_OBJECT_0)
+            {
+                CloseHandle(m_threadHandles[idx]);
+                m_threadHandles[idx] = m_threadHandles.back();
+                m_threadHandles.pop_back();
+            }
+        }
+
+        try
+        {
+            m_threadHandles.reserve(m_threadHandles.size() + 1);
+        }
+        catch (...)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        // Each thread keeps the DLL loaded until it exits, so that freeing
+        // the library can't unmap code a worker is still running.
+        if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,
+            reinterpret_cast<LPCWSTR>(CoreThreadProc), &module))
+        {
+            RETURN_LAST_ERROR();
+        }
+
+        // Counted before the thread exists so that it is never seen as
+        // blocked on more workers than are running.
+        m_threads++;
+
+        if (worker != nullptr)
+        {
+            thread = CreateThread(nullptr, 0, CoreThreadProc, worker, 0, nullptr);
+        }
+        else
+        {
+            thread = CreateThread(nullptr, 0, SpareThreadProc, this, 0, nullptr);
+        }
+
+        if (thread == nullptr)
+        {
+            m_threads--;
+            FreeLibrary(module);
+            RETURN_LAST_ERROR();
+        }
+
+        m_threadHandles.push_back(thread);
+
+        return S_OK;
+    }
+
+    bool WorkScheduler::Submit(
+        _In_ const WorkItem& item
+    ) noexcept {
+        Worker* worker = static_cast<Worker*>(t_currentWorker);
+
+        if (worker == nullptr || worker->Owner != this || !PushLocal(worker, item))
+        {
+            // Once something has overflowed keep using the overflow queue
+            // until it drains, so items already there aren't starved by a
+            // ring that keeps getting refilled.
+            if (m_overflowCount.load(std::memory_order_acquire) != 0 || !m_injection.push_back(item))
+            {
+                m_overflowCount++;
+
+                if (!m_overflow->push_back(item))
+                {
+                    m_overflowCount--;
+                    return false;
+                }
+            }
+        }
+
+        m_queued++;
+        WakeWorker();
+        StartSpareIfStarved();
+
+        return true;
+    }
+
+    void WorkScheduler::MayRunLong() noexcept
+    {
+        if (t_currentScheduler != this || t_blocked)
+        {
+            return;
+        }
+
+        // Counted even if nothing is queued yet: the work this item ends up
+        // waiting on may only be submitted later, and Submit needs to know
+        // then that this worker won't pick it up.
+        t_blocked = true;
+        m_blocked++;
+
+        StartSpareIfStarved();
+    }
+
+    void WorkScheduler::StartSpareIfStarved() noexcept
+    {
+        // Both sides of a race between Submit and MayRunLong update their
+        // counter before reading the other one, so at least one of them
+        // sees the starved state.
+        if (m_queued.load() == 0 || m_idle.load() != 0 || m_searching.load() != 0 ||
+            m_blocked.load() < m_threads.load())
+        {
+            return;
+        }
+
+        uint32_t spares = m_spares.load();
+        while (spares < SCHEDULER_SPARE_MAX)
+        {
+            if (m_spares.compare_exchange_weak(spares, spares + 1))
+            {
+                if (FAILED(StartThread(nullptr)))
+                {
+                    m_spares--;
+                }
+                break;
+            }
+        }
+    }
+
+    bool WorkScheduler::PushLocal(
+        _In_ Worker* worker,
+        _In_ const WorkItem& item
+    ) noexcept {
+        SpinLock lock(worker->Lock);
+
+        uint32_t tail = worker->Tail.load(std::memory_order_relaxed);
+        if (tail - worker->Head.load(std::memory_order_relaxed) == SCHEDULER_DEQUE_SIZE)
+        {
+            return false;
+        }
+
+        worker->Items[tail % SCHEDULER_DEQUE_SIZE] = item;
+        worker->Tail.store(tail + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    bool WorkScheduler::PopLocal(
+        _In_ Worker* worker,
+        _Out_ WorkItem& item
+    ) noexcept {
+        if (worker->Tail.load(std::memory_order_relaxed) == worker->Head.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        SpinLock lock(worker->Lock);
+
+        uint32_t tail = worker->Tail.load(std::memory_order_relaxed);
+        if (tail == worker->Head.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        tail--;
+        item = worker->Items[tail % SCHEDULER_DEQUE_SIZE];
+        worker->Tail.store(tail, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    bool WorkScheduler::Steal(
+        _In_opt_ Worker* thief,
+        _Out_ WorkItem& item
+    ) noexcept {
+        uint32_t start = m_nextVictim++;
+
+        for (uint32_t idx = 0; idx < m_coreCount; idx++)
+        {
+            Worker* victim = &m_workers[(start + idx) % m_coreCount];
+
+            if (victim == thief ||
+                victim->Tail.load(std::memory_order_relaxed) == victim->Head.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            SpinLock lock(victim->Lock);
+
+            uint32_t head = victim->Head.load(std::memory_order_relaxed);
+            if (head != victim->Tail.load(std::memory_order_relaxed))
+            {
+                item = victim->Items[head % SCHEDULER_DEQUE_SIZE];
+                victim->Head.store(head + 1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool WorkScheduler::FindWork(
+        _In_opt_ Worker* worker,
+        _Out_ WorkItem& item
+    ) noexcept {
+        if ((worker != nullptr && PopLocal(worker, item)) ||
+            m_injection.pop_front(item) ||
+            PopOverflow(item) ||
+            Steal(worker, item))
+        {
+            m_queued--;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool WorkScheduler::PopOverflow(
+        _Out_ WorkItem& item
+    ) noexcept {
+        if (m_overflowCount.load(std::memory_order_acquire) == 0 || !m_overflow->pop_front(item))
+        {
+            return false;
+        }
+
+        m_overflowCount--;
+        return true;
+    }
+
+    void WorkScheduler::WakeWorker() noexcept
+    {
+        // A searching worker will pick the item up (and wake another worker
+        // if more remain) so only go to the kernel if nobody is looking.
+        if (m_searching.load() == 0 && m_idle.load() != 0)
+        {
+            std::lock_guard<std::mutex> lock(m_idleLock);
+            m_idleCv.notify_one();
+        }
+    }
+
+    bool WorkScheduler::WaitForWork(
+        _In_ bool spare
+    ) noexcept {
+        std::unique_lock<std::mutex> lock(m_idleLock);
+
+        m_idle++;
+        m_searching--;
+
+        while (m_queued.load() == 0)
+        {
+            if (m_exiting)
+            {
+                m_idle--;
+                return false;
+            }
+
+            if (!spare)
+            {
+                m_idleCv.wait(lock);
+            }
+            else if (m_idleCv.wait_for(lock, std::chrono::milliseconds(SCHEDULER_SPARE_IDLE_MS)) == std::cv_status::timeout &&
+                m_queued.load() == 0)
+            {
+                m_idle--;
+                return false;
+            }
+        }
+
+        m_idle--;
+        m_searching++;
+
+        return true;
+    }
+
+    void WorkScheduler::Run(
+        _In_opt_ Worker* worker
+    ) noexcept {
+        WorkItem item;
+
+        m_searching++;
+
+        for (;;)
+        {
+            while (FindWork(worker, item))
+            {
+                // Hand the searching role to another worker if there is
+                // still work left for it to pick up.
+                if (--m_searching == 0 && m_queued.load() != 0)
+                {
+                    WakeWorker();
+                }
+
+                t_currentScheduler = this;
+                item.Callback(item.Context);
+                t_currentScheduler = nullptr;
+
+                if (t_blocked)
+                {
+                    t_blocked = false;
+                    m_blocked--;
+                }
+
+                m_searching++;
+            }
+
+            if (!WaitForWork(worker == nullptr))
+            {
+                return;
+            }
+        }
+    }
+
+    DWORD WINAPI WorkScheduler::CoreThreadProc(
+        _In_ void* context
+    ) noexcept {
+        Worker* worker = static_cast<Worker*>(context);
+        HMODULE module = worker->Owner->m_module;
+
+        t_currentWorker = worker;
+        worker->Owner->Run(worker);
+
+        FreeLibraryAndExitThread(module, 0);
+    }
+
+    DWORD WINAPI WorkScheduler::SpareThreadProc(
+        _In_ void* context
+    ) noexcept {
+        WorkScheduler* pthis = static_cast<WorkScheduler*>(context);
+        HMODULE module = pthis->m_module;
+
+        pthis->Run(nullptr);
+        pthis->m_threads--;
+        pthis->m_spares--;
+
+        // Work submitted while this spare was on its way out may have
+        // counted on it.
+        pthis->StartSpareIfStarved();
+
+        FreeLibraryAndExitThread(module, 0);
+    }
+} // Namespace
@@ -0,0 +1,152 @@
+/*
+ * WorkScheduler Implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WORKSCHEDULER_H__
+#define __WORKSCHEDULER_H__
+
+#include "../../../private.h"
+#include "BoundedQueue.h"
+#include "LocklessQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// Number of items a single worker can hold locally before new submissions
+// from that worker spill into the shared injection queue.
+#define SCHEDULER_DEQUE_SIZE 256
+
+// Hard cap on the number of core workers, regardless of processor count.
+#define SCHEDULER_WORKER_MAX 64
+
+// Number of spare threads that may be spawned on top of the core workers
+// when callbacks declare they may run long.
+#define SCHEDULER_SPARE_MAX 32
+
+// How long a spare worker stays around without finding work.
+#define SCHEDULER_SPARE_IDLE_MS 10000
+
+// Capacity of the preallocated injection ring. Submissions from non worker
+// threads overflow into a heap backed queue once the ring is full.
+#define SCHEDULER_INJECTION_SIZE 4096
+
+namespace OS
+{
+    using WorkCallback = void(_In_opt_ void*);
+
+    struct WorkItem
+    {
+        WorkCallback* Callback;
+        void* Context;
+    };
+
+    //
+    // WorkScheduler: a process wide, work stealing scheduler used by
+    // OS::ThreadPool. One core worker is created per logical processor.
+    // Each core worker owns a bounded deque: work submitted from a worker
+    // thread is pushed onto that worker's deque and popped LIFO, while idle
+    // workers steal FIFO from their peers. Work submitted from any other
+    // thread goes through a shared injection ring. Sleeping workers are
+    // only woken when there is no worker already looking for work.
+    //
+    class WorkScheduler
+    {
+    public:
+        // Returns the process scheduler, creating it on first use. Returns
+        // nullptr if the scheduler could not be created.
+        static WorkScheduler* Get() noexcept;
+
+        // Stops the process scheduler if it was created. The workers finish
+        // the work already queued, then exit and are joined. Every pool using
+        // the scheduler must have been terminated; a later Get() creates a
+        // new one.
+        static void Shutdown() noexcept;
+
+        // Queues a work item. Returns false if the item could not be queued.
+        bool Submit(_In_ const WorkItem& item) noexcept;
+
+        // Called from a running work item that may block for a long time.
+        // The calling worker counts as blocked until the item returns, and a
+        // spare worker is spawned whenever queued work would otherwise have
+        // no worker left to run it.
+        void MayRunLong() noexcept;
+
+        uint32_t WorkerCount() const noexcept { return m_coreCount; }
+
+    private:
+
+        struct alignas(64) Worker
+        {
+            WorkScheduler* Owner;
+            uint32_t Index;
+            std::atomic_flag Lock;
+            std::atomic<uint32_t> Head;
+            std::atomic<uint32_t> Tail;
+            WorkItem Items[SCHEDULER_DEQUE_SIZE];
+        };
+
+        WorkScheduler() noexcept;
+        ~WorkScheduler() noexcept;
+
+        static void Shutdown(_In_ WorkScheduler* scheduler) noexcept;
+
+        HRESULT Initialize() noexcept;
+        HRESULT StartThread(_In_opt_ Worker* worker) noexcept;
+
+        bool PushLocal(_In_ Worker* worker, _In_ const WorkItem& item) noexcept;
+        bool PopLocal(_In_ Worker* worker, _Out_ WorkItem& item) noexcept;
+        bool Steal(_In_opt_ Worker* thief, _Out_ WorkItem& item) noexcept;
+        bool PopOverflow(_Out_ WorkItem& item) noexcept;
+        bool FindWork(_In_opt_ Worker* worker, _Out_ WorkItem& item) noexcept;
+
+        void WakeWorker() noexcept;
+        void StartSpareIfStarved() noexcept;
+        bool WaitForWork(_In_ bool spare) noexcept;
+        void Run(_In_opt_ Worker* worker) noexcept;
+
+        static DWORD WINAPI CoreThreadProc(_In_ void* context) noexcept;
+        static DWORD WINAPI SpareThreadProc(_In_ void* context) noexcept;
+
+        HMODULE m_module = nullptr;
+        uint32_t m_coreCount = 0;
+        std::unique_ptr<Worker[]> m_workers;
+        BoundedQueue<WorkItem> m_injection;
+        std::unique_ptr<LocklessQueue<WorkItem>> m_overflow;
+        std::atomic<uint32_t> m_overflowCount{ 0 };
+
+        alignas(64) std::atomic<uint32_t> m_queued{ 0 };
+        alignas(64) std::atomic<uint32_t> m_searching{ 0 };
+        std::atomic<uint32_t> m_spares{ 0 };
+        std::atomic<uint32_t> m_threads{ 0 };
+        std::atomic<uint32_t> m_blocked{ 0 };
+        std::atomic<uint32_t> m_idle{ 0 };
+        std::atomic<uint32_t> m_nextVictim{ 0 };
+
+        std::mutex m_idleLock;
+        std::condition_variable m_idleCv;
+        bool m_exiting = false;
+
+        // Handles of the worker threads, for Shutdown to join.
+        std::mutex m_threadLock;
+        std::vector<HANDLE> m_threadHandles;
+    };
+}
+
+#endif
@@ -20,6 +20,7 @@
 #include "../../../private.h"
 #include "SpinLock.h"
 #include "XTaskQueue.h"
+#include "AsyncStatePool.h"
 
 #include <atomic>
 #include <condition_variable>
@@ -58,19 +59,19 @@ struct AsyncState
     std::mutex waitMutex;
     std::condition_variable waitCondition;
     bool waitSatisfied = false;
-    HANDLE waitEvent = nullptr;
+    HANDLE waitEvent = nullptr; // Only created for pumping waits, under waitMutex.
 
     const void* identity = nullptr;
     const char* identityName = nullptr;
 
     void* operator new(size_t size, size_t additional, const std::nothrow_t& tag)
     {
-        return ::operator new(size + additional, tag);
+        return AsyncStatePool::Alloc(size + additional, tag);
     }
 
     void operator delete(void* ptr)
     {
-        ::operator delete(ptr);
+        AsyncStatePool::Free(ptr);
     }
 
     AsyncState() noexcept
@@ -384,9 +385,6 @@ static HRESULT AllocStateNoCompletion(XAsyncBlock* asyncBlock, AsyncBlockInterna
     state->userAsyncBlock = asyncBlock;
     state->providerData.async = &state->providerAsyncBlock;
 
-    state->waitEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
-    RETURN_LAST_ERROR_IF(state->waitEvent == nullptr);
-
     RETURN_IF_FAILED(XTaskQueueSuspendTermination(state->queue));
 
     internal->state = state.Detach();
@@ -484,13 +482,19 @@ static HRESULT SignalCompletion(AsyncStateRef const& state)
 static void SignalWait(AsyncStateRef const& state)
 {
     bool newlySatisfied;
+    HANDLE waitEvent;
     {
         std::lock_guard<std::mutex> lock(state->waitMutex);
         newlySatisfied = !state->waitSatisfied;
         state->waitSatisfied = true;
         state->waitCondition.notify_all();
+        waitEvent = state->waitEvent;
+    }
+
+    if (waitEvent != nullptr)
+    {
+        SetEvent(waitEvent);
     }
-    SetEvent(state->waitEvent);
 
     assert(newlySatisfied);
     if (newlySatisfied)
@@ -590,8 +594,25 @@ HRESULT WINAPI XAsyncGetStatus(
                 APTTYPEQUALIFIER aptQualifier;
                 if (SUCCEEDED(CoGetApartmentType(&aptType, &aptQualifier)) && aptType != APTTYPE_MTA && aptType != APTTYPE_NA)
                 {
-                    DWORD idx;
-                    CoWaitForMultipleHandles(COWAIT_DEFAULT, INFINITE, 1, &state->waitEvent, &idx);
+                    HANDLE waitEvent = nullptr;
+                    {
+                        std::lock_guard<std::mutex> lock(state->waitMutex);
+
+                        if (!state->waitSatisfied)
+                        {
+                            if (state->waitEvent == nullptr)
+                            {
+                                state->waitEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+                            }
+                            waitEvent = state->waitEvent;
+                        }
+                    }
+
+                    if (waitEvent != nullptr)
+                    {
+                        DWORD idx;
+                        CoWaitForMultipleHandles(COWAIT_DEFAULT, INFINITE, 1, &waitEvent, &idx);
+                    }
                 }
             }
             {
@@ -60,16 +60,23 @@ HRESULT QueueWaitRegistry::Register(
     const XTaskQueueRegistrationToken& portToken,
     XTaskQueueRegistrationToken* token
 ) {
-    RETURN_HR_IF(E_OUTOFMEMORY, m_callbacks.capacity() == 0);
-
     std::lock_guard<std::mutex> lock(m_lock);
 
     WaitRegistration reg = { };
     reg.Port = port;
     reg.Token = ++m_nextToken;
     reg.PortToken = portToken.token;
+
+    try
+    {
+        m_callbacks.emplace(reg.Token, reg);
+    }
+    catch (...)
+    {
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
     token->token = reg.Token;
-    m_callbacks.append(reg);
 
     return S_OK;
 }
@@ -83,15 +90,12 @@ std::pair<XTaskQueuePort, XTaskQueueRegistrationToken> QueueWaitRegistry::Unregi
 
     std::lock_guard<std::mutex> lock(m_lock);
 
-    for(uint32_t idx = 0; idx < m_callbacks.count(); idx++)
+    auto it = m_callbacks.find(token.token);
+    if (it != m_callbacks.end())
     {
-        if (m_callbacks[idx].Token == token.token)
-        {
-            port = m_callbacks[idx].Port;
-            portToken.token = m_callbacks[idx].PortToken;
-            m_callbacks.removeAt(idx);
-            break;
-        }
+        port = it->second.Port;
+        portToken.token = it->second.PortToken;
+        m_callbacks.erase(it);
     }
 
     return std::pair<XTaskQueuePort, XTaskQueueRegistrationToken>(port, portToken);
@@ -107,47 +111,47 @@ TaskQueuePortImpl::TaskQueuePortImpl()
     m_header.m_runtimeIteration = 0;
     m_header.m_port = this;
     m_header.m_queue = nullptr;
+    m_stats = TaskQueueStats::Acquire(this, static_cast<uint32_t>(m_dispatchMode));
 }
 
 TaskQueuePortImpl::~TaskQueuePortImpl()
 {
     m_timer.Terminate();
 
-    EraseQueue(m_queueList.get());
-    EraseQueue(m_pendingList.get());
+    EraseQueue();
+    ErasePendingEntries();
 
-    StaticArray<WaitRegistration*, PORT_WAIT_MAX> waits;
+    std::unordered_map<uint64_t, WaitRegistration*> waits;
 
     {
         std::lock_guard<std::mutex> lock(m_lock);
-        waits = m_waits;
-        m_waits.clear();
+        waits.swap(m_waits);
     }
 
-    if (waits.count() != 0)
+    for (auto& wait : waits)
     {
-        for (uint32_t idx = 0; idx < waits.count(); idx++)
-        {
-            if (waits[idx]->threadpoolWait != nullptr)
-            {
-                SetThreadpoolWait(waits[idx]->threadpoolWait, nullptr, nullptr);
-                WaitForThreadpoolWaitCallbacks(waits[idx]->threadpoolWait, TRUE);
-                CloseThreadpoolWait(waits[idx]->threadpoolWait);
-            }
+        m_stats->waitCount.fetch_sub(1, std::memory_order_relaxed);
 
-            delete waits[idx];
+        if (wait.second->threadpoolWait != nullptr)
+        {
+            SetThreadpoolWait(wait.second->threadpoolWait, nullptr, nullptr);
+            WaitForThreadpoolWaitCallbacks(wait.second->threadpoolWait, TRUE);
+            CloseThreadpoolWait(wait.second->threadpoolWait);
         }
+
+        delete wait.second;
     }
 
     m_threadPool.Terminate();
 
-    if (m_events.count() != 0)
+    if (m_queueEvent != nullptr)
     {
-        CloseHandle(m_events[0]);
+        CloseHandle(m_queueEvent);
     }
-    
-    m_pendingList.reset();
+
     m_queueList.reset();
+
+    TaskQueueStats::Release(m_stats);
 }
 
 HRESULT WINAPI
@@ -202,13 +206,11 @@ HRESULT TaskQueuePortImpl::Initialize(
    XTaskQueueDispatchMode mode
 ) {
     m_dispatchMode = mode;
+    TaskQueueStats::SetDispatchMode(m_stats, static_cast<uint32_t>(mode));
 
     m_queueList.reset(new (std::nothrow) LocklessQueue<QueueEntry>);
     RETURN_IF_NULL_ALLOC(m_queueList);
 
-    m_pendingList.reset(new (std::nothrow) LocklessQueue<QueueEntry>(*m_queueList.get()));
-    RETURN_IF_NULL_ALLOC(m_pendingList);
-
     m_terminationList.reset(new (std::nothrow) LocklessQueue<TerminationEntry*>(0));
     RETURN_IF_NULL_ALLOC(m_terminationList);
 
@@ -221,9 +223,8 @@ HRESULT TaskQueuePortImpl::Initialize(
         pthis->SubmitPendingCallbacks();
     }));
 
-    HANDLE evt = CreateEventA(nullptr, FALSE, FALSE, nullptr);
-    RETURN_LAST_ERROR_IF_NULL(evt);
-    m_events.append(evt);
+    m_queueEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    RETURN_LAST_ERROR_IF_NULL(m_queueEvent);
 
     switch (mode)
     {
@@ -233,11 +234,13 @@ HRESULT TaskQueuePortImpl::Initialize(
 
     case XTaskQueueDispatchMode::ThreadPool:
     case XTaskQueueDispatchMode::SerializedThreadPool:
+        // Serialized ports only ever drain on one thread at a time, so a
+        // single batch drainer is enough for them.
         RETURN_IF_FAILED(m_threadPool.Initialize(this, [](void* context, OS::ThreadPoolActionStatus& status)
         {
             TaskQueuePortImpl* pthis = static_cast<TaskQueuePortImpl*>(context);
             pthis->ProcessThreadPoolCallback(status);
-        }));
+        }, mode == XTaskQueueDispatchMode::SerializedThreadPool ? 1 : UINT32_MAX));
         break;
           
     case XTaskQueueDispatchMode::Immediate:
@@ -267,13 +270,13 @@ HRESULT TaskQueuePortImpl::QueueItem(
 
     if (waitMs == 0)
     {
-        entry.enqueueTime = 0;
+        entry.enqueueTime = m_timer.GetCurrentTime();
         RETURN_HR_IF(E_OUTOFMEMORY, !AppendEntry(entry));
     }
     else
     {
         entry.enqueueTime = m_timer.GetDueTime(waitMs);
-        RETURN_HR_IF(E_OUTOFMEMORY, !m_pendingList->push_back(entry));
+        RETURN_IF_FAILED(PushPendingEntry(entry));
 
         while (true)
         {
@@ -333,13 +336,25 @@ HRESULT TaskQueuePortImpl::RegisterWaitHandle(
 
     {
         std::lock_guard<std::mutex> lock(m_lock);
-        RETURN_HR_IF(E_OUTOFMEMORY, m_events.capacity() == 0);
-        RETURN_HR_IF(E_OUTOFMEMORY, m_waits.capacity() == 0);
 
-        RETURN_IF_FAILED(InitializeWaitRegistration(waitReg.get()));
+        try
+        {
+            m_waits.emplace(waitReg->token, waitReg.get());
+        }
+        catch (...)
+        {
+            RETURN_HR(E_OUTOFMEMORY);
+        }
+
+        HRESULT hr = InitializeWaitRegistration(waitReg.get());
+        if (FAILED(hr))
+        {
+            m_waits.erase(waitReg->token);
+            RETURN_HR(hr);
+        }
 
-        m_events.append(waitHandle);
-        m_waits.append(waitReg.get());
+        m_stats->waitCount.fetch_add(1, std::memory_order_relaxed);
+        m_stats->waitRegistrations.fetch_add(1, std::memory_order_relaxed);
 
         token->token = waitReg->token;
         waitReg.release();
@@ -357,27 +372,14 @@ void TaskQueuePortImpl::UnregisterWaitHandle(
 
     {
         std::lock_guard<std::mutex> lock(m_lock);
-        for(uint32_t idx = 0; idx < m_waits.count(); idx++)
-        {
-            if (m_waits[idx]->token == token.token)
-            {
-                toDelete = m_waits[idx];
-                toDelete->deleted = true;
-                m_waits.removeAt(idx);
-                break;
-            }
-        }
 
-        if (toDelete != nullptr)
+        auto it = m_waits.find(token.token);
+        if (it != m_waits.end())
         {
-            for (uint32_t idx = 1; idx < m_events.count(); idx++)
-            {
-                if (m_events[idx] == toDelete->waitHandle)
-                {
-                    m_events.removeAt(idx);
-                    break;
-                }
-            }
+            toDelete = it->second;
+            toDelete->deleted = true;
+            m_waits.erase(it);
+            m_stats->waitCount.fetch_sub(1, std::memory_order_relaxed);
         }
     }
 
@@ -520,12 +522,18 @@ bool TaskQueuePortImpl::DrainOneItem(
     {
         popped = true;
 
+        uint64_t start = m_timer.GetCurrentTime();
+        m_stats->queueDepth.fetch_sub(1, std::memory_order_relaxed);
+        m_stats->dispatched.fetch_add(1, std::memory_order_relaxed);
+        TaskQueueStats::RecordLatency(m_stats, start > entry.enqueueTime ? start - entry.enqueueTime : 0);
+
         if (entry.portContext->GetType() == XTaskQueuePort::Work)
         {
             status.MayRunLong();
         }
 
         entry.callback(entry.callbackContext, IsCallCanceled(entry));
+        TaskQueueStats::RecordExecution(m_stats, m_timer.GetCurrentTime() - start);
         m_processingCallback--;
         m_processingCallbackCv.notify_all();
 
@@ -566,42 +574,11 @@ bool TaskQueuePortImpl::Wait(
             return false;
         }
 
-        StaticArray<HANDLE, PORT_EVENT_MAX> events;
-        StaticArray<WaitRegistration*, PORT_WAIT_MAX> waits;
-
-        {
-            std::lock_guard<std::mutex> lock(m_lock);
-            events = m_events;
-            waits = m_waits;
-
-            for (uint32_t idx = 0; idx < waits.count(); idx++)
-            {
-                waits[idx]->refs++;
-            }
-        }
-
-        DWORD waitResult = WaitForMultipleObjects(events.count(), events.data(), FALSE, timeout);
-
-        if (waitResult > WAIT_OBJECT_0 && waitResult < WAIT_OBJECT_0 + events.count())
-        {
-            for (uint32_t idx = 0; idx < waits.count(); idx++)
-            {
-                if (waits[idx]->waitHandle == events[waitResult - WAIT_OBJECT_0])
-                {
-                    if (!AppendWaitRegistrationEntry(waits[idx]))
-                    {
-                        LOG_IF_FAILED(InitializeWaitRegistration(waits[idx]));
-                    }
-                    break;
-                }
-            }
+        // Registered wait handles are watched by their threadpool waits,
+        // which append the entry and signal m_queueEvent when they fire.
+        DWORD waitResult = WaitForSingleObject(m_queueEvent, timeout);
 
-            for (uint32_t idx = 0; idx < waits.count(); idx++)
-            {
-                ReleaseWaitRegistration(waits[idx]);
-            }
-        }
-        else if (waitResult == WAIT_TIMEOUT)
+        if (waitResult == WAIT_TIMEOUT)
         {
             return false;
         }
@@ -618,7 +595,7 @@ bool TaskQueuePortImpl::IsEmpty()
 {
     bool empty =
         (m_queueList->empty()) &&
-        (m_pendingList->empty()) &&
+        (PendingListEmpty()) &&
         (m_processingCallback == 0);
 
     return empty;
@@ -694,7 +671,7 @@ void TaskQueuePortImpl::ResumePort()
     uint64_t address;
 
     QueueEntry queueEntry;
-    LocklessQueue<QueueEntry> retainEntries(*(m_pendingList.get()));
+    LocklessQueue<QueueEntry> retainEntries(*(m_queueList.get()));
 
     while (m_queueList->pop_front(queueEntry, address))
     {
@@ -759,6 +736,9 @@ bool TaskQueuePortImpl::AppendEntry(
         return false;
     }
 
+    m_stats->queueDepth.fetch_add(1, std::memory_order_relaxed);
+    m_stats->enqueued.fetch_add(1, std::memory_order_relaxed);
+
     SignalQueue();
     NotifyItemQueued();
 
@@ -771,39 +751,41 @@ void TaskQueuePortImpl::CancelPendingEntries(
 ) {
     LocklessQueue<QueueEntry> entriesToAppend(*m_queueList.get());
 
-    m_pendingList->remove_if([&](auto& entry, auto address)
     {
-        if (entry.portContext == portContext)
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+
+        auto removed = std::stable_partition(m_pendingHeap.begin(), m_pendingHeap.end(), [portContext](const PendingEntry& pending)
         {
-            if (appendToQueue)
+            return pending.entry.portContext != portContext;
+        });
+
+        if (removed != m_pendingHeap.end())
+        {
+            std::sort(removed, m_pendingHeap.end(), [](const PendingEntry& left, const PendingEntry& right)
             {
-                entriesToAppend.push_back(std::move(entry), address);
-            }
-            else
+                return PendingEntryLater(right, left);
+            });
+
+            for (auto it = removed; it != m_pendingHeap.end(); ++it)
             {
-                entry.portContext->Release();
-                m_pendingList->free_node(address);
+                entriesToAppend.push_back(std::move(it->entry), it->node);
             }
 
-            return true;
-        }
+            m_stats->pendingDepth.fetch_sub(m_pendingHeap.end() - removed, std::memory_order_relaxed);
 
-        return false;
-    });
-
-    while (appendToQueue)
-    {
-        QueueEntry entry = {};
-        uint64_t address = 0;
-        if (!entriesToAppend.pop_front(entry, address))
-        {
-            break;
+            m_pendingHeap.erase(removed, m_pendingHeap.end());
+            std::make_heap(m_pendingHeap.begin(), m_pendingHeap.end(), PendingEntryLater);
         }
+    }
 
-        if (!AppendEntry(entry, address))
+    QueueEntry cancelledEntry = {};
+    uint64_t cancelledNode = 0;
+    while (entriesToAppend.pop_front(cancelledEntry, cancelledNode))
+    {
+        if (!appendToQueue || !AppendEntry(cancelledEntry, cancelledNode))
         {
-            entry.portContext->Release();
-            m_queueList->free_node(address);
+            cancelledEntry.portContext->Release();
+            m_queueList->free_node(cancelledNode);
         }
     }
 
@@ -813,47 +795,121 @@ void TaskQueuePortImpl::CancelPendingEntries(
         hooks->PendingEntriesRemovedDuringTermination(portContext->GetType());
     }
 
-    StaticArray<WaitRegistration*, PORT_WAIT_MAX> waits;
+    std::vector<WaitRegistration*> waits;
 
     {
         std::unique_lock<std::mutex> lock(m_lock);
-        waits = m_waits;
-        m_waits.clear();
-    }
 
-    for (uint32_t index = waits.count(); index > 0; index--)
-    {
-        uint32_t idx = index - 1;
-        if (waits[idx]->queueEntry.portContext == portContext)
+        for (auto it = m_waits.begin(); it != m_waits.end();)
         {
-            CloseThreadpoolWait(waits[idx]->threadpoolWait);
-            waits[idx]->queueEntry.waitRegistration = nullptr;
+            if (it->second->queueEntry.portContext == portContext)
+            {
+                // Best effort: if this can't grow, the registration stays
+                // and is cleaned up with the port.
+                try
+                {
+                    waits.push_back(it->second);
+                }
+                catch (...)
+                {
+                    break;
+                }
 
-            if (appendToQueue)
+                it = m_waits.erase(it);
+            }
+            else
             {
-                AppendWaitRegistrationEntry(waits[idx]);
+                ++it;
             }
-            
-            delete waits[idx];
-            waits.removeAt(idx);
         }
     }
+
+    for (WaitRegistration* waitReg : waits)
+    {
+        m_stats->waitCount.fetch_sub(1, std::memory_order_relaxed);
+        CloseThreadpoolWait(waitReg->threadpoolWait);
+        waitReg->queueEntry.waitRegistration = nullptr;
+
+        if (appendToQueue)
+        {
+            AppendWaitRegistrationEntry(waitReg);
+        }
+
+        delete waitReg;
+    }
 }
 
-void TaskQueuePortImpl::EraseQueue(
-    LocklessQueue<QueueEntry>* queue
-) {
-    if (queue != nullptr)
+void TaskQueuePortImpl::EraseQueue()
+{
+    if (m_queueList != nullptr)
     {
         QueueEntry entry;
         
-        while(queue->pop_front(entry))
+        while(m_queueList->pop_front(entry))
         {
+            m_stats->queueDepth.fetch_sub(1, std::memory_order_relaxed);
             entry.portContext->Release();
         }
     }
 }
 
+bool TaskQueuePortImpl::PendingEntryLater(
+    const PendingEntry& left,
+    const PendingEntry& right
+) {
+    if (left.entry.enqueueTime != right.entry.enqueueTime)
+    {
+        return left.entry.enqueueTime > right.entry.enqueueTime;
+    }
+
+    return left.entry.id > right.entry.id;
+}
+
+HRESULT TaskQueuePortImpl::PushPendingEntry(
+    const QueueEntry& entry
+) {
+    PendingEntry pending;
+    pending.entry = entry;
+    RETURN_HR_IF(E_OUTOFMEMORY, !m_queueList->reserve_node(pending.node));
+
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+
+    try
+    {
+        m_pendingHeap.push_back(pending);
+    }
+    catch (...)
+    {
+        m_queueList->free_node(pending.node);
+        RETURN_HR(E_OUTOFMEMORY);
+    }
+
+    std::push_heap(m_pendingHeap.begin(), m_pendingHeap.end(), PendingEntryLater);
+    m_stats->pendingDepth.fetch_add(1, std::memory_order_relaxed);
+
+    return S_OK;
+}
+
+bool TaskQueuePortImpl::PendingListEmpty()
+{
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+    return m_pendingHeap.empty();
+}
+
+void TaskQueuePortImpl::ErasePendingEntries()
+{
+    std::lock_guard<std::mutex> lock(m_pendingLock);
+
+    for (auto& pending : m_pendingHeap)
+    {
+        pending.entry.portContext->Release();
+        m_queueList->free_node(pending.node);
+    }
+
+    m_stats->pendingDepth.fetch_sub(m_pendingHeap.size(), std::memory_order_relaxed);
+    m_pendingHeap.clear();
+}
+
 void TaskQueuePortImpl::PromoteReadyPendingCallbacks(
     uint64_t dueTime,
     uint64_t now
@@ -865,29 +921,26 @@ void TaskQueuePortImpl::PromoteReadyPendingCallbacks(
         QueueEntry nextItem = {};
         bool hasNextItem = false;
 
-        m_pendingList->remove_if([&](auto& entry, auto address)
         {
-            if (entry.enqueueTime <= now)
+            std::lock_guard<std::mutex> lock(m_pendingLock);
+
+            while (!m_pendingHeap.empty() && m_pendingHeap.front().entry.enqueueTime <= now)
             {
-                readyEntries.push_back(std::move(entry), address);
+                std::pop_heap(m_pendingHeap.begin(), m_pendingHeap.end(), PendingEntryLater);
 
-                return true;
+                PendingEntry& ready = m_pendingHeap.back();
+                readyEntries.push_back(std::move(ready.entry), ready.node);
+                m_pendingHeap.pop_back();
+                m_stats->pendingDepth.fetch_sub(1, std::memory_order_relaxed);
             }
 
-            if (!hasNextItem || nextItem.enqueueTime > entry.enqueueTime)
+            if (!m_pendingHeap.empty())
             {
-                if (hasNextItem)
-                {
-                    nextItem.portContext->Release();
-                }
-
-                nextItem = entry;
+                nextItem = m_pendingHeap.front().entry;
                 nextItem.portContext->AddRef();
                 hasNextItem = true;
             }
-
-            return false;
-        });
+        }
 
         QueueEntry readyEntry = {};
         uint64_t readyEntryNode = 0;
@@ -1028,7 +1081,7 @@ void TaskQueuePortImpl::SignalQueue()
 {
     if (!m_suspended)
     {
-        SetEvent(m_events[0]);
+        SetEvent(m_queueEvent);
     }
 }
 
@@ -1158,6 +1211,8 @@ bool TaskQueuePortImpl::AppendWaitRegistrationEntry(
     QueueEntry entry = waitReg->queueEntry;
     bool success = true;
 
+    entry.enqueueTime = m_timer.GetCurrentTime();
+
     if (waitReg->appended.test_and_set() == false)
     {
         entry.portContext->AddRef();
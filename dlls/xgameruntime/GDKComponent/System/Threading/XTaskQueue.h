@@ -21,14 +21,17 @@
 #define _XTASKQUEUE_H_
 
 #include "../../../private.h"
-#include "StaticArray.h"
 #include "referenced_ptr.h"
 #include "ThreadPool.h"
 #include "AtomicVector.h"
 #include "WaitTimer.h"
 #include "LocklessQueue.h"
+#include "TaskQueueStats.h"
 
 #include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 // For debugging purposes
 #define USE_UNIQUE_HANDLES true
@@ -36,10 +39,6 @@
 // DO NOT USE SUSPEND_API. ITS FOR NON-WINDOWS TARGETS!
 // #define SUSPEND_API 1
 
-#define PORT_WAIT_MAX 60
-#define PORT_EVENT_MAX (PORT_WAIT_MAX + 1)
-#define QUEUE_WAIT_MAX (PORT_WAIT_MAX * 2)
-
 static uint32_t const SUBMIT_CALLBACK_MAX = 32;
 
 enum class TaskQueuePortStatus
@@ -264,7 +263,7 @@ private:
     };
 
     std::atomic<uint64_t> m_nextToken{ 0 };
-    StaticArray<WaitRegistration, QUEUE_WAIT_MAX> m_callbacks;
+    std::unordered_map<uint64_t, WaitRegistration> m_callbacks;
     std::mutex m_lock;
 };
 
@@ -352,6 +351,14 @@ private:
         uint64_t id;
     };
 
+    // A delayed callback. The node is reserved from m_queueList up front
+    // so promoting the entry once it is due can't fail.
+    struct PendingEntry
+    {
+        QueueEntry entry;
+        uint64_t node;
+    };
+
     struct TerminationEntry
     {
         ITaskQueuePortContext* portContext;
@@ -380,7 +387,8 @@ private:
     std::condition_variable m_processingCallbackCv;
     std::mutex m_lock;
     std::unique_ptr<LocklessQueue<QueueEntry>> m_queueList;
-    std::unique_ptr<LocklessQueue<QueueEntry>> m_pendingList;
+    std::vector<PendingEntry> m_pendingHeap;
+    std::mutex m_pendingLock;
     std::unique_ptr<LocklessQueue<TerminationEntry*>> m_terminationList;
     std::unique_ptr<LocklessQueue<TerminationEntry*>> m_pendingTerminationList;
     std::mutex m_terminationLock;
@@ -391,9 +399,13 @@ private:
     std::atomic<bool> m_suspended = { false };
     std::atomic<ULONG> m_refs{ 0 };
     std::atomic_flag m_deleting;
+    TaskQueuePortStats* m_stats = nullptr;
 
-    StaticArray<WaitRegistration*, PORT_WAIT_MAX> m_waits;
-    StaticArray<HANDLE, PORT_EVENT_MAX> m_events;
+    // Registered waits, keyed by token. Each one is armed as its own ntdll
+    // threadpool wait, so there is no limit on how many a port can hold and
+    // dispatch only ever waits on m_queueEvent.
+    std::unordered_map<uint64_t, WaitRegistration*> m_waits;
+    HANDLE m_queueEvent = nullptr;
     uint64_t m_nextWaitToken = 0;
 
     HRESULT VerifyNotTerminated(ITaskQueuePortContext* portContext);
@@ -419,8 +431,19 @@ private:
         ITaskQueuePortContext* portContext,
         uint32_t timeout);
 
-    static void EraseQueue(
-        LocklessQueue<QueueEntry>* queue);
+    void EraseQueue();
+
+    // m_pendingHeap is a binary min-heap ordered by due time, and by
+    // submission order for callbacks due at the same time.
+    static bool PendingEntryLater(
+        const PendingEntry& left,
+        const PendingEntry& right);
+
+    HRESULT PushPendingEntry(
+        const QueueEntry& entry);
+
+    bool PendingListEmpty();
+    void ErasePendingEntries();
 
     void PromoteReadyPendingCallbacks(
         uint64_t dueTime,
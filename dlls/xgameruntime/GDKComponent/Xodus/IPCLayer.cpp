@@ -22,12 +22,14 @@
 #include "../../private.h"
 #include "../../WineCoreUAP/Foundation/IWineAsync.hpp"
 #include "Structs.h"
+#include "IPCRequestTable.h"
 
 #include <wine/list.h>
 #include "ntstatus.h"
 #include "robuffer.h"
 
 #include <atomic>
+#include <mutex>
 
 WINE_DEFAULT_DEBUG_CHANNEL(xodus);
 
@@ -114,20 +116,86 @@ public:
     InitializeSocket()
     {
         IAsyncAction *operation;
+        HRESULT hr;
+
         TRACE("\n");
+
+        // Responses are completed and timed out on their own queue, so a slow
+        // completion handler never holds up the socket thread.
+        {
+            const std::lock_guard<std::mutex> lock( m_QueueLock );
+            if ( !m_Queue )
+            {
+                hr = ::XTaskQueueCreate( XTaskQueueDispatchMode::ThreadPool, XTaskQueueDispatchMode::ThreadPool, &m_Queue );
+                if ( FAILED( hr ) ) return hr;
+            }
+        }
+
         return AsyncAction::Create( static_cast<IUnknown *>(this), nullptr, InitializeSocketThread, &operation );
     }
 
     HRESULT WINAPI
     SendRequestAsync( IXodusIPCPacket *packet, IAsyncOperation<IXodusIPCPacket *> **operation ) override
     {
+        PendingRequest *request;
+        UINT16 messageType;
+        UINT32 id = 0;
         HRESULT hr;
 
-        packet->AddRef();        
-        hr = AsyncOperation<IXodusIPCPacket *>::Create( static_cast<IUnknown *>(this), 
-                                packet, SendRequest, operation );
+        TRACE("packet %p, operation %p.\n", packet, operation);
+
+        {
+            const std::lock_guard<std::mutex> lock( m_QueueLock );
+            if ( !m_Queue ) return E_NOT_VALID_STATE;
+        }
+
+        hr = packet->get_MessageType( &messageType );
+        if ( FAILED( hr ) ) return hr;
+
+        request = new (std::nothrow) PendingRequest();
+        if ( !request ) return E_OUTOFMEMORY;
+
+        hr = AsyncOperation<IXodusIPCPacket *>::CreateDeferred( static_cast<IUnknown *>(this),
+                                request, CompleteRequest, operation, &request->info );
+        if ( FAILED( hr ) )
+        {
+            delete request;
+            return hr;
+        }
+
+        request->operation = *operation;
+        request->operation->AddRef();
+
+        // Register before sending, the response may arrive before send_frame
+        // returns. Nothing is registered once the connection is gone. Once
+        // registered, the request belongs to whoever completes it and may
+        // already be freed, so only the local id is used from here on.
+        {
+            const std::lock_guard<std::mutex> lock( m_QueueLock );
+            if ( m_Queue ) id = m_Requests.Add( request, ResponseTypeOf( messageType ), IPC_REQUEST_TIMEOUT_MS );
+        }
+
+        if ( !id )
+        {
+            request->status = HRESULT_FROM_NT( STATUS_CONNECTION_DISCONNECTED );
+            FinishRequest( request );
+            return S_OK;
+        }
 
-        return hr;
+        hr = SendFrame( packet );
+        if ( FAILED( hr ) )
+        {
+            // The error is reported through the operation.
+            if ( m_Requests.Remove( id ) )
+            {
+                request->status = hr;
+                FinishRequest( request );
+            }
+            return S_OK;
+        }
+
+        ScheduleSweep();
+        return S_OK;
     }
 
     HRESULT WINAPI
@@ -180,40 +248,46 @@ private:
         BYTE* frame;
     };
     
-    struct SendRequestContext
+    struct PendingRequest
     {
-        HANDLE event;
+        IWineAsyncInfoImpl *info;
+        IAsyncOperation<IXodusIPCPacket *> *operation;
         IXodusIPCPacket *response;
+        HRESULT status;
     };
 
-    static HRESULT WINAPI 
-    SendRequest( IUnknown *invoker, PVOID param, PROPVARIANT *result )
+    // Xodus answers a request of type n with a response of type n + 1, e.g.
+    // a PING (1) with a PONG (2), or an MSA token request (3) with its
+    // response (4).
+    static UINT16
+    ResponseTypeOf( UINT16 requestType )
     {
-        auto iface = static_cast<IPCLayer *>( invoker );
-        auto packet = static_cast<IXodusIPCPacket *>( param );
+        return requestType + 1;
+    }
 
+    HRESULT
+    SendFrame( IXodusIPCPacket *packet )
+    {
         BYTE* messageBuffer;
-        DWORD asyncres;
         HRESULT status = S_OK;
         NTSTATUS nts;
         IPCFrame frame{};
         IPCHeader_CTYPE header{};
-        EventRegistrationToken token{};
-        SendRequestContext context{ .event = CreateEventW(nullptr, TRUE, FALSE, nullptr) };
-        IPCResponseHandler *handler = new IPCResponseHandler( SendRequestResponseHandler, (PVOID)&context );
+        UINT32 messageLength;
 
         IBuffer *message;
         IBufferByteAccess *messageBufferByteAccess;
 
-        TRACE("invoker %p, param %p, result %p\n", invoker, param, result);
-
         packet->get_Magic( &header.Magic );
         packet->get_MessageType( &header.Message_Type );
         packet->get_Message( &message );
-        packet->Release();
 
-        status = message->get_Length( &frame.frameSize );
-        if ( FAILED( status ) ) return status;
+        status = message->get_Length( &messageLength );
+        if ( FAILED( status ) )
+        {
+            message->Release();
+            return status;
+        }
         status = message->QueryInterface<IBufferByteAccess>( &messageBufferByteAccess );
         message->Release();
         if ( FAILED( status ) ) return status;
@@ -221,9 +295,10 @@ private:
         messageBufferByteAccess->Release();
         if ( FAILED( status ) ) return status;
 
-        header.MessageLength = frame.frameSize;
+        if ( messageLength > 0xffff ) return HRESULT_FROM_WIN32( ERROR_BUFFER_OVERFLOW );
+        header.MessageLength = messageLength;
 
-        frame.frameSize += sizeof(IPCHeader_CTYPE);
+        frame.frameSize = messageLength + sizeof(IPCHeader_CTYPE);
 
         frame.frame = (PBYTE)CoTaskMemAlloc( sizeof(BYTE) * frame.frameSize );
         if ( !frame.frame )
@@ -232,52 +307,141 @@ private:
         RtlCopyMemory( frame.frame, &header.Magic, sizeof(MagicHeaderType) );
         RtlCopyMemory( frame.frame + sizeof(MagicHeaderType), &header.Message_Type, sizeof(UINT16) );
         RtlCopyMemory( frame.frame + sizeof(MagicHeaderType) + sizeof(UINT16), &header.MessageLength, sizeof(UINT16) );
-        RtlCopyMemory( frame.frame + sizeof(IPCHeader_CTYPE), messageBuffer, header.MessageLength );
-
-        status = iface->add_ResponseReceived( handler, &token );
-        if ( FAILED( status ) ) return status;
-
-        nts = __wine_unix_call( unixhandle, send_frame, (void *)&frame );
-        CoTaskMemFree( frame.frame );
-        if ( FAILED( nts ) ) return HRESULT_FROM_NT( nts );
+        RtlCopyMemory( frame.frame + sizeof(IPCHeader_CTYPE), messageBuffer, messageLength );
 
-        asyncres = WaitForSingleObject( context.event, IPC_REQUEST_TIMEOUT_MS );
-        status = iface->remove_ResponseReceived( token );
-        if ( FAILED( status ) ) return status;
-        if ( asyncres )
         {
-            WARN("Timeout while waiting for %p to respond.\n", handler);
-            return HRESULT_FROM_NT( STATUS_TIMEOUT );
+            // Frames from concurrent callers must not interleave on the socket.
+            const std::lock_guard<std::mutex> lock( m_SendLock );
+            nts = __wine_unix_call( unixhandle, send_frame, (void *)&frame );
         }
+        CoTaskMemFree( frame.frame );
+        if ( nts ) return HRESULT_FROM_NT( nts );
+
+        return S_OK;
+    }
+
+    static HRESULT WINAPI
+    CompleteRequest( IUnknown *invoker, PVOID param, PROPVARIANT *result )
+    {
+        auto request = static_cast<PendingRequest *>( param );
+
+        TRACE("invoker %p, param %p, result %p\n", invoker, param, result);
+
+        if ( FAILED( request->status ) ) return request->status;
 
+        // The reference taken when the response was matched is handed over
+        // to the operation.
         result->vt = VT_UNKNOWN;
-        result->punkVal = context.response;
+        result->punkVal = request->response;
+        request->response = nullptr;
 
         return S_OK;
     }
 
-    static HRESULT WINAPI
-    SendRequestResponseHandler( PVOID context, IXodusIPCPacket *packet )
+    static void
+    FinishRequest( PendingRequest *request )
     {
-        auto ctx = reinterpret_cast<SendRequestContext *>( context );
+        request->info->Invoke();
+        request->info->Release();
+        request->operation->Release();
+        if ( request->response ) request->response->Release();
+        delete request;
+    }
 
-        HRESULT status;
-        UINT16 messageType;
+    static void CALLBACK
+    CompletionCallback( void *context, BOOLEAN canceled )
+    {
+        auto request = static_cast<PendingRequest *>( context );
 
-        TRACE("context %p, packet %p\n", context, packet);
+        TRACE("context %p, canceled %d\n", context, canceled);
 
-        status = packet->get_MessageType( &messageType );
-        if ( FAILED( status ) ) return status;
+        // The response already arrived, so it is handed out even when the
+        // queue is being shut down.
+        FinishRequest( request );
+    }
+
+    void
+    ScheduleSweep()
+    {
+        HRESULT hr;
+
+        const std::lock_guard<std::mutex> lock( m_QueueLock );
+
+        if ( !m_Queue || m_SweepScheduled.exchange( true ) ) return;
+
+        hr = ::XTaskQueueSubmitDelayedCallback( m_Queue, XTaskQueuePort::Work, IPC_REQUEST_SWEEP_MS, this, SweepCallback );
+        if ( FAILED( hr ) )
+        {
+            ERR("Failed to schedule the request sweep, hr %#lx.\n", hr);
+            m_SweepScheduled = false;
+        }
+    }
+
+    static void CALLBACK
+    SweepCallback( void *context, BOOLEAN canceled )
+    {
+        auto iface = static_cast<IPCLayer *>( context );
+
+        TRACE("context %p, canceled %d\n", context, canceled);
 
-        if ( messageType == 1 /* PING */ )
-            return S_OK; //Skip the packet we sent.
+        for ( PVOID expired : iface->m_Requests.Expire( canceled ? ~0ull : GetTickCount64() ) )
+        {
+            auto request = static_cast<PendingRequest *>( expired );
+
+            WARN("Timeout while waiting for request %p to complete.\n", request);
+            request->status = HRESULT_FROM_NT( STATUS_TIMEOUT );
+            FinishRequest( request );
+        }
+
+        iface->m_SweepScheduled = false;
+        if ( !canceled && iface->m_Requests.Pending() ) iface->ScheduleSweep();
+    }
+
+    static void
+    CorrelateFrame( IPCLayer *iface, UINT16 messageType, IXodusIPCPacket *packet )
+    {
+        PendingRequest *request;
+        PVOID context;
+        HRESULT hr;
 
         if ( messageType == 2 /* PONG */ )
             TRACE("Got PONGED!\n");
 
-        ctx->response = packet;
-        SetEvent( ctx->event );
-        return S_OK;
+        // Frames no request waits for, such as the echo of our own PING, are
+        // only seen by the ResponseReceived handlers.
+        if ( !iface->m_Requests.Match( messageType, &context ) ) return;
+
+        if ( !(request = static_cast<PendingRequest *>( context )) )
+        {
+            WARN("Dropping a late response of type %u.\n", messageType);
+            return;
+        }
+
+        packet->AddRef();
+        request->response = packet;
+
+        hr = ::XTaskQueueSubmitCallback( iface->m_Queue, XTaskQueuePort::Completion, request, CompletionCallback );
+        if ( FAILED( hr ) )
+        {
+            ERR("Failed to queue the completion of request %p, hr %#lx.\n", request, hr);
+            FinishRequest( request );
+        }
+    }
+
+    static void
+    DispatchFrame( IPCLayer *iface, UINT16 messageType, IBuffer *message )
+    {
+        response_received_callback *currCallback;
+        IXodusIPCPacket *xodusPacket = new XodusIPCPacket( MagicHeaderType::XML, messageType, message );
+
+        CorrelateFrame( iface, messageType, xodusPacket );
+
+        LIST_FOR_EACH_ENTRY( currCallback, &iface->m_Callbacks, response_received_callback, entry )
+        {
+            currCallback->handler->Invoke( xodusPacket );
+        }
+
+        xodusPacket->Release();
     }
 
     static HRESULT WINAPI 
@@ -285,107 +449,171 @@ private:
     {
         auto iface = static_cast<IPCLayer *>( invoker );
 
-        BYTE* messageBuffer = nullptr;
-        SIZE_T offset = 0;
-        HSTRING bufferClass;
-        NTSTATUS status = STATUS_SUCCESS;
+        HRESULT status = S_OK;
+        NTSTATUS nts;
         POLL_SOCKET_ARGS currentPoll{};
-        response_received_callback *currCallback;
-
-        IBuffer *message = nullptr;
-        IBufferByteAccess *messageBufferAccess = nullptr;
-        IBufferFactory *bufferFactory = nullptr;
-        IXodusIPCPacket *xodusPacket = nullptr;
+        IPCReceiveChunk *chunk, *next;
+        IPCHeader_CTYPE header;
+        IPCFrameBuffer *message;
+
+        // Bytes [parse, tail) of the chunk are received but not yet dispatched.
+        UINT32 parse = 0, tail = 0;
+        // Room the frame at parse needs, including the NUL after its body.
+        UINT32 needed = sizeof(IPCHeader_CTYPE);
+        // Every dispatched body is followed by a NUL. When the next frame was
+        // already received, that NUL overwrote its first byte, kept here.
+        BYTE carry = 0;
+        BOOL hasCarry = FALSE;
 
         TRACE("invoker %p, param %p, result %p\n", invoker, param, result);
 
-        status = WindowsCreateString( RuntimeClass_Windows_Storage_Streams_Buffer, lstrlenW( RuntimeClass_Windows_Storage_Streams_Buffer ), &bufferClass );
-        if ( FAILED( status ) ) return status;
-
-        status = RoGetActivationFactory( bufferClass, __uuidof( IBufferFactory ), (void **)&bufferFactory );
-        WindowsDeleteString( bufferClass );
-        if ( FAILED( status ) ) return status;
+        chunk = IPCReceiveChunk::Create( IPC_RECEIVE_CHUNK_SIZE );
+        if ( !chunk ) return E_OUTOFMEMORY;
 
         // Automatically broken when the DLL is detatched. 
         while ( TRUE )
         {
+            if ( parse == tail && chunk->IsExclusive() )
+            {
+                // Nothing pending and every frame was released, start over.
+                parse = tail = 0;
+            }
+            else if ( chunk->capacity - parse < needed )
+            {
+                // The pending frame doesn't fit in what is left of the chunk. Move
+                // it into a new one; dispatched frames keep the old one alive.
+                next = IPCReceiveChunk::Create( needed > IPC_RECEIVE_CHUNK_SIZE ? needed : IPC_RECEIVE_CHUNK_SIZE );
+                if ( !next )
+                {
+                    status = E_OUTOFMEMORY;
+                    break;
+                }
+
+                RtlCopyMemory( next->data, chunk->data + parse, tail - parse );
+                if ( hasCarry ) next->data[0] = carry;
+                hasCarry = FALSE;
+
+                tail -= parse;
+                parse = 0;
+
+                chunk->Release();
+                chunk = next;
+            }
+
             // poll_sock()
-            status = __wine_unix_call( unixhandle, poll_socket, (void *)&currentPoll );
-            if ( FAILED( status ) ) return HRESULT_FROM_NT( status );
+            currentPoll.buffer = chunk->data + tail;
+            currentPoll.buffer_size = chunk->capacity - tail;
 
-            // Multiple messages may arrive at the same time.
-            // Try to parse them all
-            offset = 0;
+            nts = __wine_unix_call( unixhandle, poll_socket, (void *)&currentPoll );
+            if ( nts )
+            {
+                status = HRESULT_FROM_NT( nts );
+                break;
+            }
 
-            while ( TRUE )
+            tail += currentPoll.received;
+
+            // Multiple messages may arrive at the same time.
+            // Dispatch every complete one.
+            while ( tail - parse >= sizeof(IPCHeader_CTYPE) )
             {
-                IPCHeader_CTYPE *header;
+                UINT32 frameEnd;
 
-                if ( currentPoll.curr_buffer_size - offset < sizeof(IPCHeader_CTYPE) )
-                    break; //Not received the full header yet.
+                RtlCopyMemory( &header, chunk->data + parse, sizeof(IPCHeader_CTYPE) );
+                if ( hasCarry ) *(BYTE *)&header = carry;
 
-                header = reinterpret_cast<IPCHeader_CTYPE *>( currentPoll.curr_buffer + offset );
-                
-                if ( header->Magic == MagicHeaderType::Proto )
+                if ( header.Magic != MagicHeaderType::XML && header.Magic != MagicHeaderType::Proto )
                 {
-                    FIXME("Proto is not yet supported!\n");
+                    ERR("Invalid magic header %#x received, dropping the connection.\n", (int)header.Magic);
+                    status = E_UNEXPECTED;
+                    goto done;
+                }
+
+                frameEnd = parse + sizeof(IPCHeader_CTYPE) + header.MessageLength;
+                needed = sizeof(IPCHeader_CTYPE) + header.MessageLength + 1;
+
+                // Wait for the rest of the frame, and for room for its NUL.
+                if ( frameEnd > tail || frameEnd == chunk->capacity )
                     break;
+
+                TRACE("header.Message_Type is %d!\n", header.Message_Type);
+
+                if ( frameEnd < tail )
+                {
+                    carry = chunk->data[frameEnd];
+                    hasCarry = TRUE;
+                    parse = frameEnd;
                 }
-                else if ( header->Magic != MagicHeaderType::XML )
+                else
                 {
-                    FIXME("Invalid magic header %#x received!\n", (int)header->Magic);
-                    break;
+                    hasCarry = FALSE;
+                    parse = tail = frameEnd + 1;
                 }
 
-                if ( currentPoll.curr_buffer_size - offset < sizeof(IPCHeader_CTYPE) + header->MessageLength )
-                    break; //We have not received the full message yet.
-                TRACE("header->Message_Type is %d!\n", header->Message_Type);
+                chunk->data[frameEnd] = '\0';
+                needed = sizeof(IPCHeader_CTYPE);
+
+                if ( header.Magic == MagicHeaderType::Proto )
+                {
+                    FIXME("Proto is not yet supported!\n");
+                    continue;
+                }
 
                 /**
                  * TODO: Should we ignore messages sent by ourselves?
-                 * if ( header->Message_Type == MessageType::Ping ||
-                 *     header->Message_Type == MessageType::XstsTokenRequest )
-                 *    break;
+                 * if ( header.Message_Type == MessageType::Ping ||
+                 *     header.Message_Type == MessageType::XstsTokenRequest )
+                 *    continue;
                  */
 
-                status = bufferFactory->Create( header->MessageLength + 1, &message );
-                if ( FAILED( status ) ) return status; //something went horribly wrong.
-                status = message->QueryInterface<IBufferByteAccess>( &messageBufferAccess );
-                if ( FAILED( status ) ) return status; //something went horribly wrong.
-                status = messageBufferAccess->Buffer( &messageBuffer );
-                if ( FAILED( status ) ) return status; //something went horribly wrong.
+                message = new (std::nothrow) IPCFrameBuffer( chunk, frameEnd - header.MessageLength, header.MessageLength );
+                if ( !message )
+                {
+                    status = E_OUTOFMEMORY;
+                    goto done;
+                }
 
-                if ( !messageBuffer )
-                    return E_OUTOFMEMORY;
+                DispatchFrame( iface, header.Message_Type, message );
+                message->Release();
+            }
+        }
 
-                RtlCopyMemory( (PVOID)messageBuffer, (PVOID)(currentPoll.curr_buffer + offset + sizeof(IPCHeader_CTYPE)), header->MessageLength );
-                status = message->put_Length( static_cast<UINT32>(header->MessageLength) );
-                offset += sizeof(IPCHeader_CTYPE) + header->MessageLength;
+done:
+        chunk->Release();
+        iface->Shutdown( status );
+        return status;
+    }
 
-                messageBuffer[header->MessageLength] = '\0';
+    // Called by the socket thread once the connection is gone. Requests that
+    // are still waiting fail with the connection's status, and the queue is
+    // closed once everything already on it has run.
+    void
+    Shutdown( HRESULT status )
+    {
+        XTaskQueueHandle queue;
 
-                xodusPacket = new XodusIPCPacket( header->Magic, header->Message_Type, message );
+        TRACE("status %#lx\n", status);
 
-                messageBufferAccess->Release();
+        if ( SUCCEEDED( status ) ) status = HRESULT_FROM_NT( STATUS_CONNECTION_DISCONNECTED );
 
-                LIST_FOR_EACH_ENTRY( currCallback, &iface->m_Callbacks, response_received_callback, entry )
-                {
-                    currCallback->handler->Invoke( xodusPacket );
-                }
-                // ---- //
+        {
+            const std::lock_guard<std::mutex> lock( m_QueueLock );
+            queue = m_Queue;
+            m_Queue = nullptr;
+        }
 
-                xodusPacket->Release();
-            }
+        for ( PVOID pending : m_Requests.Clear() )
+        {
+            auto request = static_cast<PendingRequest *>( pending );
 
-            if ( offset > 0 )
-            {
-                memmove( currentPoll.curr_buffer, currentPoll.curr_buffer + offset, currentPoll.curr_buffer_size - offset );
-                currentPoll.curr_buffer_size -= offset;
-            }
+            request->status = status;
+            FinishRequest( request );
         }
 
-        bufferFactory->Release();
-        return S_OK;
+        if ( !queue ) return;
+
+        ::XTaskQueueTerminate( queue, TRUE, nullptr, nullptr );
+        ::XTaskQueueCloseHandle( queue );
     }
 
     struct response_received_callback
@@ -396,6 +624,11 @@ private:
     };
 
     struct list m_Callbacks = LIST_INIT( m_Callbacks );
+    IPCRequestTable m_Requests;
+    XTaskQueueHandle m_Queue = nullptr;
+    std::mutex m_QueueLock;
+    std::mutex m_SendLock;
+    std::atomic<bool> m_SweepScheduled{ false };
     std::atomic<INT64> m_NextEventToken{ 0 };
     std::atomic_long ref{ 1 };
 };
@@ -0,0 +1,180 @@
+/*
+ * Xbox Game runtime Library
+ *  Xodus Interopability Layer -> In-flight request table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <windows.h>
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifndef __XODUS_IPCREQUESTTABLE__
+#define __XODUS_IPCREQUESTTABLE__
+
+/**
+ * IPCRequestTable: Requests sent to Xodus that are waiting for a response.
+ *
+ * Any number of requests may be in flight on the socket at once. Frames
+ * carry no request id, but Xodus answers every request with a fixed
+ * response type, in the order the requests were sent. Each response type
+ * therefore has a FIFO of slots, and a response is matched to the oldest
+ * slot waiting for its type.
+ *
+ * A request that times out is completed, but its slot stays queued and
+ * poisoned: if its response does turn up, it is dropped there instead of
+ * being handed to the next request of that type. Xodus is assumed to have
+ * lost a response once it is late by another full timeout, and the slot
+ * is released.
+ */
+class IPCRequestTable
+{
+public:
+    // Registers a request that is about to be sent and returns an id that
+    // can be passed to Remove. The id is never 0.
+    UINT32 Add( PVOID context, UINT16 responseType, DWORD timeoutMs )
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        UINT32 id;
+
+        if ( !(id = m_nextId++) ) id = m_nextId++;
+
+        m_slots[responseType].push_back( Slot{ id, context, GetTickCount64() + timeoutMs, timeoutMs } );
+        m_count++;
+
+        return id;
+    }
+
+    // Matches a response to the oldest slot waiting for its type. Returns
+    // FALSE if no slot is waiting. Otherwise *context is the request's
+    // context, or nullptr if the response was a late one for a request that
+    // already timed out.
+    BOOL Match( UINT16 responseType, PVOID *context )
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        auto it = m_slots.find( responseType );
+
+        if ( it == m_slots.end() ) return FALSE;
+
+        *context = it->second.front().context;
+        it->second.pop_front();
+        if ( it->second.empty() ) m_slots.erase( it );
+        m_count--;
+
+        return TRUE;
+    }
+
+    // Removes a request that was never sent, and so will not get a
+    // response. Returns its context, or nullptr if it already completed.
+    PVOID Remove( UINT32 id )
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+
+        for ( auto it = m_slots.begin(); it != m_slots.end(); ++it )
+        {
+            for ( auto slot = it->second.begin(); slot != it->second.end(); ++slot )
+            {
+                PVOID context;
+
+                if ( slot->id != id ) continue;
+
+                context = slot->context;
+                it->second.erase( slot );
+                if ( it->second.empty() ) m_slots.erase( it );
+                m_count--;
+
+                return context;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // Poisons the slots whose timeout passed and returns their contexts,
+    // and releases poisoned slots that have waited long enough.
+    std::vector<PVOID> Expire( UINT64 now )
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        std::vector<PVOID> expired;
+
+        for ( auto it = m_slots.begin(); it != m_slots.end(); )
+        {
+            for ( Slot &slot : it->second )
+            {
+                if ( !slot.context || slot.deadline > now ) continue;
+
+                expired.push_back( slot.context );
+                slot.context = nullptr;
+                slot.deadline = now + slot.timeoutMs;
+            }
+
+            while ( !it->second.empty() && !it->second.front().context && it->second.front().deadline <= now )
+            {
+                it->second.pop_front();
+                m_count--;
+            }
+
+            if ( it->second.empty() ) it = m_slots.erase( it );
+            else ++it;
+        }
+
+        return expired;
+    }
+
+    // Drops every slot, e.g. because the connection is gone, and returns the
+    // contexts of the requests that were still waiting.
+    std::vector<PVOID> Clear()
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        std::vector<PVOID> pending;
+
+        for ( auto &it : m_slots )
+        {
+            for ( Slot &slot : it.second )
+                if ( slot.context ) pending.push_back( slot.context );
+        }
+
+        m_slots.clear();
+        m_count = 0;
+
+        return pending;
+    }
+
+    // Number of slots, including poisoned ones.
+    SIZE_T Pending()
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        return m_count;
+    }
+
+private:
+    struct Slot
+    {
+        UINT32 id;
+        PVOID context;
+        UINT64 deadline;
+        DWORD timeoutMs;
+    };
+
+    std::mutex m_lock;
+    std::unordered_map<UINT16, std::deque<Slot>> m_slots;
+    SIZE_T m_count = 0;
+    UINT32 m_nextId = 1;
+};
+
+#endif
@@ -173,6 +173,174 @@ IPCResponseHandler::Invoke( IXodusIPCPacket *response )
 }
 
 
+/**
+ * IPCReceiveChunk: Receive buffer shared by the frames parsed out of it.
+ */
+IPCReceiveChunk *
+IPCReceiveChunk::Create( UINT32 capacity )
+{
+    IPCReceiveChunk *chunk = new (std::nothrow) IPCReceiveChunk();
+    if ( !chunk ) return nullptr;
+
+    chunk->data = (BYTE *)malloc( capacity );
+    if ( !chunk->data )
+    {
+        delete chunk;
+        return nullptr;
+    }
+
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void
+IPCReceiveChunk::AddRef() noexcept
+{
+    ++ref;
+}
+
+void
+IPCReceiveChunk::Release() noexcept
+{
+    if ( !--ref )
+    {
+        free( data );
+        delete this;
+    }
+}
+
+BOOL
+IPCReceiveChunk::IsExclusive() const noexcept
+{
+    return ref.load() == 1;
+}
+
+/**
+ * IPCFrameBuffer: Exposes a frame body inside an IPCReceiveChunk as an IBuffer.
+ */
+IPCFrameBuffer::IPCFrameBuffer(
+    IPCReceiveChunk *chunk,
+    UINT32 offset,
+    UINT32 length )
+:   m_chunk(chunk),
+    m_offset(offset),
+    m_capacity(length),
+    m_length(length)
+{
+    m_chunk->AddRef();
+}
+
+IPCFrameBuffer::~IPCFrameBuffer()
+{
+    m_chunk->Release();
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::QueryInterface( REFIID iid, void **out ) noexcept
+{
+    TRACE( "iface %p, iid %s, out %p.\n", this, debugstr_guid( &iid ), out );
+
+    if (!out) return E_POINTER;
+    *out = nullptr;
+
+    if ( iid == __uuidof( IUnknown ) ||
+         iid == __uuidof( IInspectable ) ||
+         iid == __uuidof( IAgileObject ) ||
+         iid == __uuidof( Windows::Storage::Streams::IBuffer ) )
+    {
+        AddRef();
+        *out = static_cast<Windows::Storage::Streams::IBuffer *>(this);
+        return S_OK;
+    }
+
+    if ( iid == __uuidof( Windows::Storage::Streams::IBufferByteAccess ) )
+    {
+        AddRef();
+        *out = static_cast<Windows::Storage::Streams::IBufferByteAccess *>(this);
+        return S_OK;
+    }
+
+    FIXME( "%s not implemented, returning E_NOINTERFACE.\n", debugstr_guid( &iid ) );
+    *out = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG WINAPI 
+IPCFrameBuffer::AddRef() noexcept
+{
+    ULONG curr = static_cast<ULONG>(++ref);
+    TRACE( "iface %p increasing refcount to %lu.\n", this, curr );
+    return curr;
+}
+
+ULONG WINAPI 
+IPCFrameBuffer::Release() noexcept
+{
+    ULONG curr = static_cast<ULONG>(--ref);
+    TRACE( "iface %p decreasing refcount to %lu.\n", this, curr );
+
+    if ( !curr )
+    {
+        delete this;
+    }
+
+    return curr;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::GetIids( ULONG *iidCount, IID **iids )
+{
+    FIXME("iface %p, iidCount %p, iids %p stub!\n", this, iidCount, iids);
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::GetRuntimeClassName( HSTRING *className )
+{
+    FIXME("iface %p, className %p stub!\n", this, className);
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::GetTrustLevel( TrustLevel *trustLevel )
+{
+    FIXME("iface %p, trustLevel %p stub!\n", this, trustLevel);
+    return E_NOTIMPL;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::get_Capacity( UINT32 *value )
+{
+    TRACE("iface %p, value %p.\n", this, value);
+    *value = m_capacity;
+    return S_OK;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::get_Length( UINT32 *value )
+{
+    TRACE("iface %p, value %p.\n", this, value);
+    *value = m_length;
+    return S_OK;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::put_Length( UINT32 value )
+{
+    TRACE("iface %p, value %u.\n", this, value);
+    if ( value > m_capacity ) return E_INVALIDARG;
+    m_length = value;
+    return S_OK;
+}
+
+HRESULT WINAPI
+IPCFrameBuffer::Buffer( BYTE **value )
+{
+    TRACE("iface %p, value %p.\n", this, value);
+    *value = m_chunk->data + m_offset;
+    return S_OK;
+}
+
 /**
  * MsaTokenResponse: Wraps Msa Token response packets sent by Xodus
  */
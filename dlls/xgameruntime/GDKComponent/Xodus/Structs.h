@@ -20,8 +20,10 @@
  */
 
 #include "../../private.h"
+#include "robuffer.h"
 
 #include <atomic>
+#include <new>
 
 #ifndef __XODUS_STRUCTS__
 #define __XODUS_STRUCTS__
@@ -91,6 +93,74 @@ private:
     std::atomic_long ref{ 1 };
 };
 
+/**
+ * IPCReceiveChunk: Reference counted block the IPC reader receives into.
+ * Frames handed out as IPCFrameBuffer keep the chunk alive.
+ */
+struct IPCReceiveChunk
+{
+public:
+    static IPCReceiveChunk *Create( UINT32 capacity );
+
+    void AddRef() noexcept;
+    void Release() noexcept;
+
+    // TRUE when no IPCFrameBuffer references the chunk.
+    BOOL IsExclusive() const noexcept;
+
+    UINT32 capacity;
+    BYTE *data;
+
+private:
+    IPCReceiveChunk() = default;
+
+    std::atomic_long ref{ 1 };
+};
+
+/**
+ * IPCFrameBuffer: IBuffer over the body of a received frame, in place.
+ * The byte after the body is always NUL, so it can be read as a string.
+ */
+struct IPCFrameBuffer :
+    public Windows::Storage::Streams::IBuffer,
+    public Windows::Storage::Streams::IBufferByteAccess
+{
+public:
+    IPCFrameBuffer( 
+        IPCReceiveChunk *chunk, 
+        UINT32 offset, 
+        UINT32 length );
+    virtual ~IPCFrameBuffer();
+
+    IPCFrameBuffer( const IPCFrameBuffer& ) = delete;
+    IPCFrameBuffer& operator=( const IPCFrameBuffer& ) = delete;
+
+    /* IUnknown Methods */
+    HRESULT WINAPI QueryInterface( REFIID iid, void **out ) noexcept override;
+    ULONG WINAPI AddRef() noexcept override;
+    ULONG WINAPI Release() noexcept override;
+
+    /* IInspectable Methods */
+    HRESULT WINAPI GetIids( ULONG *iidCount, IID **iids ) override;
+    HRESULT WINAPI GetRuntimeClassName( HSTRING *className ) override;
+    HRESULT WINAPI GetTrustLevel( TrustLevel *trustLevel ) override;
+
+    /* IBuffer Methods */
+    HRESULT WINAPI get_Capacity( UINT32 *value ) override;
+    HRESULT WINAPI get_Length( UINT32 *value ) override;
+    HRESULT WINAPI put_Length( UINT32 value ) override;
+
+    /* IBufferByteAccess Methods */
+    HRESULT WINAPI Buffer( BYTE **value ) override;
+
+private:
+    IPCReceiveChunk *m_chunk;
+    UINT32 m_offset;
+    UINT32 m_capacity;
+    UINT32 m_length;
+    std::atomic_long ref{ 1 };
+};
+
 struct MsaTokenResponse :
     public IMsaTokenResponse
 {
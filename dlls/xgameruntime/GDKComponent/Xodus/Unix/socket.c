@@ -102,8 +102,6 @@
 # define HAS_IRDA
 #endif
 
-#define POLL_BUFFER_SIZE 2048
-
 WINE_DEFAULT_DEBUG_CHANNEL(xodus);
 
 // Persist connection
@@ -111,8 +109,9 @@ static int sockfd = 0;
 
 typedef struct _POLL_SOCKET_ARGS
 {
-    BYTE curr_buffer[POLL_BUFFER_SIZE];
-    SIZE_T curr_buffer_size;
+    BYTE *buffer;
+    SIZE_T buffer_size;
+    SIZE_T received;
 } POLL_SOCKET_ARGS;
 
 typedef struct _IPCFrame
@@ -163,6 +162,8 @@ static NTSTATUS conn_sock( void *args )
 }
 
 // MUST BE CALLED IN AN ASYNCHRONOUS CONTEXT!
+// Waits for data and reads as much of it as fits into the caller's buffer.
+// Framing is left to the caller, a read may end in the middle of a frame.
 static NTSTATUS poll_sock( void *args )
 {
     POLL_SOCKET_ARGS *socket_args = (POLL_SOCKET_ARGS *)args;
@@ -175,6 +176,10 @@ static NTSTATUS poll_sock( void *args )
     if ( !sockfd )
         return STATUS_CONNECTION_INVALID;
 
+    socket_args->received = 0;
+    if ( !socket_args->buffer_size )
+        return STATUS_BUFFER_TOO_SMALL;
+
     fds[0].fd = sockfd;
     fds[0].events = POLLIN;
 
@@ -185,13 +190,16 @@ static NTSTATUS poll_sock( void *args )
     if ( ret < 0 )
         return STATUS_CONNECTION_DISCONNECTED;
 
-    if ( fds[0].revents & POLLIN ) 
+    if ( fds[0].revents & (POLLIN | POLLHUP | POLLERR) )
     {
-        n = read( sockfd, socket_args->curr_buffer + socket_args->curr_buffer_size, POLL_BUFFER_SIZE - socket_args->curr_buffer_size );
+        do {
+            n = read( sockfd, socket_args->buffer, socket_args->buffer_size );
+        } while ( n < 0 && errno == EINTR );
+
         if ( n <= 0 ) 
             return STATUS_CONNECTION_DISCONNECTED;
 
-        socket_args->curr_buffer_size += n;
+        socket_args->received = n;
     }
 
     return STATUS_SUCCESS;
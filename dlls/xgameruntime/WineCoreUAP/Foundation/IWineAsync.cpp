@@ -211,6 +211,18 @@ AsyncInfo::Start() noexcept
     return S_OK;
 }
 
+HRESULT WINAPI
+AsyncInfo::Invoke() noexcept
+{
+    TRACE( "iface %p.\n", this );
+
+    // Same as Start(), but runs the callback on the calling thread.
+    IInspectable_outer->AddRef();
+    async_info_callback( NULL, this, NULL );
+
+    return S_OK;
+}
+
 /* IAsyncInfo Methods */
 HRESULT WINAPI
 AsyncInfo::get_Id( UINT32 *id ) noexcept
@@ -510,6 +522,28 @@ AsyncOperation<T>::Create( IUnknown *invoker, PVOID param, async_operation_callb
     return S_OK;
 }
 
+template<typename T>
+HRESULT WINAPI
+AsyncOperation<T>::CreateDeferred( IUnknown *invoker, PVOID param, async_operation_callback callback,
+                                    IAsyncOperation<T> **out, IWineAsyncInfoImpl **info )
+{
+    AsyncOperation<T> *impl = new AsyncOperation<T>();
+    HRESULT hr;
+
+    if ( FAILED( hr = AsyncInfo::Create( invoker, param, callback, static_cast<IInspectable *>(impl), &impl->info ) ) )
+    {
+        delete impl;
+        return hr;
+    }
+
+    impl->info->AddRef();
+    *info = impl->info;
+
+    *out = impl;
+    TRACE( "created deferred AsyncOperation %p\n", *out );
+    return S_OK;
+}
+
 template class AsyncOperation<IInspectable*>;
 template class AsyncOperation<ABI::Xodus::IXodusIPCPacket*>;
 template class AsyncOperation<ABI::Xodus::IMsaTokenResponse*>;
@@ -72,6 +72,9 @@ public:
     HRESULT WINAPI
     Start() noexcept override;
 
+    HRESULT WINAPI
+    Invoke() noexcept override;
+
     /* IAsyncInfo Methods */
     HRESULT WINAPI
     get_Id( UINT32 *id ) noexcept override;
@@ -156,6 +159,12 @@ public:
     Create( IUnknown *invoker, PVOID param, async_operation_callback callback,
                 IAsyncOperation<T> **out );
 
+    // Creates the operation without starting it. The caller gets a reference
+    // to its info and runs the callback later through Start() or Invoke().
+    static HRESULT WINAPI
+    CreateDeferred( IUnknown *invoker, PVOID param, async_operation_callback callback,
+                IAsyncOperation<T> **out, IWineAsyncInfoImpl **info );
+
 private:
     std::atomic_long ref{ 1 };
     IWineAsyncInfoImpl *info;
@@ -267,8 +267,8 @@ HRESULT WINAPI QueryApiImpl( const GUID *runtimeClassId, REFIID interfaceId, voi
 
 HRESULT WINAPI UninitializeApiImpl( void )
 {
-    TRACE("stub!\n");
-    return E_NOTIMPL;
+    TRACE("\n");
+    return UninitializeGDKComponent();
 }
 
 HRESULT WINAPI XErrorReport( HRESULT status, LPCSTR message )
@@ -88,9 +88,10 @@
 
 #define FAIL_FAST_IF_FAILED(hr)                                 do { HRESULT __hrRet = hr; if (FAILED(__hrRet)) { FAIL_FAST_MSG("%s 0x%#lx", #hr, __hrRet); }} while (0)
 
-#define POLL_BUFFER_SIZE 2048
+#define IPC_RECEIVE_CHUNK_SIZE 16384
 #define XODUS_SOCKET_SUFFIX "xodus.sock"
 #define IPC_REQUEST_TIMEOUT_MS 5000
+#define IPC_REQUEST_SWEEP_MS 250
 #define XODUS_INTEROP 0
 
 extern IXThreadingImpl *x_threading_impl;
@@ -119,8 +120,9 @@ typedef struct _INITIALIZE_OPTIONS
 
 typedef struct _POLL_SOCKET_ARGS
 {
-    BYTE curr_buffer[POLL_BUFFER_SIZE];
-    SIZE_T curr_buffer_size;
+    BYTE *buffer;
+    SIZE_T buffer_size;
+    SIZE_T received;
 } POLL_SOCKET_ARGS;
 
 enum unix_funcs
@@ -0,0 +1,461 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  XAsync / XTaskQueue benchmarks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * Every measurement is reported on a single line of the form
+ *
+ *   benchmark: name=<name> unit=<unit> count=<n> min=<x> mean=<x> p50=<x> p99=<x> max=<x>
+ *
+ * (throughput results use unit=items/s and report the rate in every field).
+ * If XGAMERUNTIME_BENCHMARK_OUTPUT is set to a file name, the same results
+ * are appended to that file as JSON objects, one per line, so runs can be
+ * compared with a script.
+ *
+ * Iteration counts are kept small so the test stays fast under winetest;
+ * interactive runs (WINETEST_INTERACTIVE=1) use ten times as many.
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#define COBJMACROS
+#include <initguid.h>
+#include <windef.h>
+#include <winbase.h>
+#include <winreg.h>
+#include <xgameerr.h>
+#include <xasync.h>
+#include <xtaskqueue.h>
+#include <xasyncprovider.h>
+
+#include "wine/test.h"
+#include "xgameruntime_test.h"
+
+static IXThreadingImpl *threading;
+static LARGE_INTEGER frequency;
+static unsigned int scale;
+static FILE *output;
+
+struct bench_result
+{
+    double *samples;
+    unsigned int count;
+};
+
+static double now_us(void)
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter( &counter );
+    return (double)counter.QuadPart * 1000000.0 / frequency.QuadPart;
+}
+
+static int compare_samples( const void *a, const void *b )
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static BOOL init_result( struct bench_result *result, unsigned int count )
+{
+    result->samples = calloc( count, sizeof(*result->samples) );
+    result->count = 0;
+    ok( result->samples != NULL, "failed to allocate %u samples\n", count );
+    return result->samples != NULL;
+}
+
+static void report( const char *name, const char *unit, double min, double mean,
+                    double p50, double p99, double max, unsigned int count )
+{
+    trace( "benchmark: name=%s unit=%s count=%u min=%.2f mean=%.2f p50=%.2f p99=%.2f max=%.2f\n",
+           name, unit, count, min, mean, p50, p99, max );
+
+    if (!output) return;
+    fprintf( output, "{\"name\":\"%s\",\"unit\":\"%s\",\"count\":%u,\"min\":%.3f,\"mean\":%.3f,"
+             "\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}\n", name, unit, count, min, mean, p50, p99, max );
+    fflush( output );
+}
+
+static void report_result( const char *name, struct bench_result *result )
+{
+    double sum = 0;
+    unsigned int i;
+
+    if (!result->count)
+    {
+        skip( "%s: no samples\n", name );
+        free( result->samples );
+        return;
+    }
+
+    qsort( result->samples, result->count, sizeof(*result->samples), compare_samples );
+    for (i = 0; i < result->count; i++) sum += result->samples[i];
+
+    report( name, "us", result->samples[0], sum / result->count,
+            result->samples[result->count / 2], result->samples[(result->count * 99) / 100],
+            result->samples[result->count - 1], result->count );
+
+    free( result->samples );
+}
+
+static void report_rate( const char *name, double rate, unsigned int count )
+{
+    report( name, "items/s", rate, rate, rate, rate, rate, count );
+}
+
+static HRESULT create_queue( XTaskQueueDispatchMode mode, XTaskQueueHandle *queue )
+{
+    HRESULT hr = IXThreadingImpl_XTaskQueueCreate( threading, mode, XTaskQueueDispatchMode_Manual, queue );
+    ok( hr == S_OK, "XTaskQueueCreate failed, hr %#lx\n", hr );
+    return hr;
+}
+
+static void close_queue( XTaskQueueHandle queue )
+{
+    HRESULT hr = IXThreadingImpl_XTaskQueueTerminate( threading, queue, TRUE, NULL, NULL );
+    ok( hr == S_OK, "XTaskQueueTerminate failed, hr %#lx\n", hr );
+    IXThreadingImpl_XTaskQueueCloseHandle( threading, queue );
+}
+
+struct latency_context
+{
+    double submitted;
+    double latency;
+    HANDLE done;
+};
+
+static void __stdcall latency_callback( void *context, BOOLEAN canceled )
+{
+    struct latency_context *ctx = context;
+
+    ctx->latency = now_us() - ctx->submitted;
+    if (ctx->done) SetEvent( ctx->done );
+}
+
+static void test_submit_latency( XTaskQueueDispatchMode mode, const char *name )
+{
+    unsigned int i, iterations = 1000 * scale;
+    struct latency_context ctx = { 0 };
+    struct bench_result result;
+    XTaskQueueHandle queue;
+    BOOLEAN dispatched;
+    HRESULT hr;
+    DWORD ret;
+
+    if (FAILED(create_queue( mode, &queue ))) return;
+    if (!init_result( &result, iterations )) goto done;
+
+    if (mode != XTaskQueueDispatchMode_Manual) ctx.done = CreateEventA( NULL, FALSE, FALSE, NULL );
+
+    for (i = 0; i < iterations; i++)
+    {
+        ctx.latency = -1;
+        ctx.submitted = now_us();
+
+        hr = IXThreadingImpl_XTaskQueueSubmitCallback( threading, queue, XTaskQueuePort_Work, &ctx, latency_callback );
+        ok( hr == S_OK, "XTaskQueueSubmitCallback failed, hr %#lx\n", hr );
+        if (FAILED(hr)) break;
+
+        if (mode == XTaskQueueDispatchMode_Manual)
+        {
+            dispatched = IXThreadingImpl_XTaskQueueDispatch( threading, queue, XTaskQueuePort_Work, 0 );
+            ok( dispatched, "XTaskQueueDispatch returned FALSE\n" );
+        }
+        else
+        {
+            ret = WaitForSingleObject( ctx.done, 5000 );
+            ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %#lx\n", ret );
+            if (ret != WAIT_OBJECT_0) break;
+        }
+
+        if (ctx.latency >= 0) result.samples[result.count++] = ctx.latency;
+    }
+
+    report_result( name, &result );
+    if (ctx.done) CloseHandle( ctx.done );
+
+done:
+    close_queue( queue );
+}
+
+struct throughput_context
+{
+    XTaskQueueHandle queue;
+    unsigned int items;
+    LONG remaining;
+    HANDLE start;
+    HANDLE done;
+};
+
+static void __stdcall throughput_callback( void *context, BOOLEAN canceled )
+{
+    struct throughput_context *ctx = context;
+    if (!InterlockedDecrement( &ctx->remaining )) SetEvent( ctx->done );
+}
+
+static DWORD WINAPI throughput_producer( void *arg )
+{
+    struct throughput_context *ctx = arg;
+    unsigned int i;
+    HRESULT hr;
+
+    WaitForSingleObject( ctx->start, INFINITE );
+
+    for (i = 0; i < ctx->items; i++)
+    {
+        hr = IXThreadingImpl_XTaskQueueSubmitCallback( threading, ctx->queue, XTaskQueuePort_Work, ctx, throughput_callback );
+        if (FAILED(hr))
+        {
+            ok( 0, "XTaskQueueSubmitCallback failed, hr %#lx\n", hr );
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void test_throughput( unsigned int producers )
+{
+    struct throughput_context ctx = { 0 };
+    HANDLE threads[8];
+    double start, elapsed;
+    XTaskQueueHandle queue;
+    unsigned int i;
+    char name[64];
+    DWORD ret;
+
+    if (FAILED(create_queue( XTaskQueueDispatchMode_ThreadPool, &queue ))) return;
+
+    ctx.queue = queue;
+    ctx.items = 20000 * scale / producers;
+    ctx.remaining = ctx.items * producers;
+    ctx.start = CreateEventA( NULL, TRUE, FALSE, NULL );
+    ctx.done = CreateEventA( NULL, TRUE, FALSE, NULL );
+
+    for (i = 0; i < producers; i++)
+    {
+        threads[i] = CreateThread( NULL, 0, throughput_producer, &ctx, 0, NULL );
+        ok( threads[i] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+        if (!threads[i]) break;
+    }
+
+    /* with a producer missing the count never drops to zero, so only time full runs */
+    start = now_us();
+    SetEvent( ctx.start );
+
+    ret = i == producers ? WaitForSingleObject( ctx.done, 60000 ) : WAIT_FAILED;
+    ok( i < producers || ret == WAIT_OBJECT_0, "WaitForSingleObject returned %#lx, %ld callbacks left\n",
+        ret, ctx.remaining );
+    elapsed = now_us() - start;
+
+    WaitForMultipleObjects( i, threads, TRUE, INFINITE );
+    while (i--) CloseHandle( threads[i] );
+
+    if (ret == WAIT_OBJECT_0)
+    {
+        sprintf( name, "throughput_threadpool_%uproducers", producers );
+        report_rate( name, ctx.items * producers * 1000000.0 / elapsed, ctx.items * producers );
+    }
+
+    CloseHandle( ctx.start );
+    CloseHandle( ctx.done );
+    close_queue( queue );
+}
+
+static void test_delayed_accuracy( UINT32 delay )
+{
+    unsigned int i, iterations = 10 * scale;
+    struct latency_context ctx = { 0 };
+    struct bench_result result;
+    XTaskQueueHandle queue;
+    char name[64];
+    HRESULT hr;
+    DWORD ret;
+
+    if (FAILED(create_queue( XTaskQueueDispatchMode_ThreadPool, &queue ))) return;
+    if (!init_result( &result, iterations )) goto done;
+
+    ctx.done = CreateEventA( NULL, FALSE, FALSE, NULL );
+
+    for (i = 0; i < iterations; i++)
+    {
+        ctx.submitted = now_us();
+
+        hr = IXThreadingImpl_XTaskQueueSubmitDelayedCallback( threading, queue, XTaskQueuePort_Work, delay, &ctx, latency_callback );
+        ok( hr == S_OK, "XTaskQueueSubmitDelayedCallback failed, hr %#lx\n", hr );
+        if (FAILED(hr)) break;
+
+        ret = WaitForSingleObject( ctx.done, delay + 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %#lx\n", ret );
+        if (ret != WAIT_OBJECT_0) break;
+
+        /* timer resolution varies, so early callbacks are reported rather than failed */
+        if (ctx.latency < delay * 1000.0)
+            trace( "delayed_lateness_%ums: callback ran %.0fus early\n", delay, delay * 1000.0 - ctx.latency );
+
+        /* report how late the callback ran, not the delay itself */
+        result.samples[result.count++] = ctx.latency - delay * 1000.0;
+    }
+
+    sprintf( name, "delayed_lateness_%ums", delay );
+    report_result( name, &result );
+    CloseHandle( ctx.done );
+
+done:
+    close_queue( queue );
+}
+
+static void test_waiter_latency(void)
+{
+    unsigned int i, iterations = 500 * scale;
+    struct latency_context ctx = { 0 };
+    XTaskQueueRegistrationToken token;
+    struct bench_result result;
+    XTaskQueueHandle queue;
+    HANDLE signal;
+    HRESULT hr;
+    DWORD ret;
+
+    if (FAILED(create_queue( XTaskQueueDispatchMode_ThreadPool, &queue ))) return;
+    if (!init_result( &result, iterations )) goto done;
+
+    signal = CreateEventA( NULL, FALSE, FALSE, NULL );
+    ctx.done = CreateEventA( NULL, FALSE, FALSE, NULL );
+
+    hr = IXThreadingImpl_XTaskQueueRegisterWaiter( threading, queue, XTaskQueuePort_Work, signal, &ctx, latency_callback, &token );
+    ok( hr == S_OK, "XTaskQueueRegisterWaiter failed, hr %#lx\n", hr );
+
+    for (i = 0; SUCCEEDED(hr) && i < iterations; i++)
+    {
+        ctx.submitted = now_us();
+        SetEvent( signal );
+
+        ret = WaitForSingleObject( ctx.done, 5000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForSingleObject returned %#lx\n", ret );
+        if (ret != WAIT_OBJECT_0) break;
+
+        result.samples[result.count++] = ctx.latency;
+    }
+
+    if (SUCCEEDED(hr)) IXThreadingImpl_XTaskQueueUnregisterWaiter( threading, queue, token );
+
+    report_result( "waiter_wake", &result );
+    CloseHandle( ctx.done );
+    CloseHandle( signal );
+
+done:
+    close_queue( queue );
+}
+
+static HRESULT __stdcall roundtrip_provider( XAsyncOp op, const XAsyncProviderData *data )
+{
+    switch (op)
+    {
+    case XAsyncOp_Begin:
+        return IXThreadingImpl_XAsyncSchedule( threading, data->async, 0 );
+    case XAsyncOp_DoWork:
+        IXThreadingImpl_XAsyncComplete( threading, data->async, S_OK, sizeof(DWORD) );
+        return S_OK;
+    case XAsyncOp_GetResult:
+        *(DWORD *)data->buffer = 0xdeadbeef;
+        return S_OK;
+    default:
+        return S_OK;
+    }
+}
+
+static void test_async_roundtrip(void)
+{
+    unsigned int i, iterations = 1000 * scale;
+    struct bench_result result;
+    XTaskQueueHandle queue;
+    XAsyncBlock async;
+    double start;
+    DWORD value;
+    HRESULT hr;
+
+    if (FAILED(create_queue( XTaskQueueDispatchMode_ThreadPool, &queue ))) return;
+    if (!init_result( &result, iterations )) goto done;
+
+    for (i = 0; i < iterations; i++)
+    {
+        memset( &async, 0, sizeof(async) );
+        async.queue = queue;
+        value = 0;
+
+        start = now_us();
+
+        hr = IXThreadingImpl_XAsyncBegin( threading, &async, NULL, NULL, NULL, roundtrip_provider );
+        ok( hr == S_OK, "XAsyncBegin failed, hr %#lx\n", hr );
+        if (FAILED(hr)) break;
+
+        hr = IXThreadingImpl_XAsyncGetStatus( threading, &async, TRUE );
+        ok( hr == S_OK, "XAsyncGetStatus returned %#lx\n", hr );
+
+        hr = IXThreadingImpl_XAsyncGetResult( threading, &async, NULL, sizeof(value), &value, NULL );
+        ok( hr == S_OK, "XAsyncGetResult returned %#lx\n", hr );
+        ok( value == 0xdeadbeef, "got value %#lx\n", value );
+
+        result.samples[result.count++] = now_us() - start;
+    }
+
+    report_result( "xasync_roundtrip", &result );
+
+done:
+    close_queue( queue );
+}
+
+START_TEST(benchmark)
+{
+    const char *filename;
+
+    if (!(threading = get_threading()))
+    {
+        release_threading( NULL );
+        return;
+    }
+
+    QueryPerformanceFrequency( &frequency );
+    scale = winetest_interactive ? 10 : 1;
+
+    if ((filename = getenv( "XGAMERUNTIME_BENCHMARK_OUTPUT" )))
+    {
+        output = fopen( filename, "a" );
+        ok( output != NULL, "failed to open %s\n", filename );
+    }
+
+    test_submit_latency( XTaskQueueDispatchMode_Manual, "submit_latency_manual" );
+    test_submit_latency( XTaskQueueDispatchMode_ThreadPool, "submit_latency_threadpool" );
+    test_submit_latency( XTaskQueueDispatchMode_SerializedThreadPool, "submit_latency_serialized" );
+
+    test_throughput( 1 );
+    test_throughput( 2 );
+    test_throughput( 4 );
+    test_throughput( 8 );
+
+    test_delayed_accuracy( 1 );
+    test_delayed_accuracy( 10 );
+    test_delayed_accuracy( 50 );
+
+    test_waiter_latency();
+    test_async_roundtrip();
+
+    if (output) fclose( output );
+    release_threading( threading );
+}
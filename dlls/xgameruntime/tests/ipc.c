@@ -0,0 +1,281 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  Xodus IPC against a mock Xodus server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <windef.h>
+#include <winbase.h>
+#include <winsock2.h>
+#include <afunix.h>
+
+#include "wine/test.h"
+
+/* wire values of the Xodus protocol */
+#define XODUS_MAGIC_XML 0x58445358
+#define XODUS_PING      1
+#define XODUS_PONG      2
+#define XODUS_EVENT     0x7fff
+
+#include "pshpack1.h"
+struct frame_header
+{
+    UINT32 magic;
+    UINT16 type;
+    UINT16 length;
+};
+#include "poppack.h"
+
+typedef HRESULT (WINAPI *InitializeApiImpl_func)( ULONG gdkVer, ULONG gsVer );
+typedef WCHAR * (CDECL *wine_get_dos_file_name_func)( const char *path );
+
+/* Runs in the child process, which connects to the mock server. */
+static void child_initialize( const char *mode )
+{
+    InitializeApiImpl_func pInitializeApiImpl;
+    HMODULE module;
+    DWORD start, elapsed;
+    HRESULT hr;
+
+    module = LoadLibraryA( "xgameruntime.dll" );
+    if (!module)
+    {
+        win_skip( "xgameruntime.dll is not available\n" );
+        return;
+    }
+
+    pInitializeApiImpl = (InitializeApiImpl_func)GetProcAddress( module, "InitializeApiImpl" );
+    ok( pInitializeApiImpl != NULL, "InitializeApiImpl is not exported\n" );
+    if (!pInitializeApiImpl) return;
+
+    start = GetTickCount();
+    hr = pInitializeApiImpl( 0, 0 );
+    elapsed = GetTickCount() - start;
+
+    if (!strcmp( mode, "pong" ))
+    {
+        /* The PONG is matched to the PING despite the frame in front of it. */
+        ok( hr != HRESULT_FROM_NT( STATUS_TIMEOUT ) && hr != HRESULT_FROM_WIN32( ERROR_TIMEOUT ),
+            "PING was not answered, hr %#lx\n", hr );
+    }
+    else
+    {
+        /* The request times out on its own, before the 10s PING wait gives up. */
+        ok( FAILED( hr ), "got hr %#lx\n", hr );
+        ok( elapsed < 9000, "took %lu ms\n", elapsed );
+    }
+
+    FreeLibrary( module );
+}
+
+static BOOL wait_readable( SOCKET s, DWORD timeout )
+{
+    struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+    fd_set set;
+
+    FD_ZERO( &set );
+    FD_SET( s, &set );
+    return select( 0, &set, NULL, NULL, &tv ) == 1;
+}
+
+static BOOL recv_all( SOCKET s, void *buffer, int size, DWORD timeout )
+{
+    char *ptr = buffer;
+    int ret;
+
+    while (size)
+    {
+        if (!wait_readable( s, timeout )) return FALSE;
+        if ((ret = recv( s, ptr, size, 0 )) <= 0) return FALSE;
+        ptr += ret;
+        size -= ret;
+    }
+
+    return TRUE;
+}
+
+/* Receives the child's PING, or returns FALSE if none arrives. */
+static BOOL recv_ping( SOCKET client )
+{
+    struct frame_header header;
+    char body[64];
+
+    if (!recv_all( client, &header, sizeof(header), 3000 )) return FALSE;
+
+    ok( header.magic == XODUS_MAGIC_XML, "got magic %#x\n", header.magic );
+    ok( header.type == XODUS_PING, "got type %u\n", header.type );
+    ok( header.length <= sizeof(body), "got length %u\n", header.length );
+    if (header.length > sizeof(body)) return FALSE;
+
+    return recv_all( client, body, header.length, 3000 );
+}
+
+static void send_pong( SOCKET client )
+{
+    static const char event[] = "<event/>";
+    char buffer[2 * sizeof(struct frame_header) + sizeof(event)];
+    struct frame_header header;
+    int size, ret;
+
+    /* An unsolicited frame is followed by the PONG, and the PONG is split
+     * across writes. */
+    header.magic = XODUS_MAGIC_XML;
+    header.type = XODUS_EVENT;
+    header.length = sizeof(event) - 1;
+    memcpy( buffer, &header, sizeof(header) );
+    memcpy( buffer + sizeof(header), event, header.length );
+    size = sizeof(header) + header.length;
+
+    header.type = XODUS_PONG;
+    header.length = 0;
+    memcpy( buffer + size, &header, sizeof(header) );
+    size += sizeof(header);
+
+    ret = send( client, buffer, size - 3, 0 );
+    ok( ret == size - 3, "send returned %d, error %d\n", ret, WSAGetLastError() );
+    Sleep( 50 );
+    ret = send( client, buffer + size - 3, 3, 0 );
+    ok( ret == 3, "send returned %d, error %d\n", ret, WSAGetLastError() );
+}
+
+/* Starts a child in the given mode and serves its connection. Returns FALSE
+ * if the child never sent a PING, i.e. Xodus interop is disabled. */
+static BOOL serve_child( SOCKET listener, const char *mode )
+{
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup = { sizeof(startup) };
+    char cmdline[MAX_PATH + 32];
+    SOCKET client = INVALID_SOCKET;
+    BOOL pinged = FALSE;
+    char **argv;
+    unsigned int i;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    sprintf( cmdline, "\"%s\" ipc %s", argv[0], mode );
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    ok( ret, "CreateProcess failed, error %lu\n", GetLastError() );
+    if (!ret) return FALSE;
+
+    /* Without interop the child exits without ever connecting. */
+    for (i = 0; i < 100 && client == INVALID_SOCKET; i++)
+    {
+        if (wait_readable( listener, 100 ))
+            client = accept( listener, NULL, NULL );
+        else if (!WaitForSingleObject( info.hProcess, 0 ))
+            break;
+    }
+    ok( client != INVALID_SOCKET || !WaitForSingleObject( info.hProcess, 0 ), "the runtime did not connect\n" );
+
+    if (client != INVALID_SOCKET && (pinged = recv_ping( client )))
+    {
+        if (!strcmp( mode, "pong" )) send_pong( client );
+    }
+
+    wait_child_process( &info );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+    if (client != INVALID_SOCKET) closesocket( client );
+
+    return pinged;
+}
+
+static void test_xodus_ipc(void)
+{
+    wine_get_dos_file_name_func pwine_get_dos_file_name;
+    SOCKADDR_UN addr = { AF_UNIX };
+    char runtime[MAX_PATH];
+    SOCKET listener;
+    WCHAR *dir;
+    int ret;
+
+    pwine_get_dos_file_name = (void *)GetProcAddress( GetModuleHandleA( "kernel32.dll" ), "wine_get_dos_file_name" );
+    if (!pwine_get_dos_file_name)
+    {
+        win_skip( "Xodus is only available on Wine\n" );
+        return;
+    }
+
+    /* The runtime connects to $XDG_RUNTIME_DIR/xodus.sock. */
+    if (!GetEnvironmentVariableA( "WINE_HOST_XDG_RUNTIME_DIR", runtime, sizeof(runtime) ))
+    {
+        skip( "XDG_RUNTIME_DIR is not set\n" );
+        return;
+    }
+
+    dir = pwine_get_dos_file_name( runtime );
+    ok( dir != NULL, "could not map %s\n", debugstr_a(runtime) );
+    if (!dir) return;
+
+    ret = WideCharToMultiByte( CP_ACP, 0, dir, -1, addr.sun_path, sizeof(addr.sun_path) - sizeof("\\xodus.sock"), NULL, NULL );
+    HeapFree( GetProcessHeap(), 0, dir );
+    ok( ret, "WideCharToMultiByte failed, error %lu\n", GetLastError() );
+    if (!ret) return;
+    strcat( addr.sun_path, "\\xodus.sock" );
+
+    if (GetFileAttributesA( addr.sun_path ) != INVALID_FILE_ATTRIBUTES)
+    {
+        skip( "%s already exists, a Xodus service may be running\n", debugstr_a(addr.sun_path) );
+        return;
+    }
+
+    listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+    ok( listener != INVALID_SOCKET, "socket failed, error %d\n", WSAGetLastError() );
+    if (listener == INVALID_SOCKET) return;
+
+    ret = bind( listener, (struct sockaddr *)&addr, sizeof(addr) );
+    ok( !ret, "bind failed, error %d\n", WSAGetLastError() );
+    ret = ret ? ret : listen( listener, 1 );
+    ok( !ret, "listen failed, error %d\n", WSAGetLastError() );
+
+    if (!ret)
+    {
+        if (!serve_child( listener, "pong" ))
+            skip( "Xodus interop is disabled\n" );
+        else
+            serve_child( listener, "silent" );
+    }
+
+    closesocket( listener );
+    DeleteFileA( addr.sun_path );
+}
+
+START_TEST(ipc)
+{
+    WSADATA data;
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc > 2)
+    {
+        child_initialize( argv[2] );
+        return;
+    }
+
+    if (WSAStartup( MAKEWORD(2, 2), &data ))
+    {
+        skip( "WSAStartup failed\n" );
+        return;
+    }
+
+    test_xodus_ipc();
+
+    WSACleanup();
+}
@@ -0,0 +1,259 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  Xodus request / response correlation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The IPC layer only talks to Xodus once interop is enabled, so these tests
+ * drive its request table the way the layer does: register requests as they
+ * are sent, and match response frames as a mock server sends them. Xodus
+ * answers a request of type n with type n + 1, in order per type, but
+ * responses of different types may come back in any order.
+ */
+
+#include "../GDKComponent/Xodus/IPCRequestTable.h"
+
+extern "C" {
+#include "wine/test.h"
+}
+
+#define XODUS_PING      1
+#define XODUS_PONG      2
+#define XODUS_MSA       3
+#define XODUS_MSA_REPLY 4
+#define XODUS_EVENT     0x7fff
+
+#define CONCURRENT_REQUESTS 2000
+
+struct request
+{
+    UINT16 type;
+    LONG completed;
+};
+
+static UINT16 response_type( UINT16 type )
+{
+    return type + 1;
+}
+
+/* Matches one response frame as the IPC layer does and checks that it lands
+ * on the request it answers. */
+static void complete( IPCRequestTable &table, UINT16 type, struct request *expect )
+{
+    struct request *request;
+    PVOID context = NULL;
+    BOOL ret;
+
+    ret = table.Match( type, &context );
+    ok( ret, "type %u: no request matched\n", type );
+    if (!ret) return;
+
+    request = static_cast<struct request *>(context);
+    ok( request == expect, "type %u: completed request %p, expected %p\n", type, request, expect );
+    if (!request) return;
+
+    ok( response_type( request->type ) == type, "request of type %u got a response of type %u\n",
+        request->type, type );
+    ok( InterlockedIncrement( &request->completed ) == 1, "request %p completed twice\n", request );
+}
+
+static void test_out_of_order(void)
+{
+    static const UINT16 types[] = { XODUS_PING, XODUS_MSA, XODUS_PING, XODUS_MSA, XODUS_MSA, XODUS_PING };
+    struct request requests[ARRAY_SIZE(types)] = {};
+    IPCRequestTable table;
+    PVOID context;
+    UINT i;
+
+    for (i = 0; i < ARRAY_SIZE(types); i++)
+    {
+        requests[i].type = types[i];
+        ok( table.Add( &requests[i], response_type( types[i] ), 60000 ) != 0, "got id 0\n" );
+    }
+    ok( table.Pending() == ARRAY_SIZE(types), "got %Iu pending\n", table.Pending() );
+
+    /* frames nobody waits for are left to the ResponseReceived handlers */
+    ok( !table.Match( XODUS_EVENT, &context ), "matched an event\n" );
+
+    /* the MSA replies overtake the PONGs, each type stays in order */
+    complete( table, XODUS_MSA_REPLY, &requests[1] );
+    complete( table, XODUS_PONG, &requests[0] );
+    complete( table, XODUS_MSA_REPLY, &requests[3] );
+    ok( !table.Match( XODUS_EVENT, &context ), "matched an event\n" );
+    complete( table, XODUS_MSA_REPLY, &requests[4] );
+    complete( table, XODUS_PONG, &requests[2] );
+    complete( table, XODUS_PONG, &requests[5] );
+
+    ok( !table.Match( XODUS_PONG, &context ), "matched a PONG with nothing pending\n" );
+    ok( table.Pending() == 0, "got %Iu pending\n", table.Pending() );
+
+    for (i = 0; i < ARRAY_SIZE(types); i++)
+        ok( requests[i].completed == 1, "request %u completed %ld times\n", i, requests[i].completed );
+}
+
+static void test_timeout(void)
+{
+    struct request first = { XODUS_PING }, second = { XODUS_PING }, third = { XODUS_PING };
+    std::vector<PVOID> expired;
+    IPCRequestTable table;
+    PVOID context;
+    UINT64 now;
+
+    now = GetTickCount64();
+    table.Add( &first, XODUS_PONG, 100 );
+    table.Add( &second, XODUS_PONG, 60000 );
+
+    expired = table.Expire( now + 1000 );
+    ok( expired.size() == 1 && expired[0] == &first, "got %Iu expired requests\n", expired.size() );
+
+    /* the late PONG of the first request must not complete the second one */
+    context = &third;
+    ok( table.Match( XODUS_PONG, &context ), "late response did not match\n" );
+    ok( context == NULL, "late response matched %p\n", context );
+    complete( table, XODUS_PONG, &second );
+
+    /* a response that never comes releases the poisoned slot eventually */
+    now = GetTickCount64();
+    table.Add( &third, XODUS_PONG, 100 );
+    expired = table.Expire( now + 1000 );
+    ok( expired.size() == 1 && expired[0] == &third, "got %Iu expired requests\n", expired.size() );
+    ok( table.Pending() == 1, "got %Iu pending\n", table.Pending() );
+    expired = table.Expire( now + 2000 );
+    ok( expired.empty(), "got %Iu expired requests\n", expired.size() );
+    ok( table.Pending() == 0, "got %Iu pending\n", table.Pending() );
+    ok( !table.Match( XODUS_PONG, &context ), "matched a released slot\n" );
+}
+
+static void test_remove(void)
+{
+    struct request requests[3] = { { XODUS_PING }, { XODUS_PING }, { XODUS_PING } };
+    IPCRequestTable table;
+    UINT32 id;
+
+    table.Add( &requests[0], XODUS_PONG, 60000 );
+    id = table.Add( &requests[1], XODUS_PONG, 60000 );
+    table.Add( &requests[2], XODUS_PONG, 60000 );
+
+    /* a request that failed to send gives its place to the next one */
+    ok( table.Remove( id ) == &requests[1], "Remove did not return the request\n" );
+    ok( table.Remove( id ) == NULL, "Remove succeeded twice\n" );
+
+    complete( table, XODUS_PONG, &requests[0] );
+    complete( table, XODUS_PONG, &requests[2] );
+    ok( table.Pending() == 0, "got %Iu pending\n", table.Pending() );
+}
+
+struct concurrent_context
+{
+    IPCRequestTable table;
+    struct request requests[CONCURRENT_REQUESTS];
+    LONG sent;
+};
+
+/* Sends the requests while the server is already answering earlier ones. */
+static DWORD WINAPI client_thread( void *arg )
+{
+    struct concurrent_context *ctx = (struct concurrent_context *)arg;
+    UINT i;
+
+    for (i = 0; i < CONCURRENT_REQUESTS; i++)
+    {
+        ok( ctx->table.Add( &ctx->requests[i], response_type( ctx->requests[i].type ), 60000 ) != 0, "got id 0\n" );
+        WriteRelease( &ctx->sent, i + 1 );
+    }
+
+    return 0;
+}
+
+/* Answers every request that was sent, MSA replies first, so responses of
+ * different types keep overtaking each other. */
+static DWORD WINAPI server_thread( void *arg )
+{
+    struct concurrent_context *ctx = (struct concurrent_context *)arg;
+    UINT next[2] = { 0, 0 }, answered = 0, type, sent, i;
+
+    while (answered < CONCURRENT_REQUESTS)
+    {
+        sent = ReadAcquire( &ctx->sent );
+
+        for (type = 2; type--;)
+        {
+            UINT16 request_type = type ? XODUS_MSA : XODUS_PING;
+
+            for (i = next[type]; i < sent; i++)
+            {
+                if (ctx->requests[i].type != request_type) continue;
+                complete( ctx->table, response_type( request_type ), &ctx->requests[i] );
+                answered++;
+            }
+            next[type] = i;
+        }
+
+        if (answered < CONCURRENT_REQUESTS) YieldProcessor();
+    }
+
+    return 0;
+}
+
+static void test_concurrent(void)
+{
+    struct concurrent_context *ctx;
+    HANDLE threads[2];
+    UINT i, count = 0;
+    DWORD ret;
+
+    ctx = new (std::nothrow) concurrent_context();
+    ok( ctx != NULL, "failed to allocate the context\n" );
+    if (!ctx) return;
+
+    /* runs of PINGs and MSA requests of varying length */
+    for (i = 0; i < CONCURRENT_REQUESTS; i++)
+        ctx->requests[i].type = (i * 7 / 3) % 2 ? XODUS_MSA : XODUS_PING;
+
+    /* the server only waits for requests the client already started sending */
+    for (i = 0; i < ARRAY_SIZE(threads); i++)
+    {
+        threads[count] = CreateThread( NULL, 0, i ? server_thread : client_thread, ctx, 0, NULL );
+        ok( threads[count] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+        if (!threads[count]) break;
+        count++;
+    }
+
+    if (count)
+    {
+        ret = WaitForMultipleObjects( count, threads, TRUE, 60000 );
+        ok( ret == WAIT_OBJECT_0, "WaitForMultipleObjects returned %#lx\n", ret );
+    }
+
+    if (count == ARRAY_SIZE(threads))
+    {
+        for (i = 0; i < CONCURRENT_REQUESTS; i++)
+            ok( ctx->requests[i].completed == 1, "request %u completed %ld times\n", i, ctx->requests[i].completed );
+        ok( ctx->table.Pending() == 0, "got %Iu pending\n", ctx->table.Pending() );
+    }
+
+    for (i = 0; i < count; i++) CloseHandle( threads[i] );
+    delete ctx;
+}
+
+extern "C" START_TEST(ipcrequest)
+{
+    test_out_of_order();
+    test_timeout();
+    test_remove();
+    test_concurrent();
+}
@@ -0,0 +1,238 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  XTaskQueue producer / consumer tests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <stdarg.h>
+#define COBJMACROS
+#include <initguid.h>
+#include <windef.h>
+#include <winbase.h>
+#include <winreg.h>
+#include <xgameerr.h>
+#include <xtaskqueue.h>
+#include <xasyncprovider.h>
+
+#include "wine/test.h"
+#include "xgameruntime_test.h"
+
+#define QUEUE_THREADS 2
+#define QUEUE_ITEMS 10000
+
+static IXThreadingImpl *threading;
+
+struct queue_item
+{
+    struct queue_context *ctx;
+    UINT value;
+};
+
+struct queue_context
+{
+    XTaskQueueHandle queue;
+    struct queue_item *items;
+    LONG producer_index;
+    LONG started;
+    LONG go;
+    LONG abort;
+    LONG dispatched;
+    LONG64 sum;
+    UINT next;
+    HANDLE done;
+};
+
+static void __stdcall sum_callback( void *context, BOOLEAN canceled )
+{
+    struct queue_item *item = context;
+    struct queue_context *ctx = item->ctx;
+
+    InterlockedAdd64( &ctx->sum, item->value );
+    if (InterlockedIncrement( &ctx->dispatched ) == QUEUE_THREADS * QUEUE_ITEMS && ctx->done)
+        SetEvent( ctx->done );
+}
+
+static void __stdcall order_callback( void *context, BOOLEAN canceled )
+{
+    struct queue_item *item = context;
+
+    ok( item->value == item->ctx->next, "got item %u, expected %u\n", item->value, item->ctx->next );
+    item->ctx->next++;
+}
+
+static void wait_for_start( struct queue_context *ctx )
+{
+    InterlockedIncrement( &ctx->started );
+    while (!ReadAcquire( &ctx->go )) YieldProcessor();
+}
+
+static DWORD WINAPI producer_thread( void *arg )
+{
+    struct queue_context *ctx = arg;
+    struct queue_item *items;
+    HRESULT hr;
+    UINT i;
+
+    items = ctx->items + (InterlockedIncrement( &ctx->producer_index ) - 1) * QUEUE_ITEMS;
+    wait_for_start( ctx );
+
+    for (i = 0; i < QUEUE_ITEMS && !ReadAcquire( &ctx->abort ); i++)
+    {
+        items[i].ctx = ctx;
+        items[i].value = i + 1;
+
+        hr = IXThreadingImpl_XTaskQueueSubmitCallback( threading, ctx->queue, XTaskQueuePort_Work, &items[i], sum_callback );
+        if (FAILED(hr))
+        {
+            ok( 0, "XTaskQueueSubmitCallback failed, hr %#lx\n", hr );
+            WriteRelease( &ctx->abort, 1 );
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static DWORD WINAPI consumer_thread( void *arg )
+{
+    struct queue_context *ctx = arg;
+
+    wait_for_start( ctx );
+
+    while (ReadAcquire( &ctx->dispatched ) < QUEUE_THREADS * QUEUE_ITEMS && !ReadAcquire( &ctx->abort ))
+        IXThreadingImpl_XTaskQueueDispatch( threading, ctx->queue, XTaskQueuePort_Work, 10 );
+
+    return 0;
+}
+
+static void test_manual_order(void)
+{
+    struct queue_context ctx = { 0 };
+    struct queue_item items[100];
+    BOOLEAN dispatched;
+    HRESULT hr;
+    UINT i;
+
+    hr = IXThreadingImpl_XTaskQueueCreate( threading, XTaskQueueDispatchMode_Manual, XTaskQueueDispatchMode_Manual, &ctx.queue );
+    ok( hr == S_OK, "XTaskQueueCreate failed, hr %#lx\n", hr );
+    if (FAILED(hr)) return;
+
+    for (i = 0; i < ARRAY_SIZE(items); i++)
+    {
+        items[i].ctx = &ctx;
+        items[i].value = i;
+        hr = IXThreadingImpl_XTaskQueueSubmitCallback( threading, ctx.queue, XTaskQueuePort_Work, &items[i], order_callback );
+        ok( hr == S_OK, "XTaskQueueSubmitCallback failed, hr %#lx\n", hr );
+    }
+
+    for (i = 0; i < ARRAY_SIZE(items); i++)
+    {
+        dispatched = IXThreadingImpl_XTaskQueueDispatch( threading, ctx.queue, XTaskQueuePort_Work, 0 );
+        ok( dispatched, "XTaskQueueDispatch %u returned FALSE\n", i );
+    }
+
+    dispatched = IXThreadingImpl_XTaskQueueDispatch( threading, ctx.queue, XTaskQueuePort_Work, 0 );
+    ok( !dispatched, "XTaskQueueDispatch returned TRUE on an empty queue\n" );
+    ok( ctx.next == ARRAY_SIZE(items), "dispatched %u items\n", ctx.next );
+
+    hr = IXThreadingImpl_XTaskQueueTerminate( threading, ctx.queue, TRUE, NULL, NULL );
+    ok( hr == S_OK, "XTaskQueueTerminate failed, hr %#lx\n", hr );
+    IXThreadingImpl_XTaskQueueCloseHandle( threading, ctx.queue );
+}
+
+/* Manual queues are drained by our consumer threads, ThreadPool queues by the
+ * runtime's workers. Either way every item must be dispatched exactly once. */
+static void test_producers( XTaskQueueDispatchMode mode, const char *name )
+{
+    static const UINT64 expect = (UINT64)QUEUE_THREADS * QUEUE_ITEMS * (QUEUE_ITEMS + 1) / 2;
+    unsigned int i, count = 0, consumers = mode == XTaskQueueDispatchMode_Manual ? QUEUE_THREADS : 0;
+    struct queue_context ctx = { 0 };
+    HANDLE threads[QUEUE_THREADS * 2];
+    LARGE_INTEGER freq, start, end;
+    HRESULT hr;
+    DWORD ret;
+
+    ctx.items = calloc( QUEUE_THREADS * QUEUE_ITEMS, sizeof(*ctx.items) );
+    ok( ctx.items != NULL, "failed to allocate items\n" );
+    if (!ctx.items) return;
+
+    hr = IXThreadingImpl_XTaskQueueCreate( threading, mode, XTaskQueueDispatchMode_Manual, &ctx.queue );
+    ok( hr == S_OK, "XTaskQueueCreate failed, hr %#lx\n", hr );
+    if (FAILED(hr))
+    {
+        free( ctx.items );
+        return;
+    }
+
+    ctx.done = CreateEventA( NULL, TRUE, FALSE, NULL );
+
+    for (i = 0; i < QUEUE_THREADS + consumers; i++)
+    {
+        threads[count] = CreateThread( NULL, 0, i < QUEUE_THREADS ? producer_thread : consumer_thread, &ctx, 0, NULL );
+        ok( threads[count] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+        if (!threads[count]) break;
+        count++;
+    }
+
+    if (count < QUEUE_THREADS + consumers) ctx.abort = 1;
+    else while (ReadAcquire( &ctx.started ) < count) Sleep( 0 );
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    WriteRelease( &ctx.go, 1 );
+
+    ret = WaitForMultipleObjects( count, threads, TRUE, 60000 );
+    ok( ret == WAIT_OBJECT_0, "%s: WaitForMultipleObjects returned %#lx\n", name, ret );
+
+    if (!ctx.abort)
+    {
+        ret = WaitForSingleObject( ctx.done, 60000 );
+        ok( ret == WAIT_OBJECT_0, "%s: WaitForSingleObject returned %#lx\n", name, ret );
+        QueryPerformanceCounter( &end );
+
+        ok( ctx.sum == expect, "%s: got sum %s, expected %s\n", name,
+            wine_dbgstr_longlong( ctx.sum ), wine_dbgstr_longlong( expect ) );
+        trace( "%s: %u producers, %u items in %.3f s\n", name, QUEUE_THREADS, QUEUE_THREADS * QUEUE_ITEMS,
+               (double)(end.QuadPart - start.QuadPart) / freq.QuadPart );
+    }
+
+    for (i = 0; i < count; i++) CloseHandle( threads[i] );
+
+    /* terminating waits for the callbacks still using ctx.items, and on a
+     * manual queue they only run when dispatched */
+    if (mode == XTaskQueueDispatchMode_Manual)
+        while (IXThreadingImpl_XTaskQueueDispatch( threading, ctx.queue, XTaskQueuePort_Work, 0 ));
+
+    hr = IXThreadingImpl_XTaskQueueTerminate( threading, ctx.queue, TRUE, NULL, NULL );
+    ok( hr == S_OK, "XTaskQueueTerminate failed, hr %#lx\n", hr );
+    IXThreadingImpl_XTaskQueueCloseHandle( threading, ctx.queue );
+
+    CloseHandle( ctx.done );
+    free( ctx.items );
+}
+
+START_TEST(queue)
+{
+    if ((threading = get_threading()))
+    {
+        test_manual_order();
+        test_producers( XTaskQueueDispatchMode_Manual, "manual" );
+        test_producers( XTaskQueueDispatchMode_ThreadPool, "threadpool" );
+    }
+
+    release_threading( threading );
+}
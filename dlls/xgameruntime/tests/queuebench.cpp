@@ -0,0 +1,230 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  LocklessQueue / BoundedQueue microbenchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/*
+ * The queue headers only depend on windows.h and the C++ standard library,
+ * so the queues are compared directly rather than through the runtime.
+ * Results use the "benchmark:" line format of benchmark.c. Interactive runs
+ * (WINETEST_INTERACTIVE=1) push ten times as many items.
+ */
+
+#include "../GDKComponent/System/Threading/LocklessQueue.h"
+#include "../GDKComponent/System/Threading/BoundedQueue.h"
+
+extern "C" {
+#include "wine/test.h"
+}
+
+#define BENCH_THREADS 2
+#define BENCH_ITEMS 20000
+
+struct bench_context
+{
+    void *queue;
+    BOOL (*push)( void *queue, UINT64 value );
+    BOOL (*pop)( void *queue, UINT64 *value );
+    UINT64 items;
+    LONG started;
+    LONG consumed;
+    LONG go;
+    UINT64 sums[BENCH_THREADS];
+    LONG consumer_index;
+};
+
+static BOOL lockless_push( void *queue, UINT64 value )
+{
+    return static_cast<LocklessQueue<UINT64> *>(queue)->push_back( value );
+}
+
+static BOOL lockless_pop( void *queue, UINT64 *value )
+{
+    return static_cast<LocklessQueue<UINT64> *>(queue)->pop_front( *value );
+}
+
+static BOOL bounded_push( void *queue, UINT64 value )
+{
+    return static_cast<BoundedQueue<UINT64> *>(queue)->push_back( value );
+}
+
+static BOOL bounded_pop( void *queue, UINT64 *value )
+{
+    return static_cast<BoundedQueue<UINT64> *>(queue)->pop_front( *value );
+}
+
+static void wait_for_start( struct bench_context *ctx )
+{
+    InterlockedIncrement( &ctx->started );
+    while (!ReadAcquire( &ctx->go )) YieldProcessor();
+}
+
+static DWORD WINAPI producer_thread( void *arg )
+{
+    struct bench_context *ctx = (struct bench_context *)arg;
+    UINT64 i;
+
+    wait_for_start( ctx );
+
+    for (i = 1; i <= ctx->items; i++)
+    {
+        /* the bounded queue refuses items when full, wait for a consumer */
+        while (!ctx->push( ctx->queue, i )) YieldProcessor();
+    }
+
+    return 0;
+}
+
+static DWORD WINAPI consumer_thread( void *arg )
+{
+    struct bench_context *ctx = (struct bench_context *)arg;
+    LONG index = InterlockedIncrement( &ctx->consumer_index ) - 1;
+    UINT64 value, sum = 0;
+
+    wait_for_start( ctx );
+
+    while ((UINT64)ReadAcquire( &ctx->consumed ) < BENCH_THREADS * ctx->items)
+    {
+        if (ctx->pop( ctx->queue, &value ))
+        {
+            sum += value;
+            InterlockedIncrement( &ctx->consumed );
+        }
+        else YieldProcessor();
+    }
+
+    ctx->sums[index] = sum;
+    return 0;
+}
+
+static void run_benchmark( const char *name, void *queue,
+                           BOOL (*push)( void *, UINT64 ), BOOL (*pop)( void *, UINT64 * ) )
+{
+    struct bench_context ctx = {};
+    HANDLE threads[BENCH_THREADS * 2];
+    LARGE_INTEGER freq, start, end;
+    UINT64 expect, sum = 0;
+    unsigned int i, count = 0;
+    double rate;
+    DWORD ret;
+
+    ctx.queue = queue;
+    ctx.push = push;
+    ctx.pop = pop;
+    ctx.items = BENCH_ITEMS * (winetest_interactive ? 10 : 1);
+    expect = BENCH_THREADS * ctx.items * (ctx.items + 1) / 2;
+
+    for (i = 0; i < BENCH_THREADS * 2; i++)
+    {
+        threads[count] = CreateThread( NULL, 0, i < BENCH_THREADS ? producer_thread : consumer_thread, &ctx, 0, NULL );
+        ok( threads[count] != NULL, "CreateThread failed, error %lu\n", GetLastError() );
+        if (!threads[count]) break;
+        count++;
+    }
+
+    if (count < BENCH_THREADS * 2)
+    {
+        /* nothing to push or pop, let the threads that did start exit */
+        ctx.items = 0;
+        WriteRelease( &ctx.go, 1 );
+        WaitForMultipleObjects( count, threads, TRUE, INFINITE );
+        for (i = 0; i < count; i++) CloseHandle( threads[i] );
+        return;
+    }
+
+    while (ReadAcquire( &ctx.started ) < BENCH_THREADS * 2) Sleep( 0 );
+
+    QueryPerformanceFrequency( &freq );
+    QueryPerformanceCounter( &start );
+    WriteRelease( &ctx.go, 1 );
+
+    ret = WaitForMultipleObjects( BENCH_THREADS * 2, threads, TRUE, 60000 );
+    ok( ret == WAIT_OBJECT_0, "%s: WaitForMultipleObjects returned %#lx\n", name, ret );
+    QueryPerformanceCounter( &end );
+
+    for (i = 0; i < BENCH_THREADS * 2; i++) CloseHandle( threads[i] );
+    for (i = 0; i < BENCH_THREADS; i++) sum += ctx.sums[i];
+
+    ok( sum == expect, "%s: got sum %s, expected %s\n", name,
+        wine_dbgstr_longlong( sum ), wine_dbgstr_longlong( expect ) );
+
+    rate = BENCH_THREADS * ctx.items / ((double)(end.QuadPart - start.QuadPart) / freq.QuadPart);
+    trace( "benchmark: name=%s unit=items/s count=%u min=%.2f mean=%.2f p50=%.2f p99=%.2f max=%.2f\n",
+           name, (unsigned int)(BENCH_THREADS * ctx.items), rate, rate, rate, rate, rate );
+}
+
+static void test_bounded_queue(void)
+{
+    BoundedQueue<UINT64> queue;
+    UINT64 value;
+    HRESULT hr;
+    UINT32 i;
+
+    hr = queue.init( 5 );
+    ok( hr == S_OK, "init failed, hr %#lx\n", hr );
+    ok( queue.capacity() == 8, "got capacity %u\n", queue.capacity() );
+    ok( queue.empty(), "queue is not empty\n" );
+    ok( !queue.pop_front( value ), "pop_front succeeded on an empty queue\n" );
+
+    for (i = 0; i < 8; i++) ok( queue.push_back( i ), "push_back %u failed\n", i );
+    ok( !queue.push_back( 8 ), "push_back succeeded on a full queue\n" );
+    ok( !queue.empty(), "queue is empty\n" );
+
+    /* wrap around a few times */
+    for (i = 0; i < 20; i++)
+    {
+        ok( queue.pop_front( value ), "pop_front failed\n" );
+        ok( value == i, "got %s, expected %u\n", wine_dbgstr_longlong( value ), i );
+        ok( queue.push_back( i + 8 ), "push_back %u failed\n", i + 8 );
+    }
+
+    for (i = 20; i < 28; i++)
+    {
+        ok( queue.pop_front( value ), "pop_front failed\n" );
+        ok( value == i, "got %s, expected %u\n", wine_dbgstr_longlong( value ), i );
+    }
+
+    ok( queue.empty(), "queue is not empty\n" );
+}
+
+static void test_benchmark(void)
+{
+    LocklessQueue<UINT64> *lockless;
+    BoundedQueue<UINT64> bounded;
+    HRESULT hr;
+
+    lockless = new (std::nothrow) LocklessQueue<UINT64>;
+    ok( lockless != NULL, "failed to allocate LocklessQueue\n" );
+    if (!lockless) return;
+
+    run_benchmark( "lockless_queue", lockless, lockless_push, lockless_pop );
+    ok( lockless->empty(), "LocklessQueue is not empty\n" );
+    delete lockless;
+
+    hr = bounded.init( 4096 );
+    ok( hr == S_OK, "init failed, hr %#lx\n", hr );
+    if (FAILED(hr)) return;
+
+    run_benchmark( "bounded_queue", &bounded, bounded_push, bounded_pop );
+    ok( bounded.empty(), "BoundedQueue is not empty\n" );
+}
+
+extern "C" START_TEST(queuebench)
+{
+    test_bounded_queue();
+    test_benchmark();
+}
@@ -0,0 +1,81 @@
+/*
+ * Xbox Game runtime Library Tests
+ *  Shared helpers for the XThreadingImpl tests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+typedef HRESULT (WINAPI *QueryApiImpl_func)( const GUID *runtimeClassId, REFIID interfaceId, void **out );
+
+static const char runtime_key[] = "Software\\Wine\\WineGDK";
+static const char asked_value[] = "LoadOtherRuntimeAsked";
+
+static HKEY runtime;
+static BOOL restore_asked;
+static DWORD saved_asked;
+
+/* Returns the runtime's IXThreadingImpl, or NULL after skipping. Either way
+ * release_threading() has to be called afterwards. */
+static IXThreadingImpl *get_threading(void)
+{
+    QueryApiImpl_func pQueryApiImpl;
+    DWORD asked = 1, size = sizeof(saved_asked);
+    IXThreadingImpl *threading;
+    HMODULE module;
+    HRESULT hr;
+
+    module = LoadLibraryA( "xgameruntime.dll" );
+    if (!module)
+    {
+        win_skip( "xgameruntime.dll is not available\n" );
+        return NULL;
+    }
+
+    pQueryApiImpl = (QueryApiImpl_func)GetProcAddress( module, "QueryApiImpl" );
+    if (!pQueryApiImpl)
+    {
+        win_skip( "QueryApiImpl is not available\n" );
+        return NULL;
+    }
+
+    /* keep the builtin runtime from asking to install the native threading
+     * library; release_threading() puts the previous setting back */
+    if (!RegCreateKeyExA( HKEY_LOCAL_MACHINE, runtime_key, 0, NULL, 0, KEY_READ | KEY_WRITE, NULL, &runtime, NULL ))
+    {
+        restore_asked = !RegQueryValueExA( runtime, asked_value, NULL, NULL, (BYTE *)&saved_asked, &size );
+        RegSetValueExA( runtime, asked_value, 0, REG_DWORD, (BYTE *)&asked, sizeof(asked) );
+    }
+
+    hr = pQueryApiImpl( &CLSID_XThreadingImpl, &IID_IXThreadingImpl, (void **)&threading );
+    if (FAILED(hr))
+    {
+        skip( "XThreadingImpl is not available, hr %#lx\n", hr );
+        return NULL;
+    }
+
+    return threading;
+}
+
+static void release_threading( IXThreadingImpl *threading )
+{
+    if (threading) IXThreadingImpl_Release( threading );
+
+    if (!runtime) return;
+
+    if (restore_asked) RegSetValueExA( runtime, asked_value, 0, REG_DWORD, (BYTE *)&saved_asked, sizeof(saved_asked) );
+    else RegDeleteValueA( runtime, asked_value );
+    RegCloseKey( runtime );
+    runtime = NULL;
+}
@@ -1078,6 +1078,35 @@ typedef volatile struct
     char                 extra[];
 } window_shm_t;
 
+typedef volatile struct
+{
+    unsigned int         flags;
+} sock_shm_t;
+
+/* the client may try a recv / send syscall before asking the server; it
+ * falls back to recv_socket / send_socket if the syscall would block */
+#define SOCKET_SHM_TRY_RECV  0x01
+#define SOCKET_SHM_TRY_SEND  0x02
+
+struct key_shm_value
+{
+    unsigned int         type;
+    data_size_t          namelen;
+    data_size_t          len;
+
+};
+
+typedef volatile struct
+{
+    data_size_t          capacity;
+    data_size_t          size;
+    unsigned int         count;
+    char                 values[];
+} key_shm_t;
+
+
+#define KEY_SHM_MAX_SIZE     4096
+
 typedef volatile union
 {
     desktop_shm_t        desktop;
@@ -1085,6 +1114,8 @@ typedef volatile union
     input_shm_t          input;
     class_shm_t          class;
     window_shm_t         window;
+    sock_shm_t           socket;
+    key_shm_t            key;
 } object_shm_t;
 
 typedef volatile struct
@@ -2080,6 +2111,7 @@ struct recv_socket_reply
     unsigned int options;
     int          nonblocking;
     char __pad_20[4];
+    struct obj_locator locator;
 };
 
 
@@ -2097,6 +2129,7 @@ struct send_socket_reply
     unsigned int options;
     int          nonblocking;
     char __pad_20[4];
+    struct obj_locator locator;
 };
 
 #define SERVER_SOCKET_IO_FORCE_ASYNC 0x01
@@ -2706,6 +2739,7 @@ struct get_key_value_reply
     struct reply_header __header;
     int          type;
     data_size_t  total;
+    struct obj_locator locator;
     /* VARARG(data,bytes); */
 };
 
@@ -6052,6 +6086,31 @@ enum inproc_sync_type
     INPROC_SYNC_SEMAPHORE = 4,
 };
 
+/* In-process synchronization object used when no ntsync device is available.
+ * The objects live in a shared memory arena (sent to clients in place of the
+ * device fd) and are modified atomically by both the server and the clients;
+ * waiters sleep on the futex word, which is bumped whenever the state changes
+ * in a way that may satisfy a wait. Slot 0 of the arena is never used. */
+typedef volatile struct
+{
+    __int64        state;
+    int            futex;
+    unsigned int   id;
+    unsigned short type;
+    unsigned short manual;
+    unsigned int   max;
+    int            waiters;
+    unsigned int   locker;
+} inproc_futex_t;
+
+
+#define INPROC_FUTEX_MUTEX_COUNT_SHIFT 32
+#define INPROC_FUTEX_MUTEX_MAX_COUNT   0x3fffffff
+#define INPROC_FUTEX_MUTEX_ABANDONED   ((unsigned __int64)1 << 63)
+
+
+#define INPROC_FUTEX_LOCKED            ((unsigned __int64)1 << 62)
+
 
 struct get_inproc_sync_fd_request
 {
@@ -6063,6 +6122,8 @@ struct get_inproc_sync_fd_reply
     struct reply_header __header;
     int           type;
     unsigned int access;
+    unsigned int index;
+    char __pad_20[4];
 };
 
 
@@ -6076,7 +6137,7 @@ struct get_inproc_alert_fd_reply
 {
     struct reply_header __header;
     obj_handle_t handle;
-    char __pad_12[4];
+    unsigned int index;
 };
 
 
@@ -7179,6 +7240,6 @@ union generic_reply
     struct alpc_create_port_reply alpc_create_port_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 958
+#define SERVER_PROTOCOL_VERSION 961
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
@@ -18,6 +18,14 @@
 
 #include "vkd3d_private.h"
 
+#ifndef _WIN32
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
 struct vkd3d_cache_entry_header
 {
     uint64_t hash;
@@ -25,21 +33,51 @@ struct vkd3d_cache_entry_header
     uint64_t value_size;
 };
 
+struct vkd3d_cache_file
+{
+#ifdef _WIN32
+    HANDLE handle;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    const uint8_t *data;
+    size_t size;
+};
+
 struct vkd3d_shader_cache
 {
     unsigned int refcount;
     struct vkd3d_mutex lock;
 
     struct rb_tree tree;
+    /* Least recently used entries first. */
+    struct list lru;
+
+    /* Disk caches only. */
+    char *path;
+    struct list cache_list_entry;
+    struct vkd3d_cache_file file;
+    uint64_t version;
+    uint64_t max_size;
+    uint64_t size;
+    uint64_t file_size;
+    bool compact;
 };
 
 struct shader_cache_entry
 {
     struct vkd3d_cache_entry_header h;
     struct rb_entry entry;
+    struct list lru_entry;
+    /* Points into the file mapping for entries loaded from disk. */
+    bool mapped;
     uint8_t *payload;
 };
 
+static struct list disk_cache_list = LIST_INIT(disk_cache_list);
+static struct vkd3d_mutex disk_cache_list_mutex = VKD3D_MUTEX_INITIALIZER;
+
 struct shader_cache_key
 {
     uint64_t hash;
@@ -66,7 +104,7 @@ static int vkd3d_shader_cache_compare_key(const void *key, const struct rb_entry
     return ret;
 }
 
-static void vkd3d_shader_cache_add_entry(struct vkd3d_shader_cache *cache,
+static int vkd3d_shader_cache_add_entry(struct vkd3d_shader_cache *cache,
         struct shader_cache_entry *e)
 {
     const struct shader_cache_key k =
@@ -76,28 +114,601 @@ static void vkd3d_shader_cache_add_entry(struct vkd3d_shader_cache *cache,
         .key = e->payload
     };
 
-    rb_put(&cache->tree, &k, &e->entry);
+    if (rb_put(&cache->tree, &k, &e->entry) == -1)
+        return -1;
+    list_add_tail(&cache->lru, &e->lru_entry);
+    return 0;
 }
 
-int vkd3d_shader_open_cache(struct vkd3d_shader_cache **cache)
+static void vkd3d_shader_cache_free_entry(struct shader_cache_entry *e)
 {
-    struct vkd3d_shader_cache *object;
+    if (!e->mapped)
+        vkd3d_free(e->payload);
+    vkd3d_free(e);
+}
 
-    TRACE("%p.\n", cache);
+static uint64_t vkd3d_shader_cache_hash_key(const void *key, size_t size)
+{
+    return vkd3d_hash_update(VKD3D_HASH_INIT, key, size);
+}
 
-    object = vkd3d_malloc(sizeof(*object));
-    if (!object)
-        return VKD3D_ERROR_OUT_OF_MEMORY;
+/* Disk caches.
+ *
+ * A cache file starts with a vkd3d_disk_cache_header, followed by an
+ * append-only log of records. Each record is a vkd3d_disk_cache_record
+ * followed by the key and the value, padded to 8 bytes, and is written with
+ * a single append so that concurrent writers never interleave. The file is
+ * mapped when the cache is opened, and entries loaded from it point into the
+ * mapping. The file is never truncated in place; when it has to shrink it is
+ * rewritten under a temporary name and renamed over the old one, so existing
+ * mappings stay valid.
+ *
+ * Records that fail validation, e.g. after a crash in the middle of a write,
+ * are skipped. Once the total size of the entries exceeds the size limit the
+ * least recently used ones are evicted, and the file is rewritten in LRU
+ * order when the cache is closed, together with the records other processes
+ * appended since it was loaded. */
+
+#define VKD3D_DISK_CACHE_MAGIC        VKD3D_MAKE_TAG('V', 'K', 'S', 'C')
+#define VKD3D_DISK_CACHE_RECORD_MAGIC VKD3D_MAKE_TAG('V', 'K', 'S', 'R')
+#define VKD3D_DISK_CACHE_VERSION 1
+
+struct vkd3d_disk_cache_header
+{
+    uint32_t magic;
+    uint32_t format_version;
+    uint64_t compiler_hash;
+    uint64_t version;
+};
+
+struct vkd3d_disk_cache_record
+{
+    uint32_t magic;
+    uint32_t checksum;
+    struct vkd3d_cache_entry_header h;
+};
+
+static unsigned int vkd3d_get_current_process_id(void)
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+static void vkd3d_cache_file_close(struct vkd3d_cache_file *file)
+{
+#ifdef _WIN32
+    if (file->data)
+        UnmapViewOfFile(file->data);
+    if (file->mapping)
+        CloseHandle(file->mapping);
+    CloseHandle(file->handle);
+#else
+    if (file->data)
+        munmap((void *)file->data, file->size);
+    close(file->fd);
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+/* Opens the file for reading and appending, and maps its current contents. */
+static bool vkd3d_cache_file_open(struct vkd3d_cache_file *file, const char *path, bool create_new)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    file->mapping = NULL;
+    file->data = NULL;
+    file->size = 0;
+
+    if ((file->handle = CreateFileA(path, GENERIC_READ | FILE_APPEND_DATA,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+            create_new ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+    {
+        WARN("Failed to open %s, error %lu.\n", debugstr_a(path), GetLastError());
+        return false;
+    }
+
+    if (!GetFileSizeEx(file->handle, &size) || (uint64_t)size.QuadPart > SIZE_MAX)
+    {
+        WARN("Failed to get the size of %s.\n", debugstr_a(path));
+        vkd3d_cache_file_close(file);
+        return false;
+    }
+    if (!size.QuadPart)
+        return true;
+
+    if (!(file->mapping = CreateFileMappingA(file->handle, NULL, PAGE_READONLY, 0, 0, NULL))
+            || !(file->data = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0)))
+    {
+        WARN("Failed to map %s, error %lu.\n", debugstr_a(path), GetLastError());
+        vkd3d_cache_file_close(file);
+        return false;
+    }
+    file->size = size.QuadPart;
+#else
+    struct stat st;
+    void *data;
+
+    file->data = NULL;
+    file->size = 0;
+
+    if ((file->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC | (create_new ? O_TRUNC : 0), 0644)) == -1)
+    {
+        WARN("Failed to open %s, errno %d.\n", debugstr_a(path), errno);
+        return false;
+    }
+
+    if (fstat(file->fd, &st) == -1 || (uint64_t)st.st_size > SIZE_MAX)
+    {
+        WARN("Failed to get the size of %s.\n", debugstr_a(path));
+        vkd3d_cache_file_close(file);
+        return false;
+    }
+    if (!st.st_size)
+        return true;
+
+    if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, file->fd, 0)) == MAP_FAILED)
+    {
+        WARN("Failed to map %s, errno %d.\n", debugstr_a(path), errno);
+        vkd3d_cache_file_close(file);
+        return false;
+    }
+    file->data = data;
+    file->size = st.st_size;
+#endif
+
+    return true;
+}
+
+/* A short write leaves a torn record behind, which is rejected when the file
+ * is loaded. Retrying could interleave with another writer, so we don't. */
+static bool vkd3d_cache_file_append(struct vkd3d_cache_file *file, const void *data, size_t size)
+{
+#ifdef _WIN32
+    DWORD written;
+
+    if (size > UINT32_MAX || !WriteFile(file->handle, data, size, &written, NULL) || written != size)
+    {
+        WARN("Failed to write %#zx bytes, error %lu.\n", size, GetLastError());
+        return false;
+    }
+#else
+    ssize_t written;
+
+    if ((written = write(file->fd, data, size)) < 0 || (size_t)written != size)
+    {
+        WARN("Failed to write %#zx bytes, errno %d.\n", size, errno);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+static bool vkd3d_cache_file_replace(const char *path, const char *new_path)
+{
+#ifdef _WIN32
+    if (!MoveFileExA(new_path, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to replace %s, error %lu.\n", debugstr_a(path), GetLastError());
+        DeleteFileA(new_path);
+        return false;
+    }
+#else
+    if (rename(new_path, path) == -1)
+    {
+        WARN("Failed to replace %s, errno %d.\n", debugstr_a(path), errno);
+        unlink(new_path);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+static bool vkd3d_cache_file_get_size(const char *path, uint64_t *size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return false;
+    *size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat st;
+
+    if (stat(path, &st) == -1)
+        return false;
+    *size = st.st_size;
+#endif
+
+    return true;
+}
+
+static void vkd3d_disk_cache_header_init(struct vkd3d_disk_cache_header *header, uint64_t version)
+{
+    const char *compiler_version = vkd3d_shader_get_version(NULL, NULL);
+
+    memset(header, 0, sizeof(*header));
+    header->magic = VKD3D_DISK_CACHE_MAGIC;
+    header->format_version = VKD3D_DISK_CACHE_VERSION;
+    header->compiler_hash = vkd3d_hash_update(VKD3D_HASH_INIT, compiler_version, strlen(compiler_version));
+    header->version = version;
+}
+
+static uint64_t vkd3d_disk_cache_record_size(const struct vkd3d_cache_entry_header *h)
+{
+    return sizeof(struct vkd3d_disk_cache_record) + align(h->key_size + h->value_size, 8);
+}
+
+static uint32_t vkd3d_disk_cache_record_checksum(const struct vkd3d_cache_entry_header *h, const void *payload)
+{
+    uint64_t hash;
+
+    hash = vkd3d_hash_update(VKD3D_HASH_INIT, h, sizeof(*h));
+    hash = vkd3d_hash_update(hash, payload, h->key_size + h->value_size);
+    return hash ^ (hash >> 32);
+}
+
+static bool vkd3d_disk_cache_write_record(struct vkd3d_cache_file *file, const struct shader_cache_entry *e)
+{
+    struct vkd3d_disk_cache_record record;
+    uint64_t size;
+    uint8_t *data;
+    bool ret;
+
+    size = vkd3d_disk_cache_record_size(&e->h);
+    if (size > SIZE_MAX || !(data = vkd3d_calloc(1, size)))
+        return false;
+
+    record.magic = VKD3D_DISK_CACHE_RECORD_MAGIC;
+    record.checksum = vkd3d_disk_cache_record_checksum(&e->h, e->payload);
+    record.h = e->h;
+    memcpy(data, &record, sizeof(record));
+    memcpy(data + sizeof(record), e->payload, e->h.key_size + e->h.value_size);
+
+    ret = vkd3d_cache_file_append(file, data, size);
+    vkd3d_free(data);
+    return ret;
+}
+
+/* Writes the header and all entries in LRU order to a new file, and replaces
+ * the cache file with it. If "check_size" is not zero, the cache file is only
+ * replaced if its size is still "check_size", so that records other processes
+ * appended in the meantime are not lost. The cache file is closed, and the
+ * entries mapped from it become invalid. */
+static bool vkd3d_disk_cache_rewrite(struct vkd3d_shader_cache *cache, uint64_t check_size)
+{
+    uint64_t size;
+    struct vkd3d_disk_cache_header header;
+    struct shader_cache_entry *e;
+    struct vkd3d_cache_file file;
+    size_t path_size;
+    char *new_path;
+    bool ret;
+
+    path_size = strlen(cache->path) + 16;
+    if (!(new_path = vkd3d_malloc(path_size)))
+    {
+        vkd3d_cache_file_close(&cache->file);
+        return false;
+    }
+    snprintf(new_path, path_size, "%s.%08x", cache->path, vkd3d_get_current_process_id());
+
+    if (!vkd3d_cache_file_open(&file, new_path, true))
+    {
+        vkd3d_cache_file_close(&cache->file);
+        vkd3d_free(new_path);
+        return false;
+    }
+
+    vkd3d_disk_cache_header_init(&header, cache->version);
+    ret = vkd3d_cache_file_append(&file, &header, sizeof(header));
+    LIST_FOR_EACH_ENTRY(e, &cache->lru, struct shader_cache_entry, lru_entry)
+    {
+        if (!ret)
+            break;
+        ret = vkd3d_disk_cache_write_record(&file, e);
+    }
+
+    vkd3d_cache_file_close(&file);
+    vkd3d_cache_file_close(&cache->file);
+
+    if (ret && check_size && (!vkd3d_cache_file_get_size(cache->path, &size) || size != check_size))
+    {
+        TRACE("Cache %s was changed by another process, not replacing it.\n", debugstr_a(cache->path));
+#ifdef _WIN32
+        DeleteFileA(new_path);
+#else
+        unlink(new_path);
+#endif
+        ret = false;
+    }
+    else if (ret)
+    {
+        ret = vkd3d_cache_file_replace(cache->path, new_path);
+    }
+    else
+    {
+        WARN("Failed to write %s.\n", debugstr_a(new_path));
+#ifdef _WIN32
+        DeleteFileA(new_path);
+#else
+        unlink(new_path);
+#endif
+    }
+
+    TRACE("Rewrote cache %s with %"PRIu64" bytes of entries, ret %#x.\n", debugstr_a(cache->path), cache->size, ret);
+    vkd3d_free(new_path);
+    return ret;
+}
+
+static void vkd3d_shader_cache_remove_entry(struct vkd3d_shader_cache *cache, struct shader_cache_entry *e)
+{
+    rb_remove(&cache->tree, &e->entry);
+    list_remove(&e->lru_entry);
+    cache->size -= vkd3d_disk_cache_record_size(&e->h);
+    vkd3d_shader_cache_free_entry(e);
+}
+
+static void vkd3d_shader_cache_evict(struct vkd3d_shader_cache *cache)
+{
+    struct shader_cache_entry *e;
+    struct list *head;
+
+    while (cache->size > cache->max_size && (head = list_head(&cache->lru)))
+    {
+        e = LIST_ENTRY(head, struct shader_cache_entry, lru_entry);
+        TRACE("Evicting cache entry %#"PRIx64".\n", e->h.hash);
+        vkd3d_shader_cache_remove_entry(cache, e);
+        cache->compact = true;
+    }
+}
+
+/* Adds the valid records of "data" to the cache. The entries point into
+ * "data", which has to stay mapped while they are used. */
+static unsigned int vkd3d_disk_cache_read_records(struct vkd3d_shader_cache *cache,
+        const uint8_t *data, size_t size, unsigned int *skipped)
+{
+    struct vkd3d_disk_cache_record record;
+    struct shader_cache_entry *e;
+    const uint8_t *payload;
+    unsigned int count = 0;
+    uint64_t record_size;
+    size_t offset;
+
+    *skipped = 0;
+
+    for (offset = sizeof(struct vkd3d_disk_cache_header); offset < size;)
+    {
+        /* Offsets are always 8-byte aligned; after an invalid record we try
+         * again at the next 8-byte boundary. */
+        if (!vkd3d_bound_range(offset, sizeof(record), size))
+        {
+            ++*skipped;
+            break;
+        }
+        memcpy(&record, data + offset, sizeof(record));
+        payload = data + offset + sizeof(record);
+
+        if (record.magic != VKD3D_DISK_CACHE_RECORD_MAGIC
+                || record.h.key_size > size || record.h.value_size > size
+                || record.h.key_size + record.h.value_size > size - offset - sizeof(record)
+                || record.checksum != vkd3d_disk_cache_record_checksum(&record.h, payload)
+                || record.h.hash != vkd3d_shader_cache_hash_key(payload, record.h.key_size))
+        {
+            ++*skipped;
+            offset += 8;
+            continue;
+        }
+
+        record_size = vkd3d_disk_cache_record_size(&record.h);
+        offset = record_size > size - offset ? size : offset + record_size;
+
+        if (!(e = vkd3d_malloc(sizeof(*e))))
+            break;
+        e->h = record.h;
+        e->mapped = true;
+        e->payload = (uint8_t *)payload;
+
+        if (vkd3d_shader_cache_add_entry(cache, e))
+        {
+            /* Another process stored the same entry. */
+            vkd3d_free(e);
+            cache->compact = true;
+            continue;
+        }
+        cache->size += record_size;
+        ++count;
+    }
+
+    return count;
+}
+
+static bool vkd3d_disk_cache_header_matches(const struct vkd3d_cache_file *file, uint64_t version)
+{
+    struct vkd3d_disk_cache_header header, file_header;
+
+    if (file->size < sizeof(file_header))
+        return false;
+
+    vkd3d_disk_cache_header_init(&header, version);
+    memcpy(&file_header, file->data, sizeof(file_header));
+    return !memcmp(&file_header, &header, sizeof(header));
+}
+
+static bool vkd3d_disk_cache_load(struct vkd3d_shader_cache *cache)
+{
+    struct vkd3d_disk_cache_header header;
+    unsigned int count, skipped;
+
+    if (!vkd3d_cache_file_open(&cache->file, cache->path, false))
+        return false;
+
+    if (!cache->file.size)
+    {
+        vkd3d_disk_cache_header_init(&header, cache->version);
+        if (!vkd3d_cache_file_append(&cache->file, &header, sizeof(header)))
+        {
+            vkd3d_cache_file_close(&cache->file);
+            return false;
+        }
+        cache->file_size = sizeof(header);
+        return true;
+    }
+
+    if (!vkd3d_disk_cache_header_matches(&cache->file, cache->version))
+    {
+        WARN("Discarding incompatible or corrupted cache %s.\n", debugstr_a(cache->path));
+        if (!vkd3d_disk_cache_rewrite(cache, 0) || !vkd3d_cache_file_open(&cache->file, cache->path, false))
+            return false;
+        cache->file_size = cache->file.size;
+        return true;
+    }
+
+    cache->file_size = cache->file.size;
+    count = vkd3d_disk_cache_read_records(cache, cache->file.data, cache->file.size, &skipped);
+
+    if (skipped)
+    {
+        WARN("Skipped %u invalid records in cache %s.\n", skipped, debugstr_a(cache->path));
+        cache->compact = true;
+    }
+    TRACE("Loaded %u entries from cache %s.\n", count, debugstr_a(cache->path));
+
+    vkd3d_shader_cache_evict(cache);
+
+    return true;
+}
+
+/* Other processes may have appended records to the cache file since it was
+ * loaded, some of which may have looked torn back then, or replaced the file
+ * altogether. Before the file is rewritten, it is opened again by path and
+ * the records we don't have yet are added, so that the rewrite keeps them. */
+static void vkd3d_disk_cache_close(struct vkd3d_shader_cache *cache)
+{
+    struct vkd3d_cache_file file;
+    unsigned int count, skipped;
+
+    if (!cache->compact && cache->file_size <= cache->max_size)
+    {
+        vkd3d_cache_file_close(&cache->file);
+        return;
+    }
+
+    if (!vkd3d_cache_file_open(&file, cache->path, false))
+    {
+        vkd3d_cache_file_close(&cache->file);
+        return;
+    }
+
+    if (!vkd3d_disk_cache_header_matches(&file, cache->version))
+    {
+        /* Another process cleared the cache or uses a different version. */
+        TRACE("Not rewriting replaced cache %s.\n", debugstr_a(cache->path));
+        vkd3d_cache_file_close(&file);
+        vkd3d_cache_file_close(&cache->file);
+        return;
+    }
+
+    count = vkd3d_disk_cache_read_records(cache, file.data, file.size, &skipped);
+    TRACE("Merged %u entries from cache %s.\n", count, debugstr_a(cache->path));
+    vkd3d_shader_cache_evict(cache);
+
+    vkd3d_disk_cache_rewrite(cache, file.size);
+    vkd3d_cache_file_close(&file);
+}
+
+static struct vkd3d_shader_cache *vkd3d_shader_cache_create(void)
+{
+    struct vkd3d_shader_cache *object;
+
+    if (!(object = vkd3d_calloc(1, sizeof(*object))))
+        return NULL;
 
     object->refcount = 1;
     rb_init(&object->tree, vkd3d_shader_cache_compare_key);
+    list_init(&object->lru);
     vkd3d_mutex_init(&object->lock);
 
+    return object;
+}
+
+int vkd3d_shader_open_cache(struct vkd3d_shader_cache **cache)
+{
+    struct vkd3d_shader_cache *object;
+
+    TRACE("%p.\n", cache);
+
+    if (!(object = vkd3d_shader_cache_create()))
+        return VKD3D_ERROR_OUT_OF_MEMORY;
+
     *cache = object;
 
     return VKD3D_OK;
 }
 
+/* Disk caches are shared by everything in the process that opens the same
+ * path. "version" is an application defined version; the cache is cleared if
+ * it doesn't match the version the file was written with. */
+int vkd3d_shader_open_disk_cache(const char *path, uint64_t version, uint64_t max_size,
+        struct vkd3d_shader_cache **cache)
+{
+    struct vkd3d_shader_cache *object;
+    enum vkd3d_result ret = VKD3D_OK;
+
+    TRACE("%s, %#"PRIx64", %#"PRIx64", %p.\n", debugstr_a(path), version, max_size, cache);
+
+    vkd3d_mutex_lock(&disk_cache_list_mutex);
+
+    LIST_FOR_EACH_ENTRY(object, &disk_cache_list, struct vkd3d_shader_cache, cache_list_entry)
+    {
+        if (strcmp(object->path, path))
+            continue;
+
+        if (object->version != version)
+        {
+            WARN("Cache %s is already open with version %#"PRIx64".\n", debugstr_a(path), object->version);
+            ret = VKD3D_ERROR_INVALID_ARGUMENT;
+        }
+        else
+        {
+            vkd3d_shader_cache_incref(*cache = object);
+        }
+        goto done;
+    }
+
+    if (!(object = vkd3d_shader_cache_create()))
+    {
+        ret = VKD3D_ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    object->version = version;
+    object->max_size = max_size;
+
+    if (!(object->path = vkd3d_strdup(path)) || !vkd3d_disk_cache_load(object))
+    {
+        WARN("Failed to open cache %s.\n", debugstr_a(path));
+        rb_destroy(&object->tree, NULL, NULL);
+        vkd3d_mutex_destroy(&object->lock);
+        vkd3d_free(object->path);
+        vkd3d_free(object);
+        ret = VKD3D_ERROR;
+        goto done;
+    }
+
+    list_add_tail(&disk_cache_list, &object->cache_list_entry);
+    *cache = object;
+
+done:
+    vkd3d_mutex_unlock(&disk_cache_list_mutex);
+    return ret;
+}
+
 unsigned int vkd3d_shader_cache_incref(struct vkd3d_shader_cache *cache)
 {
     unsigned int refcount = vkd3d_atomic_increment_u32(&cache->refcount);
@@ -108,38 +719,39 @@ unsigned int vkd3d_shader_cache_incref(struct vkd3d_shader_cache *cache)
 static void vkd3d_shader_cache_destroy_entry(struct rb_entry *entry, void *context)
 {
     struct shader_cache_entry *e = RB_ENTRY_VALUE(entry, struct shader_cache_entry, entry);
-    vkd3d_free(e->payload);
-    vkd3d_free(e);
+    vkd3d_shader_cache_free_entry(e);
 }
 
 unsigned int vkd3d_shader_cache_decref(struct vkd3d_shader_cache *cache)
 {
-    unsigned int refcount = vkd3d_atomic_decrement_u32(&cache->refcount);
+    unsigned int refcount;
+
+    /* Disk caches can be looked up by path, so their last reference has to
+     * go away under the list lock. */
+    if (cache->path)
+        vkd3d_mutex_lock(&disk_cache_list_mutex);
+    refcount = vkd3d_atomic_decrement_u32(&cache->refcount);
+    if (cache->path)
+    {
+        if (!refcount)
+            list_remove(&cache->cache_list_entry);
+        vkd3d_mutex_unlock(&disk_cache_list_mutex);
+    }
     TRACE("cache %p refcount %u.\n", cache, refcount);
 
     if (refcount)
         return refcount;
 
+    if (cache->path)
+        vkd3d_disk_cache_close(cache);
     rb_destroy(&cache->tree, vkd3d_shader_cache_destroy_entry, NULL);
     vkd3d_mutex_destroy(&cache->lock);
 
+    vkd3d_free(cache->path);
     vkd3d_free(cache);
     return 0;
 }
 
-static uint64_t vkd3d_shader_cache_hash_key(const void *key, size_t size)
-{
-    static const uint64_t fnv_prime = 0x00000100000001b3;
-    uint64_t hash = 0xcbf29ce484222325;
-    const uint8_t *k = key;
-    size_t i;
-
-    for (i = 0; i < size; ++i)
-        hash = (hash ^ k[i]) * fnv_prime;
-
-    return hash;
-}
-
 static void vkd3d_shader_cache_lock(struct vkd3d_shader_cache *cache)
 {
     vkd3d_mutex_lock(&cache->lock);
@@ -196,10 +808,19 @@ int vkd3d_shader_cache_put(struct vkd3d_shader_cache *cache,
     memcpy(e->payload, key, key_size);
     memcpy(e->payload + key_size, value, value_size);
 
+    e->mapped = false;
     vkd3d_shader_cache_add_entry(cache, e);
     TRACE("Cache entry %#"PRIx64" stored.\n", k.hash);
     ret = VKD3D_OK;
 
+    if (cache->path)
+    {
+        if (vkd3d_disk_cache_write_record(&cache->file, e))
+            cache->file_size += vkd3d_disk_cache_record_size(&e->h);
+        cache->size += vkd3d_disk_cache_record_size(&e->h);
+        vkd3d_shader_cache_evict(cache);
+    }
+
 done:
     vkd3d_shader_cache_unlock(cache);
     return ret;
@@ -227,12 +848,14 @@ int vkd3d_shader_cache_get(struct vkd3d_shader_cache *cache,
     entry = rb_get(&cache->tree, &k);
     if (!entry)
     {
-        WARN("Entry not found.\n");
+        TRACE("Entry not found.\n");
         ret = VKD3D_ERROR_NOT_FOUND;
         goto done;
     }
 
     e = RB_ENTRY_VALUE(entry, struct shader_cache_entry, entry);
+    list_remove(&e->lru_entry);
+    list_add_tail(&cache->lru, &e->lru_entry);
 
     *value_size = e->h.value_size;
     if (!value)
@@ -259,3 +882,815 @@ done:
     vkd3d_shader_cache_unlock(cache);
     return ret;
 }
+
+/* Cached pipeline state and pipeline library blobs.
+ *
+ * Both start with a vkd3d_cache_blob_header. A cached PSO is followed by the
+ * SPIR-V of each shader stage and the data of the device's Vulkan pipeline
+ * cache; a pipeline library is followed by its named cached PSOs, which don't
+ * carry Vulkan pipeline cache data, and then by that data once for the whole
+ * library. Everything but the Vulkan pipeline cache data is 8-byte aligned. */
+
+#define VKD3D_CACHE_MAGIC_PIPELINE VKD3D_MAKE_TAG('V', 'P', 'S', 'O')
+#define VKD3D_CACHE_MAGIC_LIBRARY  VKD3D_MAKE_TAG('V', 'P', 'L', 'B')
+#define VKD3D_CACHE_FORMAT_VERSION 3
+
+struct vkd3d_cache_device_key
+{
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint32_t format_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t compiler_hash;
+};
+
+struct vkd3d_cache_blob_header
+{
+    uint32_t magic;
+    uint32_t count;
+    uint64_t size;
+    uint64_t checksum;
+    struct vkd3d_cache_device_key device_key;
+};
+
+struct vkd3d_cached_shader_header
+{
+    uint32_t stage;
+    uint32_t spirv_size;
+    uint64_t key;
+};
+
+struct vkd3d_library_entry_header
+{
+    uint32_t name_size;
+    uint32_t reserved;
+    uint64_t blob_size;
+};
+
+static void vkd3d_cache_device_key_init(struct vkd3d_cache_device_key *key, const struct d3d12_device *device)
+{
+    const char *compiler_version = vkd3d_shader_get_version(NULL, NULL);
+
+    memset(key, 0, sizeof(*key));
+    key->vendor_id = device->vk_info.vendor_id;
+    key->device_id = device->vk_info.device_id;
+    key->driver_version = device->vk_info.driver_version;
+    key->format_version = VKD3D_CACHE_FORMAT_VERSION;
+    memcpy(key->pipeline_cache_uuid, device->vk_info.pipeline_cache_uuid, sizeof(key->pipeline_cache_uuid));
+    key->compiler_hash = vkd3d_hash_update(VKD3D_HASH_INIT, compiler_version, strlen(compiler_version));
+}
+
+static void vkd3d_cache_blob_header_init(void *data, size_t size, uint32_t magic,
+        uint32_t count, const struct d3d12_device *device)
+{
+    struct vkd3d_cache_blob_header header;
+
+    header.magic = magic;
+    header.count = count;
+    header.size = size;
+    header.checksum = vkd3d_hash_update(VKD3D_HASH_INIT, (uint8_t *)data + sizeof(header), size - sizeof(header));
+    vkd3d_cache_device_key_init(&header.device_key, device);
+    memcpy(data, &header, sizeof(header));
+}
+
+static HRESULT vkd3d_cache_blob_validate(const void *data, size_t size, uint32_t magic,
+        const struct d3d12_device *device, struct vkd3d_cache_blob_header *header)
+{
+    struct vkd3d_cache_device_key device_key;
+
+    if (!data || size < sizeof(*header))
+    {
+        WARN("Invalid blob %p, size %zu.\n", data, size);
+        return E_INVALIDARG;
+    }
+
+    memcpy(header, data, sizeof(*header));
+    if (header->magic != magic || header->size > size || header->size < sizeof(*header))
+    {
+        WARN("Invalid blob header, magic %#x, size %#"PRIx64".\n", header->magic, header->size);
+        return E_INVALIDARG;
+    }
+
+    vkd3d_cache_device_key_init(&device_key, device);
+    if (header->device_key.vendor_id != device_key.vendor_id || header->device_key.device_id != device_key.device_id)
+    {
+        WARN("Blob was created for device %04x:%04x.\n", header->device_key.vendor_id, header->device_key.device_id);
+        return D3D12_ERROR_ADAPTER_NOT_FOUND;
+    }
+    if (memcmp(&header->device_key, &device_key, sizeof(device_key)))
+    {
+        WARN("Blob was created by a different driver or shader compiler version.\n");
+        return D3D12_ERROR_DRIVER_VERSION_MISMATCH;
+    }
+
+    if (header->checksum != vkd3d_hash_update(VKD3D_HASH_INIT,
+            (const uint8_t *)data + sizeof(*header), header->size - sizeof(*header)))
+    {
+        WARN("Checksum mismatch.\n");
+        return E_INVALIDARG;
+    }
+
+    return S_OK;
+}
+
+HRESULT vkd3d_cached_pipeline_parse(struct vkd3d_cached_pipeline *cached,
+        struct d3d12_device *device, const D3D12_CACHED_PIPELINE_STATE *blob)
+{
+    const uint8_t *data = blob->pCachedBlob;
+    struct vkd3d_cached_shader_header shader;
+    struct vkd3d_cache_blob_header header;
+    size_t offset, size;
+    unsigned int i;
+    HRESULT hr;
+
+    if (FAILED(hr = vkd3d_cache_blob_validate(data, blob->CachedBlobSizeInBytes,
+            VKD3D_CACHE_MAGIC_PIPELINE, device, &header)))
+        return hr;
+
+    if (header.count > ARRAY_SIZE(cached->shaders))
+    {
+        WARN("Invalid shader count %u.\n", header.count);
+        return E_INVALIDARG;
+    }
+
+    size = header.size;
+    offset = sizeof(header);
+    for (i = 0; i < header.count; ++i)
+    {
+        if (!vkd3d_bound_range(offset, sizeof(shader), size))
+            return E_INVALIDARG;
+        memcpy(&shader, data + offset, sizeof(shader));
+        offset += sizeof(shader);
+        if (!shader.spirv_size || shader.spirv_size % sizeof(uint32_t)
+                || !vkd3d_bound_range(offset, shader.spirv_size, size))
+            return E_INVALIDARG;
+
+        cached->shaders[i].stage = shader.stage;
+        cached->shaders[i].key = shader.key;
+        cached->shaders[i].spirv.code = data + offset;
+        cached->shaders[i].spirv.size = shader.spirv_size;
+        offset += align(shader.spirv_size, 8);
+    }
+    if (offset > size)
+        return E_INVALIDARG;
+
+    cached->shader_count = header.count;
+    cached->vk_cache_data = data + offset;
+    cached->vk_cache_size = size - offset;
+
+    TRACE("Found %u shaders and %zu bytes of Vulkan pipeline cache data.\n",
+            cached->shader_count, cached->vk_cache_size);
+
+    return S_OK;
+}
+
+const struct vkd3d_pipeline_shader *vkd3d_cached_pipeline_find_shader(
+        const struct vkd3d_cached_pipeline *cached, VkShaderStageFlagBits stage)
+{
+    unsigned int i;
+
+    for (i = 0; i < cached->shader_count; ++i)
+    {
+        if (cached->shaders[i].stage == stage)
+            return &cached->shaders[i];
+    }
+
+    return NULL;
+}
+
+bool vkd3d_shader_cache_get_spirv(struct vkd3d_shader_cache *cache,
+        const struct vkd3d_spirv_cache_key *key, struct vkd3d_shader_code *spirv)
+{
+    size_t size = 0;
+    void *code;
+
+    if (vkd3d_shader_cache_get(cache, key, sizeof(*key), NULL, &size) < 0
+            || !size || size % sizeof(uint32_t))
+        return false;
+    if (!(code = vkd3d_malloc(size)))
+        return false;
+    /* The entry may have been evicted in the meantime. */
+    if (vkd3d_shader_cache_get(cache, key, sizeof(*key), code, &size) < 0)
+    {
+        vkd3d_free(code);
+        return false;
+    }
+
+    spirv->code = code;
+    spirv->size = size;
+    return true;
+}
+
+/* Returns the size of the device's Vulkan pipeline cache data if "data" is
+ * NULL, and otherwise the number of bytes written to "data". The cache may
+ * have grown since its size was queried, in which case the data is valid but
+ * incomplete. */
+static size_t d3d12_device_get_pipeline_cache_data(struct d3d12_device *device, void *data, size_t size)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    VkResult vr;
+
+    if (!device->vk_pipeline_cache || (data && !size))
+        return 0;
+
+    vkd3d_mutex_lock(&device->pipeline_cache_mutex);
+    vr = VK_CALL(vkGetPipelineCacheData(device->vk_device, device->vk_pipeline_cache, &size, data));
+    vkd3d_mutex_unlock(&device->pipeline_cache_mutex);
+
+    if (vr < 0)
+    {
+        WARN("Failed to get Vulkan pipeline cache data, vr %d.\n", vr);
+        return 0;
+    }
+
+    return size;
+}
+
+void d3d12_device_merge_pipeline_cache_data(struct d3d12_device *device, const void *data, size_t size)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    VkPipelineCacheCreateInfo cache_info;
+    VkPipelineCache vk_cache;
+    VkResult vr;
+
+    if (!device->vk_pipeline_cache || !size)
+        return;
+
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.pNext = NULL;
+    cache_info.flags = 0;
+    cache_info.initialDataSize = size;
+    cache_info.pInitialData = data;
+    if ((vr = VK_CALL(vkCreatePipelineCache(device->vk_device, &cache_info, NULL, &vk_cache))) < 0)
+    {
+        WARN("Failed to create Vulkan pipeline cache, vr %d.\n", vr);
+        return;
+    }
+
+    vkd3d_mutex_lock(&device->pipeline_cache_mutex);
+    vr = VK_CALL(vkMergePipelineCaches(device->vk_device, device->vk_pipeline_cache, 1, &vk_cache));
+    vkd3d_mutex_unlock(&device->pipeline_cache_mutex);
+    if (vr < 0)
+        WARN("Failed to merge Vulkan pipeline cache data, vr %d.\n", vr);
+
+    VK_CALL(vkDestroyPipelineCache(device->vk_device, vk_cache, NULL));
+}
+
+void d3d12_pipeline_cache_cleanup(struct d3d12_pipeline_cache *cache)
+{
+    unsigned int i;
+
+    for (i = 0; i < cache->shader_count; ++i)
+        vkd3d_shader_free_shader_code(&cache->shaders[i].spirv);
+}
+
+void d3d12_pipeline_cache_add_shader(struct d3d12_pipeline_cache *cache,
+        VkShaderStageFlagBits stage, uint64_t key, struct vkd3d_shader_code *spirv)
+{
+    struct vkd3d_pipeline_shader *shader;
+
+    VKD3D_ASSERT(cache->shader_count < ARRAY_SIZE(cache->shaders));
+
+    shader = &cache->shaders[cache->shader_count++];
+    shader->stage = stage;
+    shader->key = key;
+    shader->spirv = *spirv;
+    memset(spirv, 0, sizeof(*spirv));
+}
+
+/* Pipeline libraries store the Vulkan pipeline cache data once for all their
+ * pipelines, and pass a "vk_cache" of false. */
+HRESULT d3d12_pipeline_cache_serialize(const struct d3d12_pipeline_cache *cache,
+        struct d3d12_device *device, bool vk_cache, void **data, size_t *size)
+{
+    struct vkd3d_cached_shader_header shader;
+    size_t offset, vk_cache_size = 0;
+    unsigned int i;
+    uint8_t *blob;
+
+    if (vk_cache)
+        vk_cache_size = d3d12_device_get_pipeline_cache_data(device, NULL, 0);
+
+    offset = sizeof(struct vkd3d_cache_blob_header);
+    for (i = 0; i < cache->shader_count; ++i)
+        offset += sizeof(shader) + align(cache->shaders[i].spirv.size, 8);
+
+    if (!(blob = vkd3d_calloc(1, offset + vk_cache_size)))
+        return E_OUTOFMEMORY;
+
+    offset = sizeof(struct vkd3d_cache_blob_header);
+    for (i = 0; i < cache->shader_count; ++i)
+    {
+        shader.stage = cache->shaders[i].stage;
+        shader.spirv_size = cache->shaders[i].spirv.size;
+        shader.key = cache->shaders[i].key;
+        memcpy(blob + offset, &shader, sizeof(shader));
+        offset += sizeof(shader);
+        memcpy(blob + offset, cache->shaders[i].spirv.code, shader.spirv_size);
+        offset += align(shader.spirv_size, 8);
+    }
+
+    vk_cache_size = d3d12_device_get_pipeline_cache_data(device, blob + offset, vk_cache_size);
+    offset += vk_cache_size;
+
+    vkd3d_cache_blob_header_init(blob, offset, VKD3D_CACHE_MAGIC_PIPELINE, cache->shader_count, device);
+
+    TRACE("Serialized %u shaders and %zu bytes of Vulkan pipeline cache data.\n",
+            cache->shader_count, vk_cache_size);
+
+    *data = blob;
+    *size = offset;
+    return S_OK;
+}
+
+/* ID3D12PipelineLibrary */
+struct vkd3d_pipeline_library_entry
+{
+    struct rb_entry entry;
+    char *name;
+    void *data;
+    size_t size;
+};
+
+static size_t vkd3d_pipeline_library_entry_size(const struct vkd3d_pipeline_library_entry *e)
+{
+    return sizeof(struct vkd3d_library_entry_header) + align(strlen(e->name) + 1, 8) + align(e->size, 8);
+}
+
+static int vkd3d_pipeline_library_compare_name(const void *key, const struct rb_entry *entry)
+{
+    const struct vkd3d_pipeline_library_entry *e = RB_ENTRY_VALUE(entry, struct vkd3d_pipeline_library_entry, entry);
+
+    return strcmp(key, e->name);
+}
+
+static void vkd3d_pipeline_library_destroy_entry(struct rb_entry *entry, void *context)
+{
+    struct vkd3d_pipeline_library_entry *e = RB_ENTRY_VALUE(entry, struct vkd3d_pipeline_library_entry, entry);
+
+    vkd3d_free(e->name);
+    vkd3d_free(e->data);
+    vkd3d_free(e);
+}
+
+/* The library takes ownership of "name" and "data", even on failure. */
+static HRESULT d3d12_pipeline_library_add_entry(struct d3d12_pipeline_library *library,
+        char *name, void *data, size_t size)
+{
+    struct vkd3d_pipeline_library_entry *e;
+
+    if (!(e = vkd3d_malloc(sizeof(*e))))
+    {
+        vkd3d_free(name);
+        vkd3d_free(data);
+        return E_OUTOFMEMORY;
+    }
+    e->name = name;
+    e->data = data;
+    e->size = size;
+
+    vkd3d_mutex_lock(&library->mutex);
+    if (rb_put(&library->pipelines, name, &e->entry) == -1)
+    {
+        vkd3d_mutex_unlock(&library->mutex);
+        WARN("Pipeline %s already exists.\n", debugstr_a(name));
+        vkd3d_pipeline_library_destroy_entry(&e->entry, NULL);
+        return E_INVALIDARG;
+    }
+    library->serialized_size += vkd3d_pipeline_library_entry_size(e);
+    vkd3d_mutex_unlock(&library->mutex);
+
+    return S_OK;
+}
+
+static inline struct d3d12_pipeline_library *impl_from_ID3D12PipelineLibrary1(ID3D12PipelineLibrary1 *iface)
+{
+    return CONTAINING_RECORD(iface, struct d3d12_pipeline_library, ID3D12PipelineLibrary1_iface);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_QueryInterface(ID3D12PipelineLibrary1 *iface,
+        REFIID iid, void **object)
+{
+    TRACE("iface %p, iid %s, object %p.\n", iface, debugstr_guid(iid), object);
+
+    if (!object)
+    {
+        WARN("Output pointer is NULL, returning E_POINTER.\n");
+        return E_POINTER;
+    }
+
+    if (IsEqualGUID(iid, &IID_ID3D12PipelineLibrary1)
+            || IsEqualGUID(iid, &IID_ID3D12PipelineLibrary)
+            || IsEqualGUID(iid, &IID_ID3D12DeviceChild)
+            || IsEqualGUID(iid, &IID_ID3D12Object)
+            || IsEqualGUID(iid, &IID_IUnknown))
+    {
+        ID3D12PipelineLibrary1_AddRef(iface);
+        *object = iface;
+        return S_OK;
+    }
+
+    WARN("%s not implemented, returning E_NOINTERFACE.\n", debugstr_guid(iid));
+
+    *object = NULL;
+    return E_NOINTERFACE;
+}
+
+static ULONG STDMETHODCALLTYPE d3d12_pipeline_library_AddRef(ID3D12PipelineLibrary1 *iface)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    unsigned int refcount = vkd3d_atomic_increment_u32(&library->refcount);
+
+    TRACE("%p increasing refcount to %u.\n", library, refcount);
+
+    return refcount;
+}
+
+static ULONG STDMETHODCALLTYPE d3d12_pipeline_library_Release(ID3D12PipelineLibrary1 *iface)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    unsigned int refcount = vkd3d_atomic_decrement_u32(&library->refcount);
+
+    TRACE("%p decreasing refcount to %u.\n", library, refcount);
+
+    if (!refcount)
+    {
+        struct d3d12_device *device = library->device;
+
+        vkd3d_private_store_destroy(&library->private_store);
+        rb_destroy(&library->pipelines, vkd3d_pipeline_library_destroy_entry, NULL);
+        vkd3d_mutex_destroy(&library->mutex);
+        vkd3d_free(library);
+
+        d3d12_device_release(device);
+    }
+
+    return refcount;
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_GetPrivateData(ID3D12PipelineLibrary1 *iface,
+        REFGUID guid, UINT *data_size, void *data)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+
+    TRACE("iface %p, guid %s, data_size %p, data %p.\n", iface, debugstr_guid(guid), data_size, data);
+
+    return vkd3d_get_private_data(&library->private_store, guid, data_size, data);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_SetPrivateData(ID3D12PipelineLibrary1 *iface,
+        REFGUID guid, UINT data_size, const void *data)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+
+    TRACE("iface %p, guid %s, data_size %u, data %p.\n", iface, debugstr_guid(guid), data_size, data);
+
+    return vkd3d_set_private_data(&library->private_store, guid, data_size, data);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_SetPrivateDataInterface(ID3D12PipelineLibrary1 *iface,
+        REFGUID guid, const IUnknown *data)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+
+    TRACE("iface %p, guid %s, data %p.\n", iface, debugstr_guid(guid), data);
+
+    return vkd3d_set_private_data_interface(&library->private_store, guid, data);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_SetName(ID3D12PipelineLibrary1 *iface, const WCHAR *name)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+
+    TRACE("iface %p, name %s.\n", iface, debugstr_w(name, library->device->wchar_size));
+
+    return name ? S_OK : E_INVALIDARG;
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_GetDevice(ID3D12PipelineLibrary1 *iface,
+        REFIID iid, void **device)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+
+    TRACE("iface %p, iid %s, device %p.\n", iface, debugstr_guid(iid), device);
+
+    return d3d12_device_query_interface(library->device, iid, device);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(ID3D12PipelineLibrary1 *iface,
+        const WCHAR *name, ID3D12PipelineState *pipeline)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    struct d3d12_pipeline_state *state = unsafe_impl_from_ID3D12PipelineState(pipeline);
+    char *name_utf8;
+    size_t size;
+    void *data;
+    HRESULT hr;
+
+    TRACE("iface %p, name %s, pipeline %p.\n", iface, debugstr_w(name, library->device->wchar_size), pipeline);
+
+    if (!name || !state)
+        return E_INVALIDARG;
+
+    if (!(name_utf8 = vkd3d_strdup_w_utf8(name, library->device->wchar_size)))
+        return E_OUTOFMEMORY;
+
+    if (FAILED(hr = d3d12_pipeline_cache_serialize(&state->cache, library->device, false, &data, &size)))
+    {
+        vkd3d_free(name_utf8);
+        return hr;
+    }
+
+    return d3d12_pipeline_library_add_entry(library, name_utf8, data, size);
+}
+
+static HRESULT d3d12_pipeline_library_find_pipeline(struct d3d12_pipeline_library *library,
+        const WCHAR *name, D3D12_CACHED_PIPELINE_STATE *cached_pso)
+{
+    const struct vkd3d_pipeline_library_entry *e;
+    struct rb_entry *entry;
+    char *name_utf8;
+
+    if (!name)
+        return E_INVALIDARG;
+
+    if (!(name_utf8 = vkd3d_strdup_w_utf8(name, library->device->wchar_size)))
+        return E_OUTOFMEMORY;
+
+    vkd3d_mutex_lock(&library->mutex);
+    entry = rb_get(&library->pipelines, name_utf8);
+    vkd3d_mutex_unlock(&library->mutex);
+    vkd3d_free(name_utf8);
+
+    if (!entry)
+    {
+        WARN("Pipeline %s not found.\n", debugstr_w(name, library->device->wchar_size));
+        return E_INVALIDARG;
+    }
+
+    /* Entries are never removed or modified while the library is alive. */
+    e = RB_ENTRY_VALUE(entry, struct vkd3d_pipeline_library_entry, entry);
+    cached_pso->pCachedBlob = e->data;
+    cached_pso->CachedBlobSizeInBytes = e->size;
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_LoadGraphicsPipeline(ID3D12PipelineLibrary1 *iface,
+        const WCHAR *name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc, REFIID iid, void **pipeline_state)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC pipeline_desc;
+    struct d3d12_pipeline_state *object;
+    HRESULT hr;
+
+    TRACE("iface %p, name %s, desc %p, iid %s, pipeline_state %p.\n", iface,
+            debugstr_w(name, library->device->wchar_size), desc, debugstr_guid(iid), pipeline_state);
+
+    pipeline_desc = *desc;
+    if (FAILED(hr = d3d12_pipeline_library_find_pipeline(library, name, &pipeline_desc.CachedPSO)))
+        return hr;
+
+    if (FAILED(hr = d3d12_pipeline_state_create_graphics(library->device, &pipeline_desc, &object)))
+        return hr;
+
+    return return_interface(&object->ID3D12PipelineState_iface, &IID_ID3D12PipelineState, iid, pipeline_state);
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_LoadComputePipeline(ID3D12PipelineLibrary1 *iface,
+        const WCHAR *name, const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc, REFIID iid, void **pipeline_state)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    D3D12_COMPUTE_PIPELINE_STATE_DESC pipeline_desc;
+    struct d3d12_pipeline_state *object;
+    HRESULT hr;
+
+    TRACE("iface %p, name %s, desc %p, iid %s, pipeline_state %p.\n", iface,
+            debugstr_w(name, library->device->wchar_size), desc, debugstr_guid(iid), pipeline_state);
+
+    pipeline_desc = *desc;
+    if (FAILED(hr = d3d12_pipeline_library_find_pipeline(library, name, &pipeline_desc.CachedPSO)))
+        return hr;
+
+    if (FAILED(hr = d3d12_pipeline_state_create_compute(library->device, &pipeline_desc, &object)))
+        return hr;
+
+    return return_interface(&object->ID3D12PipelineState_iface, &IID_ID3D12PipelineState, iid, pipeline_state);
+}
+
+static SIZE_T STDMETHODCALLTYPE d3d12_pipeline_library_GetSerializedSize(ID3D12PipelineLibrary1 *iface)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    size_t size;
+
+    TRACE("iface %p.\n", iface);
+
+    /* Serialize() writes as much of the Vulkan pipeline cache data as fits in
+     * the size returned here, even if the cache has grown in the meantime. */
+    vkd3d_mutex_lock(&library->mutex);
+    library->vk_cache_size = d3d12_device_get_pipeline_cache_data(library->device, NULL, 0);
+    size = library->serialized_size + library->vk_cache_size;
+    vkd3d_mutex_unlock(&library->mutex);
+
+    return size;
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_Serialize(ID3D12PipelineLibrary1 *iface,
+        void *data, SIZE_T data_size)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    struct vkd3d_library_entry_header entry_header;
+    struct vkd3d_pipeline_library_entry *e;
+    size_t offset, vk_cache_size;
+    unsigned int count = 0;
+    uint8_t *ptr = data;
+
+    TRACE("iface %p, data %p, data_size %"PRIuPTR".\n", iface, data, (uintptr_t)data_size);
+
+    vkd3d_mutex_lock(&library->mutex);
+
+    if (!data || data_size < library->serialized_size + library->vk_cache_size)
+    {
+        vkd3d_mutex_unlock(&library->mutex);
+        WARN("Invalid buffer %p, size %"PRIuPTR".\n", data, (uintptr_t)data_size);
+        return E_INVALIDARG;
+    }
+
+    memset(ptr, 0, library->serialized_size);
+    offset = sizeof(struct vkd3d_cache_blob_header);
+    RB_FOR_EACH_ENTRY(e, &library->pipelines, struct vkd3d_pipeline_library_entry, entry)
+    {
+        entry_header.name_size = strlen(e->name) + 1;
+        entry_header.reserved = 0;
+        entry_header.blob_size = e->size;
+        memcpy(ptr + offset, &entry_header, sizeof(entry_header));
+        offset += sizeof(entry_header);
+        memcpy(ptr + offset, e->name, entry_header.name_size);
+        offset += align(entry_header.name_size, 8);
+        memcpy(ptr + offset, e->data, e->size);
+        offset += align(e->size, 8);
+        ++count;
+    }
+    VKD3D_ASSERT(offset == library->serialized_size);
+
+    vk_cache_size = d3d12_device_get_pipeline_cache_data(library->device, ptr + offset, data_size - offset);
+    offset += vk_cache_size;
+
+    vkd3d_cache_blob_header_init(ptr, offset, VKD3D_CACHE_MAGIC_LIBRARY, count, library->device);
+
+    vkd3d_mutex_unlock(&library->mutex);
+
+    TRACE("Serialized %u pipelines and %zu bytes of Vulkan pipeline cache data.\n", count, vk_cache_size);
+
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_LoadPipeline(ID3D12PipelineLibrary1 *iface,
+        const WCHAR *name, const D3D12_PIPELINE_STATE_STREAM_DESC *desc, REFIID iid, void **pipeline_state)
+{
+    struct d3d12_pipeline_library *library = impl_from_ID3D12PipelineLibrary1(iface);
+    D3D12_CACHED_PIPELINE_STATE cached_pso;
+    struct d3d12_pipeline_state *object;
+    HRESULT hr;
+
+    TRACE("iface %p, name %s, desc %p, iid %s, pipeline_state %p.\n", iface,
+            debugstr_w(name, library->device->wchar_size), desc, debugstr_guid(iid), pipeline_state);
+
+    if (FAILED(hr = d3d12_pipeline_library_find_pipeline(library, name, &cached_pso)))
+        return hr;
+
+    if (FAILED(hr = d3d12_pipeline_state_create(library->device, desc, &cached_pso, &object)))
+        return hr;
+
+    return return_interface(&object->ID3D12PipelineState_iface, &IID_ID3D12PipelineState, iid, pipeline_state);
+}
+
+static const struct ID3D12PipelineLibrary1Vtbl d3d12_pipeline_library_vtbl =
+{
+    /* IUnknown methods */
+    d3d12_pipeline_library_QueryInterface,
+    d3d12_pipeline_library_AddRef,
+    d3d12_pipeline_library_Release,
+    /* ID3D12Object methods */
+    d3d12_pipeline_library_GetPrivateData,
+    d3d12_pipeline_library_SetPrivateData,
+    d3d12_pipeline_library_SetPrivateDataInterface,
+    d3d12_pipeline_library_SetName,
+    /* ID3D12DeviceChild methods */
+    d3d12_pipeline_library_GetDevice,
+    /* ID3D12PipelineLibrary methods */
+    d3d12_pipeline_library_StorePipeline,
+    d3d12_pipeline_library_LoadGraphicsPipeline,
+    d3d12_pipeline_library_LoadComputePipeline,
+    d3d12_pipeline_library_GetSerializedSize,
+    d3d12_pipeline_library_Serialize,
+    /* ID3D12PipelineLibrary1 methods */
+    d3d12_pipeline_library_LoadPipeline,
+};
+
+static HRESULT d3d12_pipeline_library_load(struct d3d12_pipeline_library *library,
+        const void *blob, size_t blob_size)
+{
+    struct vkd3d_library_entry_header entry_header;
+    struct vkd3d_cache_blob_header header;
+    const uint8_t *data = blob;
+    size_t offset, size;
+    char *name, *entry_data;
+    unsigned int i;
+    HRESULT hr;
+
+    if (FAILED(hr = vkd3d_cache_blob_validate(blob, blob_size, VKD3D_CACHE_MAGIC_LIBRARY, library->device, &header)))
+        return hr;
+
+    size = header.size;
+    offset = sizeof(header);
+    for (i = 0; i < header.count; ++i)
+    {
+        if (!vkd3d_bound_range(offset, sizeof(entry_header), size))
+            return E_INVALIDARG;
+        memcpy(&entry_header, data + offset, sizeof(entry_header));
+        offset += sizeof(entry_header);
+
+        if (!entry_header.name_size || !vkd3d_bound_range(offset, entry_header.name_size, size)
+                || data[offset + entry_header.name_size - 1])
+            return E_INVALIDARG;
+        if (!(name = vkd3d_strdup((const char *)data + offset)))
+            return E_OUTOFMEMORY;
+        offset += align(entry_header.name_size, 8);
+
+        if (!vkd3d_bound_range(offset, entry_header.blob_size, size))
+        {
+            vkd3d_free(name);
+            return E_INVALIDARG;
+        }
+        if (!(entry_data = vkd3d_memdup(data + offset, entry_header.blob_size)))
+        {
+            vkd3d_free(name);
+            return E_OUTOFMEMORY;
+        }
+        offset += align(entry_header.blob_size, 8);
+
+        if (FAILED(hr = d3d12_pipeline_library_add_entry(library, name, entry_data, entry_header.blob_size)))
+            return hr;
+    }
+    if (offset > size)
+        return E_INVALIDARG;
+
+    d3d12_device_merge_pipeline_cache_data(library->device, data + offset, size - offset);
+
+    TRACE("Loaded %u pipelines and %zu bytes of Vulkan pipeline cache data.\n", header.count, size - offset);
+
+    return S_OK;
+}
+
+static HRESULT d3d12_pipeline_library_init(struct d3d12_pipeline_library *library,
+        struct d3d12_device *device, const void *blob, size_t blob_size)
+{
+    HRESULT hr;
+
+    library->ID3D12PipelineLibrary1_iface.lpVtbl = &d3d12_pipeline_library_vtbl;
+    library->refcount = 1;
+    library->device = device;
+
+    vkd3d_mutex_init(&library->mutex);
+    rb_init(&library->pipelines, vkd3d_pipeline_library_compare_name);
+    library->serialized_size = sizeof(struct vkd3d_cache_blob_header);
+    library->vk_cache_size = 0;
+
+    if (blob_size && FAILED(hr = d3d12_pipeline_library_load(library, blob, blob_size)))
+        goto fail;
+
+    if (FAILED(hr = vkd3d_private_store_init(&library->private_store)))
+        goto fail;
+
+    d3d12_device_add_ref(device);
+
+    return S_OK;
+
+fail:
+    rb_destroy(&library->pipelines, vkd3d_pipeline_library_destroy_entry, NULL);
+    vkd3d_mutex_destroy(&library->mutex);
+    return hr;
+}
+
+HRESULT d3d12_pipeline_library_create(struct d3d12_device *device, const void *blob,
+        size_t blob_size, struct d3d12_pipeline_library **library)
+{
+    struct d3d12_pipeline_library *object;
+    HRESULT hr;
+
+    if (!(object = vkd3d_malloc(sizeof(*object))))
+        return E_OUTOFMEMORY;
+
+    if (FAILED(hr = d3d12_pipeline_library_init(object, device, blob, blob_size)))
+    {
+        vkd3d_free(object);
+        return hr;
+    }
+
+    TRACE("Created pipeline library %p.\n", object);
+
+    *library = object;
+
+    return S_OK;
+}
@@ -2851,6 +2851,7 @@ static bool d3d12_command_list_update_current_framebuffer(struct d3d12_command_l
 static bool d3d12_command_list_update_compute_pipeline(struct d3d12_command_list *list)
 {
     const struct vkd3d_vk_device_procs *vk_procs = &list->device->vk_procs;
+    VkPipeline vk_pipeline;
 
     vkd3d_cond_signal(&list->device->worker_cond);
 
@@ -2863,8 +2864,11 @@ static bool d3d12_command_list_update_compute_pipeline(struct d3d12_command_list
         return false;
     }
 
-    VK_CALL(vkCmdBindPipeline(list->vk_command_buffer, list->state->vk_bind_point, list->state->u.compute.vk_pipeline));
-    list->current_pipeline = list->state->u.compute.vk_pipeline;
+    if (!(vk_pipeline = d3d12_pipeline_state_get_compute_pipeline(list->state)))
+        return false;
+
+    VK_CALL(vkCmdBindPipeline(list->vk_command_buffer, list->state->vk_bind_point, vk_pipeline));
+    list->current_pipeline = vk_pipeline;
 
     return true;
 }
@@ -571,6 +571,7 @@ static const struct vkd3d_debug_option vkd3d_config_options[] =
 {
     {"virtual_heaps", VKD3D_CONFIG_FLAG_VIRTUAL_HEAPS}, /* always use virtual descriptor heaps */
     {"vk_debug", VKD3D_CONFIG_FLAG_VULKAN_DEBUG}, /* enable Vulkan debug extensions */
+    {"defer_pipelines", VKD3D_CONFIG_FLAG_DEFER_PIPELINES}, /* create compute pipelines on first use */
 };
 
 static uint64_t vkd3d_init_config_flags(void)
@@ -1780,6 +1781,11 @@ static HRESULT vkd3d_init_device_caps(struct d3d12_device *device,
     vulkan_info->transform_feedback_queries = physical_device_info->xfb_properties.transformFeedbackQueries;
     vulkan_info->uav_read_without_format = features->shaderStorageImageReadWithoutFormat;
     vulkan_info->max_vertex_attrib_divisor = max(physical_device_info->vertex_divisor_properties.maxVertexAttribDivisor, 1);
+    vulkan_info->vendor_id = physical_device_info->properties2.properties.vendorID;
+    vulkan_info->device_id = physical_device_info->properties2.properties.deviceID;
+    vulkan_info->driver_version = physical_device_info->properties2.properties.driverVersion;
+    memcpy(vulkan_info->pipeline_cache_uuid, physical_device_info->properties2.properties.pipelineCacheUUID,
+            sizeof(vulkan_info->pipeline_cache_uuid));
 
     device->feature_options.DoublePrecisionFloatShaderOps = features->shaderFloat64;
     device->feature_options.OutputMergerLogicOp = features->logicOp;
@@ -2376,6 +2382,53 @@ static HRESULT vkd3d_create_vk_device(struct d3d12_device *device,
     return hr;
 }
 
+#define VKD3D_DEFAULT_SHADER_CACHE_SIZE (256ull * 1024 * 1024)
+
+/* Returns a newly allocated "<directory>/<program name><suffix>" path. */
+static char *vkd3d_get_shader_cache_path(const char *directory, const char *suffix)
+{
+    char program_name[PATH_MAX];
+    size_t size;
+    char *path;
+
+    if (!vkd3d_get_program_name(program_name) || !*program_name)
+        strcpy(program_name, "vkd3d");
+
+    size = strlen(directory) + strlen(program_name) + strlen(suffix) + 2;
+    if (!(path = vkd3d_malloc(size)))
+        return NULL;
+    snprintf(path, size, "%s/%s%s", directory, program_name, suffix);
+
+    return path;
+}
+
+/* The DXBC to SPIR-V translation cache is enabled by setting
+ * VKD3D_SHADER_CACHE_PATH to an existing directory. VKD3D_SHADER_CACHE_SIZE
+ * optionally sets the size limit in MiB. */
+static void d3d12_device_open_shader_cache(struct d3d12_device *device)
+{
+    uint64_t max_size = VKD3D_DEFAULT_SHADER_CACHE_SIZE;
+    const char *directory, *size;
+    char *path;
+
+    device->shader_cache = NULL;
+
+    if (!(directory = getenv("VKD3D_SHADER_CACHE_PATH")) || !*directory)
+        return;
+    if ((size = getenv("VKD3D_SHADER_CACHE_SIZE")) && *size)
+        max_size = strtoull(size, NULL, 0) * 1024 * 1024;
+
+    if (!(path = vkd3d_get_shader_cache_path(directory, ".vkd3d-cache")))
+        return;
+
+    if (vkd3d_shader_open_disk_cache(path, 0, max_size, &device->shader_cache) < 0)
+        WARN("Failed to open shader cache %s.\n", debugstr_a(path));
+    else
+        TRACE("Using shader cache %s, size limit %#"PRIx64".\n", debugstr_a(path), max_size);
+
+    vkd3d_free(path);
+}
+
 static HRESULT d3d12_device_init_pipeline_cache(struct d3d12_device *device)
 {
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
@@ -2396,6 +2449,8 @@ static HRESULT d3d12_device_init_pipeline_cache(struct d3d12_device *device)
         device->vk_pipeline_cache = VK_NULL_HANDLE;
     }
 
+    d3d12_device_open_shader_cache(device);
+
     return S_OK;
 }
 
@@ -2405,6 +2460,8 @@ static void d3d12_device_destroy_pipeline_cache(struct d3d12_device *device)
 
     if (device->vk_pipeline_cache)
         VK_CALL(vkDestroyPipelineCache(device->vk_device, device->vk_pipeline_cache, NULL));
+    if (device->shader_cache)
+        vkd3d_shader_cache_decref(device->shader_cache);
 
     vkd3d_mutex_destroy(&device->pipeline_cache_mutex);
 }
@@ -2975,6 +3032,40 @@ static const struct ID3D12ShaderCacheSessionVtbl d3d12_cache_session_vtbl =
     d3d12_cache_session_GetDesc,
 };
 
+/* Disk caches live in the working directory if requested, and otherwise in
+ * VKD3D_SHADER_CACHE_PATH. We fall back to an in-memory cache if neither is
+ * available. */
+static void d3d12_cache_session_open_disk_cache(struct d3d12_cache_session *session)
+{
+    const D3D12_SHADER_CACHE_SESSION_DESC *desc = &session->desc;
+    const GUID *id = &desc->Identifier;
+    const char *directory;
+    char suffix[64];
+    char *path;
+
+    if (desc->Flags & D3D12_SHADER_CACHE_FLAG_USE_WORKING_DIR)
+        directory = ".";
+    else if (!(directory = getenv("VKD3D_SHADER_CACHE_PATH")) || !*directory)
+    {
+        FIXME("No shader cache directory, using an in-memory cache.\n");
+        return;
+    }
+
+    snprintf(suffix, sizeof(suffix), ".%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x.vkd3d-cache",
+            (unsigned int)id->Data1, id->Data2, id->Data3, id->Data4[0], id->Data4[1], id->Data4[2],
+            id->Data4[3], id->Data4[4], id->Data4[5], id->Data4[6], id->Data4[7]);
+    if (!(path = vkd3d_get_shader_cache_path(directory, suffix)))
+        return;
+
+    if (vkd3d_shader_open_disk_cache(path, desc->Version, desc->MaximumValueFileSizeBytes, &session->cache) < 0)
+    {
+        WARN("Failed to open disk cache %s, using an in-memory cache.\n", debugstr_a(path));
+        session->cache = NULL;
+    }
+
+    vkd3d_free(path);
+}
+
 static HRESULT d3d12_cache_session_init(struct d3d12_cache_session *session,
         struct d3d12_device *device, const D3D12_SHADER_CACHE_SESSION_DESC *desc)
 {
@@ -3021,11 +3112,11 @@ static HRESULT d3d12_cache_session_init(struct d3d12_cache_session *session,
         }
     }
 
+    if (!session->cache && session->desc.Mode == D3D12_SHADER_CACHE_MODE_DISK)
+        d3d12_cache_session_open_disk_cache(session);
+
     if (!session->cache)
     {
-        if (session->desc.Mode == D3D12_SHADER_CACHE_MODE_DISK)
-            FIXME("Disk caches are not yet implemented.\n");
-
         ret = vkd3d_shader_open_cache(&session->cache);
         if (ret)
         {
@@ -3137,6 +3228,7 @@ static ULONG STDMETHODCALLTYPE d3d12_device_Release(ID3D12Device9 *iface)
         vkd3d_destroy_null_resources(&device->null_resources, device);
         vkd3d_gpu_va_allocator_cleanup(&device->gpu_va_allocator);
         vkd3d_render_pass_cache_cleanup(&device->render_pass_cache, device);
+        vkd3d_shader_compiler_cleanup(&device->shader_compiler, device);
         d3d12_device_destroy_pipeline_cache(device);
         d3d12_device_destroy_vkd3d_queues(device);
         vkd3d_desc_object_cache_cleanup(&device->view_desc_cache);
@@ -3762,11 +3854,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_device_CheckFeatureSupport(ID3D12Device9
                 return E_INVALIDARG;
             }
 
-            /* FIXME: The d3d12 documentation states that
-             * D3D12_SHADER_CACHE_SUPPORT_SINGLE_PSO is always supported, but
-             * the CachedPSO field of D3D12_GRAPHICS_PIPELINE_STATE_DESC is
-             * ignored and GetCachedBlob() is a stub. */
-            data->SupportFlags = D3D12_SHADER_CACHE_SUPPORT_NONE;
+            data->SupportFlags = D3D12_SHADER_CACHE_SUPPORT_SINGLE_PSO | D3D12_SHADER_CACHE_SUPPORT_LIBRARY;
 
             TRACE("Shader cache support %#x.\n", data->SupportFlags);
             return S_OK;
@@ -4914,10 +5002,17 @@ static LUID * STDMETHODCALLTYPE d3d12_device_GetAdapterLuid(ID3D12Device9 *iface
 static HRESULT STDMETHODCALLTYPE d3d12_device_CreatePipelineLibrary(ID3D12Device9 *iface,
         const void *blob, SIZE_T blob_size, REFIID iid, void **lib)
 {
-    FIXME("iface %p, blob %p, blob_size %"PRIuPTR", iid %s, lib %p stub!\n",
+    struct d3d12_device *device = impl_from_ID3D12Device9(iface);
+    struct d3d12_pipeline_library *object;
+    HRESULT hr;
+
+    TRACE("iface %p, blob %p, blob_size %"PRIuPTR", iid %s, lib %p.\n",
             iface, blob, (uintptr_t)blob_size, debugstr_guid(iid), lib);
 
-    return DXGI_ERROR_UNSUPPORTED;
+    if (FAILED(hr = d3d12_pipeline_library_create(device, blob, blob_size, &object)))
+        return hr;
+
+    return return_interface(&object->ID3D12PipelineLibrary1_iface, &IID_ID3D12PipelineLibrary1, iid, lib);
 }
 
 struct waiting_event_semaphore
@@ -5064,7 +5159,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_device_CreatePipelineState(ID3D12Device9
 
     TRACE("iface %p, desc %p, iid %s, pipeline_state %p.\n", iface, desc, debugstr_guid(iid), pipeline_state);
 
-    if (FAILED(hr = d3d12_pipeline_state_create(device, desc, &object)))
+    if (FAILED(hr = d3d12_pipeline_state_create(device, desc, NULL, &object)))
         return hr;
 
     return return_interface(&object->ID3D12PipelineState_iface, &IID_ID3D12PipelineState, iid, pipeline_state);
@@ -5636,9 +5731,12 @@ static HRESULT d3d12_device_init(struct d3d12_device *device,
     if (FAILED(hr = d3d12_device_init_pipeline_cache(device)))
         goto out_free_vk_resources;
 
-    if (FAILED(hr = vkd3d_private_store_init(&device->private_store)))
+    if (FAILED(hr = vkd3d_shader_compiler_init(&device->shader_compiler, device)))
         goto out_free_pipeline_cache;
 
+    if (FAILED(hr = vkd3d_private_store_init(&device->private_store)))
+        goto out_cleanup_shader_compiler;
+
     if (FAILED(hr = vkd3d_init_format_info(device)))
         goto out_free_private_store;
 
@@ -5685,6 +5783,8 @@ out_cleanup_format_info:
     vkd3d_cleanup_format_info(device);
 out_free_private_store:
     vkd3d_private_store_destroy(&device->private_store);
+out_cleanup_shader_compiler:
+    vkd3d_shader_compiler_cleanup(&device->shader_compiler, device);
 out_free_pipeline_cache:
     d3d12_device_destroy_pipeline_cache(device);
 out_free_vk_resources:
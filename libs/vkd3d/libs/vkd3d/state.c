@@ -22,6 +22,10 @@
 #include "vkd3d_shaders.h"
 #include "vkd3d_shader_utils.h"
 
+#ifndef _WIN32
+# include <unistd.h>
+#endif
+
 /* ID3D12RootSignature */
 static inline struct d3d12_root_signature *impl_from_ID3D12RootSignature(ID3D12RootSignature *iface)
 {
@@ -2220,6 +2224,16 @@ static void d3d12_pipeline_state_destroy_graphics(struct d3d12_pipeline_state *s
     }
 }
 
+static void d3d12_pipeline_state_destroy_compute(struct d3d12_pipeline_state *state,
+        struct d3d12_device *device)
+{
+    struct d3d12_compute_pipeline_state *compute = &state->u.compute;
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+
+    VK_CALL(vkDestroyPipeline(device->vk_device, compute->vk_pipeline, NULL));
+    VK_CALL(vkDestroyShaderModule(device->vk_device, compute->stage.module, NULL));
+}
+
 static void d3d12_pipeline_uav_counter_state_cleanup(struct d3d12_pipeline_uav_counter_state *uav_counters,
         struct d3d12_device *device)
 {
@@ -2250,9 +2264,10 @@ static ULONG STDMETHODCALLTYPE d3d12_pipeline_state_Release(ID3D12PipelineState
         if (d3d12_pipeline_state_is_graphics(state))
             d3d12_pipeline_state_destroy_graphics(state, device);
         else if (d3d12_pipeline_state_is_compute(state))
-            VK_CALL(vkDestroyPipeline(device->vk_device, state->u.compute.vk_pipeline, NULL));
+            d3d12_pipeline_state_destroy_compute(state, device);
 
         d3d12_pipeline_uav_counter_state_cleanup(&state->uav_counters, device);
+        d3d12_pipeline_cache_cleanup(&state->cache);
 
         if (state->implicit_root_signature)
             d3d12_root_signature_Release(state->implicit_root_signature);
@@ -2303,7 +2318,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_state_SetName(ID3D12PipelineStat
 
     if (d3d12_pipeline_state_is_compute(state))
     {
-        return vkd3d_set_vk_object_name(state->device, (uint64_t)state->u.compute.vk_pipeline,
+        return vkd3d_set_vk_object_name(state->device, (uint64_t)d3d12_pipeline_state_get_compute_pipeline(state),
                 VK_DEBUG_REPORT_OBJECT_TYPE_PIPELINE_EXT, name);
     }
 
@@ -2323,9 +2338,20 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_state_GetDevice(ID3D12PipelineSt
 static HRESULT STDMETHODCALLTYPE d3d12_pipeline_state_GetCachedBlob(ID3D12PipelineState *iface,
         ID3DBlob **blob)
 {
-    FIXME("iface %p, blob %p stub!\n", iface, blob);
+    struct d3d12_pipeline_state *state = impl_from_ID3D12PipelineState(iface);
+    size_t size;
+    void *data;
+    HRESULT hr;
+
+    TRACE("iface %p, blob %p.\n", iface, blob);
+
+    if (FAILED(hr = d3d12_pipeline_cache_serialize(&state->cache, state->device, true, &data, &size)))
+        return hr;
 
-    return E_NOTIMPL;
+    if (FAILED(hr = vkd3d_blob_create(data, size, blob)))
+        vkd3d_free(data);
+
+    return hr;
 }
 
 static const struct ID3D12PipelineStateVtbl d3d12_pipeline_state_vtbl =
@@ -2376,17 +2402,514 @@ static unsigned int feature_flags_compile_option(const struct d3d12_device *devi
     return flags;
 }
 
-static HRESULT create_shader_stage(struct d3d12_device *device,
-        struct VkPipelineShaderStageCreateInfo *stage_desc, enum VkShaderStageFlagBits stage,
-        const D3D12_SHADER_BYTECODE *code, const struct vkd3d_shader_interface_info *shader_interface)
+static uint64_t hash_shader_parameters(uint64_t hash,
+        const struct vkd3d_shader_parameter *parameters, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        hash = vkd3d_hash_update(hash, &parameters[i].name, sizeof(parameters[i].name));
+        hash = vkd3d_hash_update(hash, &parameters[i].type, sizeof(parameters[i].type));
+        hash = vkd3d_hash_update(hash, &parameters[i].data_type, sizeof(parameters[i].data_type));
+        if (parameters[i].type == VKD3D_SHADER_PARAMETER_TYPE_IMMEDIATE_CONSTANT)
+            hash = vkd3d_hash_update(hash, &parameters[i].u.immediate_constant.u.u32,
+                    sizeof(parameters[i].u.immediate_constant.u.u32));
+        else
+            hash = vkd3d_hash_update(hash, &parameters[i].u.specialization_constant.id,
+                    sizeof(parameters[i].u.specialization_constant.id));
+    }
+
+    return hash;
+}
+
+static uint64_t hash_transform_feedback_elements(uint64_t hash,
+        const struct vkd3d_shader_transform_feedback_element *elements, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        hash = vkd3d_hash_update(hash, &elements[i].stream_index, sizeof(elements[i].stream_index));
+        if (elements[i].semantic_name)
+            hash = vkd3d_hash_update(hash, elements[i].semantic_name, strlen(elements[i].semantic_name) + 1);
+        hash = vkd3d_hash_update(hash, &elements[i].semantic_index, sizeof(elements[i].semantic_index));
+        hash = vkd3d_hash_update(hash, &elements[i].component_index, sizeof(elements[i].component_index));
+        hash = vkd3d_hash_update(hash, &elements[i].component_count, sizeof(elements[i].component_count));
+        hash = vkd3d_hash_update(hash, &elements[i].output_slot, sizeof(elements[i].output_slot));
+    }
+
+    return hash;
+}
+
+/* Compute a key identifying the SPIR-V generated for a shader stage, from the
+ * bytecode and everything in the compile info which affects the translation.
+ * Returns 0 if the compile info contains structures we don't know how to hash. */
+static uint64_t shader_compile_info_get_key(const struct vkd3d_shader_compile_info *compile_info,
+        enum VkShaderStageFlagBits stage)
+{
+    const struct vkd3d_shader_interface_info *interface_info = NULL;
+    const struct vkd3d_shader_descriptor_offset_info *offset_info;
+    const struct vkd3d_shader_transform_feedback_info *xfb_info;
+    const struct vkd3d_shader_spirv_target_info *target_info;
+    uint64_t hash = VKD3D_HASH_INIT;
+    const struct
+    {
+        enum vkd3d_shader_structure_type type;
+        const void *next;
+    } *s;
+
+    hash = vkd3d_hash_update(hash, &stage, sizeof(stage));
+    hash = vkd3d_hash_update(hash, compile_info->source.code, compile_info->source.size);
+    hash = vkd3d_hash_update(hash, compile_info->options, compile_info->option_count * sizeof(*compile_info->options));
+
+    for (s = compile_info->next; s; s = s->next)
+    {
+        hash = vkd3d_hash_update(hash, &s->type, sizeof(s->type));
+
+        switch (s->type)
+        {
+            case VKD3D_SHADER_STRUCTURE_TYPE_INTERFACE_INFO:
+                interface_info = (const void *)s;
+                hash = vkd3d_hash_update(hash, interface_info->bindings,
+                        interface_info->binding_count * sizeof(*interface_info->bindings));
+                hash = vkd3d_hash_update(hash, interface_info->push_constant_buffers,
+                        interface_info->push_constant_buffer_count * sizeof(*interface_info->push_constant_buffers));
+                hash = vkd3d_hash_update(hash, interface_info->combined_samplers,
+                        interface_info->combined_sampler_count * sizeof(*interface_info->combined_samplers));
+                hash = vkd3d_hash_update(hash, interface_info->uav_counters,
+                        interface_info->uav_counter_count * sizeof(*interface_info->uav_counters));
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_SPIRV_TARGET_INFO:
+                target_info = (const void *)s;
+                if (target_info->entry_point)
+                    hash = vkd3d_hash_update(hash, target_info->entry_point, strlen(target_info->entry_point) + 1);
+                hash = vkd3d_hash_update(hash, &target_info->environment, sizeof(target_info->environment));
+                hash = vkd3d_hash_update(hash, target_info->extensions,
+                        target_info->extension_count * sizeof(*target_info->extensions));
+                hash = hash_shader_parameters(hash, target_info->parameters, target_info->parameter_count);
+                hash = vkd3d_hash_update(hash, &target_info->dual_source_blending,
+                        sizeof(target_info->dual_source_blending));
+                hash = vkd3d_hash_update(hash, target_info->output_swizzles,
+                        target_info->output_swizzle_count * sizeof(*target_info->output_swizzles));
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_DESCRIPTOR_OFFSET_INFO:
+                /* The binding and UAV counter offsets are sized by the interface info, which
+                 * is at the end of the chain. */
+                offset_info = (const void *)s;
+                hash = vkd3d_hash_update(hash, &offset_info->descriptor_table_offset,
+                        sizeof(offset_info->descriptor_table_offset));
+                hash = vkd3d_hash_update(hash, &offset_info->descriptor_table_count,
+                        sizeof(offset_info->descriptor_table_count));
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_TRANSFORM_FEEDBACK_INFO:
+                xfb_info = (const void *)s;
+                hash = hash_transform_feedback_elements(hash, xfb_info->elements, xfb_info->element_count);
+                hash = vkd3d_hash_update(hash, xfb_info->buffer_strides,
+                        xfb_info->buffer_stride_count * sizeof(*xfb_info->buffer_strides));
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_SCAN_SIGNATURE_INFO:
+                /* Output only. */
+                break;
+
+            default:
+                FIXME("Unhandled structure type %#x.\n", s->type);
+                return 0;
+        }
+    }
+
+    for (s = compile_info->next; s; s = s->next)
+    {
+        if (s->type != VKD3D_SHADER_STRUCTURE_TYPE_DESCRIPTOR_OFFSET_INFO)
+            continue;
+        if (!interface_info)
+            return 0;
+        offset_info = (const void *)s;
+        if (offset_info->binding_offsets)
+            hash = vkd3d_hash_update(hash, offset_info->binding_offsets,
+                    interface_info->binding_count * sizeof(*offset_info->binding_offsets));
+        if (offset_info->uav_counter_offsets)
+            hash = vkd3d_hash_update(hash, offset_info->uav_counter_offsets,
+                    interface_info->uav_counter_count * sizeof(*offset_info->uav_counter_offsets));
+    }
+
+    return hash ? hash : 1;
+}
+
+static bool shader_compile_info_has_struct(const struct vkd3d_shader_compile_info *compile_info,
+        enum vkd3d_shader_structure_type type)
+{
+    const struct
+    {
+        enum vkd3d_shader_structure_type type;
+        const void *next;
+    } *s;
+
+    for (s = compile_info->next; s; s = s->next)
+    {
+        if (s->type == type)
+            return true;
+    }
+
+    return false;
+}
+
+#define VKD3D_MAX_SHADER_COMPILER_THREADS 16u
+
+struct vkd3d_shader_compile_job
+{
+    struct list entry;
+    bool queued;
+    struct rb_entry tree_entry;
+    bool in_tree;
+    struct vkd3d_spirv_cache_key key;
+
+    /* Owned by the thread that submitted the job, which waits for it. */
+    const struct vkd3d_shader_compile_info *compile_info;
+    struct vkd3d_shader_cache *cache;
+
+    unsigned int refcount;
+    bool done;
+    int result;
+    struct vkd3d_shader_code spirv;
+};
+
+static int vkd3d_shader_compile_job_compare(const void *key, const struct rb_entry *entry)
+{
+    const struct vkd3d_shader_compile_job *job = RB_ENTRY_VALUE(entry, struct vkd3d_shader_compile_job, tree_entry);
+
+    return memcmp(key, &job->key, sizeof(job->key));
+}
+
+/* Called with the compiler mutex held, which is dropped while translating. */
+static void vkd3d_shader_compiler_run_job_locked(struct vkd3d_shader_compiler *compiler,
+        struct vkd3d_shader_compile_job *job)
 {
-    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
-    struct vkd3d_shader_compile_info compile_info;
-    struct VkShaderModuleCreateInfo shader_desc;
-    struct vkd3d_shader_dxbc_desc dxbc_desc;
     struct vkd3d_shader_code spirv = {0};
+    int ret;
+
+    list_remove(&job->entry);
+    job->queued = false;
+    vkd3d_mutex_unlock(&compiler->mutex);
+
+    if (job->compile_info->source_name)
+        TRACE("Compiling shader \"%s\".\n", job->compile_info->source_name);
+    if ((ret = vkd3d_shader_compile(job->compile_info, &spirv, NULL)) >= 0 && job->cache)
+        vkd3d_shader_cache_put(job->cache, &job->key, sizeof(job->key), spirv.code, spirv.size);
+
+    vkd3d_mutex_lock(&compiler->mutex);
+    job->result = ret;
+    job->spirv = spirv;
+    job->done = true;
+    if (job->in_tree)
+    {
+        rb_remove(&compiler->jobs, &job->tree_entry);
+        job->in_tree = false;
+    }
+    vkd3d_cond_broadcast(&compiler->done_cond);
+}
+
+static void *vkd3d_shader_compiler_main(void *arg)
+{
+    struct vkd3d_shader_compiler *compiler = arg;
+    struct list *head;
+
+    vkd3d_set_thread_name("vkd3d_compiler");
+
+    vkd3d_mutex_lock(&compiler->mutex);
+
+    while (!compiler->should_exit)
+    {
+        if ((head = list_head(&compiler->queue)))
+            vkd3d_shader_compiler_run_job_locked(compiler,
+                    LIST_ENTRY(head, struct vkd3d_shader_compile_job, entry));
+        else
+            vkd3d_cond_wait(&compiler->job_cond, &compiler->mutex);
+    }
+
+    vkd3d_mutex_unlock(&compiler->mutex);
+
+    return NULL;
+}
+
+/* Returns a job translating "compile_info", or a job for an identical shader
+ * that is already in flight. "key" may be NULL if the shader can't be
+ * identified, in which case the job is never shared. */
+static struct vkd3d_shader_compile_job *vkd3d_shader_compiler_submit(struct vkd3d_shader_compiler *compiler,
+        const struct vkd3d_shader_compile_info *compile_info, const struct vkd3d_spirv_cache_key *key,
+        struct vkd3d_shader_cache *cache)
+{
+    struct vkd3d_shader_compile_job *job;
+    struct rb_entry *entry;
+
+    vkd3d_mutex_lock(&compiler->mutex);
+
+    if (key && (entry = rb_get(&compiler->jobs, key)))
+    {
+        job = RB_ENTRY_VALUE(entry, struct vkd3d_shader_compile_job, tree_entry);
+        ++job->refcount;
+        TRACE("Sharing in-flight translation of shader \"%s\".\n", debugstr_a(compile_info->source_name));
+        vkd3d_mutex_unlock(&compiler->mutex);
+        return job;
+    }
+
+    if (!(job = vkd3d_calloc(1, sizeof(*job))))
+    {
+        vkd3d_mutex_unlock(&compiler->mutex);
+        return NULL;
+    }
+    job->compile_info = compile_info;
+    job->refcount = 1;
+    if (key)
+    {
+        job->key = *key;
+        job->cache = cache;
+        rb_put(&compiler->jobs, key, &job->tree_entry);
+        job->in_tree = true;
+    }
+    list_add_tail(&compiler->queue, &job->entry);
+    job->queued = true;
+    vkd3d_cond_signal(&compiler->job_cond);
+
+    vkd3d_mutex_unlock(&compiler->mutex);
+
+    return job;
+}
+
+/* Waits for the job, and releases it. The SPIR-V is returned in "spirv" on
+ * success. */
+static int vkd3d_shader_compiler_wait(struct vkd3d_shader_compiler *compiler,
+        struct vkd3d_shader_compile_job *job, struct vkd3d_shader_code *spirv)
+{
+    struct list *head;
+    int ret;
+
+    vkd3d_mutex_lock(&compiler->mutex);
+
+    while (!job->done)
+    {
+        /* Rather than sleeping, translate our own shader if no worker has
+         * picked it up yet, or help with somebody else's. */
+        if (job->queued)
+            vkd3d_shader_compiler_run_job_locked(compiler, job);
+        else if ((head = list_head(&compiler->queue)))
+            vkd3d_shader_compiler_run_job_locked(compiler,
+                    LIST_ENTRY(head, struct vkd3d_shader_compile_job, entry));
+        else
+            vkd3d_cond_wait(&compiler->done_cond, &compiler->mutex);
+    }
+
+    if ((ret = job->result) >= 0)
+    {
+        if (job->refcount == 1)
+        {
+            *spirv = job->spirv;
+            memset(&job->spirv, 0, sizeof(job->spirv));
+        }
+        else if ((spirv->code = vkd3d_memdup(job->spirv.code, job->spirv.size)))
+        {
+            spirv->size = job->spirv.size;
+        }
+        else
+        {
+            ret = VKD3D_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    if (!--job->refcount)
+    {
+        vkd3d_shader_free_shader_code(&job->spirv);
+        vkd3d_free(job);
+    }
+
+    vkd3d_mutex_unlock(&compiler->mutex);
+
+    return ret;
+}
+
+static unsigned int vkd3d_shader_compiler_get_thread_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+#endif
+    const char *value;
+    long cpu_count;
+
+    if ((value = getenv("VKD3D_SHADER_COMPILER_THREADS")))
+        return min(strtoul(value, NULL, 0), VKD3D_MAX_SHADER_COMPILER_THREADS);
+
+#ifdef _WIN32
+    GetSystemInfo(&system_info);
+    cpu_count = system_info.dwNumberOfProcessors;
+#else
+    cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    /* Threads creating pipeline states translate shaders as well. */
+    return cpu_count > 1 ? min((unsigned int)cpu_count - 1, VKD3D_MAX_SHADER_COMPILER_THREADS) : 0;
+}
+
+HRESULT vkd3d_shader_compiler_init(struct vkd3d_shader_compiler *compiler, struct d3d12_device *device)
+{
+    unsigned int thread_count, i;
+    HRESULT hr;
+
+    vkd3d_mutex_init(&compiler->mutex);
+    vkd3d_cond_init(&compiler->job_cond);
+    vkd3d_cond_init(&compiler->done_cond);
+    list_init(&compiler->queue);
+    rb_init(&compiler->jobs, vkd3d_shader_compile_job_compare);
+    compiler->should_exit = false;
+    compiler->threads = NULL;
+    compiler->thread_count = 0;
+
+    if (!(thread_count = vkd3d_shader_compiler_get_thread_count()))
+        return S_OK;
+
+    if (!(compiler->threads = vkd3d_calloc(thread_count, sizeof(*compiler->threads))))
+    {
+        vkd3d_shader_compiler_cleanup(compiler, device);
+        return E_OUTOFMEMORY;
+    }
+
+    for (i = 0; i < thread_count; ++i)
+    {
+        if (FAILED(hr = vkd3d_create_thread(device->vkd3d_instance,
+                vkd3d_shader_compiler_main, compiler, &compiler->threads[i])))
+        {
+            WARN("Failed to create shader compiler thread, hr %s.\n", debugstr_hresult(hr));
+            vkd3d_shader_compiler_cleanup(compiler, device);
+            return hr;
+        }
+        ++compiler->thread_count;
+    }
+
+    TRACE("Created %u shader compiler threads.\n", compiler->thread_count);
+
+    return S_OK;
+}
+
+void vkd3d_shader_compiler_cleanup(struct vkd3d_shader_compiler *compiler, struct d3d12_device *device)
+{
+    unsigned int i;
+
+    vkd3d_mutex_lock(&compiler->mutex);
+    VKD3D_ASSERT(list_empty(&compiler->queue));
+    compiler->should_exit = true;
+    vkd3d_cond_broadcast(&compiler->job_cond);
+    vkd3d_mutex_unlock(&compiler->mutex);
+
+    for (i = 0; i < compiler->thread_count; ++i)
+        vkd3d_join_thread(device->vkd3d_instance, &compiler->threads[i]);
+    vkd3d_free(compiler->threads);
+
+    vkd3d_cond_destroy(&compiler->done_cond);
+    vkd3d_cond_destroy(&compiler->job_cond);
+    vkd3d_mutex_destroy(&compiler->mutex);
+}
+
+/* The state of a shader stage between shader_stage_compile_begin() and
+ * shader_stage_compile_end(). The structure chain is copied, since callers
+ * reuse theirs for the next stage while this one may still be translated. */
+struct shader_stage_compile
+{
+    enum VkShaderStageFlagBits stage;
+    struct vkd3d_shader_compile_option options[8];
+    struct vkd3d_shader_compile_info compile_info;
     char source_name[33];
-    VkResult vr;
+    uint64_t key;
+    struct vkd3d_spirv_cache_key spirv_key;
+
+    struct vkd3d_shader_interface_info interface_info;
+    struct vkd3d_shader_spirv_target_info target_info;
+    struct vkd3d_shader_descriptor_offset_info offset_info;
+    struct vkd3d_shader_transform_feedback_info xfb_info;
+
+    struct vkd3d_shader_compile_job *job;
+    struct vkd3d_shader_code spirv;
+};
+
+/* Output structures are left out; their contents are filled in before the
+ * translation is submitted. */
+static bool shader_stage_compile_copy_chain(struct shader_stage_compile *c, const void *chain)
+{
+    const struct
+    {
+        enum vkd3d_shader_structure_type type;
+        const void *next;
+    } *s;
+    struct
+    {
+        enum vkd3d_shader_structure_type type;
+        const void *next;
+    } *copy;
+    const void *head = NULL, **next = &head;
+    uint32_t seen = 0;
+    size_t size;
+
+    for (s = chain; s; s = s->next)
+    {
+        switch (s->type)
+        {
+            case VKD3D_SHADER_STRUCTURE_TYPE_INTERFACE_INFO:
+                copy = (void *)&c->interface_info;
+                size = sizeof(c->interface_info);
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_SPIRV_TARGET_INFO:
+                copy = (void *)&c->target_info;
+                size = sizeof(c->target_info);
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_DESCRIPTOR_OFFSET_INFO:
+                copy = (void *)&c->offset_info;
+                size = sizeof(c->offset_info);
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_TRANSFORM_FEEDBACK_INFO:
+                copy = (void *)&c->xfb_info;
+                size = sizeof(c->xfb_info);
+                break;
+
+            case VKD3D_SHADER_STRUCTURE_TYPE_SCAN_SIGNATURE_INFO:
+                continue;
+
+            default:
+                return false;
+        }
+
+        if (seen & (1u << s->type))
+            return false;
+        seen |= 1u << s->type;
+
+        memcpy(copy, s, size);
+        *next = copy;
+        next = &copy->next;
+    }
+    *next = NULL;
+
+    c->compile_info.next = head;
+    return true;
+}
+
+/* Starts creating a shader stage. The SPIR-V is taken from "cached" if it is
+ * not NULL and has it, then from the device's shader cache, and is otherwise
+ * translated on the device's compiler threads if possible. */
+static HRESULT shader_stage_compile_begin(struct shader_stage_compile *c, struct d3d12_device *device,
+        enum VkShaderStageFlagBits stage, const D3D12_SHADER_BYTECODE *code,
+        const struct vkd3d_shader_interface_info *shader_interface, const struct vkd3d_cached_pipeline *cached)
+{
+    struct vkd3d_shader_compile_info *compile_info = &c->compile_info;
+    const struct vkd3d_spirv_cache_key *job_key = NULL;
+    const struct vkd3d_pipeline_shader *cached_shader;
+    struct vkd3d_shader_compile_info scan_info;
+    struct vkd3d_shader_dxbc_desc dxbc_desc;
+    bool use_shader_cache = false;
+    size_t size = 0;
     int ret;
 
     const struct vkd3d_shader_compile_option options[] =
@@ -2399,58 +2922,195 @@ static HRESULT create_shader_stage(struct d3d12_device *device,
         {VKD3D_SHADER_COMPILE_OPTION_DENORMAL_MODE_F32, VKD3D_SHADER_DENORMAL_MODE_ANY},
         {VKD3D_SHADER_COMPILE_OPTION_DENORMAL_MODE_F64, VKD3D_SHADER_DENORMAL_MODE_ANY},
     };
+    STATIC_ASSERT(ARRAY_SIZE(options) <= ARRAY_SIZE(c->options));
+
+    c->stage = stage;
+    c->job = NULL;
+    memset(&c->spirv, 0, sizeof(c->spirv));
+    memcpy(c->options, options, sizeof(options));
+
+    compile_info->type = VKD3D_SHADER_STRUCTURE_TYPE_COMPILE_INFO;
+    compile_info->next = shader_interface;
+    compile_info->source.code = code->pShaderBytecode;
+    compile_info->source.size = code->BytecodeLength;
+    compile_info->target_type = VKD3D_SHADER_TARGET_SPIRV_BINARY;
+    compile_info->options = c->options;
+    compile_info->option_count = ARRAY_SIZE(options);
+    compile_info->log_level = VKD3D_SHADER_LOG_NONE;
+    compile_info->source_name = NULL;
+
+    c->key = shader_compile_info_get_key(compile_info, stage);
+    memset(&c->spirv_key, 0, sizeof(c->spirv_key));
+    c->spirv_key.key = c->key;
+    c->spirv_key.stage = stage;
+
+    if (cached)
+    {
+        if (!(cached_shader = vkd3d_cached_pipeline_find_shader(cached, stage)) || cached_shader->key != c->key)
+        {
+            WARN("Cached pipeline state does not match shader stage %#x.\n", stage);
+            return E_INVALIDARG;
+        }
 
-    stage_desc->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stage_desc->pNext = NULL;
-    stage_desc->flags = 0;
-    stage_desc->stage = stage;
-    stage_desc->pName = "main";
-    stage_desc->pSpecializationInfo = NULL;
-
-    shader_desc.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shader_desc.pNext = NULL;
-    shader_desc.flags = 0;
+        if (c->key && cached_shader->spirv.size)
+        {
+            if (!(c->spirv.code = vkd3d_memdup(cached_shader->spirv.code, cached_shader->spirv.size)))
+                return E_OUTOFMEMORY;
+            c->spirv.size = cached_shader->spirv.size;
+            TRACE("Using cached SPIR-V for shader stage %#x.\n", stage);
+        }
+    }
 
-    compile_info.type = VKD3D_SHADER_STRUCTURE_TYPE_COMPILE_INFO;
-    compile_info.next = shader_interface;
-    compile_info.source.code = code->pShaderBytecode;
-    compile_info.source.size = code->BytecodeLength;
-    compile_info.target_type = VKD3D_SHADER_TARGET_SPIRV_BINARY;
-    compile_info.options = options;
-    compile_info.option_count = ARRAY_SIZE(options);
-    compile_info.log_level = VKD3D_SHADER_LOG_NONE;
-    compile_info.source_name = NULL;
+    if ((ret = vkd3d_shader_parse_dxbc_source_type(&compile_info->source, &compile_info->source_type, NULL)) < 0)
+    {
+        WARN("Failed to parse shader, vkd3d result %d.\n", ret);
+        vkd3d_shader_free_shader_code(&c->spirv);
+        return hresult_from_vkd3d_result(ret);
+    }
 
-    if ((ret = vkd3d_shader_parse_dxbc(&(struct vkd3d_shader_code){code->pShaderBytecode, code->BytecodeLength},
-            0, &dxbc_desc, NULL)) >= 0)
+    if ((ret = vkd3d_shader_parse_dxbc(&(struct vkd3d_shader_code){code->pShaderBytecode,
+            code->BytecodeLength}, 0, &dxbc_desc, NULL)) >= 0)
     {
-        sprintf(source_name, "%08x%08x%08x%08x", dxbc_desc.checksum[0],
+        sprintf(c->source_name, "%08x%08x%08x%08x", dxbc_desc.checksum[0],
                 dxbc_desc.checksum[1], dxbc_desc.checksum[2], dxbc_desc.checksum[3]);
+        compile_info->source_name = c->source_name;
+
+        if (c->key)
+        {
+            c->spirv_key.source_size = code->BytecodeLength;
+            memcpy(c->spirv_key.checksum, dxbc_desc.checksum, sizeof(c->spirv_key.checksum));
+            job_key = &c->spirv_key;
+            use_shader_cache = !!device->shader_cache;
+
+            /* Later pipeline states using the same shader don't need the blob. */
+            if (use_shader_cache && c->spirv.code && vkd3d_shader_cache_get(device->shader_cache,
+                    &c->spirv_key, sizeof(c->spirv_key), NULL, &size) < 0)
+                vkd3d_shader_cache_put(device->shader_cache, &c->spirv_key,
+                        sizeof(c->spirv_key), c->spirv.code, c->spirv.size);
+            else if (use_shader_cache && !c->spirv.code
+                    && vkd3d_shader_cache_get_spirv(device->shader_cache, &c->spirv_key, &c->spirv))
+                TRACE("Using cached SPIR-V for shader \"%s\".\n", c->source_name);
+        }
         vkd3d_shader_free_dxbc(&dxbc_desc);
-        TRACE("Compiling shader \"%s\".\n", source_name);
-        compile_info.source_name = source_name;
     }
 
-    if ((ret = vkd3d_shader_parse_dxbc_source_type(&compile_info.source, &compile_info.source_type, NULL)) < 0
-            || (ret = vkd3d_shader_compile(&compile_info, &spirv, NULL)) < 0)
+    if (c->spirv.code || (device->shader_compiler.thread_count
+            && shader_stage_compile_copy_chain(c, shader_interface)))
+    {
+        /* We still need the shader signatures. */
+        scan_info = *compile_info;
+        scan_info.next = shader_interface;
+        if (shader_compile_info_has_struct(&scan_info, VKD3D_SHADER_STRUCTURE_TYPE_SCAN_SIGNATURE_INFO)
+                && (ret = vkd3d_shader_scan(&scan_info, NULL)) < 0)
+        {
+            WARN("Failed to scan shader, vkd3d result %d.\n", ret);
+            vkd3d_shader_free_shader_code(&c->spirv);
+            return hresult_from_vkd3d_result(ret);
+        }
+
+        if (c->spirv.code || (c->job = vkd3d_shader_compiler_submit(&device->shader_compiler,
+                compile_info, job_key, use_shader_cache ? device->shader_cache : NULL)))
+            return S_OK;
+    }
+
+    if (compile_info->source_name)
+        TRACE("Compiling shader \"%s\".\n", compile_info->source_name);
+
+    if ((ret = vkd3d_shader_compile(compile_info, &c->spirv, NULL)) < 0)
     {
         WARN("Failed to compile shader, vkd3d result %d.\n", ret);
         return hresult_from_vkd3d_result(ret);
     }
-    shader_desc.codeSize = spirv.size;
-    shader_desc.pCode = spirv.code;
+
+    if (use_shader_cache)
+        vkd3d_shader_cache_put(device->shader_cache, &c->spirv_key,
+                sizeof(c->spirv_key), c->spirv.code, c->spirv.size);
+
+    return S_OK;
+}
+
+/* Releases everything held by a stage for which shader_stage_compile_end()
+ * was not called or failed. */
+static void shader_stage_compile_cleanup(struct shader_stage_compile *c, struct d3d12_device *device)
+{
+    struct vkd3d_shader_code spirv = {0};
+
+    if (c->job)
+    {
+        if (vkd3d_shader_compiler_wait(&device->shader_compiler, c->job, &spirv) >= 0)
+            vkd3d_shader_free_shader_code(&spirv);
+        c->job = NULL;
+    }
+    vkd3d_shader_free_shader_code(&c->spirv);
+    memset(&c->spirv, 0, sizeof(c->spirv));
+}
+
+/* Waits for the translation to finish and creates the shader module. The
+ * SPIR-V is stored in "cache". */
+static HRESULT shader_stage_compile_end(struct shader_stage_compile *c, struct d3d12_device *device,
+        struct VkPipelineShaderStageCreateInfo *stage_desc, struct d3d12_pipeline_cache *cache)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    struct VkShaderModuleCreateInfo shader_desc;
+    VkResult vr;
+    int ret;
+
+    if (c->job)
+    {
+        ret = vkd3d_shader_compiler_wait(&device->shader_compiler, c->job, &c->spirv);
+        c->job = NULL;
+        if (ret < 0)
+        {
+            WARN("Failed to compile shader, vkd3d result %d.\n", ret);
+            return hresult_from_vkd3d_result(ret);
+        }
+    }
+
+    stage_desc->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stage_desc->pNext = NULL;
+    stage_desc->flags = 0;
+    stage_desc->stage = c->stage;
+    stage_desc->pName = "main";
+    stage_desc->pSpecializationInfo = NULL;
+
+    shader_desc.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_desc.pNext = NULL;
+    shader_desc.flags = 0;
+    shader_desc.codeSize = c->spirv.size;
+    shader_desc.pCode = c->spirv.code;
 
     vr = VK_CALL(vkCreateShaderModule(device->vk_device, &shader_desc, NULL, &stage_desc->module));
-    vkd3d_shader_free_shader_code(&spirv);
     if (vr < 0)
     {
         WARN("Failed to create Vulkan shader module, vr %d.\n", vr);
+        shader_stage_compile_cleanup(c, device);
         return hresult_from_vk_result(vr);
     }
 
+    d3d12_pipeline_cache_add_shader(cache, c->stage, c->key, &c->spirv);
+
     return S_OK;
 }
 
+/* The generated SPIR-V is stored in "cache". If "cached" is not NULL, the
+ * SPIR-V is taken from the cached PSO instead of translating the bytecode. */
+static HRESULT create_shader_stage(struct d3d12_device *device,
+        struct VkPipelineShaderStageCreateInfo *stage_desc, enum VkShaderStageFlagBits stage,
+        const D3D12_SHADER_BYTECODE *code, const struct vkd3d_shader_interface_info *shader_interface,
+        struct d3d12_pipeline_cache *cache, const struct vkd3d_cached_pipeline *cached)
+{
+    struct shader_stage_compile c;
+    HRESULT hr;
+
+    if (FAILED(hr = shader_stage_compile_begin(&c, device, stage, code, shader_interface, cached)))
+        return hr;
+
+    if (FAILED(hr = shader_stage_compile_end(&c, device, stage_desc, cache)))
+        shader_stage_compile_cleanup(&c, device);
+
+    return hr;
+}
+
 static int vkd3d_scan_dxbc(const struct d3d12_device *device, const D3D12_SHADER_BYTECODE *code,
         struct vkd3d_shader_scan_descriptor_info *descriptor_info)
 {
@@ -2479,37 +3139,84 @@ static int vkd3d_scan_dxbc(const struct d3d12_device *device, const D3D12_SHADER
     return vkd3d_shader_scan(&compile_info, NULL);
 }
 
-static HRESULT vkd3d_create_compute_pipeline(struct d3d12_device *device,
-        const D3D12_SHADER_BYTECODE *code, const struct vkd3d_shader_interface_info *shader_interface,
-        VkPipelineLayout vk_pipeline_layout, VkPipeline *vk_pipeline)
+static HRESULT vkd3d_create_compute_pipeline_from_stage(struct d3d12_device *device,
+        const VkPipelineShaderStageCreateInfo *stage, VkPipelineLayout vk_pipeline_layout, VkPipeline *vk_pipeline)
 {
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     VkComputePipelineCreateInfo pipeline_info;
     VkResult vr;
-    HRESULT hr;
 
     pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipeline_info.pNext = NULL;
     pipeline_info.flags = 0;
-    if (FAILED(hr = create_shader_stage(device, &pipeline_info.stage,
-            VK_SHADER_STAGE_COMPUTE_BIT, code, shader_interface)))
-        return hr;
+    pipeline_info.stage = *stage;
     pipeline_info.layout = vk_pipeline_layout;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
 
-    vr = VK_CALL(vkCreateComputePipelines(device->vk_device,
-            VK_NULL_HANDLE, 1, &pipeline_info, NULL, vk_pipeline));
-    VK_CALL(vkDestroyShaderModule(device->vk_device, pipeline_info.stage.module, NULL));
-    if (vr < 0)
+    if ((vr = VK_CALL(vkCreateComputePipelines(device->vk_device,
+            device->vk_pipeline_cache, 1, &pipeline_info, NULL, vk_pipeline))) < 0)
     {
-        WARN("Failed to create Vulkan compute pipeline, hr %s.\n", debugstr_hresult(hr));
+        WARN("Failed to create Vulkan compute pipeline, vr %d.\n", vr);
         return hresult_from_vk_result(vr);
     }
 
     return S_OK;
 }
 
+static HRESULT vkd3d_create_compute_pipeline(struct d3d12_device *device,
+        const D3D12_SHADER_BYTECODE *code, const struct vkd3d_shader_interface_info *shader_interface,
+        VkPipelineLayout vk_pipeline_layout, struct d3d12_pipeline_cache *cache,
+        const struct vkd3d_cached_pipeline *cached, VkPipeline *vk_pipeline)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    VkPipelineShaderStageCreateInfo stage;
+    HRESULT hr;
+
+    if (FAILED(hr = create_shader_stage(device, &stage,
+            VK_SHADER_STAGE_COMPUTE_BIT, code, shader_interface, cache, cached)))
+        return hr;
+
+    hr = vkd3d_create_compute_pipeline_from_stage(device, &stage, vk_pipeline_layout, vk_pipeline);
+    VK_CALL(vkDestroyShaderModule(device->vk_device, stage.module, NULL));
+
+    return hr;
+}
+
+VkPipeline d3d12_pipeline_state_get_compute_pipeline(struct d3d12_pipeline_state *state)
+{
+    struct d3d12_compute_pipeline_state *compute = &state->u.compute;
+    struct d3d12_device *device = state->device;
+    const struct vkd3d_vk_device_procs *vk_procs;
+    VkPipeline vk_pipeline, new_pipeline;
+
+    /* The pipeline is only ever set once, so only a missing one needs the
+     * lock. The compare-exchange is a full barrier, which makes the handle
+     * published below visible. */
+    if (vkd3d_atomic_compare_exchange_u32(&compute->vk_pipeline_ready, 1, 1))
+        return compute->vk_pipeline;
+
+    vkd3d_mutex_lock(&device->pipeline_cache_mutex);
+
+    if (!(vk_pipeline = compute->vk_pipeline) && compute->stage.module)
+    {
+        vk_procs = &device->vk_procs;
+        if (SUCCEEDED(vkd3d_create_compute_pipeline_from_stage(device, &compute->stage,
+                compute->vk_pipeline_layout, &new_pipeline)))
+        {
+            TRACE("Created deferred compute pipeline for state %p.\n", state);
+            compute->vk_pipeline = vk_pipeline = new_pipeline;
+            vkd3d_atomic_exchange_u32(&compute->vk_pipeline_ready, 1);
+            VK_CALL(vkDestroyShaderModule(device->vk_device, compute->stage.module, NULL));
+            compute->stage.module = VK_NULL_HANDLE;
+        }
+    }
+
+    vkd3d_mutex_unlock(&device->pipeline_cache_mutex);
+
+    return vk_pipeline;
+}
+
 static HRESULT d3d12_pipeline_state_init_uav_counters(struct d3d12_pipeline_state *state,
         struct d3d12_device *device, const struct d3d12_root_signature *root_signature,
         const struct vkd3d_shader_scan_descriptor_info *shader_info, VkShaderStageFlags stage_flags)
@@ -2638,15 +3345,38 @@ static HRESULT d3d12_pipeline_state_find_and_init_uav_counters(struct d3d12_pipe
     return hr;
 }
 
+static HRESULT d3d12_pipeline_state_init_cache(struct d3d12_pipeline_state *state,
+        struct d3d12_device *device, const struct d3d12_pipeline_state_desc *desc,
+        struct vkd3d_cached_pipeline *cached, bool *use_cached)
+{
+    HRESULT hr;
+
+    if ((*use_cached = !!desc->cached_pso.CachedBlobSizeInBytes)
+            && FAILED(hr = vkd3d_cached_pipeline_parse(cached, device, &desc->cached_pso)))
+    {
+        WARN("Invalid cached pipeline state, hr %s.\n", debugstr_hresult(hr));
+        return hr;
+    }
+
+    /* Pipelines are created with the device's pipeline cache. */
+    if (*use_cached)
+        d3d12_device_merge_pipeline_cache_data(device, cached->vk_cache_data, cached->vk_cache_size);
+
+    memset(&state->cache, 0, sizeof(state->cache));
+
+    return S_OK;
+}
+
 static HRESULT d3d12_pipeline_state_init_compute(struct d3d12_pipeline_state *state,
         struct d3d12_device *device, const struct d3d12_pipeline_state_desc *desc)
 {
-    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     struct vkd3d_shader_interface_info shader_interface;
     struct vkd3d_shader_descriptor_offset_info offset_info;
     struct vkd3d_shader_spirv_target_info target_info;
     struct d3d12_root_signature *root_signature;
+    struct vkd3d_cached_pipeline cached;
     VkPipelineLayout vk_pipeline_layout;
+    bool use_cached;
     HRESULT hr;
 
     state->ID3D12PipelineState_iface.lpVtbl = &d3d12_pipeline_state_vtbl;
@@ -2654,6 +3384,14 @@ static HRESULT d3d12_pipeline_state_init_compute(struct d3d12_pipeline_state *st
 
     memset(&state->uav_counters, 0, sizeof(state->uav_counters));
 
+    if (FAILED(hr = d3d12_pipeline_state_init_cache(state, device, desc, &cached, &use_cached)))
+        return hr;
+    if (use_cached && cached.shader_count != 1)
+    {
+        WARN("Cached pipeline state has %u shader stages, expected 1.\n", cached.shader_count);
+        return E_INVALIDARG;
+    }
+
     if (!(root_signature = unsafe_impl_from_ID3D12RootSignature(desc->root_signature)))
     {
         TRACE("Root signature is NULL, looking for an embedded signature.\n");
@@ -2716,20 +3454,32 @@ static HRESULT d3d12_pipeline_state_init_compute(struct d3d12_pipeline_state *st
 
     vk_pipeline_layout = state->uav_counters.vk_pipeline_layout
             ? state->uav_counters.vk_pipeline_layout : root_signature->vk_pipeline_layout;
-    if (FAILED(hr = vkd3d_create_compute_pipeline(device, &desc->cs, &shader_interface,
-            vk_pipeline_layout, &state->u.compute.vk_pipeline)))
+    state->u.compute.vk_pipeline = VK_NULL_HANDLE;
+    state->u.compute.vk_pipeline_ready = 0;
+    state->u.compute.stage.module = VK_NULL_HANDLE;
+    state->u.compute.vk_pipeline_layout = vk_pipeline_layout;
+    if (device->vkd3d_instance->config_flags & VKD3D_CONFIG_FLAG_DEFER_PIPELINES)
+        hr = create_shader_stage(device, &state->u.compute.stage, VK_SHADER_STAGE_COMPUTE_BIT,
+                &desc->cs, &shader_interface, &state->cache, use_cached ? &cached : NULL);
+    else
+        hr = vkd3d_create_compute_pipeline(device, &desc->cs, &shader_interface, vk_pipeline_layout,
+                &state->cache, use_cached ? &cached : NULL, &state->u.compute.vk_pipeline);
+    if (FAILED(hr))
     {
         WARN("Failed to create Vulkan compute pipeline, hr %s.\n", debugstr_hresult(hr));
         d3d12_pipeline_uav_counter_state_cleanup(&state->uav_counters, device);
+        d3d12_pipeline_cache_cleanup(&state->cache);
         if (state->implicit_root_signature)
             d3d12_root_signature_Release(state->implicit_root_signature);
         return hr;
     }
+    state->u.compute.vk_pipeline_ready = !!state->u.compute.vk_pipeline;
 
     if (FAILED(hr = vkd3d_private_store_init(&state->private_store)))
     {
-        VK_CALL(vkDestroyPipeline(device->vk_device, state->u.compute.vk_pipeline, NULL));
+        d3d12_pipeline_state_destroy_compute(state, device);
         d3d12_pipeline_uav_counter_state_cleanup(&state->uav_counters, device);
+        d3d12_pipeline_cache_cleanup(&state->cache);
         if (state->implicit_root_signature)
             d3d12_root_signature_Release(state->implicit_root_signature);
         return hr;
@@ -3223,8 +3973,12 @@ static HRESULT d3d12_pipeline_state_init_graphics(struct d3d12_pipeline_state *s
     struct vkd3d_shader_spirv_target_info ps_target_info;
     struct vkd3d_shader_interface_info shader_interface;
     struct vkd3d_shader_spirv_target_info target_info;
+    struct shader_stage_compile *compiles = NULL;
     struct d3d12_root_signature *root_signature;
     bool have_attachment, is_dsv_format_unknown;
+    struct vkd3d_cached_pipeline cached;
+    unsigned int compile_count = 0;
+    bool use_cached;
     VkShaderStageFlagBits xfb_stage = 0;
     VkSampleCountFlagBits sample_count;
     const struct vkd3d_format *format;
@@ -3267,6 +4021,9 @@ static HRESULT d3d12_pipeline_state_init_graphics(struct d3d12_pipeline_state *s
         }
     }
 
+    if (FAILED(hr = d3d12_pipeline_state_init_cache(state, device, desc, &cached, &use_cached)))
+        return hr;
+
     state->implicit_root_signature = NULL;
     if (!(root_signature = unsafe_impl_from_ID3D12RootSignature(desc->root_signature)))
     {
@@ -3496,6 +4253,14 @@ static HRESULT d3d12_pipeline_state_init_graphics(struct d3d12_pipeline_state *s
         offset_info.uav_counter_offsets = root_signature->uav_counter_offsets;
     }
 
+    if (!(compiles = vkd3d_calloc(ARRAY_SIZE(shader_stages), sizeof(*compiles))))
+    {
+        hr = E_OUTOFMEMORY;
+        goto fail;
+    }
+
+    /* Start translating all stages before waiting for any of them, so that
+     * they can be translated in parallel. */
     for (i = 0; i < ARRAY_SIZE(shader_stages); ++i)
     {
         const D3D12_SHADER_BYTECODE *b = (const void *)((uintptr_t)desc + shader_stages[i].offset);
@@ -3553,12 +4318,30 @@ static HRESULT d3d12_pipeline_state_init_graphics(struct d3d12_pipeline_state *s
         if (shader_stages[i].stage == VK_SHADER_STAGE_VERTEX_BIT)
             vkd3d_prepend_struct(&shader_interface, &signature_info);
 
-        if (FAILED(hr = create_shader_stage(device, &graphics->stages[graphics->stage_count],
-                shader_stages[i].stage, b, &shader_interface)))
+        if (FAILED(hr = shader_stage_compile_begin(&compiles[compile_count], device,
+                shader_stages[i].stage, b, &shader_interface, use_cached ? &cached : NULL)))
+            goto fail;
+
+        ++compile_count;
+    }
+
+    for (i = 0; i < compile_count; ++i)
+    {
+        if (FAILED(hr = shader_stage_compile_end(&compiles[i], device,
+                &graphics->stages[graphics->stage_count], &state->cache)))
             goto fail;
 
         ++graphics->stage_count;
     }
+    vkd3d_free(compiles);
+    compiles = NULL;
+
+    if (use_cached && cached.shader_count != graphics->stage_count)
+    {
+        WARN("Cached pipeline state has %u shader stages, expected %zu.\n", cached.shader_count, graphics->stage_count);
+        hr = E_INVALIDARG;
+        goto fail;
+    }
 
     graphics->attribute_count = desc->input_layout.NumElements;
     if (graphics->attribute_count > ARRAY_SIZE(graphics->attributes))
@@ -3736,6 +4519,13 @@ static HRESULT d3d12_pipeline_state_init_graphics(struct d3d12_pipeline_state *s
     return S_OK;
 
 fail:
+    if (compiles)
+    {
+        for (i = graphics->stage_count; i < compile_count; ++i)
+            shader_stage_compile_cleanup(&compiles[i], device);
+        vkd3d_free(compiles);
+    }
+
     if (state->implicit_root_signature)
         ID3D12RootSignature_Release(state->implicit_root_signature);
 
@@ -3746,6 +4536,7 @@ fail:
     vkd3d_shader_free_scan_signature_info(&signature_info);
 
     d3d12_pipeline_uav_counter_state_cleanup(&state->uav_counters, device);
+    d3d12_pipeline_cache_cleanup(&state->cache);
 
     return hr;
 }
@@ -3775,8 +4566,8 @@ HRESULT d3d12_pipeline_state_create_graphics(struct d3d12_device *device,
     return S_OK;
 }
 
-HRESULT d3d12_pipeline_state_create(struct d3d12_device *device,
-        const D3D12_PIPELINE_STATE_STREAM_DESC *desc, struct d3d12_pipeline_state **state)
+HRESULT d3d12_pipeline_state_create(struct d3d12_device *device, const D3D12_PIPELINE_STATE_STREAM_DESC *desc,
+        const D3D12_CACHED_PIPELINE_STATE *cached_pso, struct d3d12_pipeline_state **state)
 {
     struct d3d12_pipeline_state_desc pipeline_desc;
     struct d3d12_pipeline_state *object;
@@ -3785,6 +4576,8 @@ HRESULT d3d12_pipeline_state_create(struct d3d12_device *device,
 
     if (FAILED(hr = pipeline_state_desc_from_d3d12_stream_desc(&pipeline_desc, desc, &bind_point)))
         return hr;
+    if (cached_pso)
+        pipeline_desc.cached_pso = *cached_pso;
 
     if (!(object = vkd3d_calloc(1, sizeof(*object))))
         return E_OUTOFMEMORY;
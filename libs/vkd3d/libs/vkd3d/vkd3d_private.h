@@ -170,6 +170,11 @@ struct vkd3d_vulkan_info
 
     VkPhysicalDeviceTexelBufferAlignmentPropertiesEXT texel_buffer_alignment_properties;
 
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+
     unsigned int shader_extension_count;
     enum vkd3d_shader_spirv_extension shader_extensions[VKD3D_MAX_SHADER_EXTENSIONS];
 
@@ -180,6 +185,7 @@ enum vkd3d_config_flags
 {
     VKD3D_CONFIG_FLAG_VULKAN_DEBUG = 0x00000001,
     VKD3D_CONFIG_FLAG_VIRTUAL_HEAPS = 0x00000002,
+    VKD3D_CONFIG_FLAG_DEFER_PIPELINES = 0x00000004,
 };
 
 struct vkd3d_instance
@@ -1071,6 +1077,13 @@ static inline unsigned int dsv_attachment_mask(const struct d3d12_graphics_pipel
 struct d3d12_compute_pipeline_state
 {
     VkPipeline vk_pipeline;
+    /* Set once "vk_pipeline" is valid; "vk_pipeline" may only be read
+     * without "pipeline_cache_mutex" after this has been read as set. */
+    uint32_t vk_pipeline_ready;
+    /* With deferred pipeline creation, the Vulkan pipeline is created from
+     * these on first use. */
+    VkPipelineShaderStageCreateInfo stage;
+    VkPipelineLayout vk_pipeline_layout;
 };
 
 struct d3d12_pipeline_uav_counter_state
@@ -1083,6 +1096,52 @@ struct d3d12_pipeline_uav_counter_state
     unsigned int binding_count;
 };
 
+struct vkd3d_pipeline_shader
+{
+    VkShaderStageFlagBits stage;
+    uint64_t key;
+    struct vkd3d_shader_code spirv;
+};
+
+/* Key for the device's persistent SPIR-V cache, also used to find identical
+ * translations in flight. The DXBC checksum guards against collisions of the
+ * compile key. */
+struct vkd3d_spirv_cache_key
+{
+    uint64_t key;
+    uint32_t stage;
+    uint32_t source_size;
+    uint32_t checksum[4];
+};
+
+/* The SPIR-V backing ID3D12PipelineState::GetCachedBlob(). The Vulkan
+ * pipeline cache data is taken from the device's pipeline cache. */
+struct d3d12_pipeline_cache
+{
+    struct vkd3d_pipeline_shader shaders[VKD3D_MAX_SHADER_STAGES];
+    unsigned int shader_count;
+};
+
+/* A cached PSO blob, with pointers into the application data. */
+struct vkd3d_cached_pipeline
+{
+    struct vkd3d_pipeline_shader shaders[VKD3D_MAX_SHADER_STAGES];
+    unsigned int shader_count;
+    const void *vk_cache_data;
+    size_t vk_cache_size;
+};
+
+HRESULT vkd3d_cached_pipeline_parse(struct vkd3d_cached_pipeline *cached,
+        struct d3d12_device *device, const D3D12_CACHED_PIPELINE_STATE *blob);
+const struct vkd3d_pipeline_shader *vkd3d_cached_pipeline_find_shader(
+        const struct vkd3d_cached_pipeline *cached, VkShaderStageFlagBits stage);
+void d3d12_device_merge_pipeline_cache_data(struct d3d12_device *device, const void *data, size_t size);
+void d3d12_pipeline_cache_cleanup(struct d3d12_pipeline_cache *cache);
+void d3d12_pipeline_cache_add_shader(struct d3d12_pipeline_cache *cache,
+        VkShaderStageFlagBits stage, uint64_t key, struct vkd3d_shader_code *spirv);
+HRESULT d3d12_pipeline_cache_serialize(const struct d3d12_pipeline_cache *cache,
+        struct d3d12_device *device, bool vk_cache, void **data, size_t *size);
+
 /* ID3D12PipelineState */
 struct d3d12_pipeline_state
 {
@@ -1097,6 +1156,7 @@ struct d3d12_pipeline_state
     VkPipelineBindPoint vk_bind_point;
 
     struct d3d12_pipeline_uav_counter_state uav_counters;
+    struct d3d12_pipeline_cache cache;
 
     ID3D12RootSignature *implicit_root_signature;
     struct d3d12_device *device;
@@ -1156,12 +1216,51 @@ HRESULT d3d12_pipeline_state_create_compute(struct d3d12_device *device,
         const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc, struct d3d12_pipeline_state **state);
 HRESULT d3d12_pipeline_state_create_graphics(struct d3d12_device *device,
         const D3D12_GRAPHICS_PIPELINE_STATE_DESC *desc, struct d3d12_pipeline_state **state);
-HRESULT d3d12_pipeline_state_create(struct d3d12_device *device,
-        const D3D12_PIPELINE_STATE_STREAM_DESC *desc, struct d3d12_pipeline_state **state);
+HRESULT d3d12_pipeline_state_create(struct d3d12_device *device, const D3D12_PIPELINE_STATE_STREAM_DESC *desc,
+        const D3D12_CACHED_PIPELINE_STATE *cached_pso, struct d3d12_pipeline_state **state);
 VkPipeline d3d12_pipeline_state_get_or_create_pipeline(struct d3d12_pipeline_state *state,
         D3D12_PRIMITIVE_TOPOLOGY topology, const uint32_t *strides, VkFormat dsv_format, VkRenderPass *vk_render_pass);
+VkPipeline d3d12_pipeline_state_get_compute_pipeline(struct d3d12_pipeline_state *state);
 struct d3d12_pipeline_state *unsafe_impl_from_ID3D12PipelineState(ID3D12PipelineState *iface);
 
+/* Translates shaders on a pool of worker threads. Threads waiting for a
+ * translation run queued jobs themselves, and identical shaders that are
+ * translated concurrently share a single job. */
+struct vkd3d_shader_compiler
+{
+    struct vkd3d_mutex mutex;
+    struct vkd3d_cond job_cond;
+    struct vkd3d_cond done_cond;
+    struct list queue;
+    struct rb_tree jobs;
+    bool should_exit;
+
+    union vkd3d_thread_handle *threads;
+    unsigned int thread_count;
+};
+
+HRESULT vkd3d_shader_compiler_init(struct vkd3d_shader_compiler *compiler, struct d3d12_device *device);
+void vkd3d_shader_compiler_cleanup(struct vkd3d_shader_compiler *compiler, struct d3d12_device *device);
+
+/* ID3D12PipelineLibrary */
+struct d3d12_pipeline_library
+{
+    ID3D12PipelineLibrary1 ID3D12PipelineLibrary1_iface;
+    unsigned int refcount;
+
+    struct vkd3d_mutex mutex;
+    struct rb_tree pipelines;
+    size_t serialized_size;
+    size_t vk_cache_size;
+
+    struct d3d12_device *device;
+
+    struct vkd3d_private_store private_store;
+};
+
+HRESULT d3d12_pipeline_library_create(struct d3d12_device *device, const void *blob,
+        size_t blob_size, struct d3d12_pipeline_library **library);
+
 struct vkd3d_buffer
 {
     VkBuffer vk_buffer;
@@ -1607,6 +1706,9 @@ struct d3d12_device
     struct vkd3d_mutex pipeline_cache_mutex;
     struct vkd3d_render_pass_cache render_pass_cache;
     VkPipelineCache vk_pipeline_cache;
+    /* Persistent DXBC to SPIR-V translation cache, if enabled. */
+    struct vkd3d_shader_cache *shader_cache;
+    struct vkd3d_shader_compiler shader_compiler;
 
     VkPhysicalDeviceMemoryProperties memory_properties;
 
@@ -1834,14 +1936,32 @@ static inline void vkd3d_prepend_struct(void *header, void *structure)
     vkd3d_header->next = vkd3d_structure;
 }
 
+#define VKD3D_HASH_INIT 0xcbf29ce484222325ull
+
+/* 64-bit FNV-1a. */
+static inline uint64_t vkd3d_hash_update(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x00000100000001b3ull;
+
+    return hash;
+}
+
 struct vkd3d_shader_cache;
 
 int vkd3d_shader_open_cache(struct vkd3d_shader_cache **cache);
+int vkd3d_shader_open_disk_cache(const char *path, uint64_t version, uint64_t max_size,
+        struct vkd3d_shader_cache **cache);
 unsigned int vkd3d_shader_cache_incref(struct vkd3d_shader_cache *cache);
 unsigned int vkd3d_shader_cache_decref(struct vkd3d_shader_cache *cache);
 int vkd3d_shader_cache_put(struct vkd3d_shader_cache *cache,
         const void *key, size_t key_size, const void *value, size_t value_size);
 int vkd3d_shader_cache_get(struct vkd3d_shader_cache *cache,
         const void *key, size_t key_size, void *value, size_t *value_size);
+bool vkd3d_shader_cache_get_spirv(struct vkd3d_shader_cache *cache,
+        const struct vkd3d_spirv_cache_key *key, struct vkd3d_shader_code *spirv);
 
 #endif  /* __VKD3D_PRIVATE_H */
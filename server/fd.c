@@ -111,6 +111,14 @@
 # define USE_EPOLL
 #endif /* HAVE_SYS_EPOLL_H && HAVE_EPOLL_CREATE */
 
+#if defined(USE_EPOLL) && defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+# include <sys/mman.h>
+# include <linux/io_uring.h>
+# ifdef IORING_FEAT_EXT_ARG
+#  define USE_IO_URING
+# endif
+#endif /* USE_EPOLL && HAVE_LINUX_IO_URING_H */
+
 #if defined(HAVE_PORT_H) && defined(HAVE_PORT_CREATE)
 # include <port.h>
 # define USE_EVENT_PORTS
@@ -274,14 +282,25 @@ static file_pos_t max_unix_offset = OFF_T_MAX;
 
 struct timeout_user
 {
-    struct list           entry;      /* entry in sorted timeout list */
+    struct list           entry;      /* entry in expired timeouts list */
+    int                   index;      /* index in timeout heap, -1 once expired */
+    unsigned __int64      serial;     /* insertion order, to expire equal timeouts in order */
     abstime_t             when;       /* timeout expiry */
     timeout_callback      callback;   /* callback function */
     void                 *private;    /* callback private data */
 };
 
-static struct list abs_timeout_list = LIST_INIT(abs_timeout_list); /* sorted absolute timeouts list */
-static struct list rel_timeout_list = LIST_INIT(rel_timeout_list); /* sorted relative timeouts list */
+/* binary min-heap of timeouts, ordered by expiry */
+struct timeout_heap
+{
+    struct timeout_user **users;      /* heap array */
+    int                   count;      /* number of timeouts in the heap */
+    int                   size;       /* allocated size of the array */
+};
+
+static struct timeout_heap abs_timeouts;  /* absolute timeouts, expiring on current_time */
+static struct timeout_heap rel_timeouts;  /* relative timeouts, expiring on monotonic_time */
+static unsigned __int64 timeout_serial;
 timeout_t current_time;
 timeout_t monotonic_time;
 
@@ -371,43 +390,113 @@ void set_current_time(void)
     if (user_shared_data) set_user_shared_data_time();
 }
 
+/* check whether a timeout expires before another one in the same heap */
+static inline int timeout_before( const struct timeout_user *a, const struct timeout_user *b )
+{
+    /* relative timeouts are stored negated */
+    if (a->when != b->when) return a->when > 0 ? a->when < b->when : a->when > b->when;
+    return a->serial < b->serial;
+}
+
+static inline struct timeout_heap *get_timeout_heap( const struct timeout_user *user )
+{
+    return user->when > 0 ? &abs_timeouts : &rel_timeouts;
+}
+
+static inline void timeout_heap_set( struct timeout_heap *heap, int index, struct timeout_user *user )
+{
+    heap->users[index] = user;
+    user->index = index;
+}
+
+/* move a timeout towards the top of the heap until its parent expires before it */
+static void timeout_heap_up( struct timeout_heap *heap, int index )
+{
+    struct timeout_user *user = heap->users[index];
+
+    while (index)
+    {
+        int parent = (index - 1) / 2;
+        if (!timeout_before( user, heap->users[parent] )) break;
+        timeout_heap_set( heap, index, heap->users[parent] );
+        index = parent;
+    }
+    timeout_heap_set( heap, index, user );
+}
+
+/* move a timeout towards the bottom of the heap until it expires before its children */
+static void timeout_heap_down( struct timeout_heap *heap, int index )
+{
+    struct timeout_user *user = heap->users[index];
+
+    for (;;)
+    {
+        int child = 2 * index + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count && timeout_before( heap->users[child + 1], heap->users[child] )) child++;
+        if (!timeout_before( heap->users[child], user )) break;
+        timeout_heap_set( heap, index, heap->users[child] );
+        index = child;
+    }
+    timeout_heap_set( heap, index, user );
+}
+
+static int timeout_heap_insert( struct timeout_heap *heap, struct timeout_user *user )
+{
+    if (heap->count == heap->size)
+    {
+        int new_size = max( 64, heap->size * 2 );
+        struct timeout_user **new_users;
+
+        if (!(new_users = realloc( heap->users, new_size * sizeof(*new_users) )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return 0;
+        }
+        heap->users = new_users;
+        heap->size  = new_size;
+    }
+    heap->users[heap->count++] = user;
+    timeout_heap_up( heap, heap->count - 1 );
+    return 1;
+}
+
+static void timeout_heap_remove( struct timeout_heap *heap, struct timeout_user *user )
+{
+    int index = user->index;
+    struct timeout_user *last = heap->users[--heap->count];
+
+    user->index = -1;
+    if (last == user) return;
+    timeout_heap_set( heap, index, last );
+    if (index && timeout_before( last, heap->users[(index - 1) / 2] )) timeout_heap_up( heap, index );
+    else timeout_heap_down( heap, index );
+}
+
 /* add a timeout user */
 struct timeout_user *add_timeout_user( timeout_t when, timeout_callback func, void *private )
 {
     struct timeout_user *user;
-    struct list *ptr;
 
     if (!(user = mem_alloc( sizeof(*user) ))) return NULL;
     user->when     = timeout_to_abstime( when );
+    user->serial   = timeout_serial++;
     user->callback = func;
     user->private  = private;
 
-    /* Now insert it in the linked list */
-
-    if (user->when > 0)
-    {
-        LIST_FOR_EACH( ptr, &abs_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when >= user->when) break;
-        }
-    }
-    else
+    if (!timeout_heap_insert( get_timeout_heap( user ), user ))
     {
-        LIST_FOR_EACH( ptr, &rel_timeout_list )
-        {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            if (timeout->when <= user->when) break;
-        }
+        free( user );
+        return NULL;
     }
-    list_add_before( ptr, &user->entry );
     return user;
 }
 
 /* remove a timeout user */
 void remove_timeout_user( struct timeout_user *user )
 {
-    list_remove( &user->entry );
+    if (user->index != -1) timeout_heap_remove( get_timeout_heap( user ), user );
+    else list_remove( &user->entry );  /* expired, waiting for its callback */
     free( user );
 }
 
@@ -469,8 +558,268 @@ static inline void fd_poll_event( struct fd *fd, int event )
 
 static int epoll_fd = -1;
 
+#ifdef USE_IO_URING
+
+/* The io_uring backend uses one-shot poll requests, which are armed again
+ * after each completion to get the same level-triggered behavior as epoll.
+ * Interest changes are queued in the submission ring and sent along with the
+ * next wait, so that a main loop iteration costs a single syscall. */
+
+#define URING_ENTRIES   256
+#define URING_IGNORE    (~(__u64)0)  /* user_data of requests whose completion is ignored */
+
+struct uring_user
+{
+    unsigned int gen;     /* generation of the poll request, to ignore stale completions */
+    int          events;  /* events of the armed poll request, -1 if none */
+};
+
+static int uring_fd = -1;
+static struct io_uring_sqe *uring_sqes;
+static void *uring_ring;
+static size_t uring_ring_size;
+static unsigned int *uring_sq_head, *uring_sq_tail, *uring_sq_array, uring_sq_mask, uring_sq_entries;
+static unsigned int *uring_cq_head, *uring_cq_tail, uring_cq_mask;
+static struct io_uring_cqe *uring_cqes;
+static unsigned int uring_tail;     /* local submission tail, published before entering the kernel */
+static struct uring_user *uring_users;
+static int uring_users_size;
+static int *uring_ready;            /* users with a completion in the current iteration */
+
+static int io_uring_enter( unsigned int to_submit, unsigned int min_complete, unsigned int flags,
+                           const void *arg, size_t size )
+{
+    return syscall( __NR_io_uring_enter, uring_fd, to_submit, min_complete, flags, arg, size );
+}
+
+static int init_io_uring(void)
+{
+    struct io_uring_params params;
+    const char *env = getenv( "WINEIOURING" );
+    unsigned int i;
+
+    if (env && !atoi( env )) return 0;
+
+    memset( &params, 0, sizeof(params) );
+    if ((uring_fd = syscall( __NR_io_uring_setup, URING_ENTRIES, &params )) == -1) return 0;
+    if ((params.features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) !=
+        (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) goto failed;
+
+    uring_ring_size = max( params.sq_off.array + params.sq_entries * sizeof(unsigned int),
+                           params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) );
+    uring_ring = mmap( NULL, uring_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       uring_fd, IORING_OFF_SQ_RING );
+    if (uring_ring == MAP_FAILED) goto failed;
+    uring_sqes = mmap( NULL, params.sq_entries * sizeof(*uring_sqes), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_SQES );
+    if (uring_sqes == MAP_FAILED)
+    {
+        munmap( uring_ring, uring_ring_size );
+        goto failed;
+    }
+    if (!(uring_ready = malloc( params.cq_entries * sizeof(*uring_ready) )))
+    {
+        munmap( uring_sqes, params.sq_entries * sizeof(*uring_sqes) );
+        munmap( uring_ring, uring_ring_size );
+        goto failed;
+    }
+
+    uring_sq_head    = (unsigned int *)((char *)uring_ring + params.sq_off.head);
+    uring_sq_tail    = (unsigned int *)((char *)uring_ring + params.sq_off.tail);
+    uring_sq_array   = (unsigned int *)((char *)uring_ring + params.sq_off.array);
+    uring_sq_mask    = *(unsigned int *)((char *)uring_ring + params.sq_off.ring_mask);
+    uring_sq_entries = params.sq_entries;
+    uring_cq_head    = (unsigned int *)((char *)uring_ring + params.cq_off.head);
+    uring_cq_tail    = (unsigned int *)((char *)uring_ring + params.cq_off.tail);
+    uring_cq_mask    = *(unsigned int *)((char *)uring_ring + params.cq_off.ring_mask);
+    uring_cqes       = (struct io_uring_cqe *)((char *)uring_ring + params.cq_off.cqes);
+    uring_tail       = *uring_sq_tail;
+    for (i = 0; i < uring_sq_entries; i++) uring_sq_array[i] = i;
+    if (debug_level) fprintf( stderr, "wineserver: using io_uring\n" );
+    return 1;
+
+failed:
+    close( uring_fd );
+    uring_fd = -1;
+    return 0;
+}
+
+/* give up on io_uring after an unexpected error; the poll() loop takes over */
+static void close_io_uring(void)
+{
+    perror( "io_uring_enter" );
+    close( uring_fd );
+    uring_fd = -1;
+}
+
+/* submit the queued requests without waiting */
+static int submit_io_uring(void)
+{
+    unsigned int pending;
+
+    __atomic_store_n( uring_sq_tail, uring_tail, __ATOMIC_RELEASE );
+    pending = uring_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE );
+    while (pending && io_uring_enter( pending, 0, 0, NULL, 0 ) == -1)
+    {
+        if (errno == EINTR) continue;
+        close_io_uring();
+        return 0;
+    }
+    return 1;
+}
+
+static struct io_uring_sqe *get_io_uring_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+
+    if (uring_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE ) >= uring_sq_entries)
+    {
+        /* the ring is full, flush it */
+        if (!submit_io_uring()) return NULL;
+    }
+    sqe = &uring_sqes[uring_tail++ & uring_sq_mask];
+    memset( sqe, 0, sizeof(*sqe) );
+    return sqe;
+}
+
+/* cancel the armed poll request of a user */
+static void cancel_io_uring_poll( int user )
+{
+    struct uring_user *entry = &uring_users[user];
+    struct io_uring_sqe *sqe;
+
+    if (entry->events == -1) return;
+    if (!(sqe = get_io_uring_sqe())) return;
+    sqe->opcode    = IORING_OP_POLL_REMOVE;
+    sqe->fd        = -1;
+    sqe->addr      = ((__u64)entry->gen << 32) | user;
+    sqe->user_data = URING_IGNORE;
+    entry->gen++;
+    entry->events = -1;
+}
+
+/* arm a poll request for a user, replacing the previous one */
+static void arm_io_uring_poll( int user, int unix_fd, int events )
+{
+    struct uring_user *entry = &uring_users[user];
+    struct io_uring_sqe *sqe;
+
+    cancel_io_uring_poll( user );
+    if (uring_fd == -1 || !(sqe = get_io_uring_sqe())) return;
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = unix_fd;
+    sqe->poll32_events = events;
+    sqe->user_data     = ((__u64)++entry->gen << 32) | user;
+    entry->events = events;
+}
+
+static void set_fd_io_uring_events( struct fd *fd, int user, int events )
+{
+    if (user >= uring_users_size)
+    {
+        struct uring_user *new_users;
+        int i, new_size = max( allocated_users, user + 1 );
+
+        if (!(new_users = realloc( uring_users, new_size * sizeof(*new_users) )))
+        {
+            close_io_uring();
+            return;
+        }
+        for (i = uring_users_size; i < new_size; i++)
+        {
+            new_users[i].gen = 0;
+            new_users[i].events = -1;
+        }
+        uring_users = new_users;
+        uring_users_size = new_size;
+    }
+
+    if (events == -1) cancel_io_uring_poll( user );
+    else if (uring_users[user].events != events) arm_io_uring_poll( user, fd->unix_fd, events );
+}
+
+static void remove_io_uring_user( int user )
+{
+    if (user >= uring_users_size) return;
+    cancel_io_uring_poll( user );
+    /* submit right away, the poll request holds a reference to the file */
+    if (uring_fd != -1) submit_io_uring();
+}
+
+static void main_loop_io_uring(void)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec kts;
+    struct timespec ts;
+    unsigned int head, tail, pending;
+    int i, ret, timeout, count;
+
+    memset( &arg, 0, sizeof(arg) );
+
+    while (active_users)
+    {
+        timeout = get_next_timeout( &ts );
+
+        if (!active_users) break;  /* last user removed by a timeout */
+        if (uring_fd == -1) break;  /* an error occurred with io_uring */
+
+        kts.tv_sec  = ts.tv_sec;
+        kts.tv_nsec = ts.tv_nsec;
+        arg.ts = timeout == -1 ? 0 : (__u64)(uintptr_t)&kts;
+
+        /* submit the interest changes and wait for completions in the same call */
+        __atomic_store_n( uring_sq_tail, uring_tail, __ATOMIC_RELEASE );
+        pending = uring_tail - __atomic_load_n( uring_sq_head, __ATOMIC_ACQUIRE );
+        ret = io_uring_enter( pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg) );
+        if (ret == -1 && errno != EINTR && errno != ETIME && errno != EBUSY)
+        {
+            close_io_uring();
+            break;
+        }
+
+        set_current_time();
+
+        /* put the events into the pollfd array first, like poll does */
+        head = *uring_cq_head;
+        tail = __atomic_load_n( uring_cq_tail, __ATOMIC_ACQUIRE );
+        for (count = 0; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &uring_cqes[head & uring_cq_mask];
+            int user = (unsigned int)cqe->user_data;
+
+            if (cqe->user_data == URING_IGNORE) continue;
+            if (user >= uring_users_size || uring_users[user].gen != cqe->user_data >> 32) continue;
+            uring_users[user].events = -1;  /* one-shot request, it needs to be armed again */
+            pollfd[user].revents = cqe->res < 0 ? POLLERR : cqe->res;
+            uring_ready[count++] = user;
+        }
+        __atomic_store_n( uring_cq_head, head, __ATOMIC_RELEASE );
+
+        /* read events from the pollfd array, as set_fd_events may modify them */
+        for (i = 0; i < count; i++)
+        {
+            int user = uring_ready[i];
+            if (pollfd[user].revents) fd_poll_event( poll_users[user], pollfd[user].revents );
+        }
+
+        /* arm again the requests that were not modified by the callbacks */
+        for (i = 0; i < count; i++)
+        {
+            int user = uring_ready[i];
+            if (uring_fd == -1) break;
+            if (pollfd[user].fd == -1 || uring_users[user].events != -1) continue;
+            arm_io_uring_poll( user, pollfd[user].fd, pollfd[user].events );
+        }
+    }
+}
+
+#endif /* USE_IO_URING */
+
 static inline void init_epoll(void)
 {
+#ifdef USE_IO_URING
+    if (init_io_uring()) return;
+#endif
     epoll_fd = epoll_create( 128 );
 }
 
@@ -480,6 +829,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
     struct epoll_event ev;
     int ctl;
 
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        set_fd_io_uring_events( fd, user, events );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (events == -1)  /* stop waiting on this fd completely */
@@ -514,6 +870,13 @@ static inline void set_fd_epoll_events( struct fd *fd, int user, int events )
 
 static inline void remove_epoll_user( struct fd *fd, int user )
 {
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        remove_io_uring_user( user );
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     if (pollfd[user].fd != -1)
@@ -537,6 +900,13 @@ static inline void main_loop_epoll(void)
     assert( POLLERR == EPOLLERR );
     assert( POLLHUP == EPOLLHUP );
 
+#ifdef USE_IO_URING
+    if (uring_fd != -1)
+    {
+        main_loop_io_uring();
+        return;
+    }
+#endif
     if (epoll_fd == -1) return;
 
     while (active_users)
@@ -844,58 +1214,45 @@ static int get_next_timeout( struct timespec *ts )
 {
     timeout_t ret = user_shared_data ? user_shared_data_timeout : -1;
 
-    if (!list_empty( &abs_timeout_list ) || !list_empty( &rel_timeout_list ))
+    if (abs_timeouts.count || rel_timeouts.count)
     {
         struct list expired_list, *ptr;
+        struct timeout_user *timeout;
 
-        /* first remove all expired timers from the list */
+        /* first remove all expired timers from the heaps */
 
         list_init( &expired_list );
-        while ((ptr = list_head( &abs_timeout_list )) != NULL)
+        while (abs_timeouts.count && (timeout = abs_timeouts.users[0])->when <= current_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (timeout->when <= current_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &abs_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
-        while ((ptr = list_head( &rel_timeout_list )) != NULL)
+        while (rel_timeouts.count && -(timeout = rel_timeouts.users[0])->when <= monotonic_time)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-
-            if (-timeout->when <= monotonic_time)
-            {
-                list_remove( &timeout->entry );
-                list_add_tail( &expired_list, &timeout->entry );
-            }
-            else break;
+            timeout_heap_remove( &rel_timeouts, timeout );
+            list_add_tail( &expired_list, &timeout->entry );
         }
 
         /* now call the callback for all the removed timers */
 
         while ((ptr = list_head( &expired_list )) != NULL)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
+            timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
             list_remove( &timeout->entry );
             timeout->callback( timeout->private );
             free( timeout );
         }
 
-        if ((ptr = list_head( &abs_timeout_list )) != NULL)
+        if (abs_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            timeout_t diff = timeout->when - current_time;
+            timeout_t diff = abs_timeouts.users[0]->when - current_time;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
 
-        if ((ptr = list_head( &rel_timeout_list )) != NULL)
+        if (rel_timeouts.count)
         {
-            struct timeout_user *timeout = LIST_ENTRY( ptr, struct timeout_user, entry );
-            timeout_t diff = -timeout->when - monotonic_time;
+            timeout_t diff = -rel_timeouts.users[0]->when - monotonic_time;
             if (diff < 0) diff = 0;
             if (ret == -1 || diff < ret) ret = diff;
         }
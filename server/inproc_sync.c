@@ -37,25 +37,189 @@
 # include <linux/ntsync.h>
 #endif
 
-#ifdef NTSYNC_IOC_EVENT_READ
+#ifdef __linux__
+# include <linux/futex.h>
+# ifdef HAVE_SYS_SYSCALL_H
+#  include <sys/syscall.h>
+# endif
+# if defined(__NR_futex_waitv) && defined(FUTEX_32) && defined(HAVE_MEMFD_CREATE)
+#  define USE_INPROC_FUTEX
+# endif
+#endif
 
+#if defined(NTSYNC_IOC_EVENT_READ) || defined(USE_INPROC_FUTEX)
+
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef USE_INPROC_FUTEX
+
+/* When /dev/ntsync is not available, in-process objects are kept in a shared
+ * memory arena instead, and waiters sleep on futexes inside it. The arena is
+ * sparse, pages are only allocated once slots in them get used. Waiting on
+ * several objects at once needs futex_waitv(), which appeared in Linux 5.16. */
+
+#define INPROC_FUTEX_ARENA_SIZE  (16 * 1024 * 1024)
+#define INPROC_FUTEX_ARENA_SLOTS (INPROC_FUTEX_ARENA_SIZE / sizeof(inproc_futex_t))
+
+static inproc_futex_t *futex_arena;
+static unsigned int futex_arena_used = 1;   /* slot 0 is never used */
+static unsigned int *futex_free_slots;      /* freed slots, reused oldest first */
+static unsigned int futex_free_head, futex_free_count;
+
+static int create_futex_arena(void)
+{
+    void *ptr;
+    int fd;
+
+    /* futex_waitv() with no futexes fails with EINVAL when it is supported */
+    if (syscall( __NR_futex_waitv, NULL, 0, 0, NULL, 0 ) != -1 || errno != EINVAL) return -1;
+
+    if ((fd = memfd_create( "wine-inproc-sync", MFD_CLOEXEC )) == -1) return -1;
+    if (ftruncate( fd, INPROC_FUTEX_ARENA_SIZE ) == -1 ||
+        (ptr = mmap( NULL, INPROC_FUTEX_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED ||
+        !(futex_free_slots = malloc( INPROC_FUTEX_ARENA_SLOTS * sizeof(*futex_free_slots) )))
+    {
+        close( fd );
+        return -1;
+    }
+
+    futex_arena = ptr;
+    if (debug_level) fprintf( stderr, "wineserver: using futex in-process synchronization\n" );
+    return fd;
+}
+
+/* check whether a thread that locked a slot can still unlock it */
+static int futex_locker_alive( thread_id_t tid )
+{
+    unsigned int error = get_error();
+    struct pollfd pfd;
+    struct thread *thread;
+    int alive;
+
+    thread = get_thread_from_id( tid );
+    set_error( error );
+    if (!thread) return 0;
+
+    /* a killed client closes its request pipe before we get to notice */
+    alive = thread->state != TERMINATED && thread->request_fd && (pfd.fd = get_unix_fd( thread->request_fd )) != -1;
+    if (alive)
+    {
+        pfd.events = POLLIN;
+        alive = poll( &pfd, 1, 0 ) <= 0 || !(pfd.revents & (POLLHUP | POLLERR));
+    }
+    release_object( thread );
+    return alive;
+}
+
+/* read the state of a slot, waiting until the client thread waiting for all
+ * of several objects drops its lock; it only holds it for a few instructions */
+static __int64 read_futex_slot_state( inproc_futex_t *slot )
+{
+    unsigned int spins = 0;
+    __int64 state;
+
+    while ((state = __atomic_load_n( &slot->state, __ATOMIC_SEQ_CST )) & INPROC_FUTEX_LOCKED)
+    {
+        if (++spins % 1024 || futex_locker_alive( slot->locker )) sched_yield();
+        else __atomic_compare_exchange_n( &slot->state, &state, state & ~INPROC_FUTEX_LOCKED, 0,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+    }
+    return state;
+}
+
+static __int64 exchange_futex_slot_state( inproc_futex_t *slot, __int64 value )
+{
+    __int64 state = read_futex_slot_state( slot );
+
+    while (!__atomic_compare_exchange_n( &slot->state, &state, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+        state = read_futex_slot_state( slot );
+    return state;
+}
+
+static unsigned int alloc_futex_slot( enum inproc_sync_type type, __int64 state, int manual, unsigned int max )
+{
+    inproc_futex_t *slot;
+    unsigned int index;
+
+    if (futex_free_count)
+    {
+        index = futex_free_slots[futex_free_head];
+        futex_free_head = (futex_free_head + 1) % INPROC_FUTEX_ARENA_SLOTS;
+        futex_free_count--;
+    }
+    else if (futex_arena_used < INPROC_FUTEX_ARENA_SLOTS) index = futex_arena_used++;
+    else return 0;
+
+    slot = &futex_arena[index];
+    slot->type   = type;
+    slot->manual = manual;
+    slot->max    = max;
+    exchange_futex_slot_state( slot, state );
+    __atomic_add_fetch( &slot->id, 1, __ATOMIC_SEQ_CST );
+    return index;
+}
+
+static void free_futex_slot( unsigned int index )
+{
+    unsigned int tail = (futex_free_head + futex_free_count) % INPROC_FUTEX_ARENA_SLOTS;
+
+    /* waiters still using a closed handle keep sleeping, and notice the slot
+     * was reused by checking its id */
+    exchange_futex_slot_state( &futex_arena[index], 0 );
+    futex_free_slots[tail] = index;
+    futex_free_count++;
+}
+
+static void wake_futex_slot( inproc_futex_t *slot )
+{
+    __atomic_add_fetch( &slot->futex, 1, __ATOMIC_SEQ_CST );
+    if (__atomic_load_n( &slot->waiters, __ATOMIC_SEQ_CST ))
+        syscall( __NR_futex, &slot->futex, FUTEX_WAKE, INT_MAX, NULL, 0, 0 );
+}
+
+#else /* USE_INPROC_FUTEX */
+
+static int create_futex_arena(void)
+{
+    return -1;
+}
+
+#endif /* USE_INPROC_FUTEX */
+
 int get_inproc_device_fd(void)
 {
     static int fd = -2;
-    if (fd == -2) fd = open( "/dev/ntsync", O_CLOEXEC | O_RDONLY );
+    if (fd != -2) return fd;
+#ifdef NTSYNC_IOC_EVENT_READ
+    if ((fd = open( "/dev/ntsync", O_CLOEXEC | O_RDONLY )) >= 0) return fd;
+#endif
+    fd = create_futex_arena();
     return fd;
 }
 
+static inline int use_futex_arena(void)
+{
+#ifdef USE_INPROC_FUTEX
+    return get_inproc_device_fd() >= 0 && futex_arena;
+#else
+    return 0;
+#endif
+}
+
 struct inproc_sync
 {
     struct object          obj;  /* object header */
     enum inproc_sync_type  type;
     int                    fd;
+    unsigned int           index; /* slot in the futex arena, when fd is -1 */
     struct list            entry;
 };
 
@@ -80,101 +244,139 @@ int get_inproc_sync_fd( struct inproc_sync *sync )
     return sync->fd;
 }
 
-struct inproc_sync *create_inproc_internal_sync( int manual, int signaled )
+unsigned int get_inproc_sync_index( struct inproc_sync *sync )
+{
+    if (!sync) return 0;
+    return sync->index;
+}
+
+static struct inproc_sync *create_inproc_sync( enum inproc_sync_type type, __int64 state,
+                                               int manual, unsigned int max )
 {
-    struct ntsync_event_args args = {.signaled = signaled, .manual = manual};
-    struct inproc_sync *event;
+    struct inproc_sync *sync;
 
-    if (!(event = alloc_object( &inproc_sync_ops ))) return NULL;
-    event->type = INPROC_SYNC_INTERNAL;
-    event->fd   = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_EVENT, &args );
-    list_init( &event->entry );
+    if (!(sync = alloc_object( &inproc_sync_ops ))) return NULL;
+    sync->type  = type;
+    sync->fd    = -1;
+    sync->index = 0;
+    if (type == INPROC_SYNC_MUTEX) list_add_tail( &inproc_mutexes, &sync->entry );
+    else list_init( &sync->entry );
 
-    if (event->fd == -1)
+#ifdef USE_INPROC_FUTEX
+    if (use_futex_arena())
     {
-        set_error( STATUS_TOO_MANY_OPENED_FILES );
-        release_object( event );
-        return NULL;
+        if (!(sync->index = alloc_futex_slot( type, state, manual, max )))
+        {
+            set_error( STATUS_TOO_MANY_OPENED_FILES );
+            release_object( sync );
+            return NULL;
+        }
+        return sync;
     }
-    return event;
-}
-
-struct inproc_sync *create_inproc_event_sync( int manual, int signaled )
-{
-    struct ntsync_event_args args = {.signaled = signaled, .manual = manual};
-    struct inproc_sync *event;
+#endif
 
-    if (!(event = alloc_object( &inproc_sync_ops ))) return NULL;
-    event->type = INPROC_SYNC_EVENT;
-    event->fd   = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_EVENT, &args );
-    list_init( &event->entry );
+#ifdef NTSYNC_IOC_EVENT_READ
+    switch (type)
+    {
+    case INPROC_SYNC_INTERNAL:
+    case INPROC_SYNC_EVENT:
+    {
+        struct ntsync_event_args args = {.signaled = state, .manual = manual};
+        sync->fd = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_EVENT, &args );
+        break;
+    }
+    case INPROC_SYNC_MUTEX:
+    {
+        struct ntsync_mutex_args args = {.owner = (thread_id_t)state,
+                                         .count = state >> INPROC_FUTEX_MUTEX_COUNT_SHIFT};
+        sync->fd = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_MUTEX, &args );
+        break;
+    }
+    case INPROC_SYNC_SEMAPHORE:
+    {
+        struct ntsync_sem_args args = {.count = state, .max = max};
+        sync->fd = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_SEM, &args );
+        break;
+    }
+    default:
+        assert( 0 );
+        break;
+    }
+#endif
 
-    if (event->fd == -1)
+    if (sync->fd == -1)
     {
         set_error( STATUS_TOO_MANY_OPENED_FILES );
-        release_object( event );
+        release_object( sync );
         return NULL;
     }
-    return event;
+    return sync;
 }
 
-struct inproc_sync *create_inproc_mutex_sync( thread_id_t owner, unsigned int count )
+struct inproc_sync *create_inproc_internal_sync( int manual, int signaled )
 {
-    struct ntsync_mutex_args args = {.owner = owner, .count = count};
-    struct inproc_sync *mutex;
+    return create_inproc_sync( INPROC_SYNC_INTERNAL, !!signaled, manual, 0 );
+}
 
-    if (!(mutex = alloc_object( &inproc_sync_ops ))) return NULL;
-    mutex->type = INPROC_SYNC_MUTEX;
-    mutex->fd   = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_MUTEX, &args );
-    list_add_tail( &inproc_mutexes, &mutex->entry );
+struct inproc_sync *create_inproc_event_sync( int manual, int signaled )
+{
+    return create_inproc_sync( INPROC_SYNC_EVENT, !!signaled, manual, 0 );
+}
 
-    if (mutex->fd == -1)
-    {
-        set_error( STATUS_TOO_MANY_OPENED_FILES );
-        release_object( mutex );
-        return NULL;
-    }
-    return mutex;
+struct inproc_sync *create_inproc_mutex_sync( thread_id_t owner, unsigned int count )
+{
+    return create_inproc_sync( INPROC_SYNC_MUTEX, owner | ((__int64)count << INPROC_FUTEX_MUTEX_COUNT_SHIFT), 0, 0 );
 }
 
 struct inproc_sync *create_inproc_semaphore_sync( unsigned int initial, unsigned int max )
 {
-    struct ntsync_sem_args args = {.count = initial, .max = max};
-    struct inproc_sync *sem;
-
-    if (!(sem = alloc_object( &inproc_sync_ops ))) return NULL;
-    sem->type = INPROC_SYNC_SEMAPHORE;
-    sem->fd   = ioctl( get_inproc_device_fd(), NTSYNC_IOC_CREATE_SEM, &args );
-    list_init( &sem->entry );
-
-    if (sem->fd == -1)
-    {
-        set_error( STATUS_TOO_MANY_OPENED_FILES );
-        release_object( sem );
-        return NULL;
-    }
-    return sem;
+    return create_inproc_sync( INPROC_SYNC_SEMAPHORE, initial, 0, max );
 }
 
 static void inproc_sync_dump( struct object *obj, int verbose )
 {
     struct inproc_sync *sync = (struct inproc_sync *)obj;
     assert( obj->ops == &inproc_sync_ops );
-    fprintf( stderr, "Inproc sync type=%d, fd=%d\n", sync->type, sync->fd );
+    fprintf( stderr, "Inproc sync type=%d, fd=%d, index=%u\n", sync->type, sync->fd, sync->index );
 }
 
 void signal_inproc_sync( struct inproc_sync *sync )
 {
-    __u32 count;
-    if (debug_level) fprintf( stderr, "set_inproc_event %d\n", sync->fd );
-    ioctl( sync->fd, NTSYNC_IOC_EVENT_SET, &count );
+#ifdef USE_INPROC_FUTEX
+    if (sync->index)
+    {
+        inproc_futex_t *slot = &futex_arena[sync->index];
+        if (debug_level) fprintf( stderr, "set_inproc_event index=%u\n", sync->index );
+        if (!exchange_futex_slot_state( slot, 1 )) wake_futex_slot( slot );
+        return;
+    }
+#endif
+#ifdef NTSYNC_IOC_EVENT_READ
+    {
+        __u32 count;
+        if (debug_level) fprintf( stderr, "set_inproc_event %d\n", sync->fd );
+        ioctl( sync->fd, NTSYNC_IOC_EVENT_SET, &count );
+    }
+#endif
 }
 
 void reset_inproc_sync( struct inproc_sync *sync )
 {
-    __u32 count;
-    if (debug_level) fprintf( stderr, "reset_inproc_event %d\n", sync->fd );
-    ioctl( sync->fd, NTSYNC_IOC_EVENT_RESET, &count );
+#ifdef USE_INPROC_FUTEX
+    if (sync->index)
+    {
+        if (debug_level) fprintf( stderr, "reset_inproc_event index=%u\n", sync->index );
+        exchange_futex_slot_state( &futex_arena[sync->index], 0 );
+        return;
+    }
+#endif
+#ifdef NTSYNC_IOC_EVENT_READ
+    {
+        __u32 count;
+        if (debug_level) fprintf( stderr, "reset_inproc_event %d\n", sync->fd );
+        ioctl( sync->fd, NTSYNC_IOC_EVENT_RESET, &count );
+    }
+#endif
 }
 
 static int inproc_sync_signal( struct object *obj, unsigned int access, int signal )
@@ -195,7 +397,10 @@ static void inproc_sync_destroy( struct object *obj )
     struct inproc_sync *sync = (struct inproc_sync *)obj;
     assert( obj->ops == &inproc_sync_ops );
     list_remove( &sync->entry );
-    close( sync->fd );
+#ifdef USE_INPROC_FUTEX
+    if (sync->index) free_futex_slot( sync->index );
+#endif
+    if (sync->fd != -1) close( sync->fd );
 }
 
 void abandon_inproc_mutexes( thread_id_t tid )
@@ -203,27 +408,49 @@ void abandon_inproc_mutexes( thread_id_t tid )
     struct inproc_sync *mutex;
 
     LIST_FOR_EACH_ENTRY( mutex, &inproc_mutexes, struct inproc_sync, entry )
+    {
+#ifdef USE_INPROC_FUTEX
+        if (mutex->index)
+        {
+            inproc_futex_t *slot = &futex_arena[mutex->index];
+            __int64 state = read_futex_slot_state( slot );
+
+            while ((thread_id_t)state == tid)
+            {
+                if (__atomic_compare_exchange_n( &slot->state, &state, INPROC_FUTEX_MUTEX_ABANDONED, 0,
+                                                 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ))
+                {
+                    wake_futex_slot( slot );
+                    break;
+                }
+                state = read_futex_slot_state( slot );
+            }
+            continue;
+        }
+#endif
+#ifdef NTSYNC_IOC_EVENT_READ
         ioctl( mutex->fd, NTSYNC_IOC_MUTEX_KILL, &tid );
+#endif
+    }
 }
 
-static int get_obj_inproc_sync( struct object *obj, int *type )
+static struct inproc_sync *get_obj_inproc_sync( struct object *obj, int *type )
 {
     struct object *sync;
-    int fd = -1;
 
-    if (!(sync = get_obj_sync( obj ))) return -1;
+    if (!(sync = get_obj_sync( obj ))) return NULL;
     if (sync->ops == &inproc_sync_ops)
     {
         struct inproc_sync *inproc = (struct inproc_sync *)sync;
         *type = inproc->type;
-        fd = inproc->fd;
+        return inproc;
     }
 
     release_object( sync );
-    return fd;
+    return NULL;
 }
 
-#else /* NTSYNC_IOC_EVENT_READ */
+#else /* NTSYNC_IOC_EVENT_READ || USE_INPROC_FUTEX */
 
 int get_inproc_device_fd(void)
 {
@@ -235,6 +462,11 @@ int get_inproc_sync_fd( struct inproc_sync *sync )
     return -1;
 }
 
+unsigned int get_inproc_sync_index( struct inproc_sync *sync )
+{
+    return 0;
+}
+
 struct inproc_sync *create_inproc_internal_sync( int manual, int signaled )
 {
     return NULL;
@@ -267,24 +499,30 @@ void abandon_inproc_mutexes( thread_id_t tid )
 {
 }
 
-static int get_obj_inproc_sync( struct object *obj, int *type )
+static struct inproc_sync *get_obj_inproc_sync( struct object *obj, int *type )
 {
-    return -1;
+    return NULL;
 }
 
-#endif /* NTSYNC_IOC_EVENT_READ */
+#endif /* NTSYNC_IOC_EVENT_READ || USE_INPROC_FUTEX */
 
 DECL_HANDLER(get_inproc_sync_fd)
 {
+    struct inproc_sync *sync;
     struct object *obj;
-    int fd;
 
     if (!(obj = get_handle_obj( current->process, req->handle, 0, NULL ))) return;
 
     reply->access = get_handle_access( current->process, req->handle );
 
-    if ((fd = get_obj_inproc_sync( obj, &reply->type )) < 0) set_error( STATUS_NOT_IMPLEMENTED );
-    else send_client_fd( current->process, fd, req->handle );
+    if (!(sync = get_obj_inproc_sync( obj, &reply->type ))) set_error( STATUS_NOT_IMPLEMENTED );
+    else
+    {
+        /* futex objects are found in the arena, the client doesn't need an fd */
+        if (!(reply->index = get_inproc_sync_index( sync )))
+            send_client_fd( current->process, get_inproc_sync_fd( sync ), req->handle );
+        release_object( sync );
+    }
 
     release_object( obj );
 }
@@ -632,6 +632,7 @@ struct process *create_process( int fd, struct process *parent, unsigned int fla
     process->idle_event      = NULL;
     process->peb             = 0;
     process->dir_cache       = NULL;
+    process->req_stats       = NULL;
     process->winstation      = 0;
     process->desktop         = 0;
     process->token           = NULL;
@@ -662,6 +663,7 @@ struct process *create_process( int fd, struct process *parent, unsigned int fla
         close( fd );
         goto error;
     }
+    process->req_stats = alloc_process_stats( process );
     if (!(process->msg_fd = create_anonymous_fd( &process_fd_ops, fd, &process->obj, 0 ))) goto error;
     if (!(process->sync = create_internal_sync( 1, 0 ))) goto error;
 
@@ -736,6 +738,7 @@ static void process_destroy( struct object *obj )
     if (process->msg_fd) release_object( process->msg_fd );
     if (process->idle_event) release_object( process->idle_event );
     if (process->id) free_ptid( process->id );
+    if (process->req_stats) free_process_stats( process->req_stats );
     if (process->token) release_object( process->token );
     if (process->sync) release_object( process->sync );
     list_remove( &process->rawinput_entry );
@@ -34,6 +34,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -93,6 +94,10 @@ struct key
     unsigned int      flags;       /* flags */
     timeout_t         modif;       /* last modification time */
     struct list       notify_list; /* list of notifications */
+    const struct snapshot_key *snapshot;     /* snapshot record holding the values not loaded yet */
+    struct snapshot_map       *snapshot_map; /* mapping containing that record */
+    key_shm_t        *shared;      /* values mirrored in session shared memory, for hot keys */
+    unsigned int      queries;     /* number of value queries since the key was last found unmirrored */
 };
 
 /* key flags */
@@ -102,6 +107,7 @@ struct key
 #define KEY_SYMLINK  0x0008  /* key is a symbolic link */
 #define KEY_WOWSHARE 0x0010  /* key is a Wow64 shared key (used for Software\Classes) */
 #define KEY_PREDEF   0x0020  /* key is marked as predefined */
+#define KEY_UNLINKED 0x0040  /* some subkeys have been deleted or renamed */
 
 #define OBJ_KEY_WOW64 0x100000 /* magic flag added to attributes for WoW64 redirection */
 
@@ -117,6 +123,7 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define KEY_HOT_QUERIES 16  /* number of value queries before mirroring a key in shared memory */
 
 #define MAX_NAME_LEN  256    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -133,7 +140,10 @@ static const WCHAR wow6432node[] = {'W','o','w','6','4','3','2','N','o','d','e'}
 static const WCHAR symlink_value[] = {'S','y','m','b','o','l','i','c','L','i','n','k','V','a','l','u','e'};
 static const struct unicode_str symlink_str = { symlink_value, sizeof(symlink_value) };
 
+static int registry_snapshot;  /* save the initial registry branches as binary snapshots */
+
 static void set_periodic_save_timer(void);
+static void make_dirty( struct key *key );
 static struct key_value *find_value( const struct key *key, struct unicode_str name, int *index );
 
 /* information about where to save a registry branch */
@@ -141,6 +151,11 @@ struct save_branch_info
 {
     struct key  *key;
     const char  *filename;
+    char         snapshot[32];   /* binary snapshot file name */
+    char         journal[32];    /* journal file name */
+    unsigned int generation;     /* generation of the snapshot on disk */
+    file_pos_t   snapshot_size;  /* size of the snapshot on disk, 0 if there is no valid one */
+    file_pos_t   journal_size;   /* size of the journal on disk, 0 if there is no valid one */
 };
 
 #define MAX_SAVE_BRANCH_INFO 3
@@ -215,6 +230,179 @@ static inline struct key *get_parent( const struct key *key )
     return (struct key *)parent;
 }
 
+/*
+ * The initial registry branches can also be saved in a binary snapshot format
+ * (WINEREGSNAPSHOT=1). A snapshot is a flat list of key records in tree order,
+ * each one referring to its parent by index. It is mapped as is, and the values
+ * of a key are only copied out of the mapping the first time they are needed.
+ * Periodic saves append the dirty keys to a journal, which is merged into a new
+ * snapshot once it grows too large. The text file is left alone, and is loaded
+ * instead of the snapshot if it changed since the snapshot was written.
+ */
+
+#define SNAPSHOT_VERSION      1
+#define SNAPSHOT_KEY_SYMLINK  0x0001  /* key is a symbolic link */
+#define SNAPSHOT_KEY_SUBKEYS  0x0002  /* the subkey names follow, the other subkeys have been deleted */
+
+static const char snapshot_magic[8] = {'W','I','N','E','R','E','G','S'};
+static const char journal_magic[8]  = {'W','I','N','E','R','E','G','J'};
+
+/* header of a snapshot or journal file */
+struct snapshot_header
+{
+    char             magic[8];     /* snapshot_magic or journal_magic */
+    unsigned int     version;      /* SNAPSHOT_VERSION */
+    unsigned int     generation;   /* a journal only applies to the snapshot of the same generation */
+    unsigned int     prefix_type;  /* prefix type (snapshot only) */
+    unsigned int     key_count;    /* number of key records (snapshot only) */
+    file_pos_t       text_size;    /* size of the text file when the snapshot was written, ~0 if missing */
+    unsigned __int64 text_mtime;   /* modification time of the text file */
+    unsigned __int64 text_inode;   /* inode of the text file */
+};
+
+/* a key record in a snapshot or a journal */
+struct snapshot_key
+{
+    data_size_t      size;         /* size of the whole record */
+    unsigned int     parent;       /* index of the parent record, ~0u for the branch (snapshot only) */
+    timeout_t        modif;        /* last modification time */
+    unsigned int     flags;        /* SNAPSHOT_KEY_* flags */
+    data_size_t      namelen;      /* length of the key name, or of the path below the branch in a journal */
+    data_size_t      classlen;     /* length of class name */
+    unsigned int     value_count;  /* number of value records */
+    data_size_t      values_size;  /* total size of the value records */
+    unsigned int     subkey_count; /* number of subkey names (journal only, with SNAPSHOT_KEY_SUBKEYS) */
+    /* followed by the name and class, the value records, and the subkey names */
+};
+
+/* a value record, also used for the subkey names in a journal */
+struct snapshot_value
+{
+    data_size_t      size;         /* size of the whole record */
+    unsigned int     type;         /* value type */
+    data_size_t      namelen;      /* length of value name */
+    data_size_t      len;          /* value data length in bytes */
+    /* followed by the name and the data */
+};
+
+/* a mapped snapshot file */
+struct snapshot_map
+{
+    unsigned int     refcount;     /* number of keys with values in the mapping, plus one while loading */
+    size_t           size;         /* size of the mapping */
+    void            *base;         /* base address of the mapping */
+};
+
+/* records are 8-byte aligned */
+static inline data_size_t snapshot_align( data_size_t size )
+{
+    return (size + 7) & ~7;
+}
+
+static inline data_size_t get_snapshot_values_offset( const struct snapshot_key *rec )
+{
+    return snapshot_align( sizeof(*rec) + rec->namelen + rec->classlen );
+}
+
+static void release_snapshot_map( struct snapshot_map *map )
+{
+    if (--map->refcount) return;
+    munmap( map->base, map->size );
+    free( map );
+}
+
+/* validate the key record at ptr */
+static const struct snapshot_key *get_snapshot_key( const char *ptr, const char *end )
+{
+    const struct snapshot_key *rec = (const struct snapshot_key *)ptr;
+    unsigned __int64 values;
+
+    if ((size_t)(end - ptr) < sizeof(*rec) || rec->size > end - ptr || rec->size % 8) return NULL;
+    if (rec->namelen % sizeof(WCHAR) || rec->classlen % sizeof(WCHAR)) return NULL;
+    values = ((unsigned __int64)sizeof(*rec) + rec->namelen + rec->classlen + 7) & ~7;
+    if (values + rec->values_size > rec->size) return NULL;
+    if (rec->value_count > rec->values_size / sizeof(struct snapshot_value)) return NULL;
+    if (rec->subkey_count > (rec->size - values - rec->values_size) / sizeof(struct snapshot_value)) return NULL;
+    return rec;
+}
+
+/* get the value record at ptr; return a pointer to the next one, or NULL if malformed */
+static const char *get_snapshot_value( const char *ptr, const char *end, struct key_value *value )
+{
+    const struct snapshot_value *rec = (const struct snapshot_value *)ptr;
+
+    if ((size_t)(end - ptr) < sizeof(*rec) || rec->size > end - ptr || rec->size % 8) return NULL;
+    if (rec->namelen > MAX_VALUE_LEN * sizeof(WCHAR) || rec->namelen % sizeof(WCHAR)) return NULL;
+    if ((unsigned __int64)sizeof(*rec) + rec->namelen + rec->len > rec->size) return NULL;
+
+    value->name    = (WCHAR *)(rec + 1);
+    value->namelen = rec->namelen;
+    value->type    = rec->type;
+    value->len     = rec->len;
+    value->data    = (char *)(rec + 1) + rec->namelen;
+    return ptr + rec->size;
+}
+
+/* copy the values of a key record into a key that doesn't have any */
+static int set_snapshot_values( struct key *key, const struct snapshot_key *rec )
+{
+    const char *ptr = (const char *)rec + get_snapshot_values_offset( rec );
+    const char *end = ptr + rec->values_size;
+    struct key_value *values, value;
+    unsigned int i, count = max( rec->value_count, MIN_VALUES );
+
+    if (!(values = mem_alloc( count * sizeof(*values) ))) return 0;
+
+    for (i = 0; i < rec->value_count; i++)
+    {
+        if (!(ptr = get_snapshot_value( ptr, end, &value )))
+        {
+            fprintf( stderr, "wineserver: malformed value in registry snapshot\n" );
+            break;
+        }
+        values[i] = value;
+        values[i].name = NULL;
+        values[i].data = NULL;
+        if (value.namelen && !(values[i].name = memdup( value.name, value.namelen ))) goto failed;
+        if (value.len && !(values[i].data = memdup( value.data, value.len )))
+        {
+            free( values[i].name );
+            goto failed;
+        }
+    }
+
+    key->values     = values;
+    key->nb_values  = count;
+    key->last_value = i - 1;
+    return 1;
+
+failed:
+    while (i--)
+    {
+        free( values[i].name );
+        free( values[i].data );
+    }
+    free( values );
+    return 0;
+}
+
+/* copy the values of a key out of the snapshot the first time they are needed */
+static int load_snapshot_values( struct key *key )
+{
+    if (!key->snapshot) return 1;
+    if (!set_snapshot_values( key, key->snapshot )) return 0;
+    release_snapshot_map( key->snapshot_map );
+    key->snapshot     = NULL;
+    key->snapshot_map = NULL;
+    return 1;
+}
+
+static inline int get_value_count( const struct key *key )
+{
+    if (key->snapshot) return key->snapshot->value_count;
+    return key->last_value + 1;
+}
+
 /*
  * The registry text file format v2 used by this code is similar to the one
  * used by REGEDIT import/export functionality, with the following differences:
@@ -340,6 +528,21 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* dump the values of a key that are still in a snapshot to a text file */
+static void dump_snapshot_values( const struct snapshot_key *rec, FILE *f )
+{
+    const char *ptr = (const char *)rec + get_snapshot_values_offset( rec );
+    const char *end = ptr + rec->values_size;
+    struct key_value value;
+    unsigned int i;
+
+    for (i = 0; i < rec->value_count; i++)
+    {
+        if (!(ptr = get_snapshot_value( ptr, end, &value ))) break;
+        dump_value( &value, f );
+    }
+}
+
 /* save a registry and all its subkeys to a text file */
 static void save_subkeys( const struct key *key, const struct key *base, FILE *f )
 {
@@ -348,7 +551,7 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
     if (key->flags & KEY_VOLATILE) return;
     /* save key if it has either some values or no subkeys, or needs special options */
     /* keys with no values but subkeys are saved implicitly by saving the subkeys */
-    if ((key->last_value >= 0) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
+    if (get_value_count( key ) || (key->last_subkey == -1) || key->class || (key->flags & KEY_SYMLINK))
     {
         fprintf( f, "\n[" );
         if (key != base) dump_path( key, base, f );
@@ -362,6 +565,7 @@ static void save_subkeys( const struct key *key, const struct key *base, FILE *f
         }
         if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
         for (i = 0; i <= key->last_value; i++) dump_value( &key->values[i], f );
+        if (key->snapshot) dump_snapshot_values( key->snapshot, f );
     }
     for (i = 0; i <= key->last_subkey; i++) save_subkeys( key->subkeys[i], base, f );
 }
@@ -404,6 +608,10 @@ static bool key_init( struct object *obj, const void *init_data )
     key->last_value  = -1;
     key->values      = NULL;
     key->modif       = data->modif;
+    key->snapshot    = NULL;
+    key->snapshot_map = NULL;
+    key->shared      = NULL;
+    key->queries     = 0;
     list_init( &key->notify_list );
 
     if ((key->classlen = (data->classlen / sizeof(WCHAR)) * sizeof(WCHAR)) &&
@@ -416,7 +624,7 @@ static bool key_init( struct object *obj, const void *init_data )
         set_error( STATUS_CHILD_MUST_BE_VOLATILE );
         return false;
     }
-    else key->flags |= KEY_DIRTY;
+    else make_dirty( key );
 
     return true;
 }
@@ -534,6 +742,7 @@ static struct object *key_lookup_name( struct object *obj, struct unicode_str *n
         struct key_value *value;
 
         if (!name->len && (attr & OBJ_OPENLINK)) return NULL;
+        if (!load_snapshot_values( key )) return NULL;
 
         if (!(value = find_value( key, symlink_str, &index )) ||
             value->len < sizeof(WCHAR) || *(WCHAR *)value->data != '\\')
@@ -706,6 +915,8 @@ static void key_destroy( struct object *obj )
         free( key->values[i].data );
     }
     free( key->values );
+    if (key->snapshot) release_snapshot_map( key->snapshot_map );
+    if (key->shared) free_shared_object( key->shared );
     for (i = 0; i <= key->last_subkey; i++)
     {
         key->subkeys[i]->obj.name->parent = NULL;
@@ -738,10 +949,23 @@ static void make_clean( struct key *key )
 
     if (key->flags & KEY_VOLATILE) return;
     if (!(key->flags & KEY_DIRTY)) return;
-    key->flags &= ~KEY_DIRTY;
+    key->flags &= ~(KEY_DIRTY | KEY_UNLINKED);
     for (i = 0; i <= key->last_subkey; i++) make_clean( key->subkeys[i] );
 }
 
+/* mark all the subkeys of a key as dirty (modified) */
+static void make_subkeys_dirty( struct key *key )
+{
+    int i;
+
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        key->subkeys[i]->flags |= KEY_DIRTY;
+        make_subkeys_dirty( key->subkeys[i] );
+    }
+}
+
 /* go through all the notifications and send them if necessary */
 static void check_notify( struct key *key, unsigned int change, int not_subtree )
 {
@@ -766,6 +990,71 @@ static void touch_key( struct key *key, unsigned int change )
     for (key = get_parent( key ); key; key = get_parent( key )) check_notify( key, change, 0 );
 }
 
+/* compute the size needed to mirror the values of a key in shared memory */
+static data_size_t get_key_shm_size( const struct key *key )
+{
+    data_size_t size = 0;
+    int i;
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        const struct key_value *value = &key->values[i];
+
+        if (value->len > KEY_SHM_MAX_SIZE) return KEY_SHM_MAX_SIZE + 1;
+        size += (sizeof(struct key_shm_value) + value->namelen + value->len + 3) & ~3;
+        if (size > KEY_SHM_MAX_SIZE) return size;
+    }
+    return size;
+}
+
+/* publish the values of a key in shared memory, (re)allocating the mirror if needed */
+static void update_key_shm( struct key *key )
+{
+    data_size_t size = get_key_shm_size( key ), capacity, pos = 0;
+    int i;
+
+    if (key->shared && size > key->shared->capacity)
+    {
+        /* clients notice the id change and go back to the server */
+        free_shared_object( key->shared );
+        key->shared = NULL;
+    }
+    if (!key->shared)
+    {
+        if (size > KEY_SHM_MAX_SIZE) return;
+        capacity = min( (size + 256) & ~255, KEY_SHM_MAX_SIZE );  /* leave some room to grow */
+        if (!(key->shared = alloc_shared_object( offsetof( key_shm_t, values[capacity] ) ))) return;
+    }
+    else capacity = key->shared->capacity;
+
+    SHARED_WRITE_BEGIN( key->shared, key_shm_t )
+    {
+        shared->capacity = capacity;
+        for (i = 0; i <= key->last_value; i++)
+        {
+            const struct key_value *value = &key->values[i];
+            struct key_shm_value info = { value->type, value->namelen, value->len };
+            char *ptr = (char *)shared->values + pos;
+
+            memcpy( ptr, &info, sizeof(info) );
+            memcpy( ptr + sizeof(info), value->name, value->namelen );
+            memcpy( ptr + sizeof(info) + value->namelen, value->data, value->len );
+            pos += (sizeof(info) + value->namelen + value->len + 3) & ~3;
+        }
+        shared->size  = pos;
+        shared->count = key->last_value + 1;
+    }
+    SHARED_WRITE_END;
+}
+
+/* free the shared memory mirror of a key */
+static void free_key_shm( struct key *key )
+{
+    if (!key->shared) return;
+    free_shared_object( key->shared );
+    key->shared = NULL;
+}
+
 /* get the wow6432node key if any, grabbing it and releasing the original key */
 static struct key *grab_wow6432node( struct key *key )
 {
@@ -888,6 +1177,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         break;
     case KeyFullInformation:
     case KeyCachedInformation:
+        if (!load_snapshot_values( key )) return;
         for (i = 0; i <= key->last_subkey; i++)
         {
             if (key->subkeys[i]->obj.name->len > max_subkey) max_subkey = key->subkeys[i]->obj.name->len;
@@ -912,7 +1202,7 @@ static void enum_key( struct key *key, int index, int info_class, struct enum_ke
         return;
     }
     reply->subkeys = key->last_subkey + 1;
-    reply->values  = key->last_value + 1;
+    reply->values  = get_value_count( key );
     reply->modif   = key->modif;
     reply->total   = namelen + classlen;
 
@@ -993,8 +1283,11 @@ static void rename_key( struct key *key, struct unicode_str new_name )
 
     free( key->obj.name );
     key->obj.name = new_name_ptr;
+    parent->flags |= KEY_UNLINKED;
 
     if (debug_level > 1) dump_operation( key, NULL, "Rename" );
+    /* the journal identifies keys by path, the whole subtree needs to be saved again */
+    make_subkeys_dirty( key );
     touch_key( key, REG_NOTIFY_CHANGE_NAME );
 }
 
@@ -1029,7 +1322,9 @@ static int delete_key( struct key *key, int recurse )
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
     key->flags |= KEY_DELETED;
+    free_key_shm( key );
     unlink_named_object( &key->obj );
+    parent->flags |= KEY_UNLINKED;
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 1;
 }
@@ -1124,6 +1419,7 @@ static void set_value( struct key *key, struct unicode_str name,
         set_error( STATUS_INVALID_HANDLE );
         return;
     }
+    if (!load_snapshot_values( key )) return;
 
     if ((value = find_value( key, name, &index )))
     {
@@ -1161,6 +1457,7 @@ static void set_value( struct key *key, struct unicode_str name,
     value->type  = type;
     value->len   = len;
     value->data  = ptr;
+    if (key->shared) update_key_shm( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
@@ -1176,6 +1473,7 @@ static void get_value( struct key *key, struct unicode_str name, int *type, data
         set_error( STATUS_INVALID_HANDLE );
         return;
     }
+    if (!load_snapshot_values( key )) return;
 
     if ((value = find_value( key, name, &index )))
     {
@@ -1201,6 +1499,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
         set_error( STATUS_INVALID_HANDLE );
         return;
     }
+    if (!load_snapshot_values( key )) return;
 
     if (i < 0 || i > key->last_value) set_error( STATUS_NO_MORE_ENTRIES );
     else
@@ -1259,6 +1558,7 @@ static void delete_value( struct key *key, struct unicode_str name )
         set_error( STATUS_INVALID_HANDLE );
         return;
     }
+    if (!load_snapshot_values( key )) return;
 
     if (!(value = find_value( key, name, &index )))
     {
@@ -1270,6 +1570,7 @@ static void delete_value( struct key *key, struct unicode_str name )
     free( value->data );
     for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
     key->last_value--;
+    if (key->shared) update_key_shm( key );
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
     /* try to shrink the array */
@@ -1552,6 +1853,7 @@ static struct key_value *parse_value_name( struct key *key, const char *buffer,
     if (buffer[*len] != '=') goto error;
     (*len)++;
     while (isspace(buffer[*len])) (*len)++;
+    if (!load_snapshot_values( key )) return NULL;
     if (!(value = find_value( key, name, &index ))) value = insert_value( key, name, index );
     return value;
 
@@ -1617,6 +1919,7 @@ static int load_value( struct key *key, const char *buffer, struct file_load_inf
     value->data = newptr;
     value->len  = len;
     value->type = type;
+    if (key->shared) update_key_shm( key );
     return 1;
 
  error:
@@ -1748,12 +2051,282 @@ static void load_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* get the identity of the text file of a registry branch, to detect changes made behind our back */
+static void get_text_file_stamp( const char *filename, struct snapshot_header *header )
+{
+    struct stat st;
+
+    if (stat( filename, &st ) == -1)
+    {
+        header->text_size  = ~(file_pos_t)0;
+        header->text_mtime = 0;
+        header->text_inode = 0;
+        return;
+    }
+    header->text_size  = st.st_size;
+    header->text_mtime = st.st_mtime;
+    header->text_inode = st.st_ino;
+}
+
+/* drop the values, class and link flag of a key loaded from a snapshot */
+static void clear_loaded_key( struct key *key )
+{
+    int i;
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        free( key->values[i].name );
+        free( key->values[i].data );
+    }
+    free( key->values );
+    key->values     = NULL;
+    key->nb_values  = 0;
+    key->last_value = -1;
+    if (key->snapshot)
+    {
+        release_snapshot_map( key->snapshot_map );
+        key->snapshot     = NULL;
+        key->snapshot_map = NULL;
+    }
+    free( key->class );
+    key->class    = NULL;
+    key->classlen = 0;
+    key->flags   &= ~KEY_SYMLINK;
+}
+
+/* apply a journal record to a registry branch */
+static int load_journal_key( struct key *base, const struct snapshot_key *rec )
+{
+    const char *ptr = (const char *)rec + get_snapshot_values_offset( rec ) + rec->values_size;
+    const char *end = (const char *)rec + rec->size;
+    const WCHAR *class = (const WCHAR *)(rec + 1) + rec->namelen / sizeof(WCHAR);
+    struct unicode_str name = { (const WCHAR *)(rec + 1), rec->namelen };
+    struct unicode_str *subkeys = NULL;
+    struct key_value value;
+    struct key *key;
+    unsigned int i;
+    int index, min, max, res, ret = 0;
+
+    if (name.len) key = create_key_recursive( base, name, rec->modif );
+    else key = (struct key *)grab_object( base );
+    if (!key) return 0;
+
+    /* delete the subkeys that are not listed anymore */
+    if (!(rec->flags & SNAPSHOT_KEY_SUBKEYS)) goto values;
+    if (rec->subkey_count && !(subkeys = mem_alloc( rec->subkey_count * sizeof(*subkeys) ))) goto done;
+    for (i = 0; i < rec->subkey_count; i++)
+    {
+        if (!(ptr = get_snapshot_value( ptr, end, &value ))) goto done;
+        subkeys[i].str = value.name;
+        subkeys[i].len = value.namelen;
+    }
+    for (index = key->last_subkey; index >= 0; index--)
+    {
+        struct key *subkey = key->subkeys[index];
+
+        if (subkey->flags & KEY_VOLATILE) continue;
+        for (min = 0, max = rec->subkey_count - 1, res = 1; res && min <= max;)
+        {
+            i = (min + max) / 2;
+            res = memicmp_strW( subkeys[i].str, subkey->obj.name->name,
+                                min( subkeys[i].len, subkey->obj.name->len ));
+            if (!res) res = subkeys[i].len - subkey->obj.name->len;
+            if (res > 0) max = i - 1;
+            else min = i + 1;
+        }
+        if (res && !delete_key( subkey, 1 )) goto done;
+    }
+
+values:
+    /* replace the values */
+    clear_loaded_key( key );
+    if (rec->value_count && !set_snapshot_values( key, rec )) goto done;
+
+    if (rec->classlen && !(key->class = memdup( class, rec->classlen ))) goto done;
+    key->classlen = rec->classlen;
+
+    if (rec->flags & SNAPSHOT_KEY_SYMLINK) key->flags |= KEY_SYMLINK;
+    else key->flags &= ~KEY_SYMLINK;
+    key->modif = rec->modif;
+    ret = 1;
+
+done:
+    free( subkeys );
+    release_object( key );
+    return ret;
+}
+
+/* replay the journal of a registry branch; return 0 if it couldn't be fully applied */
+static int load_journal( struct save_branch_info *info, struct key *base )
+{
+    const struct snapshot_header *header;
+    const struct snapshot_key *rec;
+    const char *ptr, *end;
+    struct stat st;
+    void *data;
+    int fd;
+
+    info->journal_size = 0;
+    if ((fd = open( info->journal, O_RDONLY )) == -1) return 1;
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header))
+    {
+        close( fd );
+        return 1;
+    }
+    data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if (data == MAP_FAILED) return 0;
+
+    header = data;
+    if (memcmp( header->magic, journal_magic, sizeof(journal_magic) ) ||
+        header->version != SNAPSHOT_VERSION || header->generation != info->generation)
+    {
+        /* left over from an older snapshot */
+        munmap( data, st.st_size );
+        return 1;
+    }
+
+    ptr = (const char *)(header + 1);
+    end = (const char *)data + st.st_size;
+    while (ptr < end)
+    {
+        if (!(rec = get_snapshot_key( ptr, end ))) break;
+        if (!load_journal_key( base, rec )) break;
+        ptr += rec->size;
+    }
+    munmap( data, st.st_size );
+
+    if (ptr < end)
+    {
+        fprintf( stderr, "wineserver: %s is corrupted\n", info->journal );
+        return 0;
+    }
+    info->journal_size = st.st_size;
+    return 1;
+}
+
+/* load a registry branch from its binary snapshot; return 0 if there is no usable snapshot */
+static int load_snapshot( struct save_branch_info *info, struct key *base )
+{
+    struct snapshot_header *header, stamp;
+    const struct snapshot_key *rec;
+    struct snapshot_map *map;
+    struct key **keys, *key;
+    const char *ptr, *end;
+    struct stat st;
+    unsigned int i;
+    int fd, ret;
+
+    if ((fd = open( info->snapshot, O_RDONLY )) == -1) return 0;
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || !(map = mem_alloc( sizeof(*map) )))
+    {
+        close( fd );
+        return 0;
+    }
+    map->refcount = 1;
+    map->size     = st.st_size;
+    map->base     = mmap( NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if (map->base == MAP_FAILED)
+    {
+        free( map );
+        return 0;
+    }
+
+    header = map->base;
+    if (memcmp( header->magic, snapshot_magic, sizeof(snapshot_magic) ) || header->version != SNAPSHOT_VERSION)
+    {
+        release_snapshot_map( map );
+        return 0;
+    }
+    /* don't reuse the generation of a stale snapshot, its journal may still be around */
+    info->generation = header->generation;
+
+    get_text_file_stamp( info->filename, &stamp );
+    if (header->text_size != stamp.text_size || header->text_mtime != stamp.text_mtime ||
+        header->text_inode != stamp.text_inode || !header->key_count ||
+        header->key_count > (map->size - sizeof(*header)) / sizeof(*rec) ||
+        !(keys = mem_alloc( header->key_count * sizeof(*keys) )))
+    {
+        release_snapshot_map( map );
+        return 0;
+    }
+    if (header->prefix_type == PREFIX_32BIT || header->prefix_type == PREFIX_64BIT)
+        prefix_type = header->prefix_type;
+
+    ptr = (const char *)(header + 1);
+    end = (const char *)map->base + map->size;
+    for (i = 0; i < header->key_count; i++)
+    {
+        struct unicode_str name;
+
+        if (!(rec = get_snapshot_key( ptr, end ))) break;
+        name.str = (const WCHAR *)(rec + 1);
+        name.len = rec->namelen;
+
+        if (!i)
+        {
+            if (rec->parent != ~0u) break;
+            key = (struct key *)grab_object( base );
+        }
+        else if (rec->parent >= i || !name.len || get_path_element( name.str, name.len ) != name.len) break;
+        else if (!(key = create_key_recursive( keys[rec->parent], name, rec->modif ))) break;
+        keys[i] = key;
+
+        if (rec->classlen && !key->class &&
+            (key->class = memdup( name.str + name.len / sizeof(WCHAR), rec->classlen )))
+            key->classlen = rec->classlen;
+        if (rec->flags & SNAPSHOT_KEY_SYMLINK) key->flags |= KEY_SYMLINK;
+        key->modif = rec->modif;
+
+        /* the values stay in the mapping until needed */
+        if (rec->value_count && !key->snapshot && key->last_value == -1)
+        {
+            key->snapshot     = rec;
+            key->snapshot_map = map;
+            map->refcount++;
+        }
+        ptr += rec->size;
+    }
+    ret = (i == header->key_count);
+    if (!ret) fprintf( stderr, "wineserver: %s is corrupted\n", info->snapshot );
+
+    info->snapshot_size = map->size;
+    while (i--) release_object( keys[i] );
+    free( keys );
+    release_snapshot_map( map );
+
+    if (ret && !load_journal( info, base )) ret = 0;
+    if (!ret)
+    {
+        /* drop what was loaded, the text file is loaded instead */
+        fprintf( stderr, "wineserver: loading %s instead\n", info->filename );
+        while (base->last_subkey >= 0)
+            if (!delete_key( base->subkeys[base->last_subkey], 1 )) break;
+        clear_loaded_key( base );
+        info->snapshot_size = 0;
+        info->journal_size  = 0;
+        return 0;
+    }
+    make_clean( base );
+    return 1;
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
-    FILE *f;
+    struct save_branch_info *info;
+    FILE *f = NULL;
+    int loaded;
 
-    if ((f = fopen( filename, "r" )))
+    assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
+
+    info = &save_branch_info[save_branch_count];
+    info->filename = filename;
+    snprintf( info->snapshot, sizeof(info->snapshot), "%s.bin", filename );
+    snprintf( info->journal, sizeof(info->journal), "%s.journal", filename );
+
+    if (!(loaded = load_snapshot( info, key )) && (f = fopen( filename, "r" )))
     {
         load_keys( key, filename, f, 0 );
         fclose( f );
@@ -1762,14 +2335,13 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        loaded = 1;
     }
 
-    assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
-
-    save_branch_info[save_branch_count].filename = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info->key = (struct key *)grab_object( key );
+    save_branch_count++;
     make_object_permanent( &key->obj );
-    return (f != NULL);
+    return loaded;
 }
 
 static WCHAR *format_user_registry_path( const struct sid *sid, struct unicode_str *path )
@@ -1869,6 +2441,8 @@ void init_registry(void)
 
     if (fchdir( config_dir_fd ) == -1) fatal_error( "chdir to config dir: %s\n", strerror( errno ));
 
+    registry_snapshot = (p = getenv( "WINEREGSNAPSHOT" )) && atoi( p );
+
     /* create the root key */
     root_key = create_named_object( &params );
     assert( root_key );
@@ -2012,12 +2586,25 @@ static void save_registry( struct key *key, obj_handle_t handle )
     }
 }
 
+/* create a temporary file in the current directory */
+static int create_temp_file( char *tmp, size_t size )
+{
+    int fd, count = 0;
+
+    for (;;)
+    {
+        snprintf( tmp, size, "reg%lx%04x.tmp", (long) getpid(), count++ );
+        if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) return fd;
+        if (errno != EEXIST) return -1;
+    }
+}
+
 /* save a registry branch to a file */
 static int save_branch( struct key *key, const char *filename )
 {
     struct stat st;
     char tmp[32];
-    int fd, count = 0, ret = 0;
+    int fd, ret = 0;
     FILE *f;
 
     if (!(key->flags & KEY_DIRTY))
@@ -2043,12 +2630,10 @@ static int save_branch( struct key *key, const char *filename )
 
     /* create a temp file */
 
-    for (;;)
+    if ((fd = create_temp_file( tmp, sizeof(tmp) )) == -1)
     {
-        snprintf( tmp, sizeof(tmp), "reg%lx%04x.tmp", (long) getpid(), count++ );
-        if ((fd = open( tmp, O_CREAT | O_EXCL | O_WRONLY, 0666 )) != -1) break;
-        if (errno != EEXIST) goto done;
-        close( fd );
+        tmp[0] = 0;
+        goto done;
     }
 
     /* now save to it */
@@ -2082,6 +2667,255 @@ done:
     return ret;
 }
 
+static void write_snapshot_data( FILE *f, const void *data, data_size_t len, data_size_t size )
+{
+    static const char padding[8];
+
+    if (len) fwrite( data, len, 1, f );
+    if (size > len) fwrite( padding, size - len, 1, f );
+}
+
+/* write a key record to a snapshot or a journal; return its size, or 0 on error */
+static data_size_t write_snapshot_key( FILE *f, const struct key *key, unsigned int parent,
+                                       const WCHAR *name, data_size_t namelen, int journal )
+{
+    int with_subkeys = journal && (key->flags & KEY_UNLINKED);
+    struct snapshot_key rec = { .parent = parent, .modif = key->modif, .namelen = namelen,
+                                .classlen = key->classlen };
+    struct snapshot_value value = { 0 };
+    data_size_t offset;
+    int i;
+
+    if (key->flags & KEY_SYMLINK) rec.flags |= SNAPSHOT_KEY_SYMLINK;
+    if (with_subkeys) rec.flags |= SNAPSHOT_KEY_SUBKEYS;
+    if (key->snapshot)
+    {
+        rec.value_count = key->snapshot->value_count;
+        rec.values_size = key->snapshot->values_size;
+    }
+    else
+    {
+        rec.value_count = key->last_value + 1;
+        for (i = 0; i <= key->last_value; i++)
+            rec.values_size += snapshot_align( sizeof(value) + key->values[i].namelen + key->values[i].len );
+    }
+    offset = get_snapshot_values_offset( &rec );
+    rec.size = offset + rec.values_size;
+    for (i = 0; with_subkeys && i <= key->last_subkey; i++)
+    {
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        rec.subkey_count++;
+        rec.size += snapshot_align( sizeof(value) + key->subkeys[i]->obj.name->len );
+    }
+
+    write_snapshot_data( f, &rec, sizeof(rec), sizeof(rec) );
+    write_snapshot_data( f, name, namelen, namelen );
+    write_snapshot_data( f, key->class, key->classlen, offset - sizeof(rec) - namelen );
+
+    /* values that were never loaded are copied as is */
+    if (key->snapshot)
+        write_snapshot_data( f, (const char *)key->snapshot + get_snapshot_values_offset( key->snapshot ),
+                             rec.values_size, rec.values_size );
+    else for (i = 0; i <= key->last_value; i++)
+    {
+        const struct key_value *val = &key->values[i];
+
+        value.size    = snapshot_align( sizeof(value) + val->namelen + val->len );
+        value.type    = val->type;
+        value.namelen = val->namelen;
+        value.len     = val->len;
+        write_snapshot_data( f, &value, sizeof(value), sizeof(value) );
+        write_snapshot_data( f, val->name, val->namelen, val->namelen );
+        write_snapshot_data( f, val->data, val->len, value.size - sizeof(value) - val->namelen );
+    }
+
+    /* subkey names, so that the journal can record deletions and renames */
+    for (i = 0; with_subkeys && i <= key->last_subkey; i++)
+    {
+        const struct object_name *subkey = key->subkeys[i]->obj.name;
+
+        if (key->subkeys[i]->flags & KEY_VOLATILE) continue;
+        value.size    = snapshot_align( sizeof(value) + subkey->len );
+        value.type    = 0;
+        value.namelen = subkey->len;
+        value.len     = 0;
+        write_snapshot_data( f, &value, sizeof(value), sizeof(value) );
+        write_snapshot_data( f, subkey->name, subkey->len, value.size - sizeof(value) );
+    }
+
+    return ferror( f ) ? 0 : rec.size;
+}
+
+/* write a key and its subkeys to a snapshot, in tree order */
+static void write_snapshot_subkeys( FILE *f, const struct key *key, const struct key *base,
+                                    unsigned int parent, unsigned int *count )
+{
+    unsigned int index = *count;
+    int i;
+
+    if (key->flags & KEY_VOLATILE) return;
+    if (key == base) write_snapshot_key( f, key, ~0u, NULL, 0, 0 );
+    else write_snapshot_key( f, key, parent, key->obj.name->name, key->obj.name->len, 0 );
+    (*count)++;
+    for (i = 0; i <= key->last_subkey; i++) write_snapshot_subkeys( f, key->subkeys[i], base, index, count );
+}
+
+/* write a new snapshot of a registry branch and start a new journal for it */
+static int write_snapshot( struct save_branch_info *info )
+{
+    struct snapshot_header header = { .version = SNAPSHOT_VERSION, .prefix_type = prefix_type };
+    file_pos_t size;
+    char tmp[32];
+    int fd, ret;
+    FILE *f;
+
+    if ((fd = create_temp_file( tmp, sizeof(tmp) )) == -1) return 0;
+    if (!(f = fdopen( fd, "w" )))
+    {
+        close( fd );
+        unlink( tmp );
+        return 0;
+    }
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", info->snapshot );
+        dump_operation( info->key, NULL, "saving" );
+    }
+
+    /* a new generation invalidates the current journal, pick one that can't match a stale journal either */
+    header.generation = info->generation ? info->generation + 1 : (unsigned int)(current_time / TICKS_PER_SEC);
+    memcpy( header.magic, snapshot_magic, sizeof(header.magic) );
+    get_text_file_stamp( info->filename, &header );
+
+    fwrite( &header, sizeof(header), 1, f );
+    write_snapshot_subkeys( f, info->key, info->key, ~0u, &header.key_count );
+    size = ftell( f );
+    /* now that the key count is known */
+    rewind( f );
+    fwrite( &header, sizeof(header), 1, f );
+
+    ret = !ferror( f );
+    if (fclose( f )) ret = 0;
+    if (ret) ret = !rename( tmp, info->snapshot );
+    if (!ret)
+    {
+        unlink( tmp );
+        return 0;
+    }
+
+    info->generation    = header.generation;
+    info->snapshot_size = size;
+    info->journal_size  = 0;
+
+    memcpy( header.magic, journal_magic, sizeof(header.magic) );
+    if ((fd = open( info->journal, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) != -1)
+    {
+        if (write( fd, &header, sizeof(header) ) == sizeof(header)) info->journal_size = sizeof(header);
+        close( fd );
+    }
+    return 1;
+}
+
+/* get the path of a key relative to a base key */
+static WCHAR *get_relative_path( const struct key *key, const struct key *base, data_size_t *ret_len )
+{
+    const struct key *parent;
+    data_size_t len = 0;
+    WCHAR *path, *p;
+
+    for (parent = key; parent != base; parent = get_parent( parent ))
+        len += parent->obj.name->len + sizeof(WCHAR);
+    if (!(path = mem_alloc( len + sizeof(WCHAR) ))) return NULL;
+
+    p = path + len / sizeof(WCHAR);
+    for (parent = key; parent != base; parent = get_parent( parent ))
+    {
+        p -= parent->obj.name->len / sizeof(WCHAR);
+        memcpy( p, parent->obj.name->name, parent->obj.name->len );
+        *--p = '\\';
+    }
+    *ret_len = len ? len - sizeof(WCHAR) : 0;
+    return path;
+}
+
+/* append the dirty keys of a registry branch to the journal */
+static int write_journal_subkeys( FILE *f, const struct key *key, const struct key *base, file_pos_t *size )
+{
+    data_size_t len, written;
+    WCHAR *path;
+    int i;
+
+    if ((key->flags & KEY_VOLATILE) || !(key->flags & KEY_DIRTY)) return 1;
+
+    if (!(path = get_relative_path( key, base, &len ))) return 0;
+    written = write_snapshot_key( f, key, ~0u, path + 1, len, 1 );
+    free( path );
+    if (!written) return 0;
+    *size += written;
+
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!write_journal_subkeys( f, key->subkeys[i], base, size )) return 0;
+    return 1;
+}
+
+/* save the changes to a registry branch at the end of its journal */
+static int append_journal( struct save_branch_info *info )
+{
+    file_pos_t size = 0;
+    int fd, ret;
+    FILE *f;
+
+    if ((fd = open( info->journal, O_WRONLY )) == -1) return 0;
+    /* drop anything written after the last complete save */
+    if (ftruncate( fd, info->journal_size ) == -1 || lseek( fd, 0, SEEK_END ) == -1 ||
+        !(f = fdopen( fd, "w" )))
+    {
+        close( fd );
+        return 0;
+    }
+
+    if (debug_level > 1)
+    {
+        fprintf( stderr, "%s: ", info->journal );
+        dump_operation( info->key, NULL, "saving" );
+    }
+
+    ret = write_journal_subkeys( f, info->key, info->key, &size );
+    if (fclose( f )) ret = 0;
+    if (ret) info->journal_size += size;
+    return ret;
+}
+
+/* save a registry branch to its snapshot, through the journal unless it's grown too large */
+static int save_branch_snapshot( struct save_branch_info *info )
+{
+    int ret = 0;
+
+    if (!(info->key->flags & KEY_DIRTY)) return 1;
+
+    if (info->journal_size && info->journal_size - sizeof(struct snapshot_header) < info->snapshot_size / 2)
+        ret = append_journal( info );
+    if (!ret) ret = write_snapshot( info );
+    if (ret) make_clean( info->key );
+    return ret;
+}
+
+/* save a registry branch in the configured format */
+static int save_registry_branch( struct save_branch_info *info )
+{
+    if (registry_snapshot) return save_branch_snapshot( info );
+    if (!info->snapshot_size || !(info->key->flags & KEY_DIRTY)) return save_branch( info->key, info->filename );
+    if (!save_branch( info->key, info->filename )) return 0;
+
+    /* the text file is now more recent than the snapshot */
+    unlink( info->snapshot );
+    unlink( info->journal );
+    info->snapshot_size = 0;
+    info->journal_size  = 0;
+    return 1;
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -2089,8 +2923,7 @@ static void periodic_save( void *arg )
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].filename );
+    for (i = 0; i < save_branch_count; i++) save_registry_branch( &save_branch_info[i] );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -2110,7 +2943,7 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].filename ))
+        if (!save_registry_branch( &save_branch_info[i] ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
                      save_branch_info[i].filename );
@@ -2261,6 +3094,17 @@ DECL_HANDLER(get_key_value)
     if ((key = get_hkey_obj( req->hkey, KEY_QUERY_VALUE )))
     {
         get_value( key, name, &reply->type, &reply->total );
+        if (!key->shared && !(key->flags & (KEY_PREDEF | KEY_DELETED)) && !key->snapshot &&
+            ++key->queries == KEY_HOT_QUERIES)
+        {
+            unsigned int status = get_error();
+            /* if the key can't be mirrored now, or the mirror is freed later
+             * because the key grew too big, try again once it is hot again */
+            key->queries = 0;
+            update_key_shm( key );
+            set_error( status );  /* failing to publish the values is not an error */
+        }
+        if (key->shared) reply->locator = get_shared_object_locator( key->shared );
         release_object( key );
     }
 }
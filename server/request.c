@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -42,6 +43,7 @@
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
+#include <time.h>
 #include <unistd.h>
 #include <poll.h>
 #ifdef __APPLE__
@@ -267,11 +269,152 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* request statistics, kept in a file of the server dir so that they can be read by "wineserver --stats" */
+
+#define STATS_BUCKETS    32  /* log2 latency buckets, in nanoseconds */
+#define STATS_PROCESSES  64  /* number of client process slots */
+
+struct request_stats
+{
+    unsigned __int64 count;                  /* number of calls */
+    unsigned __int64 total;                  /* total time in ns */
+    unsigned __int64 max;                    /* longest call in ns */
+    unsigned __int64 hist[STATS_BUCKETS];    /* calls taking [2^i,2^(i+1)) ns */
+};
+
+struct process_stats
+{
+    process_id_t     id;                     /* process id, 0 if slot is unused */
+    unsigned int     exited;                 /* process has been destroyed */
+    unsigned int     serial;                 /* allocation or exit serial, to reuse the oldest slot */
+    char             name[64];               /* base name of the main image */
+    struct
+    {
+        unsigned int     count;              /* number of calls */
+        unsigned __int64 total;              /* total time in ns */
+    } requests[REQ_NB_REQUESTS];
+};
+
+struct server_stats
+{
+    char                 magic[8];           /* "WINESTAT" */
+    unsigned int         protocol;           /* server protocol version */
+    unsigned int         nb_requests;        /* REQ_NB_REQUESTS */
+    unsigned __int64     start_time;         /* server start time, in seconds since 1970 */
+    struct request_stats requests[REQ_NB_REQUESTS];
+    struct process_stats processes[STATS_PROCESSES];
+};
+
+static const char * const server_stats_name = "stats";     /* name of the statistics file */
+static const char server_stats_magic[8] = { 'W','I','N','E','S','T','A','T' };
+static struct server_stats *server_stats;
+static unsigned int stats_serial;
+
+/* return a monotonic time in nanoseconds for the request statistics */
+static inline unsigned __int64 get_stats_time(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts )) return (unsigned __int64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return monotonic_counter() * 100;
+}
+
+/* create the statistics file; failure is not fatal, we simply don't record anything */
+static void init_request_stats(void)
+{
+    struct server_stats *stats;
+    int fd;
+
+    if ((fd = open( server_stats_name, O_CREAT | O_TRUNC | O_RDWR, 0600 )) == -1) return;
+    if (ftruncate( fd, sizeof(*stats) ) == -1 ||
+        (stats = mmap( NULL, sizeof(*stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return;
+    }
+    close( fd );
+
+    stats->protocol    = SERVER_PROTOCOL_VERSION;
+    stats->nb_requests = REQ_NB_REQUESTS;
+    stats->start_time  = time( NULL );
+    memcpy( stats->magic, server_stats_magic, sizeof(stats->magic) );
+    server_stats = stats;
+}
+
+/* allocate a statistics slot for a new process */
+struct process_stats *alloc_process_stats( struct process *process )
+{
+    struct process_stats *slot, *ret = NULL;
+    unsigned int i;
+
+    if (!server_stats) return NULL;
+
+    for (i = 0; i < STATS_PROCESSES; i++)
+    {
+        slot = &server_stats->processes[i];
+        if (!slot->id)
+        {
+            ret = slot;
+            break;
+        }
+        if (slot->exited && (!ret || slot->serial < ret->serial)) ret = slot;
+    }
+    if (!ret) return NULL;  /* all slots are used by live processes */
+
+    memset( ret, 0, sizeof(*ret) );
+    ret->id     = process->id;
+    ret->serial = ++stats_serial;
+    return ret;
+}
+
+/* mark a process statistics slot as reusable, its contents remain visible until then */
+void free_process_stats( struct process_stats *stats )
+{
+    stats->exited = 1;
+    stats->serial = ++stats_serial;
+}
+
+/* set the name of a process statistics slot from the process main image */
+static void set_process_stats_name( struct process_stats *stats, const struct process *process )
+{
+    const WCHAR *name = process->image, *end = process->image + process->imagelen / sizeof(WCHAR);
+    const WCHAR *p;
+    unsigned int i;
+
+    for (p = name; p < end; p++) if (*p == '\\') name = p + 1;
+    for (i = 0; name < end && i < sizeof(stats->name) - 1; i++, name++)
+        stats->name[i] = *name < 0x80 ? *name : '?';
+    stats->name[i] = 0;
+}
+
+/* account for a completed request */
+static void record_request_stats( enum request req, struct process_stats *proc_stats, unsigned __int64 time )
+{
+    struct request_stats *stats = &server_stats->requests[req];
+    unsigned __int64 ns = time;
+    unsigned int bucket = 0;
+
+    while ((ns >>= 1) && bucket < STATS_BUCKETS - 1) bucket++;
+
+    stats->count++;
+    stats->total += time;
+    stats->hist[bucket]++;
+    if (time > stats->max) stats->max = time;
+
+    if (!proc_stats) return;
+    proc_stats->requests[req].count++;
+    proc_stats->requests[req].total += time;
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    struct process_stats *proc_stats = NULL;
+    unsigned __int64 start = 0;
 
     current = thread;
     current->reply_size = 0;
@@ -280,6 +423,14 @@ static void call_req_handler( struct thread *thread )
 
     if (debug_level) trace_request();
 
+    /* fetch the process slot now, the thread may be gone once the handler returns */
+    if (server_stats && req < REQ_NB_REQUESTS)
+    {
+        if ((proc_stats = thread->process->req_stats) && !proc_stats->name[0] && thread->process->image)
+            set_process_stats_name( proc_stats, thread->process );
+        start = get_stats_time();
+    }
+
     if (req < REQ_NB_REQUESTS)
         req_handlers[req]( &current->req, &reply );
     else
@@ -301,6 +452,8 @@ static void call_req_handler( struct thread *thread )
         }
     }
     current = NULL;
+
+    if (start) record_request_stats( req, proc_stats, get_stats_time() - start );
 }
 
 /* read a request from a thread */
@@ -740,6 +893,106 @@ int kill_lock_owner( int sig )
     return ret;
 }
 
+static const struct server_stats *dump_stats;
+
+static int compare_request_stats( const void *p1, const void *p2 )
+{
+    const struct request_stats *s1 = &dump_stats->requests[*(const unsigned int *)p1];
+    const struct request_stats *s2 = &dump_stats->requests[*(const unsigned int *)p2];
+
+    if (s1->total != s2->total) return s1->total < s2->total ? 1 : -1;
+    return 0;
+}
+
+/* estimate a latency percentile in microseconds from the histogram buckets */
+static double get_stats_percentile( const struct request_stats *stats, unsigned int percent )
+{
+    unsigned __int64 sum = 0, limit = (stats->count * percent + 99) / 100;
+    unsigned int i;
+
+    for (i = 0; i < STATS_BUCKETS - 1; i++)
+        if ((sum += stats->hist[i]) >= limit) break;
+    return (double)((unsigned __int64)2 << i) / 1000;  /* upper bound of the bucket */
+}
+
+/* print the request statistics of the current or last server */
+int dump_request_stats(void)
+{
+    unsigned int i, j, k, count, order[REQ_NB_REQUESTS], top[5];
+    const struct process_stats *proc;
+    const struct request_stats *req;
+    struct server_stats *stats;
+    time_t start;
+    int fd;
+
+    if (!create_server_dir( 0 )) return 0;
+    if ((fd = open( server_stats_name, O_RDONLY )) == -1) return 0;
+    stats = mmap( NULL, sizeof(*stats), PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if (stats == MAP_FAILED) return 0;
+    if (memcmp( stats->magic, server_stats_magic, sizeof(stats->magic) ) ||
+        stats->protocol != SERVER_PROTOCOL_VERSION || stats->nb_requests != REQ_NB_REQUESTS)
+    {
+        fprintf( stderr, "%s/%s was written by a different wineserver version\n", server_dir, server_stats_name );
+        munmap( stats, sizeof(*stats) );
+        return 0;
+    }
+    dump_stats = stats;
+
+    start = stats->start_time;
+    printf( "Wine server request statistics since %s\n", ctime( &start ));
+    printf( "%-32s %10s %12s %10s %10s %10s %10s\n",
+            "request", "count", "total ms", "avg us", "max us", "p50 us", "p99 us" );
+
+    for (i = count = 0; i < REQ_NB_REQUESTS; i++) if (stats->requests[i].count) order[count++] = i;
+    qsort( order, count, sizeof(order[0]), compare_request_stats );
+    for (i = 0; i < count; i++)
+    {
+        req = &stats->requests[order[i]];
+        printf( "%-32s %10llu %12.3f %10.3f %10.3f %10.3f %10.3f\n", get_request_name( order[i] ),
+                (unsigned long long)req->count, (double)req->total / 1000000,
+                (double)req->total / req->count / 1000, (double)req->max / 1000,
+                get_stats_percentile( req, 50 ), get_stats_percentile( req, 99 ));
+    }
+
+    printf( "\nLatency histograms of the %u most expensive requests (calls per power of 2 of ns)\n",
+            min( count, (unsigned int)ARRAY_SIZE(top) ));
+    for (i = 0; i < count && i < ARRAY_SIZE(top); i++)
+    {
+        req = &stats->requests[order[i]];
+        printf( "%s:", get_request_name( order[i] ));
+        for (j = 0; j < STATS_BUCKETS; j++)
+            if (req->hist[j]) printf( " 2^%u:%llu", j, (unsigned long long)req->hist[j] );
+        printf( "\n" );
+    }
+
+    printf( "\nMost expensive requests per process\n" );
+    for (i = 0; i < STATS_PROCESSES; i++)
+    {
+        proc = &stats->processes[i];
+        if (!proc->id) continue;
+        printf( "%04x %s%s:", proc->id, proc->name[0] ? proc->name : "<unknown>",
+                proc->exited ? " (exited)" : "" );
+        for (j = count = 0; j < REQ_NB_REQUESTS; j++)
+        {
+            if (!proc->requests[j].count) continue;
+            /* insertion sort into the top list */
+            if (count == ARRAY_SIZE(top) && proc->requests[top[count - 1]].total >= proc->requests[j].total)
+                continue;
+            k = count < ARRAY_SIZE(top) ? count++ : count - 1;
+            for ( ; k > 0 && proc->requests[top[k - 1]].total < proc->requests[j].total; k--) top[k] = top[k - 1];
+            top[k] = j;
+        }
+        for (j = 0; j < count; j++)
+            printf( " %s %u/%.3fms", get_request_name( top[j] ), proc->requests[top[j]].count,
+                    (double)proc->requests[top[j]].total / 1000000 );
+        printf( "\n" );
+    }
+
+    munmap( stats, sizeof(*stats) );
+    return 1;
+}
+
 /* acquire the main server lock */
 static void acquire_lock(void)
 {
@@ -816,6 +1069,8 @@ static void acquire_lock(void)
         fatal_error( "out of memory\n" );
     set_fd_events( master_socket->fd, POLLIN );
     make_object_permanent( &master_socket->obj );
+
+    init_request_stats();
 }
 
 /* open the master server socket and start waiting for new clients */
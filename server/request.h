@@ -58,11 +58,15 @@ extern void close_master_socket( timeout_t timeout );
 extern void shutdown_master_socket(void);
 extern int wait_for_lock(void);
 extern int kill_lock_owner( int sig );
+extern int dump_request_stats(void);
+extern struct process_stats *alloc_process_stats( struct process *process );
+extern void free_process_stats( struct process_stats *stats );
 extern char *server_dir;
 extern int server_dir_fd, config_dir_fd;
 
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern const char *get_request_name( enum request req );
 
 /* get current tick count to return to client */
 static inline unsigned int get_tick_count(void)
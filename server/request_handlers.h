@@ -1041,14 +1041,16 @@ C_ASSERT( sizeof(struct recv_socket_request) == 64 );
 C_ASSERT( offsetof(struct recv_socket_reply, wait) == 8 );
 C_ASSERT( offsetof(struct recv_socket_reply, options) == 12 );
 C_ASSERT( offsetof(struct recv_socket_reply, nonblocking) == 16 );
-C_ASSERT( sizeof(struct recv_socket_reply) == 24 );
+C_ASSERT( offsetof(struct recv_socket_reply, locator) == 24 );
+C_ASSERT( sizeof(struct recv_socket_reply) == 40 );
 C_ASSERT( offsetof(struct send_socket_request, flags) == 12 );
 C_ASSERT( offsetof(struct send_socket_request, async) == 16 );
 C_ASSERT( sizeof(struct send_socket_request) == 56 );
 C_ASSERT( offsetof(struct send_socket_reply, wait) == 8 );
 C_ASSERT( offsetof(struct send_socket_reply, options) == 12 );
 C_ASSERT( offsetof(struct send_socket_reply, nonblocking) == 16 );
-C_ASSERT( sizeof(struct send_socket_reply) == 24 );
+C_ASSERT( offsetof(struct send_socket_reply, locator) == 24 );
+C_ASSERT( sizeof(struct send_socket_reply) == 40 );
 C_ASSERT( offsetof(struct socket_get_events_request, handle) == 12 );
 C_ASSERT( offsetof(struct socket_get_events_request, event) == 16 );
 C_ASSERT( sizeof(struct socket_get_events_request) == 24 );
@@ -1234,7 +1236,8 @@ C_ASSERT( offsetof(struct get_key_value_request, hkey) == 12 );
 C_ASSERT( sizeof(struct get_key_value_request) == 16 );
 C_ASSERT( offsetof(struct get_key_value_reply, type) == 8 );
 C_ASSERT( offsetof(struct get_key_value_reply, total) == 12 );
-C_ASSERT( sizeof(struct get_key_value_reply) == 16 );
+C_ASSERT( offsetof(struct get_key_value_reply, locator) == 16 );
+C_ASSERT( sizeof(struct get_key_value_reply) == 32 );
 C_ASSERT( offsetof(struct enum_key_value_request, hkey) == 12 );
 C_ASSERT( offsetof(struct enum_key_value_request, index) == 16 );
 C_ASSERT( offsetof(struct enum_key_value_request, info_class) == 20 );
@@ -2332,9 +2335,11 @@ C_ASSERT( offsetof(struct get_inproc_sync_fd_request, handle) == 12 );
 C_ASSERT( sizeof(struct get_inproc_sync_fd_request) == 16 );
 C_ASSERT( offsetof(struct get_inproc_sync_fd_reply, type) == 8 );
 C_ASSERT( offsetof(struct get_inproc_sync_fd_reply, access) == 12 );
-C_ASSERT( sizeof(struct get_inproc_sync_fd_reply) == 16 );
+C_ASSERT( offsetof(struct get_inproc_sync_fd_reply, index) == 16 );
+C_ASSERT( sizeof(struct get_inproc_sync_fd_reply) == 24 );
 C_ASSERT( sizeof(struct get_inproc_alert_fd_request) == 16 );
 C_ASSERT( offsetof(struct get_inproc_alert_fd_reply, handle) == 8 );
+C_ASSERT( offsetof(struct get_inproc_alert_fd_reply, index) == 12 );
 C_ASSERT( sizeof(struct get_inproc_alert_fd_reply) == 16 );
 C_ASSERT( offsetof(struct d3dkmt_object_create_request, type) == 12 );
 C_ASSERT( offsetof(struct d3dkmt_object_create_request, fd) == 16 );
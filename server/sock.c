@@ -293,6 +293,7 @@ struct sock
     icmp_fixup_data[MAX_ICMP_HISTORY_LENGTH]; /* Sent ICMP packets history used to fixup reply id. */
     struct bound_addr  *bound_addr[2]; /* Links to the entries in bound addresses tree. */
     unsigned int        icmp_fixup_data_len;  /* Sent ICMP packets history length. */
+    sock_shm_t         *shared;      /* socket in session shared memory */
     unsigned int        rd_shutdown : 1; /* is the read end shut down? */
     unsigned int        wr_shutdown : 1; /* is the write end shut down? */
     unsigned int        wr_shutdown_pending : 1; /* is a write shutdown pending? */
@@ -807,6 +808,34 @@ void sock_init(void)
     }
 }
 
+/* Tell clients whether they may try a recv() or send() syscall without asking
+ * us first. That is only safe when doing so cannot reorder data with queued
+ * asyncs, and when the call would have no side effects here: no selected
+ * events to reset, no shutdown or reset to report, no implicit bind. */
+static void sock_update_shared( struct sock *sock )
+{
+    unsigned int flags = 0;
+
+    if (!sock->shared) return;
+
+    if (sock->type && !sock->mask && !sock->reset && !sock->aborted &&
+        (sock->state == SOCK_CONNECTED || sock->state == SOCK_CONNECTIONLESS))
+    {
+        if (!sock->rd_shutdown && !sock->accept_recv_req && !async_queued( &sock->read_q ))
+            flags |= SOCKET_SHM_TRY_RECV;
+        if (!sock->wr_shutdown && sock->bound && !async_queued( &sock->write_q ))
+            flags |= SOCKET_SHM_TRY_SEND;
+    }
+
+    if (sock->shared->flags == flags) return;
+
+    SHARED_WRITE_BEGIN( sock->shared, sock_shm_t )
+    {
+        shared->flags = flags;
+    }
+    SHARED_WRITE_END;
+}
+
 static void sock_reselect( struct sock *sock )
 {
     int ev = sock_get_poll_events( sock->fd );
@@ -815,6 +844,7 @@ static void sock_reselect( struct sock *sock )
         fprintf(stderr,"sock_reselect(%p): new mask %x\n", sock, ev);
 
     set_fd_events( sock->fd, ev );
+    sock_update_shared( sock );
 }
 
 static unsigned int afd_poll_flag_to_win32( unsigned int flags )
@@ -905,6 +935,7 @@ static inline int sock_error( struct sock *sock, int *poll_event )
         if (error == ECONNRESET || error == EPIPE)
         {
             sock->reset = 1;
+            sock_update_shared( sock );
             error = 0;
         }
         else if (error)
@@ -1764,6 +1795,7 @@ static void sock_destroy( struct object *obj )
     free_async_queue( &sock->poll_q );
     if (sock->event) release_object( sock->event );
     if (sock->fd) release_object( sock->fd );
+    if (sock->shared) free_shared_object( sock->shared );
 }
 
 static struct sock *create_socket(void)
@@ -1809,6 +1841,7 @@ static struct sock *create_socket(void)
     sock->sndtimeo = 0;
     sock->icmp_fixup_data_len = 0;
     sock->bound_addr[0] = sock->bound_addr[1] = NULL;
+    sock->shared = NULL;
     init_async_queue( &sock->read_q );
     init_async_queue( &sock->write_q );
     init_async_queue( &sock->ifchange_q );
@@ -1817,6 +1850,19 @@ static struct sock *create_socket(void)
     init_async_queue( &sock->poll_q );
     memset( sock->errors, 0, sizeof(sock->errors) );
     list_init( &sock->accept_list );
+
+    if (!(sock->shared = alloc_shared_object( sizeof(*sock->shared) )))
+    {
+        release_object( sock );
+        return NULL;
+    }
+
+    SHARED_WRITE_BEGIN( sock->shared, sock_shm_t )
+    {
+        shared->flags = 0;
+    }
+    SHARED_WRITE_END;
+
     return sock;
 }
 
@@ -4200,6 +4246,7 @@ DECL_HANDLER(recv_socket)
         reply->wait = async_handoff( async, NULL, 0 );
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        reply->locator = get_shared_object_locator( sock->shared );
         release_object( async );
     }
     release_object( sock );
@@ -4321,10 +4368,12 @@ DECL_HANDLER(send_socket)
             queue_async( &sock->write_q, async );
             sock_reselect( sock );
         }
+        else sock_update_shared( sock );  /* we may have bound the socket above */
 
         reply->wait = async_handoff( async, NULL, 0 );
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        reply->locator = get_shared_object_locator( sock->shared );
         release_object( async );
     }
     release_object( sock );
@@ -2378,6 +2378,7 @@ DECL_HANDLER(get_inproc_alert_fd)
 {
     int fd;
 
+    if ((reply->index = get_inproc_sync_index( current->alert_sync ))) return;
     if ((fd = get_inproc_sync_fd( current->alert_sync )) < 0) set_error( STATUS_INVALID_PARAMETER );
     else
     {
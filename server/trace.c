@@ -1674,6 +1674,11 @@ static void dump_varargs_class_info( const char *prefix, data_size_t size )
     remove_data( sizeof(*info) );
 }
 
+const char *get_request_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "?";
+}
+
 void trace_request(void)
 {
     enum request req = current->req.request_header.req;